@@ -0,0 +1,1292 @@
+/* DAMSON checkpoint and restore
+   the emulator state is written to a versioned binary file every interval of simulated time
+   full checkpoints hold every page of the global, external and stack vectors,
+   incremental checkpoints only the pages changed since the previous one, and name their parent file
+
+   on restore only the words known to hold addresses are relocated to the corresponding word of the restored
+   vector: the semaphore a process waits on, and in each frame of its stack the array parameters, the locals the
+   optimiser keeps addresses in and the addresses among the temporaries, found by following the stack code of the
+   procedure up to the instruction the frame stopped at; the global and external vectors hold only model data
+*/
+
+#ifndef WIN32
+#define _XOPEN_SOURCE 500   /* fileno, ftruncate */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#ifndef WIN32
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+#include "compiler.h"
+#include "emulator.h"
+#include "checkpoint.h"
+
+#define CKPT_MAGIC     0x444D434B  /* "DMCK" - also detects a change of byte order */
+#define CKPT_VERSION   1
+#define PageWords      1024
+#define FullEvery      8           /* bounds the chain of files needed for a restore */
+
+enum RegionKind { GlobalRegion = 1, ExternalRegion, StackRegion };
+
+typedef struct
+{
+    unsigned int node;
+    unsigned int kind;
+    unsigned int handle;
+    unsigned int base;     /* address of the vector at checkpoint time, as held by the program */
+    unsigned int size;     /* words */
+    int          *vector;  /* restored vector */
+} RegionItem;
+
+typedef struct
+{
+    bool         address;  /* a word of a vector */
+    bool         constant; /* pushed by LN */
+    int          value;
+} StackSlot;
+
+typedef struct
+{
+    unsigned int at;       /* instruction reached by a forward jump */
+    unsigned int depth;
+    StackSlot    *stack;
+} JoinItem;
+
+typedef struct
+{
+    unsigned int           version;
+    unsigned int           full;
+    unsigned int           number;
+    unsigned int           signature;
+    unsigned long long int ticks;
+    unsigned long long int pages;     /* file offset of the page section */
+    char                   parent[MaxStringSize + 20];
+} CheckpointHeader;
+
+extern struct NodeInfo        *NodeList;
+extern struct NodeInfo        *NodeListTail;
+extern struct NodeInfo        *NameNodeList;
+extern struct LimitItem       *LimitList;
+extern struct LimitItem       *LimitListTail;
+extern unsigned long long int ProcessingTicks;
+extern unsigned long long int TotalTicks;
+extern unsigned int           sync_count;
+extern float                  AverageSearches;
+extern int                    CountSearches;
+extern struct LogInfo         LogData[];
+extern unsigned int           LogStreams;
+
+extern void                   AddProcess(unsigned int node, struct PCB *p);
+extern void                   DeleteProcess(unsigned int node, unsigned int handle);
+extern void                   SaveProcess(unsigned int n, struct PCB *p);
+extern void                   RestoreProcess(unsigned int n, struct PCB *p);
+extern void                   DeleteNode(unsigned int node);
+extern void                   Runtime_Error(unsigned int code, char *fmt, ...);
+extern bool                   Binary(unsigned char Op);
+extern bool                   Unary(unsigned char Op);
+
+unsigned long long int CheckpointInterval = 0;
+unsigned long long int NextCheckpoint     = 0;
+char                   *RestoreFile       = NULL;
+unsigned int           CheckpointNumber   = 0;
+unsigned int           ChainLength        = 0;
+unsigned int           Signature          = 0;
+char                   LastCheckpoint[MaxStringSize + 20] = "";
+FILE                   *CkptStream;
+unsigned int           CkptPages;
+
+unsigned int ModelSignature();
+void         PutWord(unsigned int x);
+void         PutLong(unsigned long long int x);
+unsigned int GetWord();
+unsigned long long int GetLong();
+void         GetBlock(void *p, unsigned int n);
+void         WriteRegion(unsigned int node, unsigned int kind, unsigned int handle, int *v, unsigned int n,
+                         unsigned int size, int **shadow, bool full);
+void         ReadHeader(FILE *s, char Filename[], CheckpointHeader *hd);
+RegionItem   *FindRegion(RegionItem *r, unsigned int nregions, unsigned int node, unsigned int kind, unsigned int handle);
+int          CompareRegionKeys(const void *a, const void *b);
+int          CompareRegionBases(const void *a, const void *b);
+int          CompareLiveNodes(const void *a, const void *b);
+unsigned int Relocate(unsigned int x, RegionItem *r, unsigned int nregions);
+unsigned int FrameProcedure(struct NodeInfo *h, unsigned int pc);
+bool         ScanFrame(struct NodeInfo *h, unsigned int first, unsigned int pc, bool *slots, unsigned int nslots,
+                       bool *changed, StackSlot *stack, unsigned int *depth, unsigned int size);
+void         RelocateProcess(struct NodeInfo *h, struct PCB *d, RegionItem *r, unsigned int nregions);
+StackSlot    PopSlot(StackSlot *s, unsigned int *n);
+bool         PushSlot(StackSlot *s, unsigned int *n, unsigned int size, bool address, bool constant, int value);
+void         JoinSlots(struct NodeInfo *h, JoinItem **joins, unsigned int *njoins, unsigned int from, int lab,
+                       StackSlot *s, unsigned int n);
+void         RebuildNodeList(unsigned int *order, unsigned int n);
+
+/* --------------------------------------------------------- */
+unsigned int ModelSignature()  /* FNV-1a over the prototypes - a restore must use the same compiled model */
+{
+    struct NodeInfo *p;
+    unsigned int    h = 2166136261u;
+    unsigned int    i;
+
+    for (p=NameNodeList; p!=NULL; p=p->NextNode)
+    {
+        for (i=1; i<=p->ProgramSize; i+=1)
+        {
+            h = (h ^ p->Instructions[i].Op) * 16777619u;
+            h = (h ^ (unsigned int) p->Instructions[i].Arg) * 16777619u;
+        }
+        h = (h ^ p->GlobalVectorSize) * 16777619u;
+        h = (h ^ p->ExternalVectorSize) * 16777619u;
+    }
+    return h;
+}
+
+/* --------------------------------------------------------- */
+void SetCheckpointInterval(float t)
+{
+    CheckpointInterval = TimeToTicks(t);
+}
+
+/* --------------------------------------------------------- */
+void CheckpointInit()  /* start of emulation - before any prototype can be released */
+{
+    Signature = ModelSignature();
+    NextCheckpoint = CheckpointInterval;
+}
+
+/* --------------------------------------------------------- */
+void PutWord(unsigned int x)
+{
+    fwrite(&x, sizeof(unsigned int), 1, CkptStream);
+}
+
+/* --------------------------------------------------------- */
+void PutLong(unsigned long long int x)
+{
+    fwrite(&x, sizeof(unsigned long long int), 1, CkptStream);
+}
+
+/* --------------------------------------------------------- */
+void GetBlock(void *p, unsigned int n)
+{
+    if (fread(p, 1, n, CkptStream) != n)
+    {
+        Runtime_Error(241, "Checkpoint file truncated\n");
+    }
+}
+
+/* --------------------------------------------------------- */
+unsigned int GetWord()
+{
+    unsigned int x;
+
+    GetBlock(&x, sizeof(unsigned int));
+    return x;
+}
+
+/* --------------------------------------------------------- */
+unsigned long long int GetLong()
+{
+    unsigned long long int x;
+
+    GetBlock(&x, sizeof(unsigned long long int));
+    return x;
+}
+
+/* --------------------------------------------------------- */
+void WriteRegion(unsigned int node, unsigned int kind, unsigned int handle, int *v, unsigned int n,
+                 unsigned int size, int **shadow, bool full)  /* the pages of v[0..n-1] changed since the last checkpoint */
+{
+    unsigned int p;
+    unsigned int lo;
+    unsigned int cnt;
+
+    if (shadow == NULL)  /* untracked - every page */
+    {
+        full = true;
+    }
+    else if (*shadow == NULL)  /* first checkpoint of this vector - compare against zero */
+    {
+        *shadow = (int *) calloc(size, sizeof(int));  /* the whole vector - a stack grows between checkpoints */
+        if (*shadow == NULL)
+        {
+            Runtime_Error(242, "Checkpoint: out of memory\n");
+        }
+    }
+
+    for (p=0; p*PageWords<n; p+=1)
+    {
+        lo  = p * PageWords;
+        cnt = (n - lo < PageWords) ? n - lo : PageWords;
+        if (full || memcmp(&v[lo], &(*shadow)[lo], sizeof(int) * cnt) != 0)
+        {
+            PutWord(node);
+            PutWord(kind);
+            PutWord(handle);
+            PutWord(p);
+            PutWord(cnt);
+            fwrite(&v[lo], sizeof(int), cnt, CkptStream);
+            if (shadow != NULL)
+            {
+                memcpy(&(*shadow)[lo], &v[lo], sizeof(int) * cnt);
+            }
+            CkptPages += 1;
+        }
+    }
+}
+
+/* --------------------------------------------------------- */
+void SaveState(FILE *s, unsigned long long int t, bool full, char parent[], bool tracking)
+{
+    struct NodeInfo *h;
+    struct PCB      *d;
+    unsigned int    i;
+    unsigned int    n;
+    long            pos;
+    long            pagepos;
+
+    CkptStream = s;
+    for (h=NodeList; h!=NULL; h=h->NextNode)
+    {
+        if (h->CurrentProcess != NULL)
+        {
+            SaveProcess(h->NodeNumber, h->CurrentProcess);
+        }
+    }
+
+    PutWord(CKPT_MAGIC);  /* header */
+    PutWord(CKPT_VERSION);
+    PutWord(full ? 1 : 0);
+    PutWord(CheckpointNumber);
+    PutWord(Signature);
+    PutLong(t);
+    pagepos = ftell(CkptStream);
+    PutLong(0);
+    n = full ? 0 : strlen(parent);
+    PutWord(n);
+    fwrite(parent, 1, n, CkptStream);
+
+    PutLong(ProcessingTicks);  /* emulator */
+    PutLong(TotalTicks);
+    PutWord(sync_count);
+    PutWord(CountSearches);
+    fwrite(&AverageSearches, sizeof(float), 1, CkptStream);
+
+    PutWord(LogStreams);  /* log channels */
+    for (i=1; i<=LogStreams; i+=1)
+    {
+        pos = 0;
+        if (LogData[i].stream != NULL)
+        {
+            fflush(LogData[i].stream);
+            pos = ftell(LogData[i].stream);
+        }
+        PutLong(LogData[i].lastlog);
+        PutLong(pos);
+    }
+
+    h = FindNode(ProfileNode);  /* profile counters */
+    n = (h != NULL) ? h->NumberOfProcedures : 0;
+    PutWord(n);
+    for (i=1; i<=n; i+=1)
+    {
+        PutWord(h->Procedures[i].CallCount);
+        PutWord(h->Procedures[i].TickCount);
+    }
+
+    n = 0;  /* vectors, for relocation */
+    for (h=NodeList; h!=NULL; h=h->NextNode)
+    {
+        n += 2 + h->NumberOfProcesses;
+    }
+    PutWord(n);
+    for (h=NodeList; h!=NULL; h=h->NextNode)
+    {
+        PutWord(h->NodeNumber);
+        PutWord(GlobalRegion);
+        PutWord(0);
+        PutWord((unsigned int) (uintptr_t) h->G);
+        PutWord(h->GlobalVectorSize + 1);
+        PutWord(h->NodeNumber);
+        PutWord(ExternalRegion);
+        PutWord(0);
+        PutWord((unsigned int) (uintptr_t) h->E);
+        PutWord(h->ExternalVectorSize + 1);
+        for (d=h->ProcessList; d!=NULL; d=d->nextPCB)
+        {
+            PutWord(h->NodeNumber);
+            PutWord(StackRegion);
+            PutWord(d->handle);
+            PutWord((unsigned int) (uintptr_t) d->stack);
+            PutWord(d->stacksize);
+        }
+    }
+
+    PutWord(NumberOfNodes);  /* nodes, in scheduler order */
+    for (h=NodeList; h!=NULL; h=h->NextNode)
+    {
+        PutWord(h->NodeNumber);
+        PutWord(h->PC);
+        PutWord(h->SP);
+        PutWord(h->FP);
+        PutLong(h->SystemTicks);
+        PutLong(h->LastClockTick);
+        PutWord(h->Tickrate);
+        PutWord(h->DMATicks);
+        PutWord(h->SyncWait ? 1 : 0);
+        PutWord(h->PktsTX);
+        PutWord(h->PktsRX);
+        PutWord(h->HandleNumber);
+        PutWord((h->CurrentProcess != NULL) ? h->CurrentProcess->handle : 0);
+        PutWord(h->NumberOfProcesses);
+        for (d=h->ProcessList; d!=NULL; d=d->nextPCB)
+        {
+            PutWord(d->handle);
+            PutWord(d->saved_PC);
+            PutWord(d->saved_SP);
+            PutWord(d->saved_FP);
+            PutWord(d->stacksize);
+            PutWord(d->status);
+            PutWord(d->priority);
+            PutWord(d->dticks);
+            PutWord((unsigned int) (uintptr_t) d->semaphore);
+        }
+    }
+
+    pos = ftell(CkptStream);  /* pages */
+    fseek(CkptStream, pagepos, SEEK_SET);
+    PutLong(pos);
+    fseek(CkptStream, pos, SEEK_SET);
+    CkptPages = 0;
+    for (h=NodeList; h!=NULL; h=h->NextNode)
+    {
+        WriteRegion(h->NodeNumber, GlobalRegion, 0, h->G, h->GlobalVectorSize + 1, h->GlobalVectorSize + 1,
+                    tracking ? &h->ShadowG : NULL, full);
+        WriteRegion(h->NodeNumber, ExternalRegion, 0, h->E, h->ExternalVectorSize + 1, h->ExternalVectorSize + 1,
+                    tracking ? &h->ShadowE : NULL, full);
+        for (d=h->ProcessList; d!=NULL; d=d->nextPCB)
+        {
+            WriteRegion(h->NodeNumber, StackRegion, d->handle, d->stack, d->saved_SP + 1, d->stacksize,
+                        tracking ? &d->shadow : NULL, full);
+        }
+    }
+    PutWord(0xFFFFFFFF);  /* end of pages */
+}
+
+/* --------------------------------------------------------- */
+void WriteCheckpoint(unsigned long long int t)
+{
+    char fname[MaxStringSize + 20];
+    char tname[MaxStringSize + 30];
+    bool full;
+
+    while (NextCheckpoint <= t)
+    {
+        NextCheckpoint += CheckpointInterval;
+    }
+
+    CheckpointNumber += 1;
+    full = (ChainLength == 0 || ChainLength >= FullEvery);
+    ChainLength = full ? 1 : ChainLength + 1;
+
+    sprintf(fname, "%s_%d.ckpt", FileBaseName, CheckpointNumber);
+    sprintf(tname, "%s.tmp", fname);  /* renamed when complete, so a preempted write leaves the last one intact */
+    CkptStream = fopen(tname, "wb");
+    if (CkptStream == NULL)
+    {
+        Runtime_Error(240, "Unable to open checkpoint file %s\n", tname);
+    }
+
+    SaveState(CkptStream, t, full, LastCheckpoint, true);
+
+    if (ferror(CkptStream))
+    {
+        Runtime_Error(240, "Unable to write checkpoint file %s\n", tname);
+    }
+    fclose(CkptStream);
+    remove(fname);
+    rename(tname, fname);
+    strcpy(LastCheckpoint, fname);
+
+    printf("Checkpoint %d at %f s: %s (%s, %d pages)\n", CheckpointNumber, TicksToTime(t), fname,
+           full ? "full" : "incremental", CkptPages);
+}
+
+/* --------------------------------------------------------- */
+void ReadHeader(FILE *s, char Filename[], CheckpointHeader *hd)
+{
+    unsigned int n;
+
+    CkptStream = s;
+    rewind(CkptStream);
+    if (GetWord() != CKPT_MAGIC)
+    {
+        Runtime_Error(243, "%s is not a checkpoint file\n", Filename);
+    }
+    hd->version = GetWord();
+    if (hd->version != CKPT_VERSION)
+    {
+        Runtime_Error(243, "Checkpoint file %s has version %d (expected %d)\n", Filename, hd->version, CKPT_VERSION);
+    }
+    hd->full      = GetWord();
+    hd->number    = GetWord();
+    hd->signature = GetWord();
+    hd->ticks     = GetLong();
+    hd->pages     = GetLong();
+    n = GetWord();
+    if (n >= sizeof(hd->parent))
+    {
+        Runtime_Error(243, "Checkpoint file %s is corrupt\n", Filename);
+    }
+    GetBlock(hd->parent, n);
+    hd->parent[n] = '\0';
+
+    if (hd->signature != Signature)
+    {
+        Runtime_Error(244, "Checkpoint file %s was written by a different model\n", Filename);
+    }
+}
+
+/* --------------------------------------------------------- */
+int CompareRegionKeys(const void *a, const void *b)
+{
+    const RegionItem *x = (const RegionItem *) a;
+    const RegionItem *y = (const RegionItem *) b;
+
+    if (x->node != y->node)
+    {
+        return (x->node > y->node) - (x->node < y->node);
+    }
+    if (x->kind != y->kind)
+    {
+        return (x->kind > y->kind) - (x->kind < y->kind);
+    }
+    return (x->handle > y->handle) - (x->handle < y->handle);
+}
+
+/* --------------------------------------------------------- */
+int CompareRegionBases(const void *a, const void *b)
+{
+    const RegionItem *x = (const RegionItem *) a;
+    const RegionItem *y = (const RegionItem *) b;
+
+    return (x->base > y->base) - (x->base < y->base);
+}
+
+/* --------------------------------------------------------- */
+int CompareLiveNodes(const void *a, const void *b)
+{
+    unsigned int x = *(const unsigned int *) a;
+    unsigned int y = *(const unsigned int *) b;
+
+    return (x > y) - (x < y);
+}
+
+/* --------------------------------------------------------- */
+RegionItem *FindRegion(RegionItem *r, unsigned int nregions, unsigned int node, unsigned int kind, unsigned int handle)
+{
+    RegionItem key;
+
+    key.node   = node;
+    key.kind   = kind;
+    key.handle = handle;
+    return (RegionItem *) bsearch(&key, r, nregions, sizeof(RegionItem), CompareRegionKeys);
+}
+
+/* --------------------------------------------------------- */
+unsigned int Relocate(unsigned int x, RegionItem *r, unsigned int nregions)  /* r sorted by base */
+{
+    unsigned int lo = 0;
+    unsigned int hi = nregions;
+    unsigned int mid;
+
+    while (lo < hi)
+    {
+        mid = (lo + hi) / 2;
+        if (r[mid].base <= x)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    if (lo > 0)
+    {
+        lo -= 1;
+        if (x - r[lo].base < r[lo].size * sizeof(int) && r[lo].vector != NULL)
+        {
+            return (unsigned int) (uintptr_t) r[lo].vector + (x - r[lo].base);
+        }
+    }
+    return x;
+}
+
+/* --------------------------------------------------------- */
+unsigned int FrameProcedure(struct NodeInfo *h, unsigned int pc)  /* procedures are contiguous, each starting with ENTRY */
+{
+    unsigned int i;
+
+    for (i=pc; i>=1 && i<=h->ProgramSize; i-=1)
+    {
+        if (h->Instructions[i].Op == s_ENTRY)
+        {
+            return i;
+        }
+    }
+    return 0;
+}
+
+/* --------------------------------------------------------- */
+StackSlot PopSlot(StackSlot *s, unsigned int *n)  /* below the values pushed in the procedure nothing is an address */
+{
+    StackSlot x;
+
+    if (*n == 0)
+    {
+        x.address  = false;
+        x.constant = false;
+        x.value    = 0;
+        return x;
+    }
+    *n -= 1;
+    return s[*n + 1];
+}
+
+/* --------------------------------------------------------- */
+bool PushSlot(StackSlot *s, unsigned int *n, unsigned int size, bool address, bool constant, int value)
+{
+    if (*n >= size)
+    {
+        return false;
+    }
+    *n += 1;
+    s[*n].address  = address;
+    s[*n].constant = constant;
+    s[*n].value    = value;
+    return true;
+}
+
+/* --------------------------------------------------------- */
+void JoinSlots(struct NodeInfo *h, JoinItem **joins, unsigned int *njoins, unsigned int from, int lab,
+               StackSlot *s, unsigned int n)  /* the stack at the target of a forward jump */
+{
+    unsigned int at;
+    JoinItem     *j;
+
+    if (lab < 1 || (unsigned int) lab > h->NumberOfLabels || h->Labels[lab] <= from)
+    {
+        return;
+    }
+    at = h->Labels[lab];
+    j = (JoinItem *) realloc(*joins, sizeof(JoinItem) * (*njoins + 1));
+    if (j == NULL)
+    {
+        Runtime_Error(242, "Checkpoint: out of memory\n");
+    }
+    *joins = j;
+    j[*njoins].at    = at;
+    j[*njoins].depth = n;
+    j[*njoins].stack = (StackSlot *) malloc(sizeof(StackSlot) * (n + 1));
+    if (j[*njoins].stack == NULL)
+    {
+        Runtime_Error(242, "Checkpoint: out of memory\n");
+    }
+    memcpy(j[*njoins].stack, s, sizeof(StackSlot) * (n + 1));
+    *njoins += 1;
+}
+
+/* --------------------------------------------------------- */
+bool ScanFrame(struct NodeInfo *h, unsigned int first, unsigned int pc, bool *slots, unsigned int nslots,
+               bool *changed, StackSlot *stack, unsigned int *depth, unsigned int size)  /* locals holding addresses, and the stack at pc */
+{
+    StackSlot     *s;
+    JoinItem      *joins = NULL;
+    unsigned int  njoins = 0;
+    unsigned int  n = 0;
+    unsigned int  i;
+    unsigned int  j;
+    unsigned int  k;
+    StackSlot     x;
+    StackSlot     y;
+    unsigned char Op;
+    int           Arg;
+    bool          flow = true;
+    bool          found = false;
+    bool          ok = true;
+
+    s = (StackSlot *) malloc(sizeof(StackSlot) * (size + 1));
+    if (s == NULL)
+    {
+        Runtime_Error(242, "Checkpoint: out of memory\n");
+    }
+    *changed = false;
+
+    for (i=first; i<=h->ProgramSize && ok; i+=1)
+    {
+        Op  = h->Instructions[i].Op;
+        Arg = h->Instructions[i].Arg;
+        if (i > first && Op == s_ENTRY)  /* the next procedure */
+        {
+            break;
+        }
+
+        for (j=0; j<njoins && !flow; j+=1)  /* reached only by a jump */
+        {
+            if (joins[j].at == i)
+            {
+                n = joins[j].depth;
+                memcpy(s, joins[j].stack, sizeof(StackSlot) * (n + 1));
+                flow = true;
+            }
+        }
+        if (!flow)  /* reached only from behind - a statement starts with an empty stack */
+        {
+            n = 0;
+        }
+        flow = true;
+
+        if (i == pc)
+        {
+            memcpy(stack, s, sizeof(StackSlot) * (n + 1));
+            *depth = n;
+            found = true;
+        }
+
+        switch (Op)
+        {
+            case s_ENTRY:
+                n = 0;
+                break;
+
+            case s_LN:
+                ok = PushSlot(s, &n, size, false, true, Arg);
+                break;
+
+            case s_LG:
+            case s_LLL:
+                ok = PushSlot(s, &n, size, false, false, 0);
+                break;
+
+            case s_LSTR:
+            case s_LLG:
+            case s_LLP:
+                ok = PushSlot(s, &n, size, true, false, 0);
+                break;
+
+            case s_LP:
+                ok = PushSlot(s, &n, size, Arg >= 1 && (unsigned int) Arg <= nslots && slots[Arg], false, 0);
+                break;
+
+            case s_SP:
+                x = PopSlot(s, &n);
+                if (x.address && Arg >= 1 && (unsigned int) Arg <= nslots && !slots[Arg])
+                {
+                    slots[Arg] = true;
+                    *changed   = true;
+                }
+                break;
+
+            case s_SG:
+            case s_DISCARD:
+                PopSlot(s, &n);
+                break;
+
+            case s_STIND:
+            case s_VCOPY:
+            case s_LBOUNDSCHECK:  /* the bounds - the address checked stays */
+            case s_GBOUNDSCHECK:
+                PopSlot(s, &n);
+                PopSlot(s, &n);
+                break;
+
+            case s_RV:
+                PopSlot(s, &n);
+                ok = PushSlot(s, &n, size, false, false, 0);
+                break;
+
+            case s_PUSHTOS:
+                x = PopSlot(s, &n);
+                ok = PushSlot(s, &n, size, x.address, x.constant, x.value) &&
+                     PushSlot(s, &n, size, x.address, x.constant, x.value);
+                break;
+
+            case s_SWAP:
+                x = PopSlot(s, &n);
+                y = PopSlot(s, &n);
+                ok = PushSlot(s, &n, size, x.address, x.constant, x.value) &&
+                     PushSlot(s, &n, size, y.address, y.constant, y.value);
+                break;
+
+            case s_JT:
+            case s_JF:
+                PopSlot(s, &n);
+                JoinSlots(h, &joins, &njoins, i, Arg, s, n);
+                break;
+
+            case s_JUMP:
+            case s_RES:  /* the value of a conditional expression stays */
+                JoinSlots(h, &joins, &njoins, i, Arg, s, n);
+                flow = false;
+                break;
+
+            case s_SWITCHON:
+                PopSlot(s, &n);
+                i += 2 * Arg + 1;  /* the default and the case table */
+                flow = false;
+                break;
+
+            case s_RTRN:
+                flow = false;
+                break;
+
+            case s_FNAP:
+            case s_RTAP:
+                x = PopSlot(s, &n);  /* the label of the procedure */
+                k = (x.constant && x.value >= 1 && (unsigned int) x.value <= h->NumberOfLabels) ? h->Labels[x.value] : 0;
+                if (k < 1 || k > h->ProgramSize || h->Instructions[k].Op != s_ENTRY)
+                {
+                    ok = false;
+                    break;
+                }
+                k = h->Instructions[k].Arg;
+                for (j=1; j<=h->Procedures[k].nArgs; j+=1)
+                {
+                    PopSlot(s, &n);
+                }
+                if (h->Procedures[k].ProcType != VoidType)
+                {
+                    ok = PushSlot(s, &n, size, false, false, 0);
+                }
+                break;
+
+            case s_SYSCALL:
+                x = PopSlot(s, &n);  /* the function */
+                y = PopSlot(s, &n);  /* the number of arguments */
+                if (!x.constant || !y.constant || y.value < 0)
+                {
+                    ok = false;
+                    break;
+                }
+                for (j=1; j<=(unsigned int) y.value; j+=1)
+                {
+                    PopSlot(s, &n);
+                }
+                if (x.value > 100 && x.value != 105)  /* functions other than deleteprocess return a value */
+                {
+                    ok = PushSlot(s, &n, size, false, false, 0);
+                }
+                break;
+
+            case s_DEBUG:
+            case s_STACK:
+            case s_QUERY:
+            case s_STORE:
+            case s_SAVE:
+            case s_RSTACK:
+            case s_LAB:
+            case s_NONE:
+                break;
+
+            default:
+                if (Binary(Op))
+                {
+                    y = PopSlot(s, &n);
+                    x = PopSlot(s, &n);
+                    ok = PushSlot(s, &n, size, (Op == s_PLUS && x.address != y.address) ||
+                                               (Op == s_MINUS && x.address && !y.address), false, 0);
+                }
+                else if (Unary(Op))
+                {
+                    PopSlot(s, &n);
+                    ok = PushSlot(s, &n, size, false, false, 0);
+                }
+                else
+                {
+                    ok = false;
+                }
+                break;
+        }
+    }
+
+    for (j=0; j<njoins; j+=1)
+    {
+        free(joins[j].stack);
+    }
+    free(joins);
+    free(s);
+    return ok && found;
+}
+
+/* --------------------------------------------------------- */
+void RelocateProcess(struct NodeInfo *h, struct PCB *d, RegionItem *r, unsigned int nregions)  /* innermost frame first */
+{
+    ProcedureItem *p;
+    StackSlot     *stack;
+    bool          *slots;
+    bool          changed;
+    unsigned int  pc;
+    unsigned int  fp;
+    unsigned int  top;
+    unsigned int  base;
+    unsigned int  depth;
+    unsigned int  first;
+    unsigned int  i;
+    int           *S = d->stack;
+
+    pc  = d->saved_PC;
+    fp  = d->saved_FP;
+    top = d->saved_SP;
+    if (pc < 1 || pc > h->ProgramSize || top >= d->stacksize)
+    {
+        Runtime_Error(246, "Checkpoint: process %d of node %d is corrupt\n", d->handle, h->NodeNumber);
+    }
+    if (h->Instructions[pc].Op == s_ENTRY)  /* called but not entered - the return address is on top */
+    {
+        if (top == 0 || S[top] == 0)  /* a process yet to start */
+        {
+            return;
+        }
+        pc  = (unsigned int) S[top] - 1;
+        top = top - 1;
+    }
+
+    stack = (StackSlot *) malloc(sizeof(StackSlot) * (d->stacksize + 1));
+    if (stack == NULL)
+    {
+        Runtime_Error(242, "Checkpoint: out of memory\n");
+    }
+
+    while (1)
+    {
+        first = FrameProcedure(h, pc);
+        if (first == 0)
+        {
+            Runtime_Error(246, "Checkpoint: process %d of node %d is corrupt\n", d->handle, h->NodeNumber);
+        }
+        p     = &h->Procedures[h->Instructions[first].Arg];
+        base  = fp + p->BP + 2;  /* above the return address and the caller's frame */
+        slots = (bool *) calloc(p->BP + 1, sizeof(bool));
+        if (slots == NULL)
+        {
+            Runtime_Error(242, "Checkpoint: out of memory\n");
+        }
+        for (i=1; i<=p->nArgs; i+=1)
+        {
+            if (p->Args[i].vDimensions[0] > 0 && p->Args[i].vOffset <= p->BP)
+            {
+                slots[p->Args[i].vOffset] = true;
+            }
+        }
+
+        do
+        {
+            if (base > top || base >= d->stacksize ||
+                !ScanFrame(h, first, pc, slots, p->BP, &changed, stack, &depth, d->stacksize))
+            {
+                Runtime_Error(246, "Checkpoint: unable to follow the stack of process %d of node %d in %s\n",
+                              d->handle, h->NodeNumber, p->Name);
+            }
+        } while (changed);
+        if (depth < top - base)
+        {
+            Runtime_Error(246, "Checkpoint: unable to follow the stack of process %d of node %d in %s\n",
+                          d->handle, h->NodeNumber, p->Name);
+        }
+
+        for (i=1; i<=p->BP; i+=1)
+        {
+            if (slots[i])
+            {
+                S[fp + i] = (int) Relocate((unsigned int) S[fp + i], r, nregions);
+            }
+        }
+        for (i=1; i<=top-base; i+=1)
+        {
+            if (stack[i].address)
+            {
+                S[base + i] = (int) Relocate((unsigned int) S[base + i], r, nregions);
+            }
+        }
+        free(slots);
+
+        if (S[fp + p->BP + 1] == 0)  /* the return address of the process */
+        {
+            break;
+        }
+        top = fp;  /* the arguments belong to the callee */
+        pc  = (unsigned int) S[fp + p->BP + 1] - 1;
+        fp  = (unsigned int) S[fp + p->BP + 2];
+        if (pc < 1 || pc > h->ProgramSize || (h->Instructions[pc].Op != s_FNAP && h->Instructions[pc].Op != s_RTAP))
+        {
+            Runtime_Error(246, "Checkpoint: process %d of node %d is corrupt\n", d->handle, h->NodeNumber);
+        }
+    }
+    free(stack);
+}
+
+/* --------------------------------------------------------- */
+void RebuildNodeList(unsigned int *order, unsigned int n)  /* scheduler list and its time buckets */
+{
+    struct LimitItem *l;
+    struct LimitItem *next;
+    struct NodeInfo  *h;
+    struct NodeInfo  *prev;
+    unsigned int     i;
+
+    for (l=LimitList; l!=NULL; l=next)
+    {
+        next = l->NextItem;
+        free(l);
+    }
+    LimitList     = NULL;
+    LimitListTail = NULL;
+    NodeList      = NULL;
+    NodeListTail  = NULL;
+
+    prev = NULL;
+    for (i=1; i<=n; i+=1)
+    {
+        h = FindNode(order[i]);
+        h->PrevNode = prev;
+        h->NextNode = NULL;
+        if (prev == NULL)
+        {
+            NodeList = h;
+        }
+        else
+        {
+            prev->NextNode = h;
+        }
+
+        if (LimitListTail == NULL || LimitListTail->Value != h->SystemTicks)
+        {
+            l = (struct LimitItem *) malloc(sizeof(struct LimitItem));
+            if (l == NULL)
+            {
+                Runtime_Error(242, "Checkpoint: out of memory\n");
+            }
+            l->Value    = h->SystemTicks;
+            l->items    = 0;
+            l->NextItem = NULL;
+            l->PrevItem = LimitListTail;
+            if (LimitListTail == NULL)
+            {
+                LimitList = l;
+            }
+            else
+            {
+                LimitListTail->NextItem = l;
+            }
+            LimitListTail = l;
+        }
+        LimitListTail->LastNode = h;
+        LimitListTail->items += 1;
+        h->LimitItem = LimitListTail;
+
+        prev = h;
+    }
+    NodeListTail = prev;
+}
+
+/* --------------------------------------------------------- */
+unsigned long long int LoadState(FILE *chain[], unsigned int nchain, char Filename[])  /* chain[0] is the target, chain[nchain-1] full */
+{
+    CheckpointHeader hd;
+    RegionItem       *regions;
+    unsigned int     nregions;
+    unsigned int     *order;
+    unsigned int     norder;
+    unsigned int     *live;
+    struct NodeInfo  *h;
+    struct NodeInfo  *next;
+    struct PCB       *d;
+    struct PCB       *last;
+    RegionItem       *r;
+    unsigned int     i;
+    unsigned int     j;
+    unsigned int     k;
+    unsigned int     n;
+    unsigned int     cur;
+    unsigned int     node;
+    unsigned int     kind;
+    unsigned int     handle;
+    unsigned int     page;
+    unsigned int     cnt;
+    unsigned long long int ticks;
+    unsigned long long int pos;
+
+    ReadHeader(chain[0], Filename, &hd);  /* state from the target */
+    ticks = hd.ticks;
+
+    ProcessingTicks = GetLong();
+    TotalTicks      = GetLong();
+    sync_count      = GetWord();
+    CountSearches   = GetWord();
+    GetBlock(&AverageSearches, sizeof(float));
+
+    n = GetWord();
+    if (n != LogStreams)
+    {
+        Runtime_Error(245, "Checkpoint has %d log channels, model has %d\n", n, LogStreams);
+    }
+    for (i=1; i<=n; i+=1)
+    {
+        LogData[i].lastlog = GetLong();
+        pos = GetLong();
+        if (LogData[i].stream != NULL)  /* opened for appending - drop anything logged after the checkpoint */
+        {
+            fflush(LogData[i].stream);
+#ifndef WIN32
+            if (ftruncate(fileno(LogData[i].stream), (off_t) pos) != 0)
+            {
+                Runtime_Error(245, "Unable to rewind log file %s\n", LogData[i].name);
+            }
+#endif
+            fseek(LogData[i].stream, (long) pos, SEEK_SET);
+        }
+    }
+
+    n = GetWord();
+    h = FindNode(ProfileNode);
+    for (i=1; i<=n; i+=1)
+    {
+        j = GetWord();
+        k = GetWord();
+        if (h != NULL && i <= h->NumberOfProcedures)
+        {
+            h->Procedures[i].CallCount = j;
+            h->Procedures[i].TickCount = k;
+        }
+    }
+
+    nregions = GetWord();
+    regions = (RegionItem *) malloc(sizeof(RegionItem) * (nregions + 1));
+    if (regions == NULL)
+    {
+        Runtime_Error(242, "Checkpoint: out of memory\n");
+    }
+    for (i=0; i<nregions; i+=1)
+    {
+        regions[i].node   = GetWord();
+        regions[i].kind   = GetWord();
+        regions[i].handle = GetWord();
+        regions[i].base   = GetWord();
+        regions[i].size   = GetWord();
+        regions[i].vector = NULL;
+    }
+    qsort(regions, nregions, sizeof(RegionItem), CompareRegionKeys);
+
+    norder = GetWord();
+    order = (unsigned int *) malloc(sizeof(unsigned int) * (norder + 1));
+    live = (unsigned int *) malloc(sizeof(unsigned int) * (norder + 1));
+    if (order == NULL || live == NULL)
+    {
+        Runtime_Error(242, "Checkpoint: out of memory\n");
+    }
+
+    for (i=1; i<=norder; i+=1)
+    {
+        node = GetWord();
+        h = FindNode(node);
+        if (h == NULL)
+        {
+            Runtime_Error(245, "Checkpoint node %d is not in the model\n", node);
+        }
+        order[i] = node;
+
+        while (h->ProcessList != NULL)  /* discard the processes created for a fresh start */
+        {
+            DeleteProcess(node, h->ProcessList->handle);
+        }
+
+        h->PC                = GetWord();
+        h->SP                = GetWord();
+        h->FP                = GetWord();
+        h->SystemTicks       = GetLong();
+        h->LastClockTick     = GetLong();
+        h->Tickrate          = GetWord();
+        h->DMATicks          = GetWord();
+        h->SyncWait          = (GetWord() != 0);
+        h->PktsTX            = GetWord();
+        h->PktsRX            = GetWord();
+        h->HandleNumber      = GetWord();
+        cur                  = GetWord();
+        n                    = GetWord();
+        h->NumberOfProcesses = 0;
+        h->CurrentProcess    = NULL;
+        h->S                 = NULL;
+
+        r = FindRegion(regions, nregions, node, GlobalRegion, 0);
+        if (r == NULL || r->size != h->GlobalVectorSize + 1)
+        {
+            Runtime_Error(245, "Checkpoint global vector of node %d does not match\n", node);
+        }
+        r->vector = h->G;
+        r = FindRegion(regions, nregions, node, ExternalRegion, 0);
+        if (r == NULL || r->size != h->ExternalVectorSize + 1)
+        {
+            Runtime_Error(245, "Checkpoint external vector of node %d does not match\n", node);
+        }
+        r->vector = h->E;
+
+        last = NULL;
+        for (j=1; j<=n; j+=1)
+        {
+            d = (struct PCB *) malloc(sizeof(struct PCB));
+            if (d == NULL)
+            {
+                Runtime_Error(242, "Checkpoint: out of memory\n");
+            }
+            d->handle    = GetWord();
+            d->saved_PC  = GetWord();
+            d->saved_SP  = GetWord();
+            d->saved_FP  = GetWord();
+            d->stacksize = GetWord();
+            d->status    = (enum ProcessState) GetWord();
+            d->priority  = GetWord();
+            d->dticks    = GetWord();
+            d->semaphore = (int *) (uintptr_t) GetWord();  /* relocated below */
+            d->shadow    = NULL;
+            d->stack     = (int *) calloc(d->stacksize, sizeof(int));
+            if (d->stack == NULL)
+            {
+                Runtime_Error(242, "Checkpoint: out of memory\n");
+            }
+
+            d->prevPCB = last;  /* keep the list order - it decides between equal priorities */
+            d->nextPCB = NULL;
+            if (last == NULL)
+            {
+                h->ProcessList = d;
+            }
+            else
+            {
+                last->nextPCB = d;
+            }
+            last = d;
+            h->NumberOfProcesses += 1;
+            AddProcess(node, d);
+            if (d->handle == cur)
+            {
+                h->CurrentProcess = d;
+            }
+
+            r = FindRegion(regions, nregions, node, StackRegion, d->handle);
+            if (r == NULL || r->size != d->stacksize)
+            {
+                Runtime_Error(245, "Checkpoint stack of node %d does not match\n", node);
+            }
+            r->vector = d->stack;
+        }
+    }
+
+    memcpy(live, order, sizeof(unsigned int) * (norder + 1));  /* nodes that had terminated by the checkpoint */
+    qsort(&live[1], norder, sizeof(unsigned int), CompareLiveNodes);
+    for (h=NodeList; h!=NULL; h=next)
+    {
+        next = h->NextNode;
+        node = h->NodeNumber;
+        if (bsearch(&node, &live[1], norder, sizeof(unsigned int), CompareLiveNodes) == NULL)
+        {
+            DeleteNode(node);
+        }
+    }
+    RebuildNodeList(order, norder);
+
+    for (k=nchain; k>0; k-=1)  /* pages, oldest first */
+    {
+        ReadHeader(chain[k-1], Filename, &hd);
+        fseek(CkptStream, (long) hd.pages, SEEK_SET);
+        while ((node = GetWord()) != 0xFFFFFFFF)
+        {
+            kind   = GetWord();
+            handle = GetWord();
+            page   = GetWord();
+            cnt    = GetWord();
+            r = FindRegion(regions, nregions, node, kind, handle);
+            if (r != NULL && r->vector != NULL && page * PageWords + cnt <= r->size && cnt <= PageWords)
+            {
+                GetBlock(&r->vector[page * PageWords], sizeof(int) * cnt);
+            }
+            else
+            {
+                fseek(CkptStream, sizeof(int) * cnt, SEEK_CUR);  /* vector no longer live */
+            }
+        }
+    }
+
+    qsort(regions, nregions, sizeof(RegionItem), CompareRegionBases);
+    for (h=NodeList; h!=NULL; h=h->NextNode)  /* addresses held by the processes */
+    {
+        for (d=h->ProcessList; d!=NULL; d=d->nextPCB)
+        {
+            if (d->semaphore != NULL)
+            {
+                d->semaphore = (int *) (uintptr_t) Relocate((unsigned int) (uintptr_t) d->semaphore, regions, nregions);
+            }
+            RelocateProcess(h, d, regions, nregions);
+        }
+        if (h->CurrentProcess != NULL)
+        {
+            RestoreProcess(h->NodeNumber, h->CurrentProcess);
+        }
+    }
+
+    free(regions);
+    free(order);
+    free(live);
+    return ticks;
+}
+
+/* --------------------------------------------------------- */
+void RestoreCheckpoint(char Filename[])
+{
+    CheckpointHeader       hd;
+    FILE                   *chain[FullEvery + 1];
+    char                   name[MaxStringSize + 20];
+    unsigned int           nchain;
+    unsigned int           i;
+    unsigned long long int ticks;
+
+    nchain = 0;  /* follow the parents back to a full checkpoint */
+    strcpy(name, Filename);
+    while (1)
+    {
+        if (nchain > FullEvery)
+        {
+            Runtime_Error(243, "Checkpoint chain of %s too long\n", Filename);
+        }
+        chain[nchain] = fopen(name, "rb");
+        if (chain[nchain] == NULL)
+        {
+            Runtime_Error(240, "Unable to open checkpoint file %s\n", name);
+        }
+        ReadHeader(chain[nchain], name, &hd);
+        if (nchain == 0)
+        {
+            CheckpointNumber = hd.number;
+        }
+        nchain += 1;
+        if (hd.full)
+        {
+            break;
+        }
+        strcpy(name, hd.parent);
+    }
+
+    ticks = LoadState(chain, nchain, Filename);
+    for (i=0; i<nchain; i+=1)
+    {
+        fclose(chain[i]);
+    }
+
+    ChainLength = 0;  /* the next checkpoint starts a new chain */
+    NextCheckpoint = (CheckpointInterval > 0) ? ticks + CheckpointInterval : 0;
+    printf("Restored checkpoint %s at %f s (%d files)\n", Filename, TicksToTime(ticks), nchain);
+}
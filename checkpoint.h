@@ -0,0 +1,19 @@
+/* DAMSON checkpoint header
+*/
+
+#ifndef CHECKPOINT
+#define CHECKPOINT
+
+#include "compiler.h"
+
+extern unsigned long long int NextCheckpoint;
+extern char                   *RestoreFile;
+
+extern void SetCheckpointInterval(float t);
+extern void CheckpointInit();
+extern void WriteCheckpoint(unsigned long long int t);
+extern void RestoreCheckpoint(char Filename[]);
+extern void SaveState(FILE *s, unsigned long long int t, bool full, char parent[], bool tracking);
+extern unsigned long long int LoadState(FILE *chain[], unsigned int nchain, char Filename[]);
+
+#endif
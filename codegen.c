@@ -134,212 +134,214 @@ typedef struct
     unsigned int pos;
 } sstackItem;
 
+typedef struct  /* one per prototype, so that prototypes can be generated at the same time */
+{
+    unsigned int        ssp;
+    sstackItem          sstack[Maxsstack + 1];
+    LabelRefItem        ProgLabelRefs;
+    unsigned int        ProgLabelList[MaxLabels + 1 + 50];
+    ConstRefItem        ProgConstRefs;
+    unsigned int        ProgCounter;
+    unsigned int        ProgSize;
+    unsigned int        ProgCode[CodeSize + 1];
+
+    unsigned int        Op;
+    unsigned int        pendingop;
+    unsigned int        arg1;
+    unsigned int        arg2;
+    unsigned int        maxssp;
+    struct lnode        *slave[r_r9 + 1];
+    struct lnode        *freelist;
+    struct lnode        dplist[100];
+    unsigned int        dp;
+    bool                incode;
+    unsigned int        cgdebug;
+    unsigned int        SYSCALL_Arg;
+    unsigned int        lastlab;
+
+    Instruction         *Instructions;  /* the prototype being generated */
+    unsigned int        ProgramSize;
+    int                 *globalvector;
+    unsigned int        globalvectorsize;
+    ProcedureItem       *Procedures;
+    unsigned int        NumberOfProcedures;
+    unsigned int        *Labels;
+    unsigned int        NumberOfLabels;
+} CodeGenState;
+
 /* globals */
-unsigned int            ssp;
-sstackItem              sstack[Maxsstack + 1];
-FILE                    *OutputFilestream;
-LabelRefItem            ProgLabelRefs;
-unsigned int            ProgLabelList[MaxLabels + 1 + 50];
-ConstRefItem            ProgConstRefs;
 unsigned int            ProgStringList[MaxStrings + 1];
-unsigned int            ProgCounter;
-unsigned int            ProgSize;
-unsigned int            ProgCode[CodeSize + 1];
-
-unsigned int            Op;
-unsigned int            pendingop;
-unsigned int            arg1;
-unsigned int            arg2;
-unsigned int            maxssp;
-struct lnode            *slave[r_r9 + 1];
-struct lnode            *freelist;
-struct lnode            dplist[100];
-unsigned int            dp;
-bool                    incode;
-unsigned int            cgdebug;
-unsigned int            SYSCALL_Arg;
-unsigned int            lastlab = 0;
-char                    FileBaseName[MaxStringSize];
-
-unsigned int            NodeNumber;
-Instruction             *Instructions;
-unsigned int            ProgramSize;
-int                     *globalvector;
-unsigned int            globalvectorsize;
-ProcedureItem           *Procedures;
-unsigned int            NumberOfProcedures;
-unsigned int            *Labels;
-unsigned int            NumberOfLabels;
 
 /* prototypes */
-bool         cgdyadic(unsigned int Op, bool swappable);
-void         forgetr(unsigned int r);
-void         forgetall();
-void         cgmonadic(unsigned int Op);
-void         OpenOutputFile(char FileName[]);
-void         CloseOutputFile();
-void         OutputWrch(char Ch);
-void         GenRRR(unsigned int Op, unsigned int Rn, unsigned int Rd, unsigned int Rm);
-void         GenRRn(unsigned int Op, unsigned int Rn, unsigned int Rd, unsigned int sh, unsigned int n);
-void         GenRRRcond(unsigned int Op, unsigned int cond, unsigned int Rn, unsigned int Rd, unsigned int Rm);
-void         GenRRncond(unsigned int Op, unsigned int cond, unsigned int Rn, unsigned int Rd, unsigned int sh, unsigned int n);
-void         GenLDR(unsigned int r, unsigned int rx, int n);
-void         GenSTR(unsigned int r, unsigned int rx, int n);
-void         GenBranch(unsigned int cond, unsigned int lab);
-void         GenBranchWithLink(unsigned int lab);
-void         GenSysCall(unsigned int n, unsigned int r);
-void         GenMult(unsigned int Rd, unsigned int Rs, unsigned int Rm);
-void         setlab(unsigned int Label);
-void         FillinLabels();
-void         AddLabelRef(unsigned int label, unsigned int Location);
-void         AddConstRef(int val, unsigned int Location);
-void         FillinConsts();
-void         OutWord(unsigned int w);
-void         WriteProgram(char filename[]);
+bool         cgdyadic(CodeGenState *cs, unsigned int Op, bool swappable);
+void         forgetr(CodeGenState *cs, unsigned int r);
+void         forgetall(CodeGenState *cs);
+void         cgmonadic(CodeGenState *cs, unsigned int Op);
+void         GenRRR(CodeGenState *cs, unsigned int Op, unsigned int Rn, unsigned int Rd, unsigned int Rm);
+void         GenRRn(CodeGenState *cs, unsigned int Op, unsigned int Rn, unsigned int Rd, unsigned int sh, unsigned int n);
+void         GenRRRcond(CodeGenState *cs, unsigned int Op, unsigned int cond, unsigned int Rn, unsigned int Rd, unsigned int Rm);
+void         GenRRncond(CodeGenState *cs, unsigned int Op, unsigned int cond, unsigned int Rn, unsigned int Rd, unsigned int sh, unsigned int n);
+void         GenLDR(CodeGenState *cs, unsigned int r, unsigned int rx, int n);
+void         GenSTR(CodeGenState *cs, unsigned int r, unsigned int rx, int n);
+void         GenBranch(CodeGenState *cs, unsigned int cond, unsigned int lab);
+void         GenBranchWithLink(CodeGenState *cs, unsigned int lab);
+void         GenSysCall(CodeGenState *cs, unsigned int n, unsigned int r);
+void         GenMult(CodeGenState *cs, unsigned int Rd, unsigned int Rs, unsigned int Rm);
+void         setlab(CodeGenState *cs, unsigned int Label);
+void         FillinLabels(CodeGenState *cs);
+void         AddLabelRef(CodeGenState *cs, unsigned int label, unsigned int Location);
+void         AddConstRef(CodeGenState *cs, int val, unsigned int Location);
+void         FillinConsts(CodeGenState *cs);
+void         OutWord(CodeGenState *cs, unsigned int w);
+void         WriteProgram(CodeGenState *cs, char filename[]);
 unsigned int powerof2(int x);
 
-void         initstack(unsigned int n);
-void         loadt(unsigned int k, int n);
-void         storein(unsigned int k, int n);
-void         stack(unsigned int n);
-void         store(unsigned int a, unsigned int b);
-void         storet(unsigned int a);
-void         swapargs();
-unsigned int regscontaining(unsigned int k, int n);
-struct lnode *getblk(struct lnode *a, unsigned int b, int c);
-void         freeblk(struct lnode *p);
-void         forgetvar(unsigned int k, int n);
-void         forgetvars();
-unsigned int choosereg(unsigned int a);
-unsigned int regsinuse();
-void         remem(unsigned int a, unsigned int b, int c);
-void         cgpendingop();
-unsigned int cgcmp(unsigned int f);
+void         initstack(CodeGenState *cs, unsigned int n);
+void         loadt(CodeGenState *cs, unsigned int k, int n);
+void         storein(CodeGenState *cs, unsigned int k, int n);
+void         stack(CodeGenState *cs, unsigned int n);
+void         store(CodeGenState *cs, unsigned int a, unsigned int b);
+void         storet(CodeGenState *cs, unsigned int a);
+void         swapargs(CodeGenState *cs);
+unsigned int regscontaining(CodeGenState *cs, unsigned int k, int n);
+struct lnode *getblk(CodeGenState *cs, struct lnode *a, unsigned int b, int c);
+void         freeblk(CodeGenState *cs, struct lnode *p);
+void         forgetvar(CodeGenState *cs, unsigned int k, int n);
+void         forgetvars(CodeGenState *cs);
+unsigned int choosereg(CodeGenState *cs, unsigned int a);
+unsigned int regsinuse(CodeGenState *cs);
+void         remem(CodeGenState *cs, unsigned int a, unsigned int b, int c);
+void         cgpendingop(CodeGenState *cs);
+unsigned int cgcmp(CodeGenState *cs, unsigned int f);
 int          condbfn(unsigned int op);
 unsigned int compbfn(unsigned int f);
-void         initslave();
-void         lose1(unsigned int k, int n);
-unsigned int rdop();
-int          rdn();
-unsigned int movetoanyr(unsigned int a);
-unsigned int movetor(unsigned int a, unsigned int r);
-unsigned int regswithinfo();
-void         dboutput(unsigned int lev);
+void         initslave(CodeGenState *cs);
+void         lose1(CodeGenState *cs, unsigned int k, int n);
+unsigned int rdop(CodeGenState *cs);
+int          rdn(CodeGenState *cs);
+unsigned int movetoanyr(CodeGenState *cs, unsigned int a);
+unsigned int movetor(CodeGenState *cs, unsigned int a, unsigned int r);
+unsigned int regswithinfo(CodeGenState *cs);
+void         dboutput(CodeGenState *cs, unsigned int lev);
 void         wrkn(unsigned int k, int n);
-void         cgcondjump(bool b, unsigned int l);
-bool         isfree(unsigned int r);
-void         freereg(unsigned int r);
-unsigned int nextfree();
-int          regusedby(unsigned int a);
-unsigned int CheckLab();
+void         cgcondjump(CodeGenState *cs, bool b, unsigned int l);
+bool         isfree(CodeGenState *cs, unsigned int r);
+void         freereg(CodeGenState *cs, unsigned int r);
+unsigned int nextfree(CodeGenState *cs);
+int          regusedby(CodeGenState *cs, unsigned int a);
+unsigned int CheckLab(CodeGenState *cs);
 unsigned int FindLocalProcedureNumber(unsigned int n, unsigned int l);
-void         cgapply(unsigned int Op, unsigned int k, bool syscall);
-void         cgsave(unsigned int n);
-void         cgreturn(unsigned int n);
-void         cgstring(unsigned int p);
-void         GenAddConstant(unsigned int Rn, unsigned int Rd, int n);
-void         GenLoadConstant(unsigned int r, int c);
-void         moveinfo(unsigned int s, unsigned int r);
-bool         isinslave(unsigned int r, unsigned int k, int n);
-void         cgname(char name[]);
+void         cgapply(CodeGenState *cs, unsigned int Op, unsigned int k, bool syscall);
+void         cgsave(CodeGenState *cs, unsigned int n);
+void         cgreturn(CodeGenState *cs, unsigned int n);
+void         cgstring(CodeGenState *cs, unsigned int p);
+void         GenAddConstant(CodeGenState *cs, unsigned int Rn, unsigned int Rd, int n);
+void         GenLoadConstant(CodeGenState *cs, unsigned int r, int c);
+void         moveinfo(CodeGenState *cs, unsigned int s, unsigned int r);
+bool         isinslave(CodeGenState *cs, unsigned int r, unsigned int k, int n);
+void         cgname(CodeGenState *cs, char name[]);
 unsigned int VarSize(unsigned int node, unsigned int p, unsigned int v);
-void         bswitch(unsigned int p, unsigned int q, unsigned int d,
+void         bswitch(CodeGenState *cs, unsigned int p, unsigned int q, unsigned int d,
                      int casek[], unsigned int casel[]);
 void         stackinc(unsigned char OpCode, int Arg);
-void         cgstind();
-void         cgrv();
-void         GenLDRR(unsigned int r, unsigned int s);
-void         GenSTRR(unsigned int Rn, unsigned int Rd, unsigned int Rm);
+void         cgstind(CodeGenState *cs);
+void         cgrv(CodeGenState *cs);
+void         GenLDRR(CodeGenState *cs, unsigned int r, unsigned int s);
+void         GenSTRR(CodeGenState *cs, unsigned int Rn, unsigned int Rd, unsigned int Rm);
 unsigned int op2size(unsigned int n);
-void         cg();
-unsigned int cgNextLabel();
+void         cg(CodeGenState *cs);
+unsigned int cgNextLabel(CodeGenState *cs);
 unsigned int pack4b(unsigned char a, unsigned char b, unsigned char c, unsigned char d);
 
 /* --------------------------------------------------------- */
-void CodeGenerate(char FileBaseName[],
-                  char nodename[], 
-                  Instruction *code,    unsigned int codesize,
-                  int *gv,              unsigned int gvsize,
-                  int *ev,              unsigned int evsize,
-                  ProcedureItem *procs, unsigned int nprocs,
-                  unsigned int *labs,   unsigned int nlabs)
+unsigned int CodeGenerate(char FileBaseName[],
+                          char nodename[], 
+                          Instruction *code,    unsigned int codesize,
+                          int *gv,              unsigned int gvsize,
+                          int *ev,              unsigned int evsize,
+                          ProcedureItem *procs, unsigned int nprocs,
+                          unsigned int *labs,   unsigned int nlabs)
 {
-    unsigned int i;
+    CodeGenState *cs;
+    unsigned int size;
     char         OutputFileName[MaxStringSize];
 
+    cs = calloc(1, sizeof(CodeGenState));
+    if (cs == NULL)
+    {
+        Error(306, "Unable to allocate memory for the code generator: node %s\n", nodename);
+    }
+
     sprintf(OutputFileName, "%s_%s.o", FileBaseName, nodename);
 
-    Instructions = code;
-    ProgramSize = codesize;
+    cs->Instructions = code;
+    cs->ProgramSize = codesize;
 
-    globalvector = gv;
-    globalvectorsize = gvsize;
+    cs->globalvector = gv;
+    cs->globalvectorsize = gvsize;
 
-    Procedures = procs;
-    NumberOfProcedures = nprocs;
+    cs->Procedures = procs;  /* the offset of each procedure is set in the prototype definition */
+    cs->NumberOfProcedures = nprocs;
 
-    Labels = labs;
-    NumberOfLabels = nlabs;
-    
-    cg();
-    FillinConsts();
-    FillinLabels();
+    cs->Labels = labs;
+    cs->NumberOfLabels = nlabs;
     
-    for (i=1; i<=nprocs; i+=1)  /* set offset in prototype definition */
-    {
-        procs[i].Offset = Procedures[i].Offset;
-    }
-    WriteProgram(OutputFileName);
+    cg(cs);
+    FillinConsts(cs);
+    FillinLabels(cs);
+    WriteProgram(cs, OutputFileName);
 
-    printf("Node %s: %d bytes\n", nodename, ProgSize * 4);
+    size = cs->ProgSize;
+    free(cs);
+    return size;
 }
 
 /* --------------------------------------------------------- */
-void setlab(unsigned int Label)
+void setlab(CodeGenState *cs, unsigned int Label)
 {
-    ProgLabelList[Label] = ProgSize;
+    cs->ProgLabelList[Label] = cs->ProgSize;
 }
 
 /* --------------------------------------------------------- */
-void AddConstRef(int val, unsigned int location)
+void AddConstRef(CodeGenState *cs, int val, unsigned int location)
 {
-   unsigned int n = ProgConstRefs.nConsts + 1;
+   unsigned int n = cs->ProgConstRefs.nConsts + 1;
    
-   if (ProgConstRefs.nConsts > MaxConsts)
+   if (cs->ProgConstRefs.nConsts > MaxConsts)
    {
        Error(301, "Too many constants (%d)\n", MaxConsts);
    }
-   ProgConstRefs.Const[n] = val;
-   ProgConstRefs.Loc[n] = location;
-   ProgConstRefs.nConsts = n;
+   cs->ProgConstRefs.Const[n] = val;
+   cs->ProgConstRefs.Loc[n] = location;
+   cs->ProgConstRefs.nConsts = n;
 }
 
 /* --------------------------------------------------------- */
-void FillinLabels()
+void FillinLabels(CodeGenState *cs)
 {
     unsigned int i;
-    for (i=1; i<=ProgLabelRefs.nLabels; i+=1)
+    for (i=1; i<=cs->ProgLabelRefs.nLabels; i+=1)
     {
-        ProgCode[ProgLabelRefs.Loc[i]] += 
-          (ProgLabelList[ProgLabelRefs.Label[i]] - ProgLabelRefs.Loc[i] - 2) & 0xFFFFFF;
+        cs->ProgCode[cs->ProgLabelRefs.Loc[i]] += 
+          (cs->ProgLabelList[cs->ProgLabelRefs.Label[i]] - cs->ProgLabelRefs.Loc[i] - 2) & 0xFFFFFF;
     }
 }
 
 /* --------------------------------------------------------- */
-void FillinConsts()
+void FillinConsts(CodeGenState *cs)
 {
     unsigned int i;
     unsigned int p;
     
-    for (i=1; i<=ProgConstRefs.nConsts; i+=1)
+    for (i=1; i<=cs->ProgConstRefs.nConsts; i+=1)
     {
-        p = (ProgSize - ProgConstRefs.Loc[i] - 2) * 4;
+        p = (cs->ProgSize - cs->ProgConstRefs.Loc[i] - 2) * 4;
         if (p > 4095)
         {
             Error(3001, "FillinConsts: offset %d too large\n", p);
         }
-        ProgCode[ProgConstRefs.Loc[i]] += p;
-        OutWord(ProgConstRefs.Const[i]);
+        cs->ProgCode[cs->ProgConstRefs.Loc[i]] += p;
+        OutWord(cs, cs->ProgConstRefs.Const[i]);
     }
 }
 
@@ -383,7 +385,7 @@ const int iSectionsNumber = 9;                           /* The number of sectio
     const char _data            = 5;
 
 /* --------------------------------------------------------- */
-void WriteProgram(char filename[])
+void WriteProgram(CodeGenState *cs, char filename[])
 {
     int          fd;
     Elf          *pElf;
@@ -487,14 +489,14 @@ void WriteProgram(char filename[])
         p += 1;
     }       
 
-    for (i=1; i<=NumberOfProcedures; i+=1)
+    for (i=1; i<=cs->NumberOfProcedures; i+=1)
     {
         p = 0;
         strsize += 1;
         moffset[i] = strsize;  /* offset of procedure name string */
         while (1)
         {
-            strtab[strsize] = Procedures[i].Name[p];
+            strtab[strsize] = cs->Procedures[i].Name[p];
             if (strtab[strsize] == '\0')
             {
                 break;
@@ -571,10 +573,10 @@ void WriteProgram(char filename[])
     x[4].st_other = 0;
     x[4].st_shndx = _text;  /* The section where the symbol is */
 
-    for (i=1; i<=NumberOfProcedures; i+=1)
+    for (i=1; i<=cs->NumberOfProcedures; i+=1)
     {
         x[i+4].st_name = moffset[i];  /* Offset in the "strtab" section where the name starts */
-        x[i+4].st_value = Procedures[i].Offset;
+        x[i+4].st_value = cs->Procedures[i].Offset;
         x[i+4].st_size = 0;
         x[i+4].st_info = ELF32_ST_INFO(STB_GLOBAL, STT_FUNC);
         x[i+4].st_other = 0;
@@ -584,7 +586,7 @@ void WriteProgram(char filename[])
     pData->d_align = 4;
     pData->d_buf = (void *) x;
     pData->d_type = ELF_T_BYTE;
-    pData->d_size = sizeof(Elf32_Sym) * (NumberOfProcedures + 5);
+    pData->d_size = sizeof(Elf32_Sym) * (cs->NumberOfProcedures + 5);
 
     if ((pShdr = elf32_getshdr(pScn)) == NULL)
     {
@@ -610,9 +612,9 @@ void WriteProgram(char filename[])
 
     pData->d_align = 4;
     pData->d_off = 0;
-    pData->d_buf = (void *) ProgCode;
+    pData->d_buf = (void *) cs->ProgCode;
     pData->d_type = ELF_T_BYTE;
-    pData->d_size = ProgSize * 4;
+    pData->d_size = cs->ProgSize * 4;
 
     if ((pShdr = elf32_getshdr(pScn)) == NULL)
     {
@@ -694,13 +696,13 @@ void WriteProgram(char filename[])
 }
 
 /* --------------------------------------------------------- */
-void OutWord(unsigned int w)
+void OutWord(CodeGenState *cs, unsigned int w)
 {
-    ProgCode[ProgSize] = w;
-    ProgSize += 1;
-    if (ProgSize >= CodeSize)
+    cs->ProgCode[cs->ProgSize] = w;
+    cs->ProgSize += 1;
+    if (cs->ProgSize >= CodeSize)
     {
-        Error(302, "Program too large (%d)\n", ProgSize);
+        Error(302, "Program too large (%d)\n", cs->ProgSize);
     }
 }
 
@@ -725,7 +727,7 @@ unsigned int op2size(unsigned int n)
 }
 
 /* --------------------------------------------------------- */
-void GenLoadConstant(unsigned int r, int x)
+void GenLoadConstant(CodeGenState *cs, unsigned int r, int x)
 {
     unsigned int op1, op2;
     unsigned int r1  = 0;
@@ -753,7 +755,7 @@ void GenLoadConstant(unsigned int r, int x)
             n = n >> 2;
             sh += 1;
         }
-        GenRRn(op1, r1, r, (16 - sh) % 16, n & 0xFF);
+        GenRRn(cs, op1, r1, r, (16 - sh) % 16, n & 0xFF);
         if ((n & 0xFFFFFF00) == 0)
             return;
         n = n >> 8;
@@ -764,7 +766,7 @@ void GenLoadConstant(unsigned int r, int x)
 }
 
 /* --------------------------------------------------------- */
-void GenAddConstant(unsigned int Rn, unsigned int Rd, int c)
+void GenAddConstant(CodeGenState *cs, unsigned int Rn, unsigned int Rd, int c)
 {
     unsigned int op;
     unsigned int n;
@@ -789,7 +791,7 @@ void GenAddConstant(unsigned int Rn, unsigned int Rd, int c)
             sh += 1;
         }
         
-        GenRRn(op, Rn, Rd, (16 - sh) % 16, n & 0xFF);
+        GenRRn(cs, op, Rn, Rd, (16 - sh) % 16, n & 0xFF);
         if ((n & 0xFFFFFF00) == 0)
             return;
         n = n >> 8;
@@ -799,260 +801,260 @@ void GenAddConstant(unsigned int Rn, unsigned int Rd, int c)
 }
 
 /* --------------------------------------------------------- */
-void AddLabelRef(unsigned int label, unsigned int location)
+void AddLabelRef(CodeGenState *cs, unsigned int label, unsigned int location)
 {
-    unsigned int n = ProgLabelRefs.nLabels + 1;
+    unsigned int n = cs->ProgLabelRefs.nLabels + 1;
     
-    if (ProgLabelRefs.nLabels >= MaxLabels)
+    if (cs->ProgLabelRefs.nLabels >= MaxLabels)
     {
         Error(303, "Too many labels (%d)\n", MaxLabels);
     }
-    ProgLabelRefs.Loc[n] = location;
-    ProgLabelRefs.Label[n] = label;
-    ProgLabelRefs.nLabels = n;
+    cs->ProgLabelRefs.Loc[n] = location;
+    cs->ProgLabelRefs.Label[n] = label;
+    cs->ProgLabelRefs.nLabels = n;
 }
 
 /* --------------------------------------------------------- */
-void GenBranch(unsigned int cond, unsigned int lab)
+void GenBranch(CodeGenState *cs, unsigned int cond, unsigned int lab)
 {
-    if (incode)
+    if (cs->incode)
     {
-        AddLabelRef(lab, ProgSize);
-        OutWord((cond << 28) | (0xA << 24));
+        AddLabelRef(cs, lab, cs->ProgSize);
+        OutWord(cs, (cond << 28) | (0xA << 24));
         if (cond == b_BR)
         {
-            incode = false;
+            cs->incode = false;
         }
     } 
 }
 
 /* --------------------------------------------------------- */
-void GenBranchWithLink(unsigned int lab)
+void GenBranchWithLink(CodeGenState *cs, unsigned int lab)
 {
-    AddLabelRef(lab, ProgSize);
-    OutWord((14 << 28) | (0xB << 24)); 
+    AddLabelRef(cs, lab, cs->ProgSize);
+    OutWord(cs, (14 << 28) | (0xB << 24)); 
 }
 
 /* --------------------------------------------------------- */
-void GenSysCall(unsigned int n, unsigned int r)
+void GenSysCall(CodeGenState *cs, unsigned int n, unsigned int r)
 {
     switch (n)
     {
         case 18:  /* putbyte */
-            OutWord(0xe7c12000);    /* strb r2,[r0,r1] */
+            OutWord(cs, 0xe7c12000);    /* strb r2,[r0,r1] */
             break;
 
         case 19:  /* putword */
-            OutWord(0xe7802101);    /* str r2,[r0,r1, lsl #2] */
+            OutWord(cs, 0xe7802101);    /* str r2,[r0,r1, lsl #2] */
             break;
  
         case 36:  /* getbyte */
-            OutWord(0xe7d10000);    /* ldrb r0,[r1,r0] */
+            OutWord(cs, 0xe7d10000);    /* ldrb r0,[r1,r0] */
             break;
 
         case 37:  /* getword */
-            OutWord(0xe7900101);    /* mov r1,r1,asl #2 */
+            OutWord(cs, 0xe7900101);    /* mov r1,r1,asl #2 */
             break;
 
         default:
-            GenLDR(r, r_g, n * 4);                       /* load global n */
-            OutWord((14 << 28) | (0x12fff3 << 4) | r);   /* BLX r */ 
+            GenLDR(cs, r, r_g, n * 4);                       /* load global n */
+            OutWord(cs, (14 << 28) | (0x12fff3 << 4) | r);   /* BLX r */ 
             break;
     }
 }
 
 /* --------------------------------------------------------- */
-void GenRRR(unsigned int Op, unsigned int Rn, unsigned int Rd, unsigned int Rm)  /* rd = rn OP rm */
+void GenRRR(CodeGenState *cs, unsigned int Op, unsigned int Rn, unsigned int Rd, unsigned int Rm)  /* rd = rn OP rm */
 {
-    if (incode)
+    if (cs->incode)
     {
-        OutWord((14 << 28) | (Op << 21) | (Rn << 16) | (Rd << 12) | Rm);
+        OutWord(cs, (14 << 28) | (Op << 21) | (Rn << 16) | (Rd << 12) | Rm);
     }
 }
 
 /* --------------------------------------------------------- */
-void GenRRn(unsigned int Op, unsigned int Rn, unsigned int Rd, unsigned int sh, unsigned int n)
+void GenRRn(CodeGenState *cs, unsigned int Op, unsigned int Rn, unsigned int Rd, unsigned int sh, unsigned int n)
 {
-    if (incode)
+    if (cs->incode)
     {
-        OutWord((14 << 28) | (1 << 25) | (Op << 21) | (Rn << 16) | (Rd << 12) | (sh << 8) | n);
+        OutWord(cs, (14 << 28) | (1 << 25) | (Op << 21) | (Rn << 16) | (Rd << 12) | (sh << 8) | n);
     }
 }
 
 /* --------------------------------------------------------- */
-void GenRRRcond(unsigned int Op, unsigned int cond, unsigned int Rn, unsigned int Rd, unsigned int Rm)  /* rd = rn OP rm */
+void GenRRRcond(CodeGenState *cs, unsigned int Op, unsigned int cond, unsigned int Rn, unsigned int Rd, unsigned int Rm)  /* rd = rn OP rm */
 {
-    if (incode)
+    if (cs->incode)
     {
-        OutWord((cond << 28) | (Op << 21) | (Rn << 16) | (Rd << 12) | Rm);
+        OutWord(cs, (cond << 28) | (Op << 21) | (Rn << 16) | (Rd << 12) | Rm);
     }
 }
 
 /* --------------------------------------------------------- */
-void GenRRncond(unsigned int Op, unsigned int cond, unsigned int Rn, unsigned int Rd, unsigned int sh, unsigned int n)
+void GenRRncond(CodeGenState *cs, unsigned int Op, unsigned int cond, unsigned int Rn, unsigned int Rd, unsigned int sh, unsigned int n)
 {
-    if (incode)
+    if (cs->incode)
     {
-        OutWord((cond << 28) | (1 << 25) | (Op << 21) | (Rn << 16) | (Rd << 12) | (sh << 8) | n);
+        OutWord(cs, (cond << 28) | (1 << 25) | (Op << 21) | (Rn << 16) | (Rd << 12) | (sh << 8) | n);
     }
 }
 
 /* --------------------------------------------------------- */
-void GenMult(unsigned int Rd, unsigned int Rs, unsigned int Rm)  /* rd = rs * rm */
+void GenMult(CodeGenState *cs, unsigned int Rd, unsigned int Rs, unsigned int Rm)  /* rd = rs * rm */
 {
-    if (incode)
+    if (cs->incode)
     {
-        OutWord((14 << 28) | (Rd << 16) | (Rs << 8) | (9 << 4) | Rm);
+        OutWord(cs, (14 << 28) | (Rd << 16) | (Rs << 8) | (9 << 4) | Rm);
     }
 }
 
 /* --------------------------------------------------------- */
-void GenLDR(unsigned int r, unsigned int rx, int n)
+void GenLDR(CodeGenState *cs, unsigned int r, unsigned int rx, int n)
 {
-    if (incode)
+    if (cs->incode)
     {
-        OutWord((14 << 28) | (0x59 << 20) | (rx << 16) | (r << 12) | n);
+        OutWord(cs, (14 << 28) | (0x59 << 20) | (rx << 16) | (r << 12) | n);
     }
 }
 
 /* --------------------------------------------------------- */
-void GenLDRR(unsigned int r, unsigned int s)
+void GenLDRR(CodeGenState *cs, unsigned int r, unsigned int s)
 {
-    if (incode)
+    if (cs->incode)
     {
-        OutWord((14 << 28) | (0x79 << 20) | (r << 16) | (r << 12) | s);
+        OutWord(cs, (14 << 28) | (0x79 << 20) | (r << 16) | (r << 12) | s);
     }
 }
 
 /* --------------------------------------------------------- */
-void GenSTR(unsigned int r, unsigned int rx, int n)
+void GenSTR(CodeGenState *cs, unsigned int r, unsigned int rx, int n)
 {
-    if (incode)
+    if (cs->incode)
     {
-        OutWord((14 << 28) | (0x58 << 20) | (rx << 16) | (r << 12) | n);
+        OutWord(cs, (14 << 28) | (0x58 << 20) | (rx << 16) | (r << 12) | n);
     }
 }
 
 /* --------------------------------------------------------- */
-void GenSTRR(unsigned int Rn, unsigned int Rd, unsigned int Rm)
+void GenSTRR(CodeGenState *cs, unsigned int Rn, unsigned int Rd, unsigned int Rm)
 {
-    if (incode)
+    if (cs->incode)
     {
-        OutWord((14 << 28) | (0x78 << 20) | (Rn << 16) | (Rd << 12) | Rm);
+        OutWord(cs, (14 << 28) | (0x78 << 20) | (Rn << 16) | (Rd << 12) | Rm);
     }
 }
 
 /* --------------------------------------------------------- */
-void initstack(unsigned int n)
+void initstack(CodeGenState *cs, unsigned int n)
 {
-    arg2 = 0;
-    arg1 = 1;
-    ssp = n;
-    pendingop = s_NONE;
-    sstack[arg2].type = k_loc;
-    sstack[arg2].val = ssp - 2;
-    sstack[arg2].pos = ssp - 2;
-    sstack[arg1].type = k_loc;
-    sstack[arg1].val = ssp - 1;
-    sstack[arg1].pos = ssp - 1;
-    if (ssp >= maxssp)
+    cs->arg2 = 0;
+    cs->arg1 = 1;
+    cs->ssp = n;
+    cs->pendingop = s_NONE;
+    cs->sstack[cs->arg2].type = k_loc;
+    cs->sstack[cs->arg2].val = cs->ssp - 2;
+    cs->sstack[cs->arg2].pos = cs->ssp - 2;
+    cs->sstack[cs->arg1].type = k_loc;
+    cs->sstack[cs->arg1].val = cs->ssp - 1;
+    cs->sstack[cs->arg1].pos = cs->ssp - 1;
+    if (cs->ssp >= cs->maxssp)
     {
-        maxssp = ssp;
+        cs->maxssp = cs->ssp;
     }
 }
 
 /* --------------------------------------------------------- */
-void stack(unsigned int n)
+void stack(CodeGenState *cs, unsigned int n)
 {
-    if (n >= ssp + 4)
+    if (n >= cs->ssp + 4)
     {
-        store(0, ssp - 1);
-        initstack(n);
+        store(cs, 0, cs->ssp - 1);
+        initstack(cs, n);
         return;
     }
-    while (n > ssp)
+    while (n > cs->ssp)
     {
-        loadt(k_loc, ssp);
+        loadt(cs, k_loc, cs->ssp);
     }
     
-    while (n != ssp)
+    while (n != cs->ssp)
     {
-        if (arg2 == 0)
+        if (cs->arg2 == 0)
         {
-            if (n == ssp - 1)
+            if (n == cs->ssp - 1)
             {
-                ssp = n;
-                sstack[arg1].type = sstack[arg2].type;
-                sstack[arg1].val  = sstack[arg2].val;
-                sstack[arg1].pos  = ssp - 1;
-                sstack[arg2].type = k_loc;
-                sstack[arg2].val  = ssp - 2;
-                sstack[arg2].pos  = ssp - 2;
+                cs->ssp = n;
+                cs->sstack[cs->arg1].type = cs->sstack[cs->arg2].type;
+                cs->sstack[cs->arg1].val  = cs->sstack[cs->arg2].val;
+                cs->sstack[cs->arg1].pos  = cs->ssp - 1;
+                cs->sstack[cs->arg2].type = k_loc;
+                cs->sstack[cs->arg2].val  = cs->ssp - 2;
+                cs->sstack[cs->arg2].pos  = cs->ssp - 2;
             }
             else
             {
-                initstack(n);
+                initstack(cs, n);
             }
             return;
         }
-        arg1 -= 1;
-        arg2 -= 1;
-        ssp -= 1;
+        cs->arg1 -= 1;
+        cs->arg2 -= 1;
+        cs->ssp -= 1;
     }
 }
 
 /* --------------------------------------------------------- */
-void store(unsigned int a, unsigned int b)
+void store(CodeGenState *cs, unsigned int a, unsigned int b)
 {
     unsigned int p;
     unsigned int s;
     
-    for (p=0; p<=arg1; p+=1)
+    for (p=0; p<=cs->arg1; p+=1)
     {
-        s = sstack[p].pos;
+        s = cs->sstack[p].pos;
         if (s > b)
         {
             break;
         }
-        if (s >= a && sstack[p].type >= k_reg)
+        if (s >= a && cs->sstack[p].type >= k_reg)
         {
-            storet(p);
+            storet(cs, p);
         }
     }
-    for (p=0; p<=arg1; p+=1)
+    for (p=0; p<=cs->arg1; p+=1)
     {
-        s = sstack[p].pos;
+        s = cs->sstack[p].pos;
         if (s > b)
         {
             return;
         }
         if (s >= a)
         {
-            storet(p);
+            storet(cs, p);
         }
     }
 }
 
 /* --------------------------------------------------------- */
-int regusedby(unsigned int a)
+int regusedby(CodeGenState *cs, unsigned int a)
 {
-    unsigned int k = sstack[a].type;
+    unsigned int k = cs->sstack[a].type;
     
     if (k != k_reg)
     {
         return -1;
     }
-    return sstack[a].val;
+    return cs->sstack[a].val;
 }
 
 /* --------------------------------------------------------- */
-bool isfree(unsigned int r)
+bool isfree(CodeGenState *cs, unsigned int r)
 {
     unsigned int t;
     
-    for (t=0; t<=arg1; t+=1)
+    for (t=0; t<=cs->arg1; t+=1)
     {
-        if (regusedby(t) == r)
+        if (regusedby(cs, t) == r)
         {
             return false;
         }
@@ -1061,96 +1063,96 @@ bool isfree(unsigned int r)
 }
 
 /* --------------------------------------------------------- */
-void freereg(unsigned int r)
+void freereg(CodeGenState *cs, unsigned int r)
 {
     unsigned int t;
     
-    for (t=0; t<=arg1; t+=1)
+    for (t=0; t<=cs->arg1; t+=1)
     {
-        if (regusedby(t) == r)
+        if (regusedby(cs, t) == r)
         {
-            storet(t);
+            storet(cs, t);
             break;
         }
     }
 }
 
 /* --------------------------------------------------------- */
-unsigned int nextfree()
+unsigned int nextfree(CodeGenState *cs)
 {
     unsigned int r;
     
-    r = choosereg(~(regswithinfo() | regsinuse()));
+    r = choosereg(cs, ~(regswithinfo(cs) | regsinuse(cs)));
     return r;
 }
 
 /* --------------------------------------------------------- */
-void storet(unsigned int a)
+void storet(CodeGenState *cs, unsigned int a)
 {
-    unsigned int k = sstack[a].type;
-    int          n = sstack[a].val;
-    unsigned int s = sstack[a].pos;
+    unsigned int k = cs->sstack[a].type;
+    int          n = cs->sstack[a].val;
+    unsigned int s = cs->sstack[a].pos;
     unsigned int r;
     
     if (!(k == k_loc && s == n))
     {
-        r = movetoanyr(a);
-        GenSTR(r, r_p, 4 * s);
-        sstack[a].type = k_loc;
-        sstack[a].val = s;
-        remem(r, k_loc, n);
+        r = movetoanyr(cs, a);
+        GenSTR(cs, r, r_p, 4 * s);
+        cs->sstack[a].type = k_loc;
+        cs->sstack[a].val = s;
+        remem(cs, r, k_loc, n);
     }
 }
 
 /* --------------------------------------------------------- */
-void loadt(unsigned int k, int n)
+void loadt(CodeGenState *cs, unsigned int k, int n)
 {
-    cgpendingop();
-    if (ssp >= Maxsstack - 3)
+    cgpendingop(cs);
+    if (cs->ssp >= Maxsstack - 3)
     {
-        Error(304, "Simulated stack overflow (%d)\n", ssp);
+        Error(304, "Simulated stack overflow (%d)\n", cs->ssp);
     }
     else
     {
-        arg1 += 1;
-        arg2 += 1;
-        sstack[arg1].type = k;
-        sstack[arg1].val = n;
-        sstack[arg1].pos = ssp;
-        ssp += 1;
-        if (maxssp < ssp)
+        cs->arg1 += 1;
+        cs->arg2 += 1;
+        cs->sstack[cs->arg1].type = k;
+        cs->sstack[cs->arg1].val = n;
+        cs->sstack[cs->arg1].pos = cs->ssp;
+        cs->ssp += 1;
+        if (cs->maxssp < cs->ssp)
         {
-            maxssp = ssp;
+            cs->maxssp = cs->ssp;
         }
     }
 }
 
 /* --------------------------------------------------------- */
-void lose1(unsigned int k, int n)
+void lose1(CodeGenState *cs, unsigned int k, int n)
 {
-    ssp -= 1;
-    if (arg2 == 0)
+    cs->ssp -= 1;
+    if (cs->arg2 == 0)
     {
-        sstack[arg2].type = k_loc;
-        sstack[arg2].val  = ssp - 2;
-        sstack[arg2].pos  = ssp - 2;
+        cs->sstack[cs->arg2].type = k_loc;
+        cs->sstack[cs->arg2].val  = cs->ssp - 2;
+        cs->sstack[cs->arg2].pos  = cs->ssp - 2;
     }
     else
     {
-        arg1 -= 1;
-        arg2 -= 1;
+        cs->arg1 -= 1;
+        cs->arg2 -= 1;
     }
-    sstack[arg1].type = k;
-    sstack[arg1].val = n;
-    sstack[arg1].pos = ssp - 1;
+    cs->sstack[cs->arg1].type = k;
+    cs->sstack[cs->arg1].val = n;
+    cs->sstack[cs->arg1].pos = cs->ssp - 1;
 }
 
  /* --------------------------------------------------------- */
-unsigned int choosereg(unsigned int regs)
+unsigned int choosereg(CodeGenState *cs, unsigned int regs)
 {
     unsigned int r;
     
-    if (cgdebug > 5)
+    if (cs->cgdebug > 5)
     {
         printf("CHOOSEREG(%4x)\n", regs);
     }
@@ -1165,67 +1167,67 @@ unsigned int choosereg(unsigned int regs)
 }
     
 /* --------------------------------------------------------- */
-void initslave()
+void initslave(CodeGenState *cs)
 {
     unsigned int r;
     
     for (r=r_r0; r<=r_r9; r+=1)
     {
-        slave[r] = NULL;
+        cs->slave[r] = NULL;
     }
 }
 
 /* --------------------------------------------------------- */
-void forgetr(unsigned int r)
+void forgetr(CodeGenState *cs, unsigned int r)
 {
     struct lnode *a;
 
-    a = (struct lnode *) &slave[r];
+    a = (struct lnode *) &cs->slave[r];
     while (a->next != NULL)
     {
         a = a->next;
     }
-    a->next = freelist;
-    freelist = slave[r];
-    slave[r] = NULL;
+    a->next = cs->freelist;
+    cs->freelist = cs->slave[r];
+    cs->slave[r] = NULL;
 }
 
 /* --------------------------------------------------------- */
-void forgetall()
+void forgetall(CodeGenState *cs)
 {
     unsigned int r;
     
     for (r=r_r0; r<=r_r9; r+=1)
     {
-        forgetr(r);
+        forgetr(cs, r);
     }
 }
 
 /* --------------------------------------------------------- */
-void remem(unsigned int r, unsigned int k, int n)
+void remem(CodeGenState *cs, unsigned int r, unsigned int k, int n)
 {
     if (k < k_reg)
     {
-        slave[r] = getblk(slave[r], k, n);
+        cs->slave[r] = getblk(cs, cs->slave[r], k, n);
     }
 }
 
 /* --------------------------------------------------------- */
-void moveinfo(unsigned int s, unsigned int r)
+void moveinfo(CodeGenState *cs, unsigned int s, unsigned int r)
 {
     struct lnode *p;
     
-    p = slave[s];
-    forgetr(r);
+    p = cs->slave[s];
+    forgetr(cs, r);
     while (p != NULL)
     {
-        remem(r, p->type, p->val);
+        remem(cs, r, p->type, p->val);
         p = p->next;
     } 
 }
 
 /* --------------------------------------------------------- */
-void forgetvar(unsigned int k, int n)
+void forgetvar(CodeGenState *cs, unsigned int k, int n)
 {
     struct lnode *a;
     struct lnode *p;
@@ -1234,7 +1236,7 @@ void forgetvar(unsigned int k, int n)
     for (r=r_r0; r<= r_r9; r+=1)
     {
         
-        a = (struct lnode *) &slave[r];
+        a = (struct lnode *) &cs->slave[r];
         while (1)
         {
             p = a->next;
@@ -1245,7 +1247,7 @@ void forgetvar(unsigned int k, int n)
             if (p->type == k && p->val == n)
             {
                 a->next = p->next;
-                freeblk(p);
+                freeblk(cs, p);
             }
             else
             {
@@ -1256,7 +1258,7 @@ void forgetvar(unsigned int k, int n)
 }
 
 /* --------------------------------------------------------- */
-void forgetvars()
+void forgetvars(CodeGenState *cs)
 {
     struct lnode *a;
     struct lnode *p;
@@ -1265,7 +1267,7 @@ void forgetvars()
     for (r=r_r0; r<= r_r9; r+=1)
     {
         
-        a = (struct lnode *) &slave[r];
+        a = (struct lnode *) &cs->slave[r];
         while (1)
         {
             p = a->next;
@@ -1276,7 +1278,7 @@ void forgetvars()
             if (p->type < k_numb)
             {
                 a->next = p->next;
-                freeblk(p);
+                freeblk(cs, p);
             }
             else
             {
@@ -1287,7 +1289,7 @@ void forgetvars()
 }
 
 /* --------------------------------------------------------- */
-unsigned int regscontaining(unsigned int k, int n)
+unsigned int regscontaining(CodeGenState *cs, unsigned int k, int n)
 {
     unsigned int regset = 0;
     unsigned int r;
@@ -1299,7 +1301,7 @@ unsigned int regscontaining(unsigned int k, int n)
     
     for (r=r_r0; r<=r_r9; r+=1)
     {
-        if (isinslave(r, k, n))
+        if (isinslave(cs, r, k, n))
         {
             regset = regset | (1 << r);
         }
@@ -1308,11 +1310,11 @@ unsigned int regscontaining(unsigned int k, int n)
 }
 
 /* --------------------------------------------------------- */
-bool isinslave(unsigned int r, unsigned int k, int n)
+bool isinslave(CodeGenState *cs, unsigned int r, unsigned int k, int n)
 {
     struct lnode *p;
     
-    p = slave[r];
+    p = cs->slave[r];
     
     while (p != NULL)
     {
@@ -1326,30 +1328,30 @@ bool isinslave(unsigned int r, unsigned int k, int n)
 }
 
 /* --------------------------------------------------------- */
-unsigned int regsinuse()
+unsigned int regsinuse(CodeGenState *cs)
 {
     unsigned int regset = 0;
     unsigned int t;
     
-    for (t=0; t<=arg1; t+=1)
+    for (t=0; t<=cs->arg1; t+=1)
     {
-        if (sstack[t].type == k_reg)
+        if (cs->sstack[t].type == k_reg)
         {
-            regset = regset | (1 << sstack[t].val);
+            regset = regset | (1 << cs->sstack[t].val);
         }
     }
     return regset;
 } 
  
 /* --------------------------------------------------------- */
-unsigned int regswithinfo()
+unsigned int regswithinfo(CodeGenState *cs)
 {
     unsigned int regset = 0;
     unsigned int r;
     
     for (r=r_r0; r<=r_r9; r+=1)
     {
-        if (slave[r] != NULL)
+        if (cs->slave[r] != NULL)
         {
             regset = regset | (1 << r);
         }
@@ -1358,18 +1360,18 @@ unsigned int regswithinfo()
 }
 
 /* --------------------------------------------------------- */
-struct lnode *getblk(struct lnode *a, unsigned int b, int c)
+struct lnode *getblk(CodeGenState *cs, struct lnode *a, unsigned int b, int c)
 {
-    struct lnode *p = freelist;
+    struct lnode *p = cs->freelist;
     
     if (p == NULL)
     {
-        dp += 1;
-        p = &dplist[dp];
+        cs->dp += 1;
+        p = &cs->dplist[cs->dp];
     }
     else
     {
-        freelist = p->next;
+        cs->freelist = p->next;
     }
     p->next = a;
     p->type = b;
@@ -1378,26 +1380,26 @@ struct lnode *getblk(struct lnode *a, unsigned int b, int c)
 }
 
 /* --------------------------------------------------------- */
-void freeblk(struct lnode *p)
+void freeblk(CodeGenState *cs, struct lnode *p)
 {
-    p->next = freelist;
-    freelist = p;
+    p->next = cs->freelist;
+    cs->freelist = p;
 }
 
 /* --------------------------------------------------------- */
-void swapargs()
+void swapargs(CodeGenState *cs)
 {
-    unsigned int k  = sstack[arg1].type;
-    int          n  = sstack[arg1].val;
+    unsigned int k  = cs->sstack[cs->arg1].type;
+    int          n  = cs->sstack[cs->arg1].val;
     
-    sstack[arg1].type = sstack[arg2].type;
-    sstack[arg1].val  = sstack[arg2].val;
-    sstack[arg2].type = k;
-    sstack[arg2].val  = n;
+    cs->sstack[cs->arg1].type = cs->sstack[cs->arg2].type;
+    cs->sstack[cs->arg1].val  = cs->sstack[cs->arg2].val;
+    cs->sstack[cs->arg2].type = k;
+    cs->sstack[cs->arg2].val  = n;
 }
 
 /* --------------------------------------------------------- */
-unsigned int movetoanyr(unsigned int a)
+unsigned int movetoanyr(CodeGenState *cs, unsigned int a)
 {
     unsigned int k;
     int          n;
@@ -1407,40 +1409,40 @@ unsigned int movetoanyr(unsigned int a)
     
     while (1)
     {
-        usedregs = regsinuse();
-        k = sstack[a].type;
-        n = sstack[a].val;
+        usedregs = regsinuse(cs);
+        k = cs->sstack[a].type;
+        n = cs->sstack[a].val;
         
         if (k == k_reg)  /* already on the stack? */
         {
             return n;
         }
     
-        poss = regscontaining(k, n);  /* in the slave ? */
+        poss = regscontaining(cs, k, n);  /* in the slave ? */
         if (poss != 0)
         {
-            return choosereg(poss);
+            return choosereg(cs, poss);
 
         }
     
-        poss = ~(usedregs | regswithinfo());
+        poss = ~(usedregs | regswithinfo(cs));
         if (poss != 0)
         {
-            return movetor(a, choosereg(poss));
+            return movetor(cs, a, choosereg(cs, poss));
         }
 
         poss = ~usedregs;
         if (poss != 0)
         {
-            return movetor(a, choosereg(poss));
+            return movetor(cs, a, choosereg(cs, poss));
         }
         
         /* all regs in use - so free the oldest */
-        for (t=0; t<= arg1; t+=1)
+        for (t=0; t<= cs->arg1; t+=1)
         {
-            if (regusedby(t) >= 0)
+            if (regusedby(cs, t) >= 0)
             {
-                storet(t);
+                storet(cs, t);
                 break;
             }
         }
@@ -1448,7 +1450,7 @@ unsigned int movetoanyr(unsigned int a)
 }
 
 /* --------------------------------------------------------- */
-unsigned int movetor(unsigned int a, unsigned int r)
+unsigned int movetor(CodeGenState *cs, unsigned int a, unsigned int r)
 {
     unsigned int k;
     int          n;
@@ -1456,30 +1458,30 @@ unsigned int movetor(unsigned int a, unsigned int r)
     int          poss;
     int          p;
     
-    k = sstack[a].type;
-    n = sstack[a].val;
+    k = cs->sstack[a].type;
+    n = cs->sstack[a].val;
     
     if (k == k_reg && n == r)
     {
         return r;
     }
     
-    if (regusedby(a) != r)
+    if (regusedby(cs, a) != r)
     {
-        freereg(r);
-        k = sstack[a].type;
-        n = sstack[a].val;
+        freereg(cs, r);
+        k = cs->sstack[a].type;
+        n = cs->sstack[a].val;
     }
     
-    poss = regscontaining(k, n);
+    poss = regscontaining(cs, k, n);
     
     if (poss != 0)
     {
-        s = choosereg(poss);
+        s = choosereg(cs, poss);
         if (r != s)
         {
-            GenRRR(i_MOV, 0, r, s);
-            moveinfo(s, r);
+            GenRRR(cs, i_MOV, 0, r, s);
+            moveinfo(cs, s, r);
         }
         goto ret;
     }
@@ -1491,17 +1493,17 @@ unsigned int movetor(unsigned int a, unsigned int r)
             {
                 Error(3002, "k_loc offset too large %d\n", n * 4);
             }
-            GenLDR(r, r_p, n * 4);
+            GenLDR(cs, r, r_p, n * 4);
             break;
         case k_glob:
             if (n > 1023)
             {
                 Error(3003, "k_glob offset too large %d\n", n * 4);
             }
-            GenLDR(r, r_g, n * 4);
+            GenLDR(cs, r, r_g, n * 4);
             break;
         case k_numb:
-            GenLoadConstant(r, n);
+            GenLoadConstant(cs, r, n);
             break;
         case k_lab:
             /* *** to be written */
@@ -1511,36 +1513,36 @@ unsigned int movetor(unsigned int a, unsigned int r)
             {
                 Error(3004, "k_lvloc offset too large %d\n", n * 4);
             }
-            GenAddConstant(r_p, r, n * 4);
+            GenAddConstant(cs, r_p, r, n * 4);
             break;
         case k_lvglob:
             if (n > 1023)
             {
                 Error(3005, "k_lvglob offset too large %d\n", n * 4);
             }
-            GenAddConstant(r_g, r, n * 4);
+            GenAddConstant(cs, r_g, r, n * 4);
             break;
         case k_lvlab:
             /* only applies to strings - the label will be forwards (i.e. +ve offset from PC*/
-            p = (ProgLabelList[n] - ProgSize - 2) * 4;
-printf("k_lvlab: n=%d lab=%d p=%d Progsize=%d\n", n, ProgLabelList[n], p, ProgSize); 
+            p = (cs->ProgLabelList[n] - cs->ProgSize - 2) * 4;
+printf("k_lvlab: n=%d lab=%d p=%d Progsize=%d\n", n, cs->ProgLabelList[n], p, cs->ProgSize); 
             if (op2size(p) == 1)
             {
-                GenAddConstant(r_pc, r, p);
+                GenAddConstant(cs, r_pc, r, p);
             }
             else
             {
-                GenRRR(i_MOV, 0, r, r_pc);
-                GenAddConstant(r, r, p);
+                GenRRR(cs, i_MOV, 0, r, r_pc);
+                GenAddConstant(cs, r, r, p);
             }
             break;                  
     }
 
 ret:
-    forgetr(r);
-    remem(r, k, n);
-    sstack[a].type = k_reg;
-    sstack[a].val = r;
+    forgetr(cs, r);
+    remem(cs, r, k, n);
+    cs->sstack[a].type = k_reg;
+    cs->sstack[a].val = r;
     return r;
 }
 
@@ -1564,40 +1566,18 @@ unsigned int powerof2(int x)  /* return shift value 2,3,4,5... for 4,8,16,32...
 }
 
 /* --------------------------------------------------------- */
-void OpenOutputFile(char FileName[])
-{
-    OutputFilestream = fopen(FileName, "w+b");
-    if (OutputFilestream == NULL) 
-    {
-        return;
-    }
-}
-
-/* --------------------------------------------------------- */
-void CloseOutputFile()
-{
-  fclose(OutputFilestream);
-}
-
-/* --------------------------------------------------------- */
-void OutputWrch(char Ch)
-{
-    fputc(Ch, OutputFilestream);
-}
-
-/* --------------------------------------------------------- */
-unsigned int cgNextLabel()
+unsigned int cgNextLabel(CodeGenState *cs)
 {
-    NumberOfLabels += 1;
-    if (NumberOfLabels >= MaxLabels)
+    cs->NumberOfLabels += 1;
+    if (cs->NumberOfLabels >= MaxLabels)
     {
         Error(305, "Too many labels (%d)", MaxLabels);
     }
-    return NumberOfLabels;
+    return cs->NumberOfLabels;
 }
 
 /* --------------------------------------------------------- */
-void bswitch(unsigned int p, unsigned int q, unsigned int d,
+void bswitch(CodeGenState *cs, unsigned int p, unsigned int q, unsigned int d,
              int casek[], unsigned int casel[])
 {
     unsigned int m;
@@ -1607,52 +1587,52 @@ void bswitch(unsigned int p, unsigned int q, unsigned int d,
     
     if ((q - p) > 6)
     {
-        m = cgNextLabel();
+        m = cgNextLabel(cs);
         t = (p + q) / 2;
-        loadt(k_numb, casek[t]);
-        GenBranch(cgcmp(b_GE), m);
-        r = movetoanyr(arg1);  /* find which reg was used and forget it */
-        forgetr(r);
-        stack(ssp-1);
-        bswitch(p, t-1, d, casek, casel);
-        GenBranch(b_BR, d);
-        setlab(m);
-        forgetall();
-        incode = true;
-        GenBranch(b_EQ, casel[t]);
-        bswitch(t+1, q, d, casek, casel); 
+        loadt(cs, k_numb, casek[t]);
+        GenBranch(cs, cgcmp(cs, b_GE), m);
+        r = movetoanyr(cs, cs->arg1);  /* find which reg was used and forget it */
+        forgetr(cs, r);
+        stack(cs, cs->ssp-1);
+        bswitch(cs, p, t-1, d, casek, casel);
+        GenBranch(cs, b_BR, d);
+        setlab(cs, m);
+        forgetall(cs);
+        cs->incode = true;
+        GenBranch(cs, b_EQ, casel[t]);
+        bswitch(cs, t+1, q, d, casek, casel); 
     }
     else
     {
         for (i=p; i<=q; i+=1)
         {
-            loadt(k_numb, casek[i]);
-            GenBranch(cgcmp(b_EQ), casel[i]);
-            r = movetoanyr(arg1);  /* find which reg was used and forget it */
-            forgetr(r);
-            stack(ssp-1);
+            loadt(cs, k_numb, casek[i]);
+            GenBranch(cs, cgcmp(cs, b_EQ), casel[i]);
+            r = movetoanyr(cs, cs->arg1);  /* find which reg was used and forget it */
+            forgetr(cs, r);
+            stack(cs, cs->ssp-1);
         }
     }
 }
 
 /* --------------------------------------------------------- */
-void storein(unsigned int k, int n)
+void storein(CodeGenState *cs, unsigned int k, int n)
 {
     unsigned int r;
     
-    cgpendingop();
+    cgpendingop(cs);
     
-    r = movetoanyr(arg1);
+    r = movetoanyr(cs, cs->arg1);
     switch (k)
     {
         default: 
             Error(3006, "storein: unrecognised type (%d)\n", k);
             break;
         case k_loc: 
-            GenSTR(r, r_p, n * 4);
+            GenSTR(cs, r, r_p, n * 4);
             break;
         case k_glob:
-            GenSTR(r, r_g, n * 4);
+            GenSTR(cs, r, r_g, n * 4);
             break;
         //case k_lab: 
         //    s = choosereg(~reginuse());
@@ -1660,33 +1640,33 @@ void storein(unsigned int k, int n)
         //    genrnr(mf_sw,r,0,s);
         //    break;
     }
-    forgetvar(k, n);
-    remem(r, k, n);
-    stack(ssp-1);
+    forgetvar(cs, k, n);
+    remem(cs, r, k, n);
+    stack(cs, cs->ssp-1);
 }
 
 /* --------------------------------------------------------- */
-unsigned int rdop()
+unsigned int rdop(CodeGenState *cs)
 {
-    ProgCounter += 1;
-    if (ProgCounter > ProgramSize)
+    cs->ProgCounter += 1;
+    if (cs->ProgCounter > cs->ProgramSize)
     {
         return s_EOF;
     }
     else
     {
-        return Instructions[ProgCounter].Op;
+        return cs->Instructions[cs->ProgCounter].Op;
     }
 }
 
 /* --------------------------------------------------------- */
-int rdn()
+int rdn(CodeGenState *cs)
 {
-    return Instructions[ProgCounter].Arg;
+    return cs->Instructions[cs->ProgCounter].Arg;
 }
 
 /* --------------------------------------------------------- */
-void dboutput(unsigned int lev)
+void dboutput(CodeGenState *cs, unsigned int lev)
 {
     unsigned int r;
     unsigned int t;
@@ -1697,7 +1677,7 @@ void dboutput(unsigned int lev)
         printf("\nSLAVE: ");
         for (r=r_r0; r<= r_r9; r+=1)
         {
-            p = slave[r];
+            p = cs->slave[r];
             if (p == NULL) 
             {
                 continue;
@@ -1714,14 +1694,14 @@ void dboutput(unsigned int lev)
     if (lev > 1)
     {
         printf("\nSTACK: ");
-        for (t=0; t<=arg1; t+=1)
+        for (t=0; t<=cs->arg1; t+=1)
         {
-            wrkn(sstack[t].type, sstack[t].val);
+            wrkn(cs->sstack[t].type, cs->sstack[t].val);
         }
     }
  
     printf("\nIPC=%d OP=%d/%d SSP=%d ARG1=%d ARG2=%d PC=%x\n", 
-           ProgCounter, Op, pendingop, ssp, arg1, arg2, ProgSize * 4);
+           cs->ProgCounter, cs->Op, cs->pendingop, cs->ssp, cs->arg1, cs->arg2, cs->ProgSize * 4);
 }
  
 /* --------------------------------------------------------- */
@@ -1755,14 +1735,14 @@ void wrkn(unsigned int k, int n)
 }
 
 /* --------------------------------------------------------- */
-unsigned int CheckLab()
+unsigned int CheckLab(CodeGenState *cs)
 {
     unsigned int i;
     unsigned int lab = 0;
         
-    for (i=1; i<=NumberOfLabels; i+=1)
+    for (i=1; i<=cs->NumberOfLabels; i+=1)
     {
-        if (ProgCounter == Labels[i])
+        if (cs->ProgCounter == cs->Labels[i])
         {
             lab = i;
             break;
@@ -1773,7 +1753,7 @@ unsigned int CheckLab()
 
 /* --------------------------------------------------------- */
 
-void cg()
+void cg(CodeGenState *cs)
 {
     unsigned int i;
     unsigned int p;
@@ -1782,78 +1762,78 @@ void cg()
     unsigned int nextop;
     unsigned int r;
     
-    ProgCounter = 0;
-    ProgSize = 0;
-    ProgLabelRefs.nLabels = 0;
-    ProgConstRefs.nConsts = 0;
-    incode = true;
+    cs->ProgCounter = 0;
+    cs->ProgSize = 0;
+    cs->ProgLabelRefs.nLabels = 0;
+    cs->ProgConstRefs.nConsts = 0;
+    cs->incode = true;
 
-    GenBranch(b_BR, 0);     /* add JMP main at start */
+    GenBranch(cs, b_BR, 0);     /* add JMP main at start */
     
-    initslave();
-    initstack(3);
-    cgdebug = 0;  /* was 10 - 0 to switch off */
-    Op = rdop();
+    initslave(cs);
+    initstack(cs, 3);
+    cs->cgdebug = 0;  /* was 10 - 0 to switch off */
+    cs->Op = rdop(cs);
     
     while (1)
     {
-        if (cgdebug > 6)
+        if (cs->cgdebug > 6)
         {
-            dboutput(3);
+            dboutput(cs, 3);
         }
         
-        switch (Op)
+        switch (cs->Op)
         {
             case s_EOF:
                 return;
                 
             case s_LP:
-                loadt(k_loc, rdn() + 2);
+                loadt(cs, k_loc, rdn(cs) + 2);
                 break;
             
             case s_LG:
-                loadt(k_glob, rdn());
+                loadt(cs, k_glob, rdn(cs));
                 break;
 
             case s_LL:
-                loadt(k_lab, rdn());
+                loadt(cs, k_lab, rdn(cs));
                 break;
 
             case s_LN:
-                loadt(k_numb, rdn());
+                loadt(cs, k_numb, rdn(cs));
                 break;
 
             case s_LLP:
-                loadt(k_lvloc, rdn() + 2);
+                loadt(cs, k_lvloc, rdn(cs) + 2);
                 break;
 
             case s_LSTR:
             case s_LLG:
-                loadt(k_lvglob, rdn());
+                loadt(cs, k_lvglob, rdn(cs));
                 break;
 
             case s_LLL:
-                loadt(k_lvlab, rdn());
+                loadt(cs, k_lvlab, rdn(cs));
                 break;
 
             case s_SP:
-                storein(k_loc, rdn() + 2);
+                storein(cs, k_loc, rdn(cs) + 2);
                 break;
 
             case s_SG:
-                storein(k_glob, rdn());
+                storein(cs, k_glob, rdn(cs));
                 break;
             
             case s_SL:
-                storein(k_lab, rdn());
+                storein(cs, k_lab, rdn(cs));
                 break;
 
             case s_STIND:
-                cgstind();
+                cgstind(cs);
                 break;
 
             case s_RV:
-                cgrv();
+                cgrv(cs);
                 break;
 
             case s_MULT: case s_DIV: case s_REM:
@@ -1866,73 +1846,73 @@ void cg()
             case s_OR: case s_AND:
             case s_NOT: case s_NEG: case s_ABS: case s_COMP:
             case s_FLOAT: case s_INT:
-                cgpendingop();
-                pendingop = Op;
+                cgpendingop(cs);
+                cs->pendingop = cs->Op;
                 break;
                 
             case s_JT:
             case s_JF:
-                l = rdn();
-                nextop = rdop();
+                l = rdn(cs);
+                nextop = rdop(cs);
                 if (nextop == s_JUMP)
                 {
-                    cgcondjump(Op == s_JF, rdn());
+                    cgcondjump(cs, cs->Op == s_JF, rdn(cs));
                     goto jump;
                 }
-                cgcondjump(Op == s_JT, l);
-                Op = nextop;
+                cgcondjump(cs, cs->Op == s_JT, l);
+                cs->Op = nextop;
                 continue;
                 
             case s_RES:
-                cgpendingop();
-                store(0, ssp-2);
-                movetor(arg1, r_r0);
-                stack(ssp-1);
+                cgpendingop(cs);
+                store(cs, 0, cs->ssp-2);
+                movetor(cs, cs->arg1, r_r0);
+                stack(cs, cs->ssp-1);
                 
             case s_JUMP:
-                cgpendingop();
-                store(0, ssp-1);
-                l = rdn();
+                cgpendingop(cs);
+                store(cs, 0, cs->ssp-1);
+                l = rdn(cs);
             
             jump:
                 while (1)
                 {
-                    Op = rdop();
-                    if (Op != s_STACK)
+                    cs->Op = rdop(cs);
+                    if (cs->Op != s_STACK)
                     {
                         break;
                     }
-                    stack(rdn());
+                    stack(cs, rdn(cs));
                 }
                 
-                if (Op != s_LAB)
+                if (cs->Op != s_LAB)
                 {
-                    GenBranch(b_BR, l);
-                    incode = false;
+                    GenBranch(cs, b_BR, l);
+                    cs->incode = false;
                     continue;
                 }
-                m = rdn();
+                m = rdn(cs);
                 if (l != m)
                 {
-                    GenBranch(b_BR, l);
-                    incode = false;
+                    GenBranch(cs, b_BR, l);
+                    cs->incode = false;
                 }
                 goto lab;
                 
             case s_LAB:
-                cgpendingop();
-                store(0, ssp - 1);
-                m = rdn();
+                cgpendingop(cs);
+                store(cs, 0, cs->ssp - 1);
+                m = rdn(cs);
             lab:
-                setlab(m);
-                lastlab = m;
-                incode = true;
-                forgetall();
+                setlab(cs, m);
+                cs->lastlab = m;
+                cs->incode = true;
+                forgetall(cs);
                 break;
                     
             case s_RSTACK:
-                initstack(rdn());
-                loadt(k_reg, r_r0);
+                initstack(cs, rdn(cs));
+                loadt(cs, k_reg, r_r0);
                 break;
             
             case s_SWITCHON:
@@ -1945,16 +1925,16 @@ void cg()
                 int          casek[MaxSwitches];
                 unsigned int casel[MaxSwitches];
                 
-                n = rdn();
-                rdop();
-                d = rdn();
+                n = rdn(cs);
+                rdop(cs);
+                d = rdn(cs);
                 
                 for (i=1; i<=n; i+=1)
                 {
-                    rdop();
-                    a = rdn();
-                    rdop();
-                    l = rdn();
+                    rdop(cs);
+                    a = rdn(cs);
+                    rdop(cs);
+                    l = rdn(cs);
                     j = i - 1;
                     while (j != 0)
                     {
@@ -1970,131 +1950,131 @@ void cg()
                     casel[j+1] = l;
                 }
                 
-                cgpendingop();
-                store(0, ssp-2);
-                movetor(arg1, r_r0);
-                bswitch(1, n, d, casek, casel);
-                GenBranch(b_BR, d);
-                stack(ssp - 1);
+                cgpendingop(cs);
+                store(cs, 0, cs->ssp-2);
+                movetor(cs, cs->arg1, r_r0);
+                bswitch(cs, 1, n, d, casek, casel);
+                GenBranch(cs, b_BR, d);
+                stack(cs, cs->ssp - 1);
                 break;
             }
 
             case s_RTRN:
-                cgreturn(rdn());
-                incode = false;
+                cgreturn(cs, rdn(cs));
+                cs->incode = false;
                 break;
 
             case s_ENTRY:
-                p = rdn();
-                forgetall();
-                incode = true;
-                cgname(Procedures[p].Name);
-                setlab(lastlab);  /* reset entry label *after* the entry name */
-                Procedures[p].Offset = ProgSize * 4;  /* needed for ELF generator */
+                p = rdn(cs);
+                forgetall(cs);
+                cs->incode = true;
+                cgname(cs, cs->Procedures[p].Name);
+                setlab(cs, cs->lastlab);  /* reset entry label *after* the entry name */
+                cs->Procedures[p].Offset = cs->ProgSize * 4;  /* needed for ELF generator */
                 break;
                 
             case s_SAVE:
-                cgsave(rdn());
+                cgsave(cs, rdn(cs));
                 break;
                 
             case s_FNAP:
             case s_RTAP:
-                cgapply(Op, rdn(), false);
+                cgapply(cs, cs->Op, rdn(cs), false);
                 break;
 
             case s_SYSCALL:
-                p = sstack[arg1].val;  /* remove syscall no. from stack */
-                stack(ssp-1);
+                p = cs->sstack[cs->arg1].val;  /* remove syscall no. from stack */
+                stack(cs, cs->ssp-1);
                 if (p < 100)
                 {
-                    sstack[arg1].val = p + 10;        /* 11-29 */
-                    cgapply(s_RTAP, rdn(), true);
+                    cs->sstack[cs->arg1].val = p + 10;        /* 11-29 */
+                    cgapply(cs, s_RTAP, rdn(cs), true);
                 }
                 else
                 {
-                    sstack[arg1].val = p - 100 + 30;  /* 31-49 */
-                    cgapply(s_FNAP, rdn(), true);
+                    cs->sstack[cs->arg1].val = p - 100 + 30;  /* 31-49 */
+                    cgapply(cs, s_FNAP, rdn(cs), true);
                 }
                 break;
                
             case s_PUSHTOS:
-                cgpendingop();   /* only used for += etc operators */
-                r = movetoanyr(arg1);
-                GenRRR(i_MOV, 0, r_lr, r);  /* use link reg to remember addr */
-                sstack[arg1].val = r_lr;
-                loadt(k_reg, r);
+                cgpendingop(cs);   /* only used for += etc operators */
+                r = movetoanyr(cs, cs->arg1);
+                GenRRR(cs, i_MOV, 0, r_lr, r);  /* use link reg to remember addr */
+                cs->sstack[cs->arg1].val = r_lr;
+                loadt(cs, k_reg, r);
                 break;
 
             case s_VCOPY:
-                loadt(k_numb, rdn());
-                movetor(arg1, r_r2);
-                stack(ssp-1);
-                movetor(arg1, r_r1);
-                stack(ssp-1);
-                movetor(arg1, r_r0);
-                stack(ssp-1);
+                loadt(cs, k_numb, rdn(cs));
+                movetor(cs, cs->arg1, r_r2);
+                stack(cs, cs->ssp-1);
+                movetor(cs, cs->arg1, r_r1);
+                stack(cs, cs->ssp-1);
+                movetor(cs, cs->arg1, r_r0);
+                stack(cs, cs->ssp-1);
                 for (r=r_r3; r<=r_r9; r+=1)
                 {
-                    freereg(r);
+                    freereg(cs, r);
                 }
-                GenSysCall(4, r_r3);
-                forgetall();
+                GenSysCall(cs, 4, r_r3);
+                forgetall(cs);
                 break;
 
             case s_SWAP:
-                cgpendingop();
-                swapargs();
+                cgpendingop(cs);
+                swapargs(cs);
                 break;
 
             case s_STACK:
-                cgpendingop();
-                stack(rdn());
+                cgpendingop(cs);
+                stack(cs, rdn(cs));
                 break;
 
             case s_QUERY:
-                cgpendingop();
-                stack(ssp + 1);
+                cgpendingop(cs);
+                stack(cs, cs->ssp + 1);
                 break;
 
             case s_STORE:
-                cgpendingop();
-                store(0, ssp-1);
+                cgpendingop(cs);
+                store(cs, 0, cs->ssp-1);
                 break;
             
             case s_DISCARD:  /* ignored by compiler */
                 break;
 
             default:
-                Error(3007, "Unknown icode (%d)\n", Op);
+                Error(3007, "Unknown icode (%d)\n", cs->Op);
                 break;
         }
-        Op = rdop();
+        cs->Op = rdop(cs);
     }
 }
 
 /* --------------------------------------------------------- */
-void cgcondjump(bool b, unsigned int l)
+void cgcondjump(CodeGenState *cs, bool b, unsigned int l)
 {
-    int bfn = condbfn(pendingop);
+    int bfn = condbfn(cs->pendingop);
     
     if (bfn < 0)
     {
-        cgpendingop();
-        loadt(k_numb, 0);
+        cgpendingop(cs);
+        loadt(cs, k_numb, 0);
         bfn = b_NE;
     }
-    pendingop = s_NONE;
-    store(0, ssp-3);
+    cs->pendingop = s_NONE;
+    store(cs, 0, cs->ssp-3);
     if (!b)
     {
         bfn = compbfn(bfn);
     }
-    bfn = cgcmp(bfn);
+    bfn = cgcmp(cs, bfn);
     if (bfn != b_NO)
     {
-        GenBranch(bfn, l);
+        GenBranch(cs, bfn, l);
     }
-    stack(ssp-2);    
+    stack(cs, cs->ssp-2);    
 }
 
 /* --------------------------------------------------------- */
@@ -2148,13 +2128,13 @@ unsigned int compbfn(unsigned int f)
 }
 
 /* --------------------------------------------------------- */
-void cgpendingop()
+void cgpendingop(CodeGenState *cs)
 {
     unsigned int f = 0;
     unsigned int r = 0;
-    unsigned int pndop = pendingop;
+    unsigned int pndop = cs->pendingop;
     
-    pendingop = s_NONE;
+    cs->pendingop = s_NONE;
     
     switch (pndop)
     {
@@ -2170,32 +2150,32 @@ void cgpendingop()
         case s_GR:
         case s_LE:
         case s_GE:
-            f = cgcmp(condbfn(pndop));  /* was f = cgcmp(compbfn(condbfn(pndop))); */
-            r = nextfree();
-            GenRRncond(i_MOV, f, 0, r, 0, 1);
-            GenRRncond(i_MOV, compbfn(f), 0, r, 0, 0);
-            forgetr(r);
-            lose1(k_reg, r);
+            f = cgcmp(cs, condbfn(pndop));  /* was f = cgcmp(compbfn(condbfn(pndop))); */
+            r = nextfree(cs);
+            GenRRncond(cs, i_MOV, f, 0, r, 0, 1);
+            GenRRncond(cs, i_MOV, compbfn(f), 0, r, 0, 0);
+            forgetr(cs, r);
+            lose1(cs, k_reg, r);
             return;
 
         case s_OR:
-            cgdyadic(i_ORR, true);
+            cgdyadic(cs, i_ORR, true);
             break;
 
         case s_AND:
-            cgdyadic(i_AND, true);
+            cgdyadic(cs, i_AND, true);
             break;
 
         case s_PLUS:
-            cgdyadic(i_ADD, true);
+            cgdyadic(cs, i_ADD, true);
             break;
 
         case s_MINUS:
-            cgdyadic(i_SUB, false);
+            cgdyadic(cs, i_SUB, false);
             break;
 
         case s_MULT:
-            cgdyadic(i_MULT, true);
+            cgdyadic(cs, i_MULT, true);
             break;
 
         case s_DIV:
@@ -2207,78 +2187,78 @@ void cgpendingop()
             if (pndop == s_DIVF)  f = 3;  /* DIVF    = syscall 3 */
             if (pndop == s_DIV || pndop == s_REM)
             {
-                movetor(arg2, r_r1);
-                movetor(arg1, r_r0);
+                movetor(cs, cs->arg2, r_r1);
+                movetor(cs, cs->arg1, r_r0);
             }
             else
             {
-                movetor(arg2, r_r0);
-                movetor(arg1, r_r1);
+                movetor(cs, cs->arg2, r_r0);
+                movetor(cs, cs->arg1, r_r1);
             }
             for (r=r_r2; r<=r_r9; r+=1)
             {
-                freereg(r);
+                freereg(cs, r);
             }
-            GenSysCall(f, r_r2);
-            forgetall();
+            GenSysCall(cs, f, r_r2);
+            forgetall(cs);
             if (pndop == s_REM)
             {
-                lose1(k_reg, r_r1);
+                lose1(cs, k_reg, r_r1);
             }
             else
             {
-                lose1(k_reg, r_r0);
+                lose1(cs, k_reg, r_r0);
             }
             break;
 
         case s_NEG:
-            cgmonadic(i_NEG);
+            cgmonadic(cs, i_NEG);
             return;
 
         case s_ABS:
-            cgmonadic(i_ABS);
+            cgmonadic(cs, i_ABS);
             return;
 
         case s_NOT:
-            cgmonadic(i_NOT);
+            cgmonadic(cs, i_NOT);
             return;
 
         case s_COMP:
-            cgmonadic(i_COMP);
+            cgmonadic(cs, i_COMP);
             return;
             
         case s_FLOAT:
-            cgmonadic(i_FLOAT);
+            cgmonadic(cs, i_FLOAT);
             return;
 
         case s_INT:
-            cgmonadic(i_INT);
+            cgmonadic(cs, i_INT);
             return;
 
         case s_LOGAND:
-            cgdyadic(i_AND, true);
+            cgdyadic(cs, i_AND, true);
             break;
 
         case s_LOGOR:
-            cgdyadic(i_ORR, true);
+            cgdyadic(cs, i_ORR, true);
             break;
 
         case s_NEQV:
-            cgdyadic(i_EOR, true);
+            cgdyadic(cs, i_EOR, true);
             break;
 
         case s_LSHIFT:
-            cgdyadic(i_LSHIFT, false);
+            cgdyadic(cs, i_LSHIFT, false);
             break;
 
         case s_RSHIFT:
-            cgdyadic(i_RSHIFT, false);
+            cgdyadic(cs, i_RSHIFT, false);
             break;
     }
 }
 
 /* --------------------------------------------------------- */
-bool cgdyadic(unsigned int Op, bool swapable)
+bool cgdyadic(CodeGenState *cs, unsigned int Op, bool swapable)
 {
     unsigned int r;
     unsigned int s = 0;
@@ -2289,23 +2269,23 @@ bool cgdyadic(unsigned int Op, bool swapable)
     unsigned int sh;
     bool         swapped = false;
 
-    if (swapable && (sstack[arg2].type == k_numb))
+    if (swapable && (cs->sstack[cs->arg2].type == k_numb))
     {
-        swapargs();
+        swapargs(cs);
         swapped = true;
     }
 
-    if (Op == i_SUB && (sstack[arg2].type == k_numb))
+    if (Op == i_SUB && (cs->sstack[cs->arg2].type == k_numb))
     {
-        swapargs();
+        swapargs(cs);
         swapped = true;
         Op = i_RSB;
     }
         
-    k1 = sstack[arg1].type;
-    k2 = sstack[arg2].type;
-    n1 = sstack[arg1].val;
-    n2 = sstack[arg2].val;
+    k1 = cs->sstack[cs->arg1].type;
+    k2 = cs->sstack[cs->arg2].type;
+    n1 = cs->sstack[cs->arg1].val;
+    n2 = cs->sstack[cs->arg2].val;
     
     if (k1 == k_numb && k2 == k_numb)
     {
@@ -2356,17 +2336,17 @@ bool cgdyadic(unsigned int Op, bool swapable)
                 printf("CG error: unknown dyadic Op%d\n", Op);
                 break;
         }
-        lose1(k_numb, n);
+        lose1(cs, k_numb, n);
         return swapped;
     }
 
     if (k1 == k_numb)
     {
-        r = movetoanyr(arg2);
+        r = movetoanyr(cs, cs->arg2);
         if (Op != i_CMP)
         {
-            s = nextfree();
-            forgetr(s);
+            s = nextfree(cs);
+            forgetr(cs, s);
         }
         
         if (Op == i_LSHIFT || Op == i_RSHIFT)
@@ -2374,14 +2354,14 @@ bool cgdyadic(unsigned int Op, bool swapable)
             if (n1 != 0)
             {
                 sh = (Op == i_LSHIFT) ? 0 : 4; 
-                GenRRR(i_MOV, 0, s, (n1 << 7) | (sh << 4) | r); 
-                lose1(k_reg, s);
+                GenRRR(cs, i_MOV, 0, s, (n1 << 7) | (sh << 4) | r); 
+                lose1(cs, k_reg, s);
             }
             else
             {
-                stack(ssp-1);
+                stack(cs, cs->ssp-1);
             }
-            pendingop = s_NONE;
+            cs->pendingop = s_NONE;
             return swapped;
         }
         
@@ -2391,50 +2371,50 @@ bool cgdyadic(unsigned int Op, bool swapable)
             switch (n1)
             {
                 case 0:
-                    GenRRn(i_MOV, 0, r, 0, 0);
-                    forgetr(r);
-                    remem(r, k_numb, 0);
+                    GenRRn(cs, i_MOV, 0, r, 0, 0);
+                    forgetr(cs, r);
+                    remem(cs, r, k_numb, 0);
                     break;
                 case 1:
                     break;
                 case 2:
-                    GenRRR(i_ADD, r, r, r);
-                    forgetr(r);
+                    GenRRR(cs, i_ADD, r, r, r);
+                    forgetr(cs, r);
                     break;
                 case -1:
-                    GenRRn(i_RSB, r, r, 0, 1);
-                    forgetr(r);
+                    GenRRn(cs, i_RSB, r, r, 0, 1);
+                    forgetr(cs, r);
                     break;
                 case -2:
-                    GenRRR(i_ADD, r, r, r);
-                    GenRRn(i_RSB, r, r, 0, 1);
-                    forgetr(r);
+                    GenRRR(cs, i_ADD, r, r, r);
+                    GenRRn(cs, i_RSB, r, r, 0, 1);
+                    forgetr(cs, r);
                     break;
                 default:
                     sh = powerof2(n1);
                     if (sh > 0)
                     {
-                        GenRRR(i_MOV, 0, r, (sh << 7) | r); 
+                        GenRRR(cs, i_MOV, 0, r, (sh << 7) | r); 
                         if (n1 < 0)
                         {
-                            GenRRn(i_RSB, r, r, 0, 1);
+                            GenRRn(cs, i_RSB, r, r, 0, 1);
                         }
-                        forgetr(r);
+                        forgetr(cs, r);
                     }
             }
             if (sh > 0)
             {
-                lose1(k_reg, r);
-                pendingop = s_NONE;
+                lose1(cs, k_reg, r);
+                cs->pendingop = s_NONE;
                 return swapped;
             }
         
-            s = movetoanyr(arg1);
-            t = nextfree();
-            forgetr(t);
-            GenMult(t, r, s);
-            lose1(k_reg, t);
-            pendingop = s_NONE;
+            s = movetoanyr(cs, cs->arg1);
+            t = nextfree(cs);
+            forgetr(cs, t);
+            GenMult(cs, t, r, s);
+            lose1(cs, k_reg, t);
+            cs->pendingop = s_NONE;
             return swapped;
         }
         
@@ -2442,7 +2422,7 @@ bool cgdyadic(unsigned int Op, bool swapable)
         {
             Op = i_CMN;
             n1 = -n1;
-            sstack[arg1].val = n1;
+            cs->sstack[cs->arg1].val = n1;
         }
         
         if (op2size(n1) == 1)
@@ -2455,27 +2435,27 @@ bool cgdyadic(unsigned int Op, bool swapable)
             }
             if (Op == i_CMP || Op == i_CMN)
             {
-                GenRRn(Op, r, 0, (16 - sh) % 16, n1 | (1 << 20));
+                GenRRn(cs, Op, r, 0, (16 - sh) % 16, n1 | (1 << 20));
             }
             else
             {
-                GenRRn(Op, r, s, (16 - sh) % 16, n1);
-                lose1(k_reg, s);
+                GenRRn(cs, Op, r, s, (16 - sh) % 16, n1);
+                lose1(cs, k_reg, s);
             }
             return swapped;
         }
         else
         {
 
-            t = movetoanyr(arg1);
+            t = movetoanyr(cs, cs->arg1);
             if (Op == i_CMP || Op == i_CMN)
             {
-                GenRRR(Op, r, 0, t | (1 << 20));
+                GenRRR(cs, Op, r, 0, t | (1 << 20));
             }
             else
             {
-                GenRRR(Op, r, s, t);
-                lose1(k_reg, s);
+                GenRRR(cs, Op, r, s, t);
+                lose1(cs, k_reg, s);
             }
             return swapped;
         }
@@ -2483,47 +2463,47 @@ bool cgdyadic(unsigned int Op, bool swapable)
     
     /* at this point, neither argument is a constant so use regs */
 
-    r = movetoanyr(arg2);
-    s = movetoanyr(arg1);
+    r = movetoanyr(cs, cs->arg2);
+    s = movetoanyr(cs, cs->arg1);
     if (Op != i_CMP)  /* t not used in comparison */
     {
-        t = nextfree();
-        forgetr(t);
+        t = nextfree(cs);
+        forgetr(cs, t);
     }
     
     if (Op == i_CMP)
     {
-        GenRRR(Op, r, 0, s | (1 << 20));
+        GenRRR(cs, Op, r, 0, s | (1 << 20));
     }
     else if ((Op == i_LSHIFT) || (Op == i_RSHIFT))
     {
         sh = (Op == i_LSHIFT) ? 1 : 5;
-        GenRRR(i_MOV, 0, t, (s << 8) | (sh << 4) | r); 
+        GenRRR(cs, i_MOV, 0, t, (s << 8) | (sh << 4) | r); 
     }
     else if (Op == i_MULT)
     {
-        GenMult(t, r, s);
+        GenMult(cs, t, r, s);
     }
     else
     {
-        GenRRR(Op, r, t, s);
+        GenRRR(cs, Op, r, t, s);
     }
     if (Op != i_CMP)
     {
-        lose1(k_reg, t);
+        lose1(cs, k_reg, t);
     }
     return swapped;
 }
 
 /* --------------------------------------------------------- */
-void cgmonadic(unsigned int Op)
+void cgmonadic(CodeGenState *cs, unsigned int Op)
 {
     unsigned int r;
     unsigned int k;
     int n;
     
-    k = sstack[arg1].type;
-    n = sstack[arg1].val;
+    k = cs->sstack[cs->arg1].type;
+    n = cs->sstack[cs->arg1].val;
     if (k == k_numb)
     {
         switch(Op)
@@ -2557,36 +2537,36 @@ void cgmonadic(unsigned int Op)
                 Error(3009, "Unknown monadic constant Op (%d)\n", Op);
                 break;
         }
-        sstack[arg1].val = n;
+        cs->sstack[cs->arg1].val = n;
         return;
     }
     
-    r = movetoanyr(arg1);
+    r = movetoanyr(cs, cs->arg1);
     switch(Op)
     {
         case i_NEG:
-            GenRRn(i_RSB, r, r, 0, 0);  
+            GenRRn(cs, i_RSB, r, r, 0, 0);  
             break;
         case i_COMP:
-            GenRRR(i_MVN, 0, r, r);
+            GenRRR(cs, i_MVN, 0, r, r);
             break;
         case i_NOT:
-            GenRRn(i_CMP, r | 16, 0, 0, 0);  /* also set bit 20 */
-            GenRRncond(i_MOV, b_NE, 0, r, 0, 0);
-            GenRRncond(i_MOV, b_EQ, 0, r, 0, 1);  
+            GenRRn(cs, i_CMP, r | 16, 0, 0, 0);  /* also set bit 20 */
+            GenRRncond(cs, i_MOV, b_NE, 0, r, 0, 0);
+            GenRRncond(cs, i_MOV, b_EQ, 0, r, 0, 1);  
             break;
         case i_ABS:
-            GenRRn(i_CMP, r | 16, 0, 0, 0);  /* also set bit 20 */
-            GenRRncond(i_RSB, b_LS, r, r, 0, 0);
+            GenRRn(cs, i_CMP, r | 16, 0, 0, 0);  /* also set bit 20 */
+            GenRRncond(cs, i_RSB, b_LS, r, r, 0, 0);
             break;
         case i_FLOAT:
-            GenRRR(i_MOV, 0, r, (16 << 7) | r);
+            GenRRR(cs, i_MOV, 0, r, (16 << 7) | r);
             break;
         case i_INT:
-            GenRRR(i_MOV, 0, r, (16 << 7) | (4 << 4) | r);
+            GenRRR(cs, i_MOV, 0, r, (16 << 7) | (4 << 4) | r);
             break;
         case i_RV:
-            GenLDR(r, r, 0);
+            GenLDR(cs, r, r, 0);
             break;
         default: 
             Error(3010, "Unknown monadic op (%d)\n", Op);
@@ -2594,24 +2574,24 @@ void cgmonadic(unsigned int Op)
     }
     if (!(Op == i_FLOAT || Op == i_INT))
     {
-        forgetr(r);
-        sstack[arg1].type = k_reg;
-        sstack[arg1].val = r;
+        forgetr(cs, r);
+        cs->sstack[cs->arg1].type = k_reg;
+        cs->sstack[cs->arg1].val = r;
     }
 }
 
 /* --------------------------------------------------------- */
-unsigned int cgcmp(unsigned int f)
+unsigned int cgcmp(CodeGenState *cs, unsigned int f)
 {
     unsigned int k1, k2;
     int          n1, n2;
     bool         swapped;
     bool         jumping;
     
-    k1 = sstack[arg1].type;
-    k2 = sstack[arg2].type;
-    n1 = sstack[arg1].val;
-    n2 = sstack[arg2].val;
+    k1 = cs->sstack[cs->arg1].type;
+    k2 = cs->sstack[cs->arg2].type;
+    n1 = cs->sstack[cs->arg1].val;
+    n2 = cs->sstack[cs->arg2].val;
     jumping = false;
     
     if (k1 == k_numb && k2 == k_numb)
@@ -2650,7 +2630,7 @@ unsigned int cgcmp(unsigned int f)
         }
     }
     
-    swapped = cgdyadic(i_CMP, true);
+    swapped = cgdyadic(cs, i_CMP, true);
     if (!swapped) 
     {
         return f;
@@ -2674,95 +2654,95 @@ unsigned int cgcmp(unsigned int f)
 }
 
 /* --------------------------------------------------------- */
-void cgrv()
+void cgrv(CodeGenState *cs)
 {
 
     unsigned int r;
     unsigned int s;
-    unsigned int k = sstack[arg1].type;
-    int n          = sstack[arg1].val;
+    unsigned int k = cs->sstack[cs->arg1].type;
+    int n          = cs->sstack[cs->arg1].val;
     
-    if (pendingop == s_MINUS && k == k_numb)
+    if (cs->pendingop == s_MINUS && k == k_numb)
     {
-        pendingop = s_PLUS;
+        cs->pendingop = s_PLUS;
         n = -n;
     }
-    if (pendingop == s_PLUS && k == k_numb)
+    if (cs->pendingop == s_PLUS && k == k_numb)
     {
-        r = movetoanyr(arg2);
-        GenLDR(r, r, n);
-        lose1(k_reg, r);
+        r = movetoanyr(cs, cs->arg2);
+        GenLDR(cs, r, r, n);
+        lose1(cs, k_reg, r);
 
-        pendingop = s_NONE;
+        cs->pendingop = s_NONE;
     }
-    else if (pendingop == s_PLUS)
+    else if (cs->pendingop == s_PLUS)
     {
-        s = movetoanyr(arg1);
-        r = movetoanyr(arg2);
-        GenLDRR(r, s);
-        lose1(k_reg, r);
-        pendingop = s_NONE;
+        s = movetoanyr(cs, cs->arg1);
+        r = movetoanyr(cs, cs->arg2);
+        GenLDRR(cs, r, s);
+        lose1(cs, k_reg, r);
+        cs->pendingop = s_NONE;
     }
     else
     {
-        cgpendingop();
-        r = movetoanyr(arg1);
-        GenLDR(r, r, 0);
+        cgpendingop(cs);
+        r = movetoanyr(cs, cs->arg1);
+        GenLDR(cs, r, r, 0);
     }
-    forgetr(r);
+    forgetr(cs, r);
 }
 
 /* --------------------------------------------------------- */
-void cgstind()
+void cgstind(CodeGenState *cs)
 {
     unsigned int r1;
     unsigned int r2;
     unsigned int r3;
     unsigned int k;
     int          n;
-    unsigned int arg3 = arg2-1;
+    unsigned int arg3 = cs->arg2-1;
 
     
-    k = sstack[arg1].type;
-    n = sstack[arg1].val;
+    k = cs->sstack[cs->arg1].type;
+    n = cs->sstack[cs->arg1].val;
 
-    if (pendingop == s_MINUS && k == k_numb)
+    if (cs->pendingop == s_MINUS && k == k_numb)
     {
-        pendingop = s_PLUS;
+        cs->pendingop = s_PLUS;
         n = -n;
     }
-    if (pendingop == s_PLUS && k == k_numb)
+    if (cs->pendingop == s_PLUS && k == k_numb)
     {
-        r2 = movetoanyr(arg2);
-        r1 = movetoanyr(arg3);
-        stack(ssp-3);
-        GenSTR(r1, r2, n);
-        pendingop = s_NONE;
-        forgetvars();
+        r2 = movetoanyr(cs, cs->arg2);
+        r1 = movetoanyr(cs, arg3);
+        stack(cs, cs->ssp-3);
+        GenSTR(cs, r1, r2, n);
+        cs->pendingop = s_NONE;
+        forgetvars(cs);
     }
-    else if (pendingop == s_PLUS)
+    else if (cs->pendingop == s_PLUS)
     {
-        r1 = movetoanyr(arg1);
-        r2 = movetoanyr(arg2);
-        r3 = movetoanyr(arg3);
-        stack(ssp-3);
-        GenSTRR(r2, r3, r1);
-        pendingop = s_NONE;
-        forgetvars();
+        r1 = movetoanyr(cs, cs->arg1);
+        r2 = movetoanyr(cs, cs->arg2);
+        r3 = movetoanyr(cs, arg3);
+        stack(cs, cs->ssp-3);
+        GenSTRR(cs, r2, r3, r1);
+        cs->pendingop = s_NONE;
+        forgetvars(cs);
     }
     else
     {
-        cgpendingop();
-        r1 = movetoanyr(arg1);
-        r2 = movetoanyr(arg2);
-        stack(ssp-2);
-        GenSTR(r2, r1, 0);
-        forgetvars();
+        cgpendingop(cs);
+        r1 = movetoanyr(cs, cs->arg1);
+        r2 = movetoanyr(cs, cs->arg2);
+        stack(cs, cs->ssp-2);
+        GenSTR(cs, r2, r1, 0);
+        forgetvars(cs);
     }
 }
 
 /* --------------------------------------------------------- */
-void cgsave(unsigned int n)
+void cgsave(CodeGenState *cs, unsigned int n)
 {
     unsigned int r;
     unsigned int s;
@@ -2773,18 +2753,18 @@ void cgsave(unsigned int n)
         {
             break;
         }
-        remem(r, k_loc, s);
+        remem(cs, r, k_loc, s);
     }
 
-    initstack(n);
+    initstack(cs, n);
     
-    OutWord(0xE8A4C800);              /* STM r_r4,{r_p,r_lr,r_pc}        inc r4    */
-    OutWord(0XE884000F);              /* STM r_r4,{r_r0,r_r1,r_r2,r_r3}  no inc r4 */
-    GenRRn(i_SUB, r_r4, r_p, 0, 12);  /* SUB r_p,r_r4,#12                          */
+    OutWord(cs, 0xE8A4C800);              /* STM r_r4,{r_p,r_lr,r_pc}        inc r4    */
+    OutWord(cs, 0XE884000F);              /* STM r_r4,{r_r0,r_r1,r_r2,r_r3}  no inc r4 */
+    GenRRn(cs, i_SUB, r_r4, r_p, 0, 12);  /* SUB r_p,r_r4,#12                          */
 }
 
 /* --------------------------------------------------------- */
-void cgapply(unsigned int Op, unsigned int k, bool syscall)
+void cgapply(CodeGenState *cs, unsigned int Op, unsigned int k, bool syscall)
 {
     unsigned int sa1 = k+3;
     unsigned int sa4 = k+6;
@@ -2793,41 +2773,41 @@ void cgapply(unsigned int Op, unsigned int k, bool syscall)
     unsigned int t;
     unsigned int l;
     
-    cgpendingop();
+    cgpendingop(cs);
     
     /* store args 5,6.... */
-    store(sa4+1, ssp-2);
+    store(cs, sa4+1, cs->ssp-2);
     
     /* now deal with non-args */
-    for (t=0; t<=arg2; t+=1)
+    for (t=0; t<=cs->arg2; t+=1)
     {
-        if (sstack[t].pos >= k)
+        if (cs->sstack[t].pos >= k)
         {
             break;
         }
-        if (sstack[t].type == k_reg)
+        if (cs->sstack[t].type == k_reg)
         {
-            storet(t);
+            storet(cs, t);
         }
     }
     
     /* move args 1-4 to arg regs */
-    for (t=arg2; t>=0; t-=1)
+    for (t=cs->arg2; t>=0; t-=1)
     {
-        s = sstack[t].pos;
+        s = cs->sstack[t].pos;
         r = s-k-3;
         if (s < sa1)
         {
             break;
         }
-        if ((s <= sa4) && isfree(r))
+        if ((s <= sa4) && isfree(cs, r))
         {
-            movetor(t, r);
+            movetor(cs, t, r);
         }
     }
-    for (t=arg2; t>=0; t-=1)
+    for (t=cs->arg2; t>=0; t-=1)
     {
-        s = sstack[t].pos;
+        s = cs->sstack[t].pos;
         r = s-k-3;
         if (s < sa1)
         {
@@ -2835,7 +2815,7 @@ void cgapply(unsigned int Op, unsigned int k, bool syscall)
         }
         if (s <= sa4)
         {
-            movetor(t, r);
+            movetor(cs, t, r);
         }
     }
     
@@ -2843,66 +2823,66 @@ void cgapply(unsigned int Op, unsigned int k, bool syscall)
     for (s=sa1; s<=sa4; s+=1)
     {
         r = s-k-3;
-        if (s >= sstack[0].pos)
+        if (s >= cs->sstack[0].pos)
         {
             break;
         }
-        if (regusedby(arg1) == r)
+        if (regusedby(cs, cs->arg1) == r)
         {
-            movetor(arg1, r_r9);
+            movetor(cs, cs->arg1, r_r9);
         }
-        loadt(k_loc, s);
-        movetor(arg1, r);
-        stack(ssp - 1);
+        loadt(cs, k_loc, s);
+        movetor(cs, cs->arg1, r);
+        stack(cs, cs->ssp - 1);
     }
 
 
-    GenAddConstant(r_p, r_r4, 4 * k);  /* ADD r_r4,r_p,#4*k  */
+    GenAddConstant(cs, r_p, r_r4, 4 * k);  /* ADD r_r4,r_p,#4*k  */
             
-    l = sstack[arg1].val;
+    l = cs->sstack[cs->arg1].val;
     if (syscall)
     {
-        GenSysCall(l, r_r5);
+        GenSysCall(cs, l, r_r5);
     }
     else
     {
-        GenBranchWithLink(l);
+        GenBranchWithLink(cs, l);
     }
-    forgetall();
-    stack(k);
+    forgetall(cs);
+    stack(cs, k);
     
     if (Op == s_FNAP)
     {
-        loadt(k_reg, r_r0);
+        loadt(cs, k_reg, r_r0);
     }
 }
 
 /* --------------------------------------------------------- */
-void cgreturn(unsigned int n)
+void cgreturn(CodeGenState *cs, unsigned int n)
 {
-    cgpendingop();
-    if (Procedures[n].ProcType != VoidType)
+    cgpendingop(cs);
+    if (cs->Procedures[n].ProcType != VoidType)
     {
-        movetor(arg1, r_r0);
-        stack(ssp - 1);
+        movetor(cs, cs->arg1, r_r0);
+        stack(cs, cs->ssp - 1);
     }
     
-    OutWord(0xE89B8800);   /* LDM r_p,{r_p,r_pc}  no inc */
+    OutWord(cs, 0xE89B8800);   /* LDM r_p,{r_p,r_pc}  no inc */
     
-    initstack(ssp);
+    initstack(cs, cs->ssp);
 }
 
 /* --------------------------------------------------------- */
-void cgstring(unsigned int n)  /* n is the string number */
+void cgstring(CodeGenState *cs, unsigned int n)  /* n is the string number */
 {
     unsigned int lab = 0;
     
     lab = ProgStringList[n];
-    loadt(k_lvlab, lab);
+    loadt(cs, k_lvlab, lab);
 }
 
 /* --------------------------------------------------------- */
-void cgname(char name[])
+void cgname(CodeGenState *cs, char name[])
 {
     unsigned int  w;
     unsigned int  i;
@@ -2928,9 +2908,9 @@ void cgname(char name[])
         }
     }
     w = pack4b(str[0], str[1], str[2], str[3]);
-    OutWord(w);
+    OutWord(cs, w);
     w = pack4b(str[4], str[5], str[6], str[7]);
-    OutWord(w);
+    OutWord(cs, w);
 }
 
 /* --------------------------------------------------------- */
@@ -1,9 +1,9 @@
 #include "compiler.h"
 
-extern void CodeGenerate(char Filename[],
-                         char nodename[], 
-                         Instruction *code,    unsigned int codesize, 
-                         int *gv,              unsigned int gvsize,
-                         int *ev,              unsigned int evsize,
-                         ProcedureItem *procs, unsigned int nprocs,
-                         unsigned int *labs,   unsigned int nlabs);
+extern unsigned int CodeGenerate(char Filename[],  /* returns the size of the object in words */
+                                 char nodename[], 
+                                 Instruction *code,    unsigned int codesize, 
+                                 int *gv,              unsigned int gvsize,
+                                 int *ev,              unsigned int evsize,
+                                 ProcedureItem *procs, unsigned int nprocs,
+                                 unsigned int *labs,   unsigned int nlabs);
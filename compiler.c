@@ -1,18 +1,39 @@
 /* DAMSON compiler
 */
 
+#ifndef WIN32
+#define _XOPEN_SOURCE 500   /* mkdir */
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
 
+#ifdef WIN32
+#include <direct.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#endif
+
 #include "compiler.h"
 #include "emulator.h"
 #include "codegen.h"
 #include "debug.h"
+#include "image.h"
+#include "optimise.h"
+#include "ssa.h"
+#include "inline.h"
+#include "prune.h"
+#include "connect.h"
 
 #define MaxKeyWords   16
-#define MaxDirectives 9
+#define MaxDirectives 11
 #define MaxProcs      13
 #define MaxFunctions  9
 #define MaxSwitches   100
@@ -20,19 +41,17 @@
 #define MaxBreaks     100
 #define MaxContinues  100
 
-#define CodeSize      10000
-#define MaxDefines    1000
-#define MaxProcedures 100
 #define MaxPrototypes 100
 #define MaxRangeSize  100
-#define MaxGlobals    1000
-#define MaxExternals  1000
-#define MaxGvSize     10000
-#define MaxEvSize     800000
 #define MaxStrings    500
+#define NameBlockSize 65536
 
 #define SAVESPACESIZE 3
 
+#define CACHE_MAGIC        0x444D5043  /* "DMPC" - prototype cache file */
+#define CACHE_VERSION      3
+#define MaxSectionIncludes 32
+
 #define CR            13
 #define EOL           10
 #define SPACE         ' '
@@ -44,7 +63,7 @@ char *KeyWords[MaxKeyWords] =
   "continue", "case", "default", "int", "float", "void",   "return", "extern" };
 
 char *Directives[MaxDirectives] =
-{ "", "timestamp", "node", "monitor", "define", "include", "alias", "log", "snapshot" };
+{ "", "timestamp", "node", "monitor", "define", "include", "alias", "log", "snapshot", "connect", "incbin" };
 
 char *Procs[MaxProcs] =
 { "", "sendpkt", "delay", "printf", "exit", "signal", "wait", "tickrate",
@@ -78,6 +97,8 @@ char *Functions[MaxFunctions] =
 #define c_ALIAS            25
 #define c_LOG              26
 #define c_SNAPSHOT         27
+#define c_CONNECT          28
+#define c_INCBIN           29
 
 #define c_LBRACKET         30
 #define c_RBRACKET         31
@@ -140,23 +161,23 @@ typedef struct
     unsigned int CaseAddress;
 } SwitchItem;
 
-typedef struct
+typedef struct  /* the stacks of nested expressions share an arena, each starting at the top of the enclosing one */
 {
-    unsigned int Size;
-    unsigned int Stack[StackSize];
-} OpStackStruct;
+    int          *Stack;
+    unsigned int Top;   /* top of the innermost stack */
+    unsigned int Size;  /* allocated */
+} ExprArena;
 
 typedef struct
 {
+    ExprArena    *Arena;
+    unsigned int Base;
     unsigned int Size;
-    enum VarType Stack[StackSize];
-} ArgStackStruct;
+} ExprStack;
 
-typedef struct
-{
-    unsigned int Size;
-    int Stack[StackSize];
-} ConstStackStruct;
+typedef ExprStack OpStackStruct;
+typedef ExprStack ArgStackStruct;
+typedef ExprStack ConstStackStruct;
 
 typedef struct
 {
@@ -165,6 +186,53 @@ typedef struct
     enum VarType DefType;
 } DefinetableItem;
 
+#define CH_LETTER     1  /* character classes */
+#define CH_DIGIT      2
+#define CH_UNDERSCORE 4
+#define CH_NAME       (CH_LETTER | CH_DIGIT | CH_UNDERSCORE)
+#define CH_NUMBER     8
+#define CH_SPACE      16
+
+typedef struct SourceItem  /* a source file read into memory, kept for further includes */
+{
+    char              *Name;
+    char              *Text;
+    unsigned int      Size;
+    struct SourceItem *Next;
+} SourceItem;
+
+typedef struct  /* hashed index by name into one of the name tables */
+{
+    unsigned int *Slots;              /* table index, 0 = empty */
+    unsigned int Size;                /* power of 2, at most half full */
+    unsigned int First;               /* first table index */
+    unsigned int Count;               /* last table index entered */
+    char         *(*Name)(unsigned int i);
+} SymbolIndex;
+
+typedef struct  /* a prototype whose ARM code is generated once the source has been read */
+{
+    struct NodeInfo *Node;
+    unsigned int    Size;     /* of its object, in words */
+} PendingCodeItem;
+
+typedef struct  /* an interrupt vector in the linker file, filled in once its procedure has been placed */
+{
+    long            Pos;
+    ProcedureItem   *Proc;
+    unsigned int    Count;    /* consecutive entries, one per key */
+} LinkerFixup;
+
+typedef struct  /* a #connect of the alias statement being read */
+{
+    Connectivity    *Matrix;
+    unsigned int    Vector;        /* label of the handler */
+    unsigned int    WeightOffset;  /* first element of the external array of weights, 0 if none */
+    unsigned int    WeightSize;    /* elements */
+    enum VarType    WeightType;
+    int             *WeightBase;   /* the array as the alias statement left it */
+} ConnectItem;
+
 typedef struct
 {
     char            *nodename;
@@ -208,25 +276,42 @@ bool                   SymbolBackSpacing;
 unsigned int           LastSymbol;
 char                   LastSymbolString[MaxStringSize + 1];
 unsigned int           Errors;
-FILE                   *FileStream = NULL;
-DefinetableItem        Defines[MaxDefines + 1];
+SourceItem             *SourceFiles = NULL;
+bool                   InMemory = false;        /* compiling for a library call - no files are read or written */
+IncludeResolver        Resolver = NULL;         /* then the text of an include comes from the caller */
+void                   *ResolverContext = NULL;
+jmp_buf                *FatalErrorPoint = NULL; /* a library call in progress, which fails rather than exit */
+char                   *Source = NULL;  /* text being read */
+unsigned int           SourceSize = 0;
+unsigned int           SourcePos = 0;
+unsigned char          CharClass[256];
+DefinetableItem        *Defines = NULL;
+unsigned int           DefinesSize = 0;
 unsigned int           NumberOfDefines;
-ProcedureItem          Procedures[MaxProcedures + 1];
+ProcedureItem          *Procedures = NULL;
+unsigned int           ProceduresSize = 0;
+NametableItem          **LocalTables = NULL;  /* compiler's own table of MaxLocals items for each procedure */
+unsigned int           LocalTablesSize = 0;
 unsigned int           NumberOfProcedures;
 FILE                   *LinkerFileStream;
 FILE                   *MakefileStream;
+char                   FileBaseName[MaxStringSize];
 unsigned int           ssp;
 unsigned int           CurrentProcedure;
 unsigned int           PC;
 unsigned int           NumberOfInterrupts;
-InterruptVector        IntVector[MaxNodes + 1];
-NametableItem          Globals[MaxGlobals + 1];
+InterruptVector        *IntVector = NULL;
+unsigned int           IntVectorSize = 0;
+NametableItem          *Globals = NULL;
+unsigned int           GlobalsSize = 0;
 unsigned int           NumberOfGlobals;
-NametableItem          Externals[MaxExternals + 1];
+NametableItem          *Externals = NULL;
+unsigned int           ExternalsSize = 0;
 unsigned int           NumberOfExternals;
 unsigned int           NumberOfLogs;
 unsigned int           FirstLog;
-Instruction            Instructions[CodeSize + 1];
+Instruction            *Instructions = NULL;
+unsigned int           InstructionsSize = 0;
 unsigned int           ProgramSize;
 unsigned int           Node;
 unsigned int           BreakList[MaxBreaks];
@@ -235,9 +320,11 @@ unsigned int           ContinueList[MaxContinues];
 unsigned int           ContinueListFlag[MaxContinues];
 unsigned int           ContinueLevel;
 unsigned int           gvsize;
-int                    GlobalVector[MaxGvSize + 1];
+int                    *GlobalVector = NULL;
+unsigned int           GlobalVectorSize = 0;
 unsigned int           evsize;
-int                    ExternalVector[MaxEvSize + 1];
+int                    *ExternalVector = NULL;
+unsigned int           ExternalVectorSize = 0;
 bool                   DisAssembling;
 bool                   CodeGenerating;
 bool                   BoundsChecking;
@@ -245,7 +332,9 @@ char                   LastString[MaxStringSize];
 enum TimeStampMode     TimeStamping;
 bool                   Monitoring;
 unsigned int           NumberOfNodes;
-struct tnode           *Links;
+LinkItem               *Links = NULL;
+unsigned int           NumberOfLinks = 0;
+unsigned int           LinksSize = 0;
 bool                   externmode;
 char                   *CurrentPrototype;
 char                   *Prototypes[MaxPrototypes];
@@ -253,7 +342,8 @@ unsigned int           NumberOfPrototypes;
 bool                   AliasMode;
 unsigned int           Including;
 bool                   GlobalDeclarations;
-struct LineInfo        LineNumbers[MaxLines+1];
+struct LineInfo        *LineNumbers = NULL;
+unsigned int           LineNumbersSize = 0;
 struct LineInfo        *LineNumberList;
 unsigned int           NumberOfLines;
 unsigned int           FirstLine;
@@ -262,10 +352,66 @@ unsigned long long int samplingt2;
 unsigned long long int samplingt3;
 RangeListType          RangeList;
 unsigned int           nMakefiles;
+unsigned int           LocalProcedure;  /* procedure indexed by LocalIndex */
 char                   MakefileNames[MaxPrototypes + 1] [MaxStringSize];
 bool                   LogFiles;
+char                   *CacheDirectory = NULL;
+bool                   CacheTemporary = false;  /* made for the section workers, and removed */
+char                   TemporaryCache[MaxStringSize + 40];
+unsigned int           CompileJobs = 0;         /* workers compiling the #node sections; 0 or 1 - none */
+unsigned int           CompileSection = 0;      /* in a worker, the section it compiles */
+unsigned int           SectionsSeen;
+unsigned int           SectionObjectSize;       /* words of the object generated for the section */
+PendingCodeItem        *PendingCode = NULL;     /* prototypes waiting for the code generator */
+unsigned int           PendingCodeSize = 0;
+unsigned int           nPendingCode = 0;
+unsigned int           NextPendingCode;         /* the next to be taken by a code generator thread */
+LinkerFixup            *LinkerFixups = NULL;
+unsigned int           LinkerFixupsSize = 0;
+unsigned int           nLinkerFixups = 0;
+ConnectItem            *Connects = NULL;
+unsigned int           ConnectsSize = 0;
+unsigned int           nConnects = 0;
+InterruptVector        *NodeIntVector = NULL;  /* of a node with connections from a file */
+unsigned int           NodeIntVectorSize = 0;
+#ifndef WIN32
+pthread_mutex_t        PendingCodeLock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+bool                   Optimising = false;
+bool                   KeepingGlobals = false;  /* globals may be named from outside the model, so are not pruned */
+bool                   Debugging;
+unsigned int           SymbolStart;      /* source position of the last symbol read */
+char                   *SectionSource;   /* the prototype section being compiled */
+unsigned int           SectionStart;
+unsigned int           SectionLine;
+unsigned int           SectionDefines;
+unsigned int           SectionKey;       /* hash of the context the section is compiled in */
+bool                   SectionCacheable;
+bool                   SectionCached;
+unsigned int           nSectionIncludes;
+char                   SectionIncludes[MaxSectionIncludes + 1][MaxStringSize + 1];
+unsigned int           SectionIncludeHash[MaxSectionIncludes + 1];
+char                   **PrunedNames = NULL;  /* names dropped from the section, which must stay unused */
+unsigned int           PrunedNamesSize = 0;
+unsigned int           nPrunedNames;
+char                   **NameSlots = NULL;  /* interned names */
+unsigned int           NameSlotsSize = 0;
+unsigned int           NumberOfInternedNames = 0;
+char                   *NameBlock = NULL;
+unsigned int           NameBlockFree = 0;
+ExprArena              OpArena = { NULL, 0, 0 };
+ExprArena              ArgArena = { NULL, 0, 0 };
+ExprArena              ConstArena = { NULL, 0, 0 };
+unsigned char          *CacheBuffer = NULL;
+unsigned int           CacheBufferSize = 0;
+unsigned int           CacheUsed;
 
 /* PROTOTYPES */
+void         *Grow(void *a, unsigned int *size, unsigned int n, unsigned int itemsize);
+void         FreeTables();
+void         LocalTable(unsigned int p);
+void         ExprStackInit(ExprStack *s, ExprArena *a);
+void         ExprStackPush(int x, ExprStack *s);
 unsigned int NextLabel();
 void         SetLabel(unsigned int lab, unsigned int addr);
 unsigned int GetLabel(unsigned int lab);
@@ -273,8 +419,28 @@ int          Str2Int(char str[]);
 void         CopyString(char a[], char b[]);
 void         FileBackSpace(char Ch);
 char         Rdch();
+void         InitCharClass();
+SourceItem   *NewSource(char Filename[], unsigned int size);
+SourceItem   *LoadSource(char Filename[]);
+void         FreeSources();
 void         ReadName(char Str[], char Ch);
 bool         SameString(char a[], char b[]);
+unsigned int HashName(char v[]);
+void         ClearIndex(SymbolIndex *x);
+void         IndexEntry(SymbolIndex *x, unsigned int i);
+unsigned int FindIndex(SymbolIndex *x, char v[], unsigned int n);
+char         *LookupName(char v[], bool add);
+char         *InternName(char v[]);
+char         *InternedName(char v[]);
+char         *KeyWordName(unsigned int i);
+char         *DirectiveName(unsigned int i);
+char         *ProcName(unsigned int i);
+char         *FunctionName(unsigned int i);
+char         *DefineName(unsigned int i);
+char         *GlobalName(unsigned int i);
+char         *ExternalName(unsigned int i);
+char         *ProcedureName(unsigned int i);
+char         *LocalName(unsigned int i);
 void         ReadCharacter(char str[], char Ch);
 void         ReadNumber(char Str[], char Ch);
 void         ReadString(char Str[], char tCh);
@@ -318,12 +484,39 @@ void         ReadAddress();
 enum VarType ReadExpression();
 void         EvaluateConstant(unsigned int Op, ConstStackStruct *s);
 int          ReadConstantExpression(enum VarType *t);
+int          ConstantCall(char v[], enum VarType *t);
 void         ReadBooleanExpression();
 void         ReadBlock(unsigned int Op);
 unsigned int ReadStatement();
-struct tnode *AddLink(struct tnode *p, unsigned int s, unsigned int d);
-void         FreeLinks(struct tnode *p);
+void         AddLink(unsigned int slow, unsigned int shigh, unsigned int dlow, unsigned int dhigh);
+void         FreeLinks();
 bool         ReadFile(char FileName[], bool include);
+unsigned int HashBytes(unsigned int h, void *p, unsigned int n);
+unsigned int SectionContext();
+void         CacheFileName(char fname[], char ext[]);
+bool         SectionEnds(unsigned int pos);
+unsigned int NextName(unsigned int pos, char Str[]);
+bool         NamedAfter(unsigned int pos, char name[]);
+bool         SectionRoots(unsigned int pos, bool *procs, bool *globals);
+void         PruneUnused(unsigned int end);
+void         PutCacheBlock(void *p, unsigned int n);
+void         PutCacheWord(unsigned int x);
+void         PutCacheString(char str[]);
+void         GetCacheBlock(unsigned char **p, void *d, unsigned int n);
+unsigned int GetCacheWord(unsigned char **p);
+void         GetCacheString(unsigned char **p, char str[]);
+void         PutCacheNames(NametableItem *t, unsigned int n);
+void         GetCacheNames(unsigned char **p, NametableItem *t, unsigned int n);
+void         BeginSection();
+void         EndSection(unsigned int end);
+bool         SectionToCache(unsigned int end);
+bool         ReadCachedSection();
+void         WriteCachedSection(unsigned int end);
+void         CompileSections(char FileName[]);
+void         RemoveTemporaryCache();
+unsigned int SkimStatement();
+void         GenerateCode();
+void         *CodeWorker(void *arg);
 char*        FindLocalName(unsigned int pc, unsigned int p);
 char*        FindGlobalName(unsigned int p);
 void         DisAssemble();
@@ -336,6 +529,10 @@ unsigned int AllocateConstantExternalArray(unsigned int dimensions[], enum VarTy
 unsigned int AllocateExternalArray(unsigned int a[]);
 void         ReadRange(RangeListType *rlist);
 void         ReadAliasStatement(RangeListType *nlist);
+void         ReadConnectDirective(RangeListType *nlist);
+unsigned int ConnectNode(unsigned int node);
+void         CloseConnects();
+void         ReadIncbinDirective();
 void         CheckPrintf(char argstr[], unsigned int n);
 unsigned int AliasReadAddress();
 int          Str2FixedPoint(char str[]);
@@ -358,6 +555,98 @@ int Str2FixedPoint(char str[])
     }
 }
  
+/* --------------------------------------------------------- */
+void *Grow(void *a, unsigned int *size, unsigned int n, unsigned int itemsize)  /* room for items 0..n, new items zeroed */
+{
+    unsigned int s = *size;
+
+    if (n < s)
+    {
+        return a;
+    }
+    if (s == 0)
+    {
+        s = 256;
+    }
+    while (n >= s)
+    {
+        s *= 2;
+    }
+
+    a = realloc(a, (size_t) s * itemsize);
+    if (a == NULL)
+    {
+        Error(129, "Unable to allocate compiler table (%d items)\n", s);
+    }
+    memset((char *) a + (size_t) *size * itemsize, 0, (size_t) (s - *size) * itemsize);
+    *size = s;
+    return a;
+}
+
+/* --------------------------------------------------------- */
+void FreeTables()  /* end of a compilation - the tables have been copied to the prototypes */
+{
+    unsigned int i;
+
+    free(Instructions);
+    free(GlobalVector);
+    free(ExternalVector);
+    free(Globals);
+    free(Externals);
+    free(Procedures);
+    free(Defines);
+    free(LineNumbers);
+    for (i=0; i<LocalTablesSize; i+=1)
+    {
+        free(LocalTables[i]);
+    }
+    free(LocalTables);
+    free(OpArena.Stack);
+    free(ArgArena.Stack);
+    free(ConstArena.Stack);
+
+    Instructions = NULL;
+    GlobalVector = NULL;
+    ExternalVector = NULL;
+    Globals = NULL;
+    Externals = NULL;
+    Procedures = NULL;
+    Defines = NULL;
+    LineNumbers = NULL;
+    LocalTables = NULL;
+    OpArena.Stack = NULL;
+    ArgArena.Stack = NULL;
+    ConstArena.Stack = NULL;
+
+    InstructionsSize = 0;
+    GlobalVectorSize = 0;
+    ExternalVectorSize = 0;
+    GlobalsSize = 0;
+    ExternalsSize = 0;
+    ProceduresSize = 0;
+    DefinesSize = 0;
+    LineNumbersSize = 0;
+    LocalTablesSize = 0;
+    OpArena.Size = 0;
+    ArgArena.Size = 0;
+    ConstArena.Size = 0;
+}
+
+/* --------------------------------------------------------- */
+void LocalTable(unsigned int p)  /* procedure p is compiled in the compiler's own table; prototypes keep only nLocals items */
+{
+    LocalTables = Grow(LocalTables, &LocalTablesSize, p, sizeof(NametableItem *));
+    if (LocalTables[p] == NULL)
+    {
+        LocalTables[p] = calloc(MaxLocals + 1, sizeof(NametableItem));
+        if (LocalTables[p] == NULL)
+        {
+            Error(129, "Unable to allocate compiler table (%d items)\n", MaxLocals + 1);
+        }
+    }
+    Procedures[p].Args = LocalTables[p];
+}
+
 /* --------------------------------------------------------- */
 unsigned int NextLabel()
 {
@@ -559,6 +848,10 @@ void Error(unsigned int code, char *fmt, ...)
 
     if (code < 1000)  /* fatal error */
     {
+        if (FatalErrorPoint != NULL)
+        {
+            longjmp(*FatalErrorPoint, (int) code);  /* the library call fails instead */
+        }
         Shutdown();
         exit(EXIT_FAILURE);
     }
@@ -577,7 +870,10 @@ void FileBackSpace(char Ch)
     {
         LineNumber = LineNumber - 1;
     }
-    ungetc(Ch, FileStream);
+    if (Ch != EOF)  /* as ungetc */
+    {
+        SourcePos -= 1;
+    }
 }
 
 /* --------------------------------------------------------- */
@@ -587,16 +883,22 @@ char Rdch()
 
     do
     {
-        Ch = fgetc(FileStream);
+        if (SourcePos >= SourceSize)
+        {
+            return EOF;
+        }
+        Ch = Source[SourcePos];
+        SourcePos += 1;
     } while (Ch == CR);
 
     if (Ch == EOL)
     {
         LineNumber += 1;
-        if (LineNumber > MaxLines)
+        if (LineNumber > MaxLines)  /* the debugger's table */
         {
             Error(236, "Too many lines in program (%d)\n", LineNumber);
         }
+        LineNumbers = Grow(LineNumbers, &LineNumbersSize, LineNumber, sizeof(struct LineInfo));
         externmode = false;
         if (Including == 0)
         {
@@ -607,6 +909,34 @@ char Rdch()
     return Ch;
 }
 
+/* --------------------------------------------------------- */
+void InitCharClass()
+{
+    unsigned int c;
+
+    for (c = 0; c <= 255; c += 1)
+    {
+        CharClass[c] = 0;
+        if (((c >= 'A') && (c <= 'Z')) || ((c >= 'a') && (c <= 'z')))
+        {
+            CharClass[c] |= CH_LETTER;
+        }
+        if ((c >= '0') && (c <= '9'))
+        {
+            CharClass[c] |= CH_DIGIT;
+        }
+        if (((c >= '0') && (c <= '9')) || ((c >= 'A') && (c <= 'F')) || ((c >= 'a') && (c <= 'f')) ||
+            (c == '.') || (c == 'X') || (c == 'x'))
+        {
+            CharClass[c] |= CH_NUMBER;
+        }
+    }
+    CharClass['_'] |= CH_UNDERSCORE;
+    CharClass[SPACE] |= CH_SPACE;
+    CharClass[TAB] |= CH_SPACE;
+    CharClass[EOL] |= CH_SPACE;
+}
+
 /* --------------------------------------------------------- */
 void ReadName(char Str[], char Ch)  /* Ch is an alphabetic character */
 {
@@ -614,10 +944,7 @@ void ReadName(char Str[], char Ch)  /* Ch is an alphabetic character */
 
     p = 0;
 
-    while (((Ch >= 'A') && (Ch <= 'Z')) ||
-           ((Ch >= 'a') && (Ch <= 'z')) ||
-           ((Ch == '_') && (p > 0)) ||
-           ((Ch >= '0') && (Ch <= '9') && (p > 0)))
+    while ((CharClass[(unsigned char) Ch] & ((p == 0) ? CH_LETTER : CH_NAME)) != 0)
     {
         Str[p] = Ch;
         p     += 1;
@@ -638,6 +965,200 @@ bool SameString(char a[], char b[])
     return strcmp(a, b) == 0;
 }
 
+/* --------------------------------------------------------- */
+/* name tables are indexed by open hashing, entries being added to an index as the table grows */
+
+SymbolIndex KeyWordIndex   = { NULL, 0, 1, 0, KeyWordName };
+SymbolIndex DirectiveIndex = { NULL, 0, 1, 0, DirectiveName };
+SymbolIndex ProcIndex      = { NULL, 0, 1, 0, ProcName };
+SymbolIndex FunctionIndex  = { NULL, 0, 1, 0, FunctionName };
+SymbolIndex DefineIndex    = { NULL, 0, 1, 0, DefineName };
+SymbolIndex GlobalIndex    = { NULL, 0, GLOBALBASE, GLOBALBASE - 1, GlobalName };
+SymbolIndex ExternalIndex  = { NULL, 0, 1, 0, ExternalName };
+SymbolIndex ProcedureIndex = { NULL, 0, 1, 0, ProcedureName };
+SymbolIndex LocalIndex     = { NULL, 0, 1, 0, LocalName };
+
+char *KeyWordName(unsigned int i)   { return KeyWords[i]; }
+char *DirectiveName(unsigned int i) { return Directives[i]; }
+char *ProcName(unsigned int i)      { return Procs[i]; }
+char *FunctionName(unsigned int i)  { return Functions[i]; }
+char *DefineName(unsigned int i)    { return Defines[i].DefName; }
+char *GlobalName(unsigned int i)    { return Globals[i].Name; }
+char *ExternalName(unsigned int i)  { return Externals[i].Name; }
+char *ProcedureName(unsigned int i) { return Procedures[i].Name; }
+char *LocalName(unsigned int i)     { return Procedures[LocalProcedure].Args[i].Name; }
+
+/* --------------------------------------------------------- */
+unsigned int HashName(char v[])  /* FNV-1a */
+{
+    unsigned int h = 2166136261u;
+
+    while (*v != 0)
+    {
+        h = (h ^ (unsigned char) *v) * 16777619u;
+        v += 1;
+    }
+    return h;
+}
+
+/* --------------------------------------------------------- */
+void ClearIndex(SymbolIndex *x)  /* the table has been reset or replaced */
+{
+    x->Count = x->First - 1;
+    if (x->Slots != NULL)
+    {
+        memset(x->Slots, 0, sizeof(unsigned int) * x->Size);
+    }
+}
+
+/* --------------------------------------------------------- */
+void IndexEntry(SymbolIndex *x, unsigned int i)
+{
+    unsigned int k;
+    unsigned int j;
+
+    if (2 * (i - x->First + 1) > x->Size)  /* grow and re-enter the earlier names */
+    {
+        free(x->Slots);
+        x->Size = (x->Size == 0) ? 64 : x->Size * 2;
+        x->Slots = calloc(x->Size, sizeof(unsigned int));
+        if (x->Slots == NULL)
+        {
+            Error(126, "Unable to allocate symbol table (%d)\n", x->Size);
+        }
+        for (j = x->First; j < i; j += 1)
+        {
+            IndexEntry(x, j);
+        }
+    }
+
+    k = HashName(x->Name(i)) & (x->Size - 1);
+    while (x->Slots[k] != 0)
+    {
+        if (SameString(x->Name(i), x->Name(x->Slots[k])))
+        {
+            return;  /* the first declaration is found, as by a scan */
+        }
+        k = (k + 1) & (x->Size - 1);
+    }
+    x->Slots[k] = i;
+}
+
+/* --------------------------------------------------------- */
+unsigned int FindIndex(SymbolIndex *x, char v[], unsigned int n)  /* n: last table index in use */
+{
+    unsigned int k;
+
+    if (n < x->Count)
+    {
+        ClearIndex(x);
+    }
+    while (x->Count < n)
+    {
+        x->Count += 1;
+        IndexEntry(x, x->Count);
+    }
+
+    if (x->Slots == NULL)
+    {
+        return 0;
+    }
+    k = HashName(v) & (x->Size - 1);
+    while (x->Slots[k] != 0)
+    {
+        if (SameString(v, x->Name(x->Slots[k])))
+        {
+            return x->Slots[k];
+        }
+        k = (k + 1) & (x->Size - 1);
+    }
+    return 0;
+}
+
+/* --------------------------------------------------------- */
+/* symbol names are interned: each name is held once, so name tables hold pointers and names match by address */
+
+char *LookupName(char v[], bool add)
+{
+    char         **old;
+    unsigned int oldsize;
+    unsigned int j;
+    unsigned int k;
+    unsigned int s;
+
+    if (add && 2 * (NumberOfInternedNames + 1) > NameSlotsSize)  /* grow and re-enter the names */
+    {
+        old = NameSlots;
+        oldsize = NameSlotsSize;
+        NameSlotsSize = (oldsize == 0) ? 1024 : oldsize * 2;
+        NameSlots = calloc(NameSlotsSize, sizeof(char *));
+        if (NameSlots == NULL)
+        {
+            Error(126, "Unable to allocate symbol table (%d)\n", NameSlotsSize);
+        }
+        for (j = 0; j < oldsize; j += 1)
+        {
+            if (old[j] != NULL)
+            {
+                k = HashName(old[j]) & (NameSlotsSize - 1);
+                while (NameSlots[k] != NULL)
+                {
+                    k = (k + 1) & (NameSlotsSize - 1);
+                }
+                NameSlots[k] = old[j];
+            }
+        }
+        free(old);
+    }
+
+    if (NameSlots == NULL)
+    {
+        return NULL;
+    }
+    k = HashName(v) & (NameSlotsSize - 1);
+    while (NameSlots[k] != NULL)
+    {
+        if (SameString(v, NameSlots[k]))
+        {
+            return NameSlots[k];
+        }
+        k = (k + 1) & (NameSlotsSize - 1);
+    }
+    if (!add)
+    {
+        return NULL;
+    }
+
+    s = strlen(v) + 1;
+    if (s > NameBlockFree)  /* names are never freed, so are packed into blocks */
+    {
+        NameBlockFree = (s > NameBlockSize) ? s : NameBlockSize;
+        NameBlock = malloc(NameBlockFree);
+        if (NameBlock == NULL)
+        {
+            Error(126, "Unable to allocate symbol table (%d)\n", NameBlockFree);
+        }
+    }
+    memcpy(NameBlock, v, s);
+    NameSlots[k] = NameBlock;
+    NameBlock += s;
+    NameBlockFree -= s;
+    NumberOfInternedNames += 1;
+    return NameSlots[k];
+}
+
+/* --------------------------------------------------------- */
+char *InternName(char v[])  /* adds the name if new */
+{
+    return LookupName(v, true);
+}
+
+/* --------------------------------------------------------- */
+char *InternedName(char v[])  /* NULL if no symbol has been given the name */
+{
+    return LookupName(v, false);
+}
+
 /* --------------------------------------------------------- */
 void ReadCharacter(char str[], char Ch)
 {
@@ -667,10 +1188,7 @@ void ReadNumber(char Str[], char Ch)  /* Ch is a numeric character */
 
     p = 0;
 
-    while (((Ch >= '0') && (Ch <= '9')) ||
-           ((Ch >= 'A') && (Ch <= 'F')) ||
-           ((Ch >= 'a') && (Ch <= 'f')) ||
-           (Ch == '.') || (Ch == 'X') || (Ch == 'x') || (Ch == 'E') || (Ch == 'e'))
+    while ((CharClass[(unsigned char) Ch] & CH_NUMBER) != 0)
     {
         Str[p] = Ch;
         p     += 1;
@@ -794,7 +1312,8 @@ unsigned int ReadSymbol(char Str[])
         {
             return c_EOF;
         }
-    } while (Ch == SPACE || Ch == TAB || Ch == EOL);
+    } while ((CharClass[(unsigned char) Ch] & CH_SPACE) != 0);
+    SymbolStart = SourcePos - 1;
 
     switch (Ch)
     {
@@ -813,14 +1332,12 @@ unsigned int ReadSymbol(char Str[])
     case '#':
         Ch = Rdch();
         ReadName(Str, Ch);
-        for (i = 1; i <= MaxDirectives - 1; i += 1)
+        i = FindIndex(&DirectiveIndex, Str, MaxDirectives - 1);
+        if (i > 0)
         {
-            if (SameString(Str, Directives[i]))
-            {
-                LastSymbol = c_TIMESTAMP + i - 1;
-                CopyString(Str, LastSymbolString);
-                return LastSymbol;
-            }
+            LastSymbol = c_TIMESTAMP + i - 1;
+            CopyString(Str, LastSymbolString);
+            return LastSymbol;
         }
         Error(1040, "Unknown directive %s\n", Str);
         LastSymbol = c_ERROR;
@@ -847,14 +1364,12 @@ unsigned int ReadSymbol(char Str[])
             break;
         }
 
-        for (i = 1; i <= MaxKeyWords - 1; i += 1)
+        i = FindIndex(&KeyWordIndex, Str, MaxKeyWords - 1);
+        if (i > 0)
         {
-            if (SameString(Str, KeyWords[i]))
-            {
-                CopyString(Str, LastSymbolString);
-                LastSymbol = i;
-                return LastSymbol;
-            }
+            CopyString(Str, LastSymbolString);
+            LastSymbol = i;
+            return LastSymbol;
         }
         CopyString(Str, LastSymbolString);
         LastSymbol = c_VAR;
@@ -1190,32 +1705,24 @@ void AddProcedure(char v[], enum VarType ptype)
     pnum    = 0;
     nparams = 0;
 
-    if (NumberOfProcedures >= MaxProcedures)
-    {
-        Error(102, "Too many procedures <%s> %d\n", v, MaxProcedures);
-    }
+    Procedures = Grow(Procedures, &ProceduresSize, NumberOfProcedures + 1, sizeof(ProcedureItem));
+    LocalTable(NumberOfProcedures + 1);
 
-    if (NumberOfProcedures > 0)
+    i = FindLocalProcedure(v);
+    if (i > 0)
     {
-        for (i = 1; i <= NumberOfProcedures; i += 1)
+        if (Procedures[i].Versions > 1)
         {
-            if (SameString(v, Procedures[i].Name))
-            {
-                if (Procedures[i].Versions > 1)
-                {
-                    Error(1055, "Multiple declaration %s\n", v);
-                }
-                pnum = i;  /* prototype already declared */
-                break;
-            }
+            Error(1055, "Multiple declaration %s\n", v);
         }
+        pnum = i;  /* prototype already declared */
     }
 
     if (pnum == 0 && SameString(v, "main"))   /* prototype not needed for main */
     {
         unsigned int l = NextLabel();
         NumberOfProcedures += 1;
-        CopyString(v, Procedures[NumberOfProcedures].Name);
+        Procedures[NumberOfProcedures].Name = InternName(v);
         Procedures[NumberOfProcedures].ProcType = ptype;
         Procedures[NumberOfProcedures].nArgs = 0;
         Procedures[NumberOfProcedures].BP = 0;
@@ -1228,7 +1735,7 @@ void AddProcedure(char v[], enum VarType ptype)
     if (pnum == 0)  /* prototype declaration */
     {
         NumberOfProcedures += 1;
-        CopyString(v, Procedures[NumberOfProcedures].Name);
+        Procedures[NumberOfProcedures].Name = InternName(v);
         Procedures[NumberOfProcedures].ProcType = ptype;
         Procedures[NumberOfProcedures].nArgs = 0;
         Procedures[NumberOfProcedures].Label = NextLabel();
@@ -1251,6 +1758,7 @@ void AddProcedure(char v[], enum VarType ptype)
             {
                 t = (s == c_INT) ? IntType : FloatType;
                 nparams += 1;
+                Procedures[NumberOfProcedures].Args[nparams].Name    = InternName("");  /* named by the definition */
                 Procedures[NumberOfProcedures].Args[nparams].vType   = t;
                 Procedures[NumberOfProcedures].Args[nparams].vOffset = nparams;
                 s = ReadSymbol(Str);
@@ -1366,7 +1874,11 @@ void AddProcedure(char v[], enum VarType ptype)
                 s = ReadSymbol(Str);
                 if (s == c_VAR)
                 {
-                    CopyString(Str, Procedures[pnum].Args[nparams].Name);
+                    Procedures[pnum].Args[nparams].Name = InternName(Str);
+                    if (LocalProcedure == pnum)
+                    {
+                        ClearIndex(&LocalIndex);
+                    }
                 }
                 else
                 {
@@ -1474,31 +1986,18 @@ void AddProcedure(char v[], enum VarType ptype)
 /* --------------------------------------------------------- */
 unsigned int FindLocal(unsigned int proc, char v[])
 {
-    unsigned int i;
-
-    for (i = 1; i <= Procedures[proc].nLocals; i += 1)
+    if (proc != LocalProcedure)  /* one procedure's locals are indexed at a time */
     {
-        if (SameString(v, Procedures[proc].Args[i].Name))
-        {
-            return i;
-        }
+        LocalProcedure = proc;
+        ClearIndex(&LocalIndex);
     }
-    return 0;
+    return FindIndex(&LocalIndex, v, Procedures[proc].nLocals);
 }
 
 /* --------------------------------------------------------- */
 unsigned int FindLocalProcedure(char v[])
 {
-    unsigned int i;
-
-    for (i = 1; i <= NumberOfProcedures; i += 1)
-    {
-        if (SameString(v, Procedures[i].Name))
-        {
-            return i;
-        }
-    }
-    return 0;
+    return FindIndex(&ProcedureIndex, v, NumberOfProcedures);
 }
 
 /* --------------------------------------------------------- */
@@ -1524,12 +2023,9 @@ unsigned int AddString(char str[])
 
     strcpy(LastString, str);  /* remember last string */    
     gvsize += 1;
-    if (gvsize >= MaxGvSize)
-    {
-        Error(103, "Too many globals <%d>\n", gvsize);
-    }
     b = gvsize;
     s = strlen(str) + 1;  /* assume 4 bytes per word */
+    GlobalVector = Grow(GlobalVector, &GlobalVectorSize, gvsize + s / 4 + 1, sizeof(int));
     
     memcpy(&GlobalVector[gvsize], str, s);
     gvsize += s / 4 + 1;
@@ -1558,12 +2054,9 @@ void AddGlobal(char v[], enum VarType t, bool scalar)
     }
 
     NumberOfGlobals += 1;
-    if (NumberOfGlobals >= MaxGlobals)
-    {
-        Error(104, "Too many global variables (%d) %s\n", MaxGlobals, v);
-    }
+    Globals = Grow(Globals, &GlobalsSize, NumberOfGlobals, sizeof(NametableItem));
 
-    CopyString(v, Globals[NumberOfGlobals].Name);
+    Globals[NumberOfGlobals].Name = InternName(v);
 
     dim = 0;
     x = 0;
@@ -1578,10 +2071,7 @@ void AddGlobal(char v[], enum VarType t, bool scalar)
         }
         
         gvsize += 1;
-        if (gvsize >= MaxGvSize)
-        {
-            Error(103, "Too many globals <%d>\n", gvsize);
-        }
+        GlobalVector = Grow(GlobalVector, &GlobalVectorSize, gvsize, sizeof(int));
         GlobalVector[gvsize] = x;
 
         Globals[NumberOfGlobals].vOffset = gvsize;
@@ -1682,12 +2172,9 @@ void AddExternal(char v[], enum VarType t, bool scalar)
     }
 
     NumberOfExternals += 1;
-    if (NumberOfExternals >= MaxExternals)
-    {
-        Error(105, "Too many external variables (%d) %s\n", MaxExternals, v);
-    }
+    Externals = Grow(Externals, &ExternalsSize, NumberOfExternals, sizeof(NametableItem));
 
-    CopyString(v, Externals[NumberOfExternals].Name);
+    Externals[NumberOfExternals].Name = InternName(v);
 
     dim = 0;
     x = 0;
@@ -1702,10 +2189,7 @@ void AddExternal(char v[], enum VarType t, bool scalar)
         }
         
         evsize += 1;
-        if (evsize >= MaxEvSize)
-        {
-            Error(125, "Too many externals <%d>\n", evsize);
-        }
+        ExternalVector = Grow(ExternalVector, &ExternalVectorSize, evsize, sizeof(int));
         ExternalVector[evsize] = x;
 
         Externals[NumberOfExternals].vOffset = evsize;
@@ -1792,6 +2276,7 @@ unsigned int AllocateConstantExternalArray(unsigned int dimensions[], enum VarTy
     char         Str[MaxStringSize + 1];
     int          x;
     bool         negsign;
+    enum VarType vt;
     
     b = evsize + 1;
     
@@ -1813,35 +2298,47 @@ unsigned int AllocateConstantExternalArray(unsigned int dimensions[], enum VarTy
                 negsign = true;
                 Op = ReadSymbol(Str);
             }
-            if (Op != c_NUMBER)
-            {
-                Error(1210, "Number expected in constant array declaration <%s>\n", Str);
-            }
-            dn = LookupDefine(Str);
-            if (dn > 0)
+            if (Op == c_VAR)  /* a procedure run by the compiler */
             {
-                x = Defines[dn].DefValue;
+                x = ConstantCall(Str, &vt);
+                if (vt != t)
+                {
+                    x = (t == FloatType) ? x * 65536 : (int) ((float) x / 65536.0);
+                }
+                if (negsign)
+                {
+                    x = -x;
+                }
             }
             else
             {
-                if (t == IntType)
+                if (Op != c_NUMBER)
                 {
-                     x = Str2Int(Str);
+                    Error(1210, "Number expected in constant array declaration <%s>\n", Str);
                 }
-                else
+                dn = LookupDefine(Str);
+                if (dn > 0)
                 {
-                    x = Str2FixedPoint(Str);
+                    x = Defines[dn].DefValue;
                 }
-                if (negsign)
+                else
                 {
-                    x = -x;
+                    if (t == IntType)
+                    {
+                         x = Str2Int(Str);
+                    }
+                    else
+                    {
+                        x = Str2FixedPoint(Str);
+                    }
+                    if (negsign)
+                    {
+                        x = -x;
+                    }
                 }
             }
             evsize += 1;
-            if (evsize >= MaxEvSize)
-            {
-                Error(125, "Too many externals <%d>\n", evsize);
-            }
+            ExternalVector = Grow(ExternalVector, &ExternalVectorSize, evsize, sizeof(int));
             ExternalVector[evsize] = x;
             
             Op = ReadSymbol(Str);
@@ -1903,10 +2400,7 @@ unsigned int AllocateExternalArray(unsigned int a[])
     for (i=1; i<=n; i+=1)
     {
         evsize += 1;
-        if (evsize >= MaxEvSize)
-        {
-            Error(125, "Too many externals <%d>\n", evsize);
-        }
+        ExternalVector = Grow(ExternalVector, &ExternalVectorSize, evsize, sizeof(int));
         ExternalVector[evsize] = 0;
     }
 
@@ -1922,6 +2416,7 @@ unsigned int AllocateConstantGlobalArray(unsigned int dimensions[], enum VarType
     char         Str[MaxStringSize + 1];
     int          x;
     bool         negsign;
+    enum VarType vt;
     
     b = gvsize + 1;
     
@@ -1943,35 +2438,47 @@ unsigned int AllocateConstantGlobalArray(unsigned int dimensions[], enum VarType
                 negsign = true;
                 Op = ReadSymbol(Str);
             }
-            if (Op != c_NUMBER)
-            {
-                Error(1245, "Number expected in constant array declaration <%s>\n", Str);
-            }
-            dn = LookupDefine(Str);
-            if (dn > 0)
+            if (Op == c_VAR)  /* a procedure run by the compiler */
             {
-                x = Defines[dn].DefValue;
+                x = ConstantCall(Str, &vt);
+                if (vt != t)
+                {
+                    x = (t == FloatType) ? x * 65536 : (int) ((float) x / 65536.0);
+                }
+                if (negsign)
+                {
+                    x = -x;
+                }
             }
             else
             {
-                if (t == IntType)
+                if (Op != c_NUMBER)
                 {
-                     x = Str2Int(Str);
+                    Error(1245, "Number expected in constant array declaration <%s>\n", Str);
                 }
-                else
+                dn = LookupDefine(Str);
+                if (dn > 0)
                 {
-                    x = Str2FixedPoint(Str);
+                    x = Defines[dn].DefValue;
                 }
-                if (negsign)
+                else
                 {
-                    x = -x;
+                    if (t == IntType)
+                    {
+                         x = Str2Int(Str);
+                    }
+                    else
+                    {
+                        x = Str2FixedPoint(Str);
+                    }
+                    if (negsign)
+                    {
+                        x = -x;
+                    }
                 }
             }
             gvsize += 1;
-            if (gvsize >= MaxGvSize)
-            {
-                Error(103, "Too many globals <%d>\n", gvsize);
-            }
+            GlobalVector = Grow(GlobalVector, &GlobalVectorSize, gvsize, sizeof(int));
             GlobalVector[gvsize] = x;
             
             Op = ReadSymbol(Str);
@@ -2033,10 +2540,7 @@ unsigned int AllocateGlobalArray(unsigned int a[])
     for (i=1; i<=n; i+=1)
     {
         gvsize += 1;
-        if (gvsize >= MaxGvSize)
-        {
-            Error(103, "Too many globals <%d>\n", gvsize);
-        }
+        GlobalVector = Grow(GlobalVector, &GlobalVectorSize, gvsize, sizeof(int));
         GlobalVector[gvsize] = 0;
     }
 
@@ -2085,18 +2589,12 @@ void AddLocal(char v[], enum VarType t, bool scalar)
         Error(1277, "External name clash <%s>\n", v);
     }
     
-    n = Procedures[CurrentProcedure].nLocals;
-    if (n > 0)
+    if (FindLocal(CurrentProcedure, v) != 0)
     {
-        for (i = 1; i <= n; i += 1)
-        {
-            if (SameString(v, Procedures[CurrentProcedure].Args[i].Name))
-            {
-                Error(1275, "Multiple declaration <%s>\n", v);
-                return;
-            }
-        }
+        Error(1275, "Multiple declaration <%s>\n", v);
+        return;
     }
+    n = Procedures[CurrentProcedure].nLocals;
 
     n = n + 1;
     if (n >= MaxLocals)
@@ -2105,7 +2603,7 @@ void AddLocal(char v[], enum VarType t, bool scalar)
     }
 
     Procedures[CurrentProcedure].nLocals = n;
-    CopyString(v, Procedures[CurrentProcedure].Args[n].Name);
+    Procedures[CurrentProcedure].Args[n].Name = InternName(v);
 
     dim = 0;
 
@@ -2231,10 +2729,7 @@ void AddDefine(char str[], int x, enum VarType t)
     }
 
     NumberOfDefines += 1;
-    if (NumberOfDefines >= MaxDefines)
-    {
-        Error(107, "Too many define statements (%d) %s\n", MaxDefines, str);
-    }
+    Defines = Grow(Defines, &DefinesSize, NumberOfDefines, sizeof(DefinetableItem));
 
     CopyString(str, Defines[NumberOfDefines].DefName);
     Defines[NumberOfDefines].DefValue = x;
@@ -2245,76 +2740,31 @@ void AddDefine(char str[], int x, enum VarType t)
 /* --------------------------------------------------------- */
 unsigned int LookupDefine(char v[])
 {
-    unsigned int i;
-
-    for (i = 1; i <= NumberOfDefines; i += 1)
-    {
-        if (SameString(v, Defines[i].DefName))
-        {
-            return i;
-        }
-    }
-    return 0;
+    return FindIndex(&DefineIndex, v, NumberOfDefines);
 }
 
 /* --------------------------------------------------------- */
 unsigned int FindGlobal(char v[])
 {
-    unsigned int i;
-
-    for (i = GLOBALBASE; i <= NumberOfGlobals; i += 1)
-    {
-        if (SameString(v, Globals[i].Name))
-        {
-            return i;
-        }
-    }
-    return 0;
+    return FindIndex(&GlobalIndex, v, NumberOfGlobals);
 }
 
 /* --------------------------------------------------------- */
 unsigned int FindExternal(char v[])
 {
-    unsigned int i;
-
-    for (i = 1; i <= NumberOfExternals; i += 1)
-    {
-        if (SameString(v, Externals[i].Name))
-        {
-            return i;
-        }
-    }
-    return 0;
+    return FindIndex(&ExternalIndex, v, NumberOfExternals);
 }
 
 /* --------------------------------------------------------- */
 unsigned int FindProcedure(char v[])
 {
-    unsigned int i;
-
-    for (i = 1; i <= MaxProcs - 1; i += 1)
-    {
-        if (SameString(v, Procs[i]))
-        {
-            return i;
-        }
-    }
-    return 0;
+    return FindIndex(&ProcIndex, v, MaxProcs - 1);
 }
 
 /* --------------------------------------------------------- */
 unsigned int FindFunction(char v[])
 {
-    unsigned int i;
-
-    for (i = 1; i <= MaxFunctions - 1; i += 1)
-    {
-        if (SameString(v, Functions[i]))
-        {
-            return i;
-        }
-    }
-    return 0;
+    return FindIndex(&FunctionIndex, v, MaxFunctions - 1);
 }
 
 /* --------------------------------------------------------- */
@@ -2358,14 +2808,11 @@ void GenCode2(unsigned char OpCode, int Arg)
         }
     }
     
+    Instructions = Grow(Instructions, &InstructionsSize, PC, sizeof(Instruction));
     Instructions[PC].Op  = OpCode;
     Instructions[PC].Arg = Arg;
     PC                     += 1;
     ProgramSize            += 1;
-    if (ProgramSize >= CodeSize)
-    {
-        Error(108, "Program too large %d\n", CodeSize);
-    }
     stackinc(OpCode, Arg);
 }
 
@@ -2436,10 +2883,29 @@ void SymbolBackSpace()
     SymbolBackSpacing = true;
 }
 
+/* --------------------------------------------------------- */
+void ExprStackInit(ExprStack *s, ExprArena *a)
+{
+    s->Arena = a;
+    s->Base  = a->Top;  /* any stack above it has been finished with */
+    s->Size  = 0;
+}
+
+/* --------------------------------------------------------- */
+void ExprStackPush(int x, ExprStack *s)
+{
+    ExprArena *a = s->Arena;
+
+    s->Size += 1;
+    a->Top = s->Base + s->Size;
+    a->Stack = Grow(a->Stack, &a->Size, a->Top, sizeof(int));
+    a->Stack[a->Top] = x;
+}
+
 /* --------------------------------------------------------- */
 void OpStackInit(OpStackStruct *s)
 {
-    s->Size = 0;
+    ExprStackInit(s, &OpArena);
 }
 
 /* --------------------------------------------------------- */
@@ -2451,15 +2917,7 @@ bool OpStackEmpty(OpStackStruct *s)
 /* --------------------------------------------------------- */
 void OpStackPush(unsigned int Op, OpStackStruct *s)
 {
-    if (s->Size >= StackSize)
-    {
-        Error(109, "Op stack overflow (%d)\n", StackSize);
-    }
-    else
-    {
-        s->Size          += 1;
-        s->Stack[s->Size] = Op;
-    }
+    ExprStackPush(Op, s);
 }
 
 /* --------------------------------------------------------- */
@@ -2473,34 +2931,27 @@ unsigned int OpStackPop(OpStackStruct *s)
     else
     {
         s->Size -= 1;
-        return s->Stack[s->Size + 1];
+        s->Arena->Top = s->Base + s->Size;
+        return s->Arena->Stack[s->Base + s->Size + 1];
     }
 }
 
 /* --------------------------------------------------------- */
 unsigned int OpStackTop(OpStackStruct *s)
 {
-    return s->Stack[s->Size];
+    return s->Arena->Stack[s->Base + s->Size];
 }
 
 /* --------------------------------------------------------- */
 void ArgStackInit(ArgStackStruct *s)
 {
-    s->Size = 0;
+    ExprStackInit(s, &ArgArena);
 }
 
 /* --------------------------------------------------------- */
 void ArgStackPush(enum VarType Arg, ArgStackStruct *s)
 {
-    if (s->Size >= StackSize)
-    {
-        Error(111, "Arg stack overflow (%d)\n", StackSize);
-    }
-    else
-    {
-        s->Size          += 1;
-        s->Stack[s->Size] = Arg;
-    }
+    ExprStackPush(Arg, s);
 }
 
 /* --------------------------------------------------------- */
@@ -2514,28 +2965,21 @@ enum VarType ArgStackPop(ArgStackStruct *s)
     else
     {
         s->Size -= 1;
-        return s->Stack[s->Size + 1];
+        s->Arena->Top = s->Base + s->Size;
+        return s->Arena->Stack[s->Base + s->Size + 1];
     }
 }
 
 /* --------------------------------------------------------- */
 void ConstStackInit(ConstStackStruct *s)
 {
-    s->Size = 0;
+    ExprStackInit(s, &ConstArena);
 }
 
 /* --------------------------------------------------------- */
 void ConstStackPush(int x, ConstStackStruct *s)
 {
-    if (s->Size >= StackSize)
-    {
-        Error(113, "Const stack overflow (%d)\n", StackSize);
-    }
-    else
-    {
-        s->Size          += 1;
-        s->Stack[s->Size] = x;
-    }
+    ExprStackPush(x, s);
 }
 
 /* --------------------------------------------------------- */
@@ -2549,7 +2993,8 @@ int ConstStackPop(ConstStackStruct *s)
     else
     {
         s->Size -= 1;
-        return s->Stack[s->Size + 1];
+        s->Arena->Top = s->Base + s->Size;
+        return s->Arena->Stack[s->Base + s->Size + 1];
     }
 }
 
@@ -3780,6 +4225,7 @@ int ReadConstantExpression(enum VarType *t)
     OpStackStruct    OpStack;
     ConstStackStruct ConstStack;
     enum VarType     vt = IntType;
+    enum VarType     ct;
     unsigned int     d;
 
     OpStackInit(&OpStack);
@@ -3844,6 +4290,19 @@ int ReadConstantExpression(enum VarType *t)
             break;
 
         case c_VAR:
+            if (FindLocalProcedure(Str) > 0)  /* a procedure run by the compiler */
+            {
+                ConstStackPush(ConstantCall(Str, &ct), &ConstStack);
+                if (ct == FloatType)
+                {
+                    vt = FloatType;
+                }
+                Op = c_NUMBER;
+                break;
+            }
+            Error(1435, "Constant expected in a directive <%s>\n", Str);
+            break;
+
         case c_STRING:
             Error(1435, "Constant expected in a directive <%s>\n", Str);
             break;
@@ -3890,6 +4349,92 @@ int ReadConstantExpression(enum VarType *t)
     }
 }
 
+/* --------------------------------------------------------- */
+int ConstantCall(char v[], enum VarType *t)  /* a call with constant arguments, run by the emulator as the source is read */
+{
+    unsigned int    p = FindLocalProcedure(v);
+    unsigned int    Op;
+    unsigned int    nArgs = 0;
+    unsigned int    i;
+    char            Str[MaxStringSize + 1];
+    int             Args[MaxLocals + 1];
+    enum VarType    vt;
+    int             x = 0;
+    struct NodeInfo *b = NULL;
+
+    *t = Procedures[p].ProcType;
+    Op = ReadSymbol(Str);
+    if (Op != c_LBRACKET)
+    {
+        Error(1436, "( expected in call of <%s> in a constant expression\n", v);
+        return 0;
+    }
+    if (NextSymbol(Str) == c_RBRACKET)
+    {
+        Op = ReadSymbol(Str);
+    }
+    else
+    {
+        while (1)
+        {
+            nArgs += 1;
+            if (nArgs > MaxLocals)
+            {
+                Error(1437, "Too many arguments in call of <%s> in a constant expression\n", v);
+                return 0;
+            }
+            Args[nArgs] = ReadConstantExpression(&vt);
+            Op = ReadSymbol(Str);
+            if (Op == c_RBRACKET)
+            {
+                break;
+            }
+            if (Op != c_COMMA)
+            {
+                Error(1437, ", or ) expected in call of <%s> in a constant expression <%s>\n", v, Str);
+                return 0;
+            }
+        }
+    }
+
+    if (nArgs != Procedures[p].nArgs)
+    {
+        Error(1395, "Procedure <%s> has %d arguments (%d defined)\n", v, nArgs, Procedures[p].nArgs);
+        return 0;
+    }
+    for (i=1; i<=nArgs; i+=1)
+    {
+        if (Procedures[p].Args[i].vDimensions[0] > 0)
+        {
+            Error(1438, "Procedure <%s> cannot be evaluated at compile time\n", v);
+            return 0;
+        }
+    }
+    if (Procedures[p].ProcType == VoidType)
+    {
+        Error(1438, "Procedure <%s> cannot be evaluated at compile time\n", v);
+        return 0;
+    }
+    if (Errors > 0)
+    {
+        return 0;
+    }
+
+    if (AliasMode)  /* the code of the prototype, complete */
+    {
+        b = FindNamedNode(RangeList.Name);
+    }
+    if (!EvaluateProcedure((b != NULL) ? b->Instructions : Instructions, 
+                           (b != NULL) ? b->ProgramSize : PC - 1,
+                           Labels, Procedures, 
+                           p, CurrentProcedure, b, 
+                           Args, &x))
+    {
+        Error(1438, "Procedure <%s> cannot be evaluated at compile time\n", v);
+    }
+    return x;
+}
+
 /* --------------------------------------------------------- */
 void ReadBooleanExpression()
 {
@@ -3944,6 +4489,212 @@ void ReadBlock(unsigned int Op)
     Op = ReadSymbol(Str);  /* skip } */
 }
 
+/* --------------------------------------------------------- */
+void ReadConnectDirective(RangeListType *nlist)  /* #connect "file" handler [, weights] */
+{
+    unsigned int Op;
+    unsigned int p1;
+    unsigned int p2;
+    char         Str[MaxStringSize + 1];
+    char         tStr[MaxStringSize + 1];
+    ConnectItem  *c;
+    Connectivity *m;
+    unsigned int i;
+    unsigned int j;
+    unsigned int k;
+    unsigned int n;
+    int          w;
+
+    Op = ReadSymbol(Str);  /* skip directive */
+    Op = ReadSymbol(Str);  /* connectivity file */
+    if (Op != c_STRING)
+    {
+        Error(1720, "String expected in CONNECT directive <%s>\n", Str);
+        return;
+    }
+    Op = ReadSymbol(tStr);  /* handler */
+    p1 = (Op == c_VAR) ? FindLocalProcedure(tStr) : 0;
+    if (p1 == 0)
+    {
+        Error(1725, "Unknown function in CONNECT directive <%s>\n", tStr);
+        return;
+    }
+
+    nConnects += 1;
+    Connects = Grow(Connects, &ConnectsSize, nConnects, sizeof(ConnectItem));
+    c = &Connects[nConnects];
+    c->Matrix = OpenConnectivity(Str);
+    c->Vector = Labels[p1];
+    m = c->Matrix;
+
+    if (NextSymbol(tStr) == c_COMMA)  /* the weights go to an external array */
+    {
+        ReadSymbol(tStr);
+        ReadSymbol(tStr);
+        p2 = FindExternal(tStr);
+        if (p2 == 0 || Externals[p2].vDimensions[0] == 0)
+        {
+            Error(1730, "External array expected for the weights in CONNECT directive <%s>\n", tStr);
+        }
+        else if (m->Weights == NULL)
+        {
+            Error(1735, "Connectivity file %s has no weights for <%s>\n", Str, tStr);
+        }
+        else
+        {
+            c->WeightOffset = Externals[p2].vOffset;
+            c->WeightType   = Externals[p2].vType;
+            c->WeightSize   = 1;
+            for (i=1; i<=Externals[p2].vDimensions[0]; i+=1)
+            {
+                c->WeightSize *= Externals[p2].vDimensions[i];
+            }
+        }
+    }
+
+    for (i=1; i<=nlist->nItems; i+=1)  /* links from the runs of consecutive sources of each node */
+    {
+        for (j=nlist->Range[i].low; j<=nlist->Range[i].high && j<m->nRows; j+=1)
+        {
+            if (c->WeightOffset > 0 && m->RowStart[j + 1] - m->RowStart[j] > c->WeightSize)
+            {
+                Error(1740, "Node %d has %d connections, more than the elements of <%s>\n", 
+                      j, m->RowStart[j + 1] - m->RowStart[j], tStr);
+            }
+            for (k=m->RowStart[j]; c->WeightOffset > 0 && k<m->RowStart[j + 1]; k+=1)
+            {
+                if (!ConnectionWeight(m, k, c->WeightType, &w))
+                {
+                    Error(1775, "Weight of connection %d in %s is out of range for <%s>\n", k, Str, tStr);
+                    break;
+                }
+            }
+            for (k=m->RowStart[j]; k<m->RowStart[j + 1]; k=n)
+            {
+                n = SourceRun(m, k, m->RowStart[j + 1]);
+                AddLink(m->Sources[k], m->Sources[n - 1], j, j);
+            }
+        }
+    }
+}
+
+/* --------------------------------------------------------- */
+unsigned int ConnectNode(unsigned int node)  /* interrupt vector and weights of a node, from the alias statement and its files */
+{
+    ConnectItem  *c;
+    Connectivity *m;
+    unsigned int i;
+    unsigned int k;
+    unsigned int n;
+    unsigned int nv;
+
+    NodeIntVector = Grow(NodeIntVector, &NodeIntVectorSize, NumberOfInterrupts, sizeof(InterruptVector));
+    memcpy(NodeIntVector, IntVector, sizeof(InterruptVector) * (NumberOfInterrupts + 1));
+    nv = NumberOfInterrupts;
+
+    for (i=1; i<=nConnects; i+=1)
+    {
+        c = &Connects[i];
+        m = c->Matrix;
+        if (c->WeightOffset > 0)
+        {
+            memcpy(&ExternalVector[c->WeightOffset], c->WeightBase, sizeof(int) * c->WeightSize);
+        }
+        if (node >= m->nRows)
+        {
+            continue;
+        }
+        for (k=m->RowStart[node]; k<m->RowStart[node + 1]; k=n)
+        {
+            n = SourceRun(m, k, m->RowStart[node + 1]);
+            nv += 1;
+            NodeIntVector = Grow(NodeIntVector, &NodeIntVectorSize, nv, sizeof(InterruptVector));
+            NodeIntVector[nv].iNumber = m->Sources[k];
+            NodeIntVector[nv].iLast   = m->Sources[n - 1];
+            NodeIntVector[nv].iVector = c->Vector;
+        }
+        if (c->WeightOffset > 0)
+        {
+            for (k=m->RowStart[node]; k<m->RowStart[node + 1] && k-m->RowStart[node]<c->WeightSize; k+=1)
+            {
+                ConnectionWeight(m, k, c->WeightType, &ExternalVector[c->WeightOffset + k - m->RowStart[node]]);  /* checked when read */
+            }
+        }
+    }
+    return nv;
+}
+
+/* --------------------------------------------------------- */
+void CloseConnects()
+{
+    unsigned int i;
+
+    for (i=1; i<=nConnects; i+=1)
+    {
+        CloseConnectivity(Connects[i].Matrix);
+        free(Connects[i].WeightBase);
+        memset(&Connects[i], 0, sizeof(ConnectItem));
+    }
+    nConnects = 0;
+}
+
+/* --------------------------------------------------------- */
+void ReadIncbinDirective()  /* #incbin array "file" */
+{
+    unsigned int  Op;
+    unsigned int  p;
+    unsigned int  i;
+    unsigned int  n;
+    NametableItem *a;
+    int           *v;
+    size_t        size;
+    char          Str[MaxStringSize + 1];
+    char          tStr[MaxStringSize + 1];
+
+    a = NULL;
+    v = NULL;
+    Op = ReadSymbol(tStr);  /* array */
+    if (Op == c_VAR)
+    {
+        if ((p = FindGlobal(tStr)) > 0)
+        {
+            a = &Globals[p];
+            v = GlobalVector;
+        }
+        else if ((p = FindExternal(tStr)) > 0)
+        {
+            a = &Externals[p];
+            v = ExternalVector;
+        }
+    }
+    if (a == NULL || a->vDimensions[0] == 0)
+    {
+        Error(1745, "Global or external array expected in INCBIN directive <%s>\n", tStr);
+        return;
+    }
+
+    Op = ReadSymbol(Str);  /* binary file */
+    if (Op != c_STRING)
+    {
+        Error(1750, "String expected in INCBIN directive <%s>\n", Str);
+        return;
+    }
+
+    n = 1;
+    for (i=1; i<=a->vDimensions[0]; i+=1)
+    {
+        n *= a->vDimensions[i];
+    }
+    if (!LoadBinaryArray(Str, &v[a->vOffset], n, a->vType, &size))
+    {
+        Error(1755, "Unable to read binary file %s\n", Str);
+    }
+    else if (size != (size_t) n * 4)
+    {
+        Error(1760, "Binary file %s has %d bytes, <%s> needs %d\n", Str, (int) size, tStr, n * 4);
+    }
+}
+
 /* --------------------------------------------------------- */
 void ReadAliasStatement(RangeListType *nlist)
 {
@@ -3959,7 +4710,6 @@ void ReadAliasStatement(RangeListType *nlist)
     unsigned int  i;
     unsigned int  j;
     unsigned int  k;
-    unsigned int  l;
     bool          logging;
     unsigned int  chn;
     enum VarType  vt;
@@ -3978,6 +4728,17 @@ void ReadAliasStatement(RangeListType *nlist)
     while (1)
     {
         Op = NextSymbol(Str);
+        if (Op == c_CONNECT)
+        {
+            ReadConnectDirective(nlist);
+            continue;
+        }
+        if (Op == c_INCBIN)
+        {
+            ReadSymbol(Str);  /* skip directive */
+            ReadIncbinDirective();
+            continue;
+        }
         if (Op == c_LOG || Op == c_SNAPSHOT)
         {
             chn = 0;
@@ -4147,21 +4908,18 @@ void ReadAliasStatement(RangeListType *nlist)
             p2 = Labels[p1];
             ReadRange(&InterruptRangeList);
             
-            for (i=1; i<=InterruptRangeList.nItems; i+=1)
+            for (i=1; i<=InterruptRangeList.nItems; i+=1)  /* kept as ranges, however many nodes they cover */
             {
-                for (j=InterruptRangeList.Range[i].low; j<=InterruptRangeList.Range[i].high; j+=1)
+                for (k=1; k<=nlist->nItems; k+=1)
                 {
-                    for (k=1; k<=nlist->nItems; k+=1)
-                    {
-                        for (l=nlist->Range[k].low; l<=nlist->Range[k].high; l+=1)
-                        {
-                            Links = AddLink(Links, j, l);
-                        }
-                    }
-                    NumberOfInterrupts += 1;
-                    IntVector[NumberOfInterrupts].iNumber = j;
-                    IntVector[NumberOfInterrupts].iVector = p2;
+                    AddLink(InterruptRangeList.Range[i].low, InterruptRangeList.Range[i].high,
+                            nlist->Range[k].low,             nlist->Range[k].high);
                 }
+                NumberOfInterrupts += 1;
+                IntVector = Grow(IntVector, &IntVectorSize, NumberOfInterrupts, sizeof(InterruptVector));
+                IntVector[NumberOfInterrupts].iNumber = InterruptRangeList.Range[i].low;
+                IntVector[NumberOfInterrupts].iLast   = InterruptRangeList.Range[i].high;
+                IntVector[NumberOfInterrupts].iVector = p2;
             }
         }
         else
@@ -4196,6 +4954,7 @@ unsigned int ReadStatement()
     unsigned int    adjust[MaxDimensions + 1];
     struct NodeInfo *aliasnode;
     enum VarType    vt;
+    unsigned int    end;
 	
     Op = ReadSymbol(Str);
 
@@ -5393,6 +6152,7 @@ unsigned int ReadStatement()
             return c_EOF;
         }
         
+        end = (Op == c_EOF) ? SourceSize : SymbolStart;  /* end of the section of any current prototype */
         if (Op != c_EOF)
         {
             s = ReadSymbol(Str);
@@ -5405,20 +6165,61 @@ unsigned int ReadStatement()
         if (CurrentPrototype != NULL && Errors == 0)
         {
             struct NodeInfo *b;
+            bool            pending = false;
 
-            if (CodeGenerating)
+            if (Optimising && !SectionCached)
             {
-                CodeGenerate(FileBaseName, 
-                             CurrentPrototype, 
-                             Instructions, ProgramSize, 
-                             GlobalVector, gvsize,
-                             ExternalVector, evsize,
-                             Procedures, NumberOfProcedures,
-                             Labels, NumberOfLabels);
-                UpdateMakefile(MakefileStream, FileBaseName, CurrentPrototype);
+                if (!Debugging)  /* keep the code line for line with the source */
+                {
+                    if (Including == 0)
+                    {
+                        PruneUnused(end);
+                    }
+                    if (!CodeGenerating)  /* the ARM code generator lays out its own frames */
+                    {
+                        ProgramSize = InlineProcedures(&Instructions, &InstructionsSize, ProgramSize, 
+                                                       Labels, &NumberOfLabels, MaxLabels - 1, 
+                                                       LineNumbers, FirstLine, LineNumber, 
+                                                       Procedures, NumberOfProcedures);
+                    }
+                    ProgramSize = OptimiseSSA(&Instructions, &InstructionsSize, ProgramSize, 
+                                              Labels, NumberOfLabels, 
+                                              LineNumbers, FirstLine, LineNumber, 
+                                              Procedures, NumberOfProcedures, 
+                                              CodeGenerating);
+                }
+                ProgramSize = Peephole(Instructions, ProgramSize, 
+                                       Labels, NumberOfLabels, 
+                                       LineNumbers, FirstLine, LineNumber, 
+                                       Debugging);
+                PC = ProgramSize + 1;
             }
-            
-            b = CreatePrototype(CurrentPrototype, 
+
+            if (CodeGenerating && !SectionCached)
+            {
+                if (SectionToCache(end))  /* the cache keeps the object, so it is needed now */
+                {
+                    SectionObjectSize = CodeGenerate(FileBaseName, 
+                                                     CurrentPrototype, 
+                                                     Instructions, ProgramSize, 
+                                                     GlobalVector, gvsize,
+                                                     ExternalVector, evsize,
+                                                     Procedures, NumberOfProcedures,
+                                                     Labels, NumberOfLabels);
+                    printf("Node %s: %d bytes\n", CurrentPrototype, SectionObjectSize * 4);
+                }
+                else
+                {
+                    pending = true;  /* generated from the prototype with the others */
+                }
+            }
+            EndSection(end);
+            if (CodeGenerating)
+            {
+                UpdateMakefile(MakefileStream, FileBaseName, CurrentPrototype);
+            }
+            
+            b = CreatePrototype(CurrentPrototype, 
                                 Instructions, ProgramSize, 
                                 GlobalVector, gvsize,
                                 Globals, NumberOfGlobals, 
@@ -5427,6 +6228,13 @@ unsigned int ReadStatement()
                                 Procedures, NumberOfProcedures, 
                                 Labels, NumberOfLabels);
 
+            if (pending)
+            {
+                nPendingCode += 1;
+                PendingCode = Grow(PendingCode, &PendingCodeSize, nPendingCode, sizeof(PendingCodeItem));
+                PendingCode[nPendingCode].Node = b;
+            }
+
             for (i=FirstLine; i<LineNumber; i+=1)
             {
                 LineNumbers[i].pnode = b;
@@ -5442,27 +6250,38 @@ unsigned int ReadStatement()
             ResetNode();
         }
         
-        if (Op == c_NODE && CurrentPrototype == NULL)
+        if (AliasMode)
         {
-            s = strlen(Str) + 1;
-            CurrentPrototype = malloc(s);
-            if (CurrentPrototype == NULL)
+            InterruptVector *intv = IntVector;
+            unsigned int    nintv = NumberOfInterrupts;
+
+            for (k=1; k<=nConnects; k+=1)  /* arrays of weights, as the nodes with fewer connections keep them */
             {
-                Error(119, "Unable to allocate prototype node %s\n", Str);
+                if (Connects[k].WeightOffset > 0)
+                {
+                    s = sizeof(int) * Connects[k].WeightSize;
+                    Connects[k].WeightBase = malloc(s);
+                    if (Connects[k].WeightBase == NULL)
+                    {
+                        Error(135, "Unable to allocate connectivity (%d weights)\n", Connects[k].WeightSize);
+                    }
+                    memcpy(Connects[k].WeightBase, &ExternalVector[Connects[k].WeightOffset], s);
+                }
             }
-            memcpy(CurrentPrototype, Str, s);
-        }
 
-        if (AliasMode)
-        {
             for (i=1; i<=RangeList.nItems; i+=1)
             {
                 for (j=RangeList.Range[i].low; j<=RangeList.Range[i].high; j+=1)
                 {
+                    if (nConnects > 0)
+                    {
+                        nintv = ConnectNode(j);
+                        intv = NodeIntVector;
+                    }
                     CreateNode(j,              RangeList.Name, 
                                GlobalVector,   gvsize, 
                                ExternalVector, evsize,
-                               IntVector,      NumberOfInterrupts);
+                               intv,           nintv);
                     
                     NumberOfNodes += 1;
 
@@ -5496,14 +6315,28 @@ unsigned int ReadStatement()
                             outword(ExternalVector[k], LinkerFileStream);
                         }
 
-                        outword(NumberOfInterrupts, LinkerFileStream);
-                        for (k=1; k<=NumberOfInterrupts; k+=1)
+                        s = 0;
+                        for (k=1; k<=nintv; k+=1)
+                        {
+                            s += intv[k].iLast - intv[k].iNumber + 1;
+                        }
+                        outword(s, LinkerFileStream);  /* the loader wants an entry for each key */
+                        for (k=1; k<=nintv; k+=1)
                         {
                             struct NodeInfo *pn = FindNamedNode(RangeList.Name);
-
-                            p1 = pn->Instructions[IntVector[k].iVector + 1].Arg;
-                            outword(pn->Procedures[p1].Offset, LinkerFileStream);
-                            outword(IntVector[k].iNumber, LinkerFileStream);
+                            unsigned int    key;
+
+                            p1 = pn->Instructions[intv[k].iVector + 1].Arg;
+                            nLinkerFixups += 1;  /* the code may not have been generated yet */
+                            LinkerFixups = Grow(LinkerFixups, &LinkerFixupsSize, nLinkerFixups, sizeof(LinkerFixup));
+                            LinkerFixups[nLinkerFixups].Pos = ftell(LinkerFileStream);
+                            LinkerFixups[nLinkerFixups].Proc = &pn->Procedures[p1];
+                            LinkerFixups[nLinkerFixups].Count = intv[k].iLast - intv[k].iNumber + 1;
+                            for (key=intv[k].iNumber; key<=intv[k].iLast; key+=1)
+                            {
+                                outword(pn->Procedures[p1].Offset, LinkerFileStream);
+                                outword(key, LinkerFileStream);
+                            }
                         }
 
                         outword(NumberOfLogs, LinkerFileStream);
@@ -5566,10 +6399,23 @@ unsigned int ReadStatement()
                 }
             }
 
+            CloseConnects();
             AliasMode = false;
             ResetNode();
         }
         
+        if (Op == c_NODE && CurrentPrototype == NULL)
+        {
+            s = strlen(Str) + 1;
+            CurrentPrototype = malloc(s);
+            if (CurrentPrototype == NULL)
+            {
+                Error(119, "Unable to allocate prototype node %s\n", Str);
+            }
+            memcpy(CurrentPrototype, Str, s);
+            BeginSection();  /* after the alias has reset the tables */
+        }
+
         if (Op == c_ALIAS)
         {
             ReadRange(&RangeList);
@@ -5581,6 +6427,12 @@ unsigned int ReadStatement()
             {
                 Error(124, "Cannot find parent node %s\n", Str);
             }
+            GlobalVector = Grow(GlobalVector, &GlobalVectorSize, aliasnode->GlobalVectorSize, sizeof(int));
+            ExternalVector = Grow(ExternalVector, &ExternalVectorSize, aliasnode->ExternalVectorSize, sizeof(int));
+            Globals = Grow(Globals, &GlobalsSize, aliasnode->NumberOfGlobals, sizeof(NametableItem));
+            Externals = Grow(Externals, &ExternalsSize, aliasnode->NumberOfExternals, sizeof(NametableItem));
+            Procedures = Grow(Procedures, &ProceduresSize, aliasnode->NumberOfProcedures, sizeof(ProcedureItem));
+
             s = sizeof(int) * (aliasnode->GlobalVectorSize + 1);
             memcpy(GlobalVector, aliasnode->G, s);
             gvsize = aliasnode->GlobalVectorSize;
@@ -5600,6 +6452,17 @@ unsigned int ReadStatement()
             s = sizeof(ProcedureItem) * (aliasnode->NumberOfProcedures + 1);
             memcpy(Procedures, aliasnode->Procedures, s);
             NumberOfProcedures = aliasnode->NumberOfProcedures;
+            for (i=0; i<=NumberOfProcedures; i+=1)
+            {
+                LocalTable(i);
+                s = sizeof(NametableItem) * (Procedures[i].nLocals + 1);
+                memcpy(Procedures[i].Args, aliasnode->Procedures[i].Args, s);
+            }
+
+            ClearIndex(&GlobalIndex);  /* name tables replaced */
+            ClearIndex(&ExternalIndex);
+            ClearIndex(&ProcedureIndex);
+            ClearIndex(&LocalIndex);
             
             s = sizeof(int) * (aliasnode->NumberOfLabels + 1);
             memcpy(Labels, aliasnode->Labels, s);
@@ -5613,6 +6476,7 @@ unsigned int ReadStatement()
         break;
 
     case c_TIMESTAMP:
+        SectionCacheable = false;  /* a cached section could not repeat it */
         ReadString(Str, EOL);
         if (SameString(Str, "off"))
         {
@@ -5630,6 +6494,7 @@ unsigned int ReadStatement()
         break;
         
     case c_MONITOR:
+        SectionCacheable = false;
         ReadString(Str, EOL);
         if (SameString(Str, "off"))
         {
@@ -5637,163 +6502,1141 @@ unsigned int ReadStatement()
         }
         else if (SameString(Str, "on"))
         {
-            Monitoring = true;
+            Monitoring = true;
+        }
+        else
+        {
+            Error(1765, "Unknown monitor mode <%s>\n", Str);
+            Monitoring = false;
+        }
+        break;
+
+    case c_INCBIN:
+        SectionCacheable = false;  /* the file is not part of the cache key */
+        ReadIncbinDirective();
+        break;
+
+    case c_INCLUDE:
+        if (ReadSymbol(Str) == c_STRING)
+        {   unsigned int OldLineNumber = LineNumber;
+            LineNumber = 1;
+            //printf("include: %s\n", Str);
+            ReadFile(Str, true);
+            LineNumber = OldLineNumber;
+        }
+        else
+        {
+            Error(1770, "String expected in INCLUDE directive <%s>\n", Str);
+        }
+        break;
+
+    case c_ELSE:
+        break;
+
+    case c_SEMICOLON:  /* empty statement */
+        break;
+        
+    default:
+        Error(1175, "Unrecognised Keyword (%d)\n", Op);
+        return c_ERROR;
+        break;
+    }
+    return Op;
+}
+
+/* --------------------------------------------------------- */
+void ReadRange(RangeListType *rlist)
+{
+    unsigned int Op;
+    unsigned int x1;
+    unsigned int x2;
+    char         Str[MaxStringSize + 1];
+    
+    rlist->nItems = 0;
+    
+    Op = NextSymbol(Str);
+    if (Op != c_NUMBER)
+    {
+        Error(1780, "Number expected in range list <%s>\n", Str);
+    }
+
+    while (Op == c_NUMBER)
+    {
+        ReadSymbol(Str);
+        x1 = atoi(Str);
+        Op = NextSymbol(Str);
+        if (Op == c_MINUS)
+        {
+            ReadSymbol(Str);
+            Op = NextSymbol(Str);
+            if (Op == c_NUMBER)
+            {
+                x2 = atoi(Str);
+                if (x2 < x1)
+                {
+                    Error(1785, "Number too small in range list<%s>\n", Str);
+                }
+                rlist->nItems += 1;
+                if (rlist->nItems > MaxRangeSize)
+                {
+                    Error(1790, "Too many items in range list (%d)\n", MaxRangeSize);
+                }
+                rlist->Range[rlist->nItems].low = x1;
+                rlist->Range[rlist->nItems].high = x2;
+                ReadSymbol(Str);
+                Op = NextSymbol(Str);
+            }
+            else
+            {
+                Error(1795, "Number expected in range list <%s>\n", Str);
+            }
+            if (Op == c_COMMA)
+            {
+                ReadSymbol(Str);
+                Op = NextSymbol(Str);
+            }
+        }
+        else if (Op == c_COMMA)
+        {
+            rlist->nItems += 1;
+            if (rlist->nItems > MaxRangeSize)
+            {
+                Error(1800, "Too many items in range list (%d)\n", MaxRangeSize);
+            }
+            rlist->Range[rlist->nItems].low = x1;
+            rlist->Range[rlist->nItems].high = x1;
+            ReadSymbol(Str);
+            Op = NextSymbol(Str);
+        }
+        else
+        {
+            if (x1 >= 0)
+            {
+                rlist->nItems += 1;
+                if (rlist->nItems > MaxRangeSize)
+                {
+                    Error(1805, "Too many items in range list (%d)\n", MaxRangeSize);
+                }
+                rlist->Range[rlist->nItems].low = x1;
+                rlist->Range[rlist->nItems].high = x1;
+            }
+            break;
+        }
+    }
+}
+
+/* --------------------------------------------------------- */
+SourceItem *NewSource(char Filename[], unsigned int size)  /* room for the text of a source, to be filled in */
+{
+    SourceItem *f;
+
+    f = malloc(sizeof(SourceItem));
+    if (f == NULL)
+    {
+        Error(127, "Unable to read source file %s\n", Filename);
+    }
+    f->Name = malloc(strlen(Filename) + 1);
+    f->Text = malloc(size + 1);
+    if (f->Name == NULL || f->Text == NULL)
+    {
+        Error(127, "Unable to read source file %s\n", Filename);
+    }
+    CopyString(Filename, f->Name);
+    f->Size = 0;
+
+    f->Next = SourceFiles;
+    SourceFiles = f;
+    return f;
+}
+
+/* --------------------------------------------------------- */
+SourceItem *LoadSource(char Filename[])  /* each file is read once per compilation */
+{
+    SourceItem   *f;
+    FILE         *fp;
+    long         size;
+    char         *text;
+    unsigned int n;
+
+    for (f = SourceFiles; f != NULL; f = f->Next)
+    {
+        if (SameString(Filename, f->Name))
+        {
+            return f;
+        }
+    }
+
+    if (InMemory)
+    {
+        text = (Resolver == NULL) ? NULL : Resolver(Filename, &n, ResolverContext);
+        if (text == NULL)
+        {
+            return NULL;
+        }
+        f = NewSource(Filename, n);
+        memcpy(f->Text, text, n);
+        f->Size = n;
+        return f;
+    }
+
+    fp = fopen(Filename, "rb");
+    if (fp == NULL)
+    {
+        return NULL;
+    }
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    if (size < 0)
+    {
+        Error(127, "Unable to read source file %s\n", Filename);
+    }
+
+    f = NewSource(Filename, size);
+    f->Size = fread(f->Text, 1, size, fp);
+    fclose(fp);
+    return f;
+}
+
+/* --------------------------------------------------------- */
+void FreeSources()
+{
+    SourceItem *f;
+
+    while (SourceFiles != NULL)
+    {
+        f = SourceFiles;
+        SourceFiles = f->Next;
+        free(f->Name);
+        free(f->Text);
+        free(f);
+    }
+    Source = NULL;
+    SourceSize = 0;
+    SourcePos = 0;
+}
+
+/* --------------------------------------------------------- */
+bool ReadFile(char Filename[], bool include)
+{
+    unsigned int t;
+    SourceItem   *f;
+    char         *OldSource;
+    unsigned int OldSourceSize;
+    unsigned int OldSourcePos;
+
+    f = LoadSource(Filename);
+    if (f == NULL)
+    {
+        return false;
+    }
+
+    if (include && CurrentPrototype != NULL && !AliasMode)  /* part of the prototype's cache key */
+    {
+        if (nSectionIncludes < MaxSectionIncludes && strlen(Filename) <= MaxStringSize)
+        {
+            nSectionIncludes += 1;
+            CopyString(Filename, SectionIncludes[nSectionIncludes]);
+            SectionIncludeHash[nSectionIncludes] = HashBytes(2166136261u, f->Text, f->Size);
+        }
+        else
+        {
+            SectionCacheable = false;
+        }
+    }
+
+    if (include)
+    {
+        Including += 1;
+    }
+    OldSource = Source;
+    OldSourceSize = SourceSize;
+    OldSourcePos = SourcePos;
+
+    Source = f->Text;
+    SourceSize = f->Size;
+    SourcePos = 0;
+    do
+    {
+        t = (CompileSection > 0 && CurrentPrototype == NULL && !include) ? SkimStatement() : ReadStatement();
+    } while (t != c_EOF);
+
+    Source = OldSource;
+    SourceSize = OldSourceSize;
+    SourcePos = OldSourcePos;
+    if (include)
+    {
+        Including -= 1;
+    }
+
+    return true;
+}
+
+/* --------------------------------------------------------- */
+/* prototype cache
+   the compiled form of each #node section is kept in the cache directory, keyed by the section's text,
+   the #defines in force, the text of any files it includes and the compiler options.
+   an unchanged section is then skipped, its bytecode, tables and generated object taken from the cache */
+
+unsigned int HashBytes(unsigned int h, void *p, unsigned int n)  /* FNV-1a, continuing from h */
+{
+    unsigned char *c = p;
+    unsigned int  i;
+
+    for (i = 0; i < n; i += 1)
+    {
+        h = (h ^ c[i]) * 16777619u;
+    }
+    return h;
+}
+
+/* --------------------------------------------------------- */
+unsigned int SectionContext()
+{
+    unsigned int h = 2166136261u;
+    unsigned int x[10];
+    unsigned int i;
+
+    x[0] = VERSION_MAJOR;
+    x[1] = VERSION_MINOR;
+    x[2] = CodeGenerating;
+    x[3] = BoundsChecking;
+    x[4] = TimeStamping;
+    x[5] = Monitoring;
+    x[6] = Optimising;
+    x[7] = Debugging;  /* lines are kept apart when optimising for the debugger */
+    x[8] = ArithmeticChecking;  /* float multiplies are kept for their overflow checks */
+    x[9] = KeepingGlobals;
+    h = HashBytes(h, x, sizeof(x));
+    h = HashBytes(h, CurrentPrototype, strlen(CurrentPrototype) + 1);
+
+    for (i = 1; i <= NumberOfDefines; i += 1)
+    {
+        h = HashBytes(h, Defines[i].DefName, strlen(Defines[i].DefName) + 1);
+        h = HashBytes(h, &Defines[i].DefValue, sizeof(int));
+        h = HashBytes(h, &Defines[i].DefType, sizeof(enum VarType));
+    }
+    return h;
+}
+
+/* --------------------------------------------------------- */
+void CacheFileName(char fname[], char ext[])
+{
+    char *base;
+
+    base = strrchr(FileBaseName, '/');
+    base = (base == NULL) ? FileBaseName : base + 1;
+    sprintf(fname, "%s/%s_%s.%s", CacheDirectory, base, CurrentPrototype, ext);
+}
+
+/* --------------------------------------------------------- */
+bool SectionEnds(unsigned int pos)  /* the section is followed by #node, #alias or the end of the file */
+{
+    unsigned int n;
+
+    if (pos == SourceSize)
+    {
+        return true;
+    }
+    if (Source[pos] != '#')
+    {
+        return false;
+    }
+    for (n = 0; pos + 1 + n < SourceSize && (CharClass[(unsigned char) Source[pos + 1 + n]] & CH_NAME) != 0; n += 1)
+    {
+    }
+    return (n == 4 && strncmp(&Source[pos + 1], "node", 4) == 0) ||
+           (n == 5 && strncmp(&Source[pos + 1], "alias", 5) == 0);
+}
+
+/* --------------------------------------------------------- */
+unsigned int NextName(unsigned int pos, char Str[])  /* the next name in the source from pos, with the # of a directive */
+{
+    unsigned int n = 0;
+
+    while (pos < SourceSize && (CharClass[(unsigned char) Source[pos]] & CH_LETTER) == 0 &&
+           Source[pos] != '_' && Source[pos] != '#')
+    {
+        if ((CharClass[(unsigned char) Source[pos]] & CH_DIGIT) != 0)  /* not the tail of a number */
+        {
+            while (pos < SourceSize && (CharClass[(unsigned char) Source[pos]] & CH_NAME) != 0)
+            {
+                pos += 1;
+            }
+        }
+        else
+        {
+            pos += 1;
+        }
+    }
+    if (pos < SourceSize && Source[pos] == '#')
+    {
+        Str[n] = '#';
+        n += 1;
+        pos += 1;
+    }
+    while (pos < SourceSize && (CharClass[(unsigned char) Source[pos]] & CH_NAME) != 0)
+    {
+        if (n < MaxStringSize)
+        {
+            Str[n] = Source[pos];
+            n += 1;
+        }
+        pos += 1;
+    }
+    Str[n] = '\0';
+    return pos;
+}
+
+/* --------------------------------------------------------- */
+bool NamedAfter(unsigned int pos, char name[])  /* name, or an include, appears in the source from pos */
+{
+    char Str[MaxStringSize + 1];
+
+    while (pos < SourceSize)
+    {
+        pos = NextName(pos, Str);
+        if (SameString(Str, name) || SameString(Str, "#include"))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* --------------------------------------------------------- */
+bool SectionRoots(unsigned int pos, bool *procs, bool *globals)
+{
+    /* the procedures and globals named after the section, by #alias statements, #log and #snapshot
+       channels and interrupt vectors, are used from outside its code; false if a file is included */
+    char         Str[MaxStringSize + 1];
+    unsigned int p;
+
+    while (pos < SourceSize)
+    {
+        pos = NextName(pos, Str);
+        if (SameString(Str, "#include"))
+        {
+            return false;
+        }
+        if (Str[0] != '\0' && Str[0] != '#')
+        {
+            p = FindGlobal(Str);
+            if (p > 0)
+            {
+                globals[p] = true;
+            }
+            p = FindLocalProcedure(Str);
+            if (p > 0)
+            {
+                procs[p] = true;
+            }
+        }
+    }
+    return true;
+}
+
+/* --------------------------------------------------------- */
+void PruneUnused(unsigned int end)  /* drop the procedures, globals and strings of the section nothing uses */
+{
+    bool         *procs   = calloc(NumberOfProcedures + 1, sizeof(bool));
+    bool         *globals = calloc(NumberOfGlobals + 1, sizeof(bool));
+    char         **names  = malloc((NumberOfGlobals + 1) * sizeof(char *));
+    unsigned int n        = NumberOfGlobals;
+    unsigned int i;
+
+    if (procs == NULL || globals == NULL || names == NULL)
+    {
+        Error(133, "Unable to allocate pruning tables (%d)\n", NumberOfGlobals + 1);
+    }
+
+    if (SectionRoots(end, procs, globals))
+    {
+        if (KeepingGlobals)  /* an ensemble, a branch or the library may name them */
+        {
+            for (i = GLOBALBASE + 1; i <= n; i += 1)
+            {
+                globals[i] = true;
+            }
+        }
+        for (i = 0; i <= n; i += 1)
+        {
+            names[i] = Globals[i].Name;
+        }
+        ProgramSize = PruneSection(Instructions, ProgramSize, Labels, NumberOfLabels,
+                                   LineNumbers, FirstLine, LineNumber,
+                                   Procedures, NumberOfProcedures, procs,
+                                   Globals, &NumberOfGlobals, globals,
+                                   GlobalVector, &gvsize);
+        ClearIndex(&GlobalIndex);
+
+        for (i = GLOBALBASE + 1; i <= n; i += 1)  /* remembered, for the cache */
+        {
+            if (!globals[i])
+            {
+                nPrunedNames += 1;
+                PrunedNames = Grow(PrunedNames, &PrunedNamesSize, nPrunedNames, sizeof(char *));
+                PrunedNames[nPrunedNames] = names[i];
+            }
+        }
+        for (i = 1; i <= NumberOfProcedures; i += 1)
+        {
+            if (!procs[i])
+            {
+                nPrunedNames += 1;
+                PrunedNames = Grow(PrunedNames, &PrunedNamesSize, nPrunedNames, sizeof(char *));
+                PrunedNames[nPrunedNames] = Procedures[i].Name;
+            }
+        }
+    }
+
+    free(procs);
+    free(globals);
+    free(names);
+}
+
+/* --------------------------------------------------------- */
+void PutCacheBlock(void *p, unsigned int n)
+{
+    while (CacheUsed + n > CacheBufferSize)
+    {
+        CacheBufferSize = (CacheBufferSize == 0) ? 65536 : CacheBufferSize * 2;
+        CacheBuffer = realloc(CacheBuffer, CacheBufferSize);
+        if (CacheBuffer == NULL)
+        {
+            Error(128, "Unable to allocate prototype cache buffer (%d)\n", CacheBufferSize);
+        }
+    }
+    memcpy(&CacheBuffer[CacheUsed], p, n);
+    CacheUsed += n;
+}
+
+/* --------------------------------------------------------- */
+void PutCacheWord(unsigned int x)
+{
+    PutCacheBlock(&x, sizeof(unsigned int));
+}
+
+/* --------------------------------------------------------- */
+void PutCacheString(char str[])
+{
+    PutCacheWord(strlen(str) + 1);
+    PutCacheBlock(str, strlen(str) + 1);
+}
+
+/* --------------------------------------------------------- */
+void GetCacheBlock(unsigned char **p, void *d, unsigned int n)
+{
+    memcpy(d, *p, n);
+    *p += n;
+}
+
+/* --------------------------------------------------------- */
+unsigned int GetCacheWord(unsigned char **p)
+{
+    unsigned int x;
+
+    GetCacheBlock(p, &x, sizeof(unsigned int));
+    return x;
+}
+
+/* --------------------------------------------------------- */
+void GetCacheString(unsigned char **p, char str[])
+{
+    unsigned int n = GetCacheWord(p);
+
+    GetCacheBlock(p, str, n);
+}
+
+/* --------------------------------------------------------- */
+void PutCacheNames(NametableItem *t, unsigned int n)  /* items 0..n, names as strings */
+{
+    unsigned int i;
+
+    for (i = 0; i <= n; i += 1)
+    {
+        PutCacheString((t[i].Name != NULL) ? t[i].Name : "");
+        PutCacheWord(t[i].vType);
+        PutCacheWord(t[i].vOffset);
+        PutCacheBlock(t[i].vDimensions, sizeof(t[i].vDimensions));
+    }
+}
+
+/* --------------------------------------------------------- */
+void GetCacheNames(unsigned char **p, NametableItem *t, unsigned int n)
+{
+    char         Str[MaxStringSize + 1];
+    unsigned int i;
+
+    for (i = 0; i <= n; i += 1)
+    {
+        GetCacheString(p, Str);
+        t[i].Name    = InternName(Str);
+        t[i].vType   = GetCacheWord(p);
+        t[i].vOffset = GetCacheWord(p);
+        GetCacheBlock(p, t[i].vDimensions, sizeof(t[i].vDimensions));
+    }
+}
+
+/* --------------------------------------------------------- */
+void BeginSection()  /* a #node name has been read */
+{
+    SectionCached = false;
+    SectionCacheable = (CacheDirectory != NULL) && (Including == 0) && (Errors == 0);
+    if (!SectionCacheable)
+    {
+        return;
+    }
+
+    SectionSource = Source;
+    SectionStart = SourcePos;
+    SectionLine = LineNumber;
+    SectionDefines = NumberOfDefines;
+    SectionKey = SectionContext();
+    nSectionIncludes = 0;
+    nPrunedNames = 0;
+
+    if (ReadCachedSection())
+    {
+        SectionCached = true;
+        SectionCacheable = false;  /* nothing new to write */
+    }
+    if (CacheTemporary && CompileSection == 0)  /* the workers' cache is removed after the compile */
+    {
+        SectionCacheable = false;
+    }
+}
+
+/* --------------------------------------------------------- */
+bool SectionToCache(unsigned int end)  /* the section will be written to the cache when it ends */
+{
+    return SectionCacheable && Source == SectionSource && Including == 0 && Errors == 0 && end >= SectionStart;
+}
+
+/* --------------------------------------------------------- */
+void EndSection(unsigned int end)  /* the section has been compiled, up to source position end */
+{
+    if (SectionToCache(end))
+    {
+        WriteCachedSection(end);
+    }
+    SectionCacheable = false;
+    SectionCached = false;
+
+#ifndef WIN32
+    if (CompileSection > 0)  /* a worker's section is in the cache */
+    {
+        _exit((Errors == 0) ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+#endif
+}
+
+/* --------------------------------------------------------- */
+bool ReadCachedSection()
+{
+    char          fname[2 * MaxStringSize + 20];
+    char          Str[MaxStringSize + 1];
+    FILE          *fp;
+    long          size;
+    unsigned char *data;
+    unsigned char *p;
+    unsigned int  h[6];
+    unsigned int  len;
+    unsigned int  nlines;
+    unsigned int  n;
+    unsigned int  i;
+    SourceItem    *f;
+
+    CacheFileName(fname, "dpc");
+    fp = fopen(fname, "rb");
+    if (fp == NULL)
+    {
+        return false;
+    }
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    if (size < (long) sizeof(h))
+    {
+        fclose(fp);
+        return false;
+    }
+    data = malloc(size);
+    if (data == NULL || fread(data, 1, size, fp) != (size_t) size)
+    {
+        free(data);
+        fclose(fp);
+        return false;
+    }
+    fclose(fp);
+
+    /* header: magic, version, context, section length, section hash, body hash */
+    p = data;
+    GetCacheBlock(&p, h, sizeof(h));
+    len = h[3];
+    if (h[0] != CACHE_MAGIC || h[1] != CACHE_VERSION || h[2] != SectionKey ||
+        len > SourceSize - SectionStart || !SectionEnds(SectionStart + len) ||
+        HashBytes(2166136261u, &Source[SectionStart], len) != h[4] ||
+        HashBytes(2166136261u, p, size - sizeof(h)) != h[5])
+    {
+        free(data);
+        return false;
+    }
+
+    n = GetCacheWord(&p);  /* included files must be unchanged */
+    for (i = 1; i <= n; i += 1)
+    {
+        GetCacheString(&p, Str);
+        f = LoadSource(Str);
+        if (f == NULL || HashBytes(2166136261u, f->Text, f->Size) != GetCacheWord(&p))
+        {
+            free(data);
+            return false;
         }
-        else
+    }
+
+    n = GetCacheWord(&p);  /* nothing dropped from the section may be used after it */
+    for (i = 1; i <= n; i += 1)
+    {
+        GetCacheString(&p, Str);
+        if (NamedAfter(SectionStart + len, Str))
         {
-            Error(1765, "Unknown monitor mode <%s>\n", Str);
-            Monitoring = false;
+            free(data);
+            return false;
         }
-        break;
+    }
 
-    case c_INCLUDE:
-        if (ReadSymbol(Str) == c_STRING)
-        {   unsigned int OldLineNumber = LineNumber;
-            LineNumber = 1;
-            //printf("include: %s\n", Str);
-            ReadFile(Str, true);
-            LineNumber = OldLineNumber;
+    nlines = GetCacheWord(&p);
+    if (SectionLine + nlines > MaxLines)
+    {
+        Error(236, "Too many lines in program (%d)\n", SectionLine + nlines);
+    }
+    LineNumbers = Grow(LineNumbers, &LineNumbersSize, SectionLine + nlines, sizeof(struct LineInfo));
+    for (i = 1; i <= nlines; i += 1)
+    {
+        LineNumbers[SectionLine + i].codeoffset = GetCacheWord(&p);
+    }
+    LineNumber = SectionLine + nlines;
+    SourcePos = SectionStart + len;
+
+    n = GetCacheWord(&p);
+    Defines = Grow(Defines, &DefinesSize, NumberOfDefines + n, sizeof(DefinetableItem));
+    GetCacheBlock(&p, &Defines[NumberOfDefines + 1], sizeof(DefinetableItem) * n);
+    NumberOfDefines += n;
+
+    PC                 = GetCacheWord(&p);
+    ssp                = GetCacheWord(&p);
+    CurrentProcedure   = GetCacheWord(&p);
+    GlobalDeclarations = GetCacheWord(&p);
+    ProgramSize        = GetCacheWord(&p);
+    Instructions       = Grow(Instructions, &InstructionsSize, (PC > ProgramSize) ? PC : ProgramSize, sizeof(Instruction));
+    GetCacheBlock(&p, Instructions, sizeof(Instruction) * (ProgramSize + 1));
+    gvsize             = GetCacheWord(&p);
+    GlobalVector       = Grow(GlobalVector, &GlobalVectorSize, gvsize, sizeof(int));
+    GetCacheBlock(&p, GlobalVector, sizeof(int) * (gvsize + 1));
+    NumberOfGlobals    = GetCacheWord(&p);
+    Globals            = Grow(Globals, &GlobalsSize, NumberOfGlobals, sizeof(NametableItem));
+    GetCacheNames(&p, Globals, NumberOfGlobals);
+    evsize             = GetCacheWord(&p);
+    ExternalVector     = Grow(ExternalVector, &ExternalVectorSize, evsize, sizeof(int));
+    GetCacheBlock(&p, ExternalVector, sizeof(int) * (evsize + 1));
+    NumberOfExternals  = GetCacheWord(&p);
+    Externals          = Grow(Externals, &ExternalsSize, NumberOfExternals, sizeof(NametableItem));
+    GetCacheNames(&p, Externals, NumberOfExternals);
+    NumberOfLabels     = GetCacheWord(&p);
+    GetCacheBlock(&p, Labels, sizeof(unsigned int) * (NumberOfLabels + 1));
+    NumberOfProcedures = GetCacheWord(&p);
+    Procedures         = Grow(Procedures, &ProceduresSize, NumberOfProcedures, sizeof(ProcedureItem));
+    for (i = 0; i <= NumberOfProcedures; i += 1)
+    {
+        GetCacheString(&p, Str);
+        Procedures[i].Name      = InternName(Str);
+        Procedures[i].ProcType  = GetCacheWord(&p);
+        Procedures[i].nArgs     = GetCacheWord(&p);
+        Procedures[i].Label     = GetCacheWord(&p);
+        Procedures[i].BP        = GetCacheWord(&p);
+        Procedures[i].nLocals   = GetCacheWord(&p);
+        LocalTable(i);
+        GetCacheNames(&p, Procedures[i].Args, Procedures[i].nLocals);
+        Procedures[i].Versions  = GetCacheWord(&p);
+        Procedures[i].Offset    = GetCacheWord(&p);
+        Procedures[i].CallCount = 0;
+        Procedures[i].TickCount = 0;
+    }
+
+    if (CodeGenerating)  /* the object generated from this bytecode */
+    {
+        n = GetCacheWord(&p);
+        i = GetCacheWord(&p);
+        sprintf(fname, "%s_%s.o", FileBaseName, CurrentPrototype);
+        fp = fopen(fname, "wb");
+        if (fp == NULL)
+        {
+            Error(120, "Can't open object file %s\n", fname);
+        }
+        fwrite(p, 1, i, fp);
+        fclose(fp);
+        printf("Node %s: %d bytes (unchanged)\n", CurrentPrototype, n * 4);
+    }
+
+    ClearIndex(&GlobalIndex);
+    ClearIndex(&ExternalIndex);
+    ClearIndex(&ProcedureIndex);
+    ClearIndex(&LocalIndex);
+    ClearIndex(&DefineIndex);
+    free(data);
+    return true;
+}
+
+/* --------------------------------------------------------- */
+void WriteCachedSection(unsigned int end)
+{
+    char          fname[2 * MaxStringSize + 20];
+    unsigned char buf[4096];
+    FILE          *fp;
+    long          size;
+    unsigned int  h[6];
+    unsigned int  i;
+    unsigned int  n;
+
+    CacheUsed = 0;
+    PutCacheWord(nSectionIncludes);
+    for (i = 1; i <= nSectionIncludes; i += 1)
+    {
+        PutCacheString(SectionIncludes[i]);
+        PutCacheWord(SectionIncludeHash[i]);
+    }
+
+    PutCacheWord(nPrunedNames);
+    for (i = 1; i <= nPrunedNames; i += 1)
+    {
+        PutCacheString(PrunedNames[i]);
+    }
+
+    PutCacheWord(LineNumber - SectionLine);
+    for (i = SectionLine + 1; i <= LineNumber; i += 1)
+    {
+        PutCacheWord(LineNumbers[i].codeoffset);
+    }
+
+    PutCacheWord(NumberOfDefines - SectionDefines);
+    PutCacheBlock(&Defines[SectionDefines + 1], sizeof(DefinetableItem) * (NumberOfDefines - SectionDefines));
+
+    PutCacheWord(PC);
+    PutCacheWord(ssp);
+    PutCacheWord(CurrentProcedure);
+    PutCacheWord(GlobalDeclarations);
+    PutCacheWord(ProgramSize);
+    PutCacheBlock(Instructions, sizeof(Instruction) * (ProgramSize + 1));
+    PutCacheWord(gvsize);
+    PutCacheBlock(GlobalVector, sizeof(int) * (gvsize + 1));
+    PutCacheWord(NumberOfGlobals);
+    PutCacheNames(Globals, NumberOfGlobals);
+    PutCacheWord(evsize);
+    PutCacheBlock(ExternalVector, sizeof(int) * (evsize + 1));
+    PutCacheWord(NumberOfExternals);
+    PutCacheNames(Externals, NumberOfExternals);
+    PutCacheWord(NumberOfLabels);
+    PutCacheBlock(Labels, sizeof(unsigned int) * (NumberOfLabels + 1));
+    PutCacheWord(NumberOfProcedures);
+    for (i = 0; i <= NumberOfProcedures; i += 1)
+    {
+        n = (Procedures[i].nLocals < MaxLocals) ? Procedures[i].nLocals : 0;  /* entry 0 is not used */
+        Procedures[i].nLocals = n;
+        PutCacheString((Procedures[i].Name != NULL) ? Procedures[i].Name : "");
+        PutCacheWord(Procedures[i].ProcType);
+        PutCacheWord(Procedures[i].nArgs);
+        PutCacheWord(Procedures[i].Label);
+        PutCacheWord(Procedures[i].BP);
+        PutCacheWord(n);
+        PutCacheNames(Procedures[i].Args, n);
+        PutCacheWord(Procedures[i].Versions);
+        PutCacheWord(Procedures[i].Offset);
+    }
+
+    if (CodeGenerating)
+    {
+        sprintf(fname, "%s_%s.o", FileBaseName, CurrentPrototype);
+        fp = fopen(fname, "rb");
+        if (fp == NULL)
+        {
+            return;
         }
-        else
+        fseek(fp, 0, SEEK_END);
+        size = ftell(fp);
+        fseek(fp, 0, SEEK_SET);
+        PutCacheWord(SectionObjectSize);
+        PutCacheWord(size);
+        while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
         {
-            Error(1770, "String expected in INCLUDE directive <%s>\n", Str);
+            PutCacheBlock(buf, n);
         }
-        break;
+        fclose(fp);
+    }
 
-    case c_ELSE:
-        break;
+    h[0] = CACHE_MAGIC;
+    h[1] = CACHE_VERSION;
+    h[2] = SectionKey;
+    h[3] = end - SectionStart;
+    h[4] = HashBytes(2166136261u, &Source[SectionStart], end - SectionStart);
+    h[5] = HashBytes(2166136261u, CacheBuffer, CacheUsed);
 
-    case c_SEMICOLON:  /* empty statement */
-        break;
-        
-    default:
-        Error(1175, "Unrecognised Keyword (%d)\n", Op);
-        return c_ERROR;
-        break;
+    CacheFileName(fname, "dpc");
+    fp = fopen(fname, "wb");
+    if (fp == NULL)
+    {
+        return;  /* the cache is only an optimisation */
     }
-    return Op;
+    fwrite(h, sizeof(h), 1, fp);
+    fwrite(CacheBuffer, 1, CacheUsed, fp);
+    fclose(fp);
 }
 
 /* --------------------------------------------------------- */
-void ReadRange(RangeListType *rlist)
+/* parallel front end
+   with -j n, each #node section of the source file is compiled into the prototype cache by a forked worker,
+   in a directory of its own if no -cache is given. a worker passes over the source ahead of its section,
+   taking only the directives that set the context, compiles its section and exits.
+   the source is then compiled in order, as before, with each section taken from the cache; a section
+   a worker could not compile in the same context misses and is compiled again in its place.
+   with -c and no -cache, the sections are compiled in order and only their code generation is shared */
+
+void CompileSections(char FileName[])
 {
-    unsigned int Op;
-    unsigned int x1;
-    unsigned int x2;
+#ifndef WIN32
+    SourceItem   *f = LoadSource(FileName);
+    char         *OldSource = Source;
+    unsigned int OldSourceSize = SourceSize;
     char         Str[MaxStringSize + 1];
-    
-    rlist->nItems = 0;
-    
-    Op = NextSymbol(Str);
-    if (Op != c_NUMBER)
+    unsigned int n = 0;
+    unsigned int pos = 0;
+    unsigned int k;
+    unsigned int active;
+    int          pid;
+    int          status;
+
+    if (f == NULL)
     {
-        Error(1780, "Number expected in range list <%s>\n", Str);
+        return;
+    }
+    Source = f->Text;  /* count the sections, and any in comments */
+    SourceSize = f->Size;
+    while (pos < SourceSize)
+    {
+        pos = NextName(pos, Str);
+        if (SameString(Str, "#node"))
+        {
+            n += 1;
+        }
+    }
+    Source = OldSource;
+    SourceSize = OldSourceSize;
+    if (n < 2)
+    {
+        return;
     }
 
-    while (Op == c_NUMBER)
+    if (CacheDirectory == NULL)
     {
-        ReadSymbol(Str);
-        x1 = atoi(Str);
-        Op = NextSymbol(Str);
-        if (Op == c_MINUS)
+        sprintf(TemporaryCache, "%s/damson%d", P_tmpdir, (int) getpid());
+        if (mkdir(TemporaryCache, 0700) != 0)
         {
-            ReadSymbol(Str);
-            Op = NextSymbol(Str);
-            if (Op == c_NUMBER)
-            {
-                x2 = atoi(Str);
-                if (x2 < x1)
-                {
-                    Error(1785, "Number too small in range list<%s>\n", Str);
-                }
-                rlist->nItems += 1;
-                if (rlist->nItems > MaxRangeSize)
-                {
-                    Error(1790, "Too many items in range list (%d)\n", MaxRangeSize);
-                }
-                rlist->Range[rlist->nItems].low = x1;
-                rlist->Range[rlist->nItems].high = x2;
-                ReadSymbol(Str);
-                Op = NextSymbol(Str);
-            }
-            else
+            return;
+        }
+        CacheDirectory = TemporaryCache;
+        CacheTemporary = true;
+    }
+
+    active = 0;
+    k = 1;
+    while (k <= n || active > 0)
+    {
+        if (k <= n && active < CompileJobs)
+        {
+            fflush(NULL);  /* otherwise buffered output is duplicated in the worker */
+            pid = fork();
+            if (pid < 0)
             {
-                Error(1795, "Number expected in range list <%s>\n", Str);
+                Error(134, "Unable to start compile worker for section %d\n", k);
             }
-            if (Op == c_COMMA)
+            if (pid == 0)
             {
-                ReadSymbol(Str);
-                Op = NextSymbol(Str);
+                CompileSection = k;
+                SectionsSeen = 0;
+                if (freopen("/dev/null", "w", stdout) == NULL)  /* errors are reported when the section is compiled again */
+                {
+                    _exit(EXIT_FAILURE);
+                }
+                return;
             }
+            k += 1;
+            active += 1;
+            continue;
         }
-        else if (Op == c_COMMA)
+
+        if (wait(&status) < 0)
         {
-            rlist->nItems += 1;
-            if (rlist->nItems > MaxRangeSize)
+            break;
+        }
+        active -= 1;
+    }
+#endif
+}
+
+/* --------------------------------------------------------- */
+void RemoveTemporaryCache()
+{
+#ifndef WIN32
+    char          fname[2 * MaxStringSize + 80];
+    DIR           *d;
+    struct dirent *e;
+
+    if (!CacheTemporary || CompileSection > 0)
+    {
+        return;
+    }
+    d = opendir(CacheDirectory);
+    if (d != NULL)
+    {
+        while ((e = readdir(d)) != NULL)
+        {
+            if (strcmp(e->d_name, ".") != 0 && strcmp(e->d_name, "..") != 0)
             {
-                Error(1800, "Too many items in range list (%d)\n", MaxRangeSize);
+                sprintf(fname, "%s/%.*s", CacheDirectory, MaxStringSize, e->d_name);
+                remove(fname);
             }
-            rlist->Range[rlist->nItems].low = x1;
-            rlist->Range[rlist->nItems].high = x1;
-            ReadSymbol(Str);
-            Op = NextSymbol(Str);
         }
-        else
-        {
-            if (x1 >= 0)
+        closedir(d);
+    }
+    rmdir(CacheDirectory);
+    CacheDirectory = NULL;
+    CacheTemporary = false;
+#endif
+}
+
+/* --------------------------------------------------------- */
+unsigned int SkimStatement()  /* a worker passes over the source ahead of its section */
+{
+    char         Str[MaxStringSize + 1];
+    unsigned int Op = NextSymbol(Str);
+
+    switch (Op)
+    {
+        case c_NODE:
+            SectionsSeen += 1;
+            if (SectionsSeen == CompileSection)
             {
-                rlist->nItems += 1;
-                if (rlist->nItems > MaxRangeSize)
-                {
-                    Error(1805, "Too many items in range list (%d)\n", MaxRangeSize);
-                }
-                rlist->Range[rlist->nItems].low = x1;
-                rlist->Range[rlist->nItems].high = x1;
+                return ReadStatement();
             }
             break;
-        }
+
+        case c_DEFINE:  /* the context of the sections that follow */
+        case c_TIMESTAMP:
+        case c_MONITOR:
+        case c_INCLUDE:
+            return ReadStatement();
     }
+    ReadSymbol(Str);
+    return Op;
 }
 
 /* --------------------------------------------------------- */
-bool ReadFile(char Filename[], bool include)
+/* parallel code generation
+   the ARM code of a section that is not going to the cache is generated from its prototype once the
+   whole source has been read, with -j n on n threads, each taking the next prototype waiting. the
+   interrupt vectors already in the linker file are then filled in with the offsets of their procedures */
+
+void GenerateCode()
 {
-    unsigned int t;
-    FILE         *OldFileStream;
+    unsigned int i;
+    unsigned int k;
+    unsigned int n = 0;
+#ifndef WIN32
+    pthread_t    *workers = NULL;
+#endif
 
-    if (include)
+    NextPendingCode = 1;
+#ifndef WIN32
+    if (CompileJobs > 1 && nPendingCode > 1)
     {
-        Including += 1;
+        workers = malloc(sizeof(pthread_t) * CompileJobs);
+        while (workers != NULL && n < CompileJobs - 1 && n < nPendingCode - 1)
+        {
+            if (pthread_create(&workers[n], NULL, CodeWorker, NULL) != 0)
+            {
+                break;  /* this thread generates the rest */
+            }
+            n += 1;
+        }
     }
-    OldFileStream = FileStream;
-    
-    FileStream = fopen(Filename, "r");
-    if (FileStream == NULL)
+#endif
+    CodeWorker(NULL);  /* this thread takes its share too */
+#ifndef WIN32
+    for (i=0; i<n; i+=1)
     {
-        return false;
+        pthread_join(workers[i], NULL);
     }
-    else
+    free(workers);
+#endif
+
+    for (i=1; i<=nPendingCode; i+=1)
     {
-        do
+        printf("Node %s: %d bytes\n", PendingCode[i].Node->NodeName, PendingCode[i].Size * 4);
+    }
+    for (i=1; i<=nLinkerFixups; i+=1)
+    {
+        for (k=0; k<LinkerFixups[i].Count; k+=1)
         {
-            t = ReadStatement();
-        } while (t != c_EOF);
+            fseek(LinkerFileStream, LinkerFixups[i].Pos + 8 * k, SEEK_SET);
+            outword(LinkerFixups[i].Proc->Offset, LinkerFileStream);
+        }
     }
+    fseek(LinkerFileStream, 0, SEEK_END);
 
-    fclose(FileStream);
-    FileStream = OldFileStream;
-    if (include)
+    free(PendingCode);
+    PendingCode = NULL;
+    PendingCodeSize = 0;
+    nPendingCode = 0;
+    free(LinkerFixups);
+    LinkerFixups = NULL;
+    LinkerFixupsSize = 0;
+    nLinkerFixups = 0;
+}
+
+/* --------------------------------------------------------- */
+void *CodeWorker(void *arg)  /* generates prototypes until none are left waiting */
+{
+    struct NodeInfo *b;
+    unsigned int    i;
+
+    while (1)
     {
-        Including -= 1;
+#ifndef WIN32
+        pthread_mutex_lock(&PendingCodeLock);
+#endif
+        i = NextPendingCode;
+        NextPendingCode += 1;
+#ifndef WIN32
+        pthread_mutex_unlock(&PendingCodeLock);
+#endif
+        if (i > nPendingCode)
+        {
+            return NULL;
+        }
+        b = PendingCode[i].Node;
+        PendingCode[i].Size = CodeGenerate(FileBaseName, 
+                                           b->NodeName, 
+                                           b->Instructions, b->ProgramSize, 
+                                           b->G, b->GlobalVectorSize,
+                                           b->E, b->ExternalVectorSize,
+                                           b->Procedures, b->NumberOfProcedures,
+                                           b->Labels, b->NumberOfLabels);
     }
-
-    return true;
 }
 
 /* --------------------------------------------------------- */
 bool Compile(char FileName[], bool codegen, bool dis, bool debug, bool bcheck)
 {
-    unsigned int i;
     char         LinkerFileName[MaxStringSize];
     bool         result;
     unsigned     s;
@@ -5803,29 +7646,45 @@ bool Compile(char FileName[], bool codegen, bool dis, bool debug, bool bcheck)
     Node               = 0;
     NumberOfNodes      = 0;
     Monitoring         = false;
-    Links              = NULL;
+    FreeLinks();
     LineNumber         = 1;
     FirstLine          = 1;
     NumberOfDefines    = 0;  /* global to a module */
+    ClearIndex(&DefineIndex);
     NumberOfPrototypes = 0;
     CurrentPrototype   = NULL;
     AliasMode          = false;
     Including          = 0;
+    SectionCacheable   = false;
+    SectionCached      = false;
     NumberOfLogs       = 0;
-	LogFiles           = !(codegen | dis);
+	LogFiles           = !(codegen | dis) && ImageFile == NULL && !InMemory;  /* an image opens the log files when it is run */
 	
-    for (i=1; i<=MaxLines; i+=1)
-    {
-        LineNumbers[i].pnode = NULL;
-    }
+    FreeTables();  /* grown as the source is read */
+    LineNumbers = Grow(LineNumbers, &LineNumbersSize, LineNumber, sizeof(struct LineInfo));
 
     CodeGenerating = codegen;
     DisAssembling = dis;
     BoundsChecking = bcheck;
+    Debugging = debug;
 
+    InitCharClass();
     SetFileBaseName(FileName, FileBaseName);
+
+    if (CacheDirectory != NULL)
+    {
+#ifdef WIN32
+        _mkdir(CacheDirectory);
+#else
+        mkdir(CacheDirectory, 0777);  /* may already exist */
+#endif
+    }
+    if (CompileJobs > 1 && !(CodeGenerating && CacheDirectory == NULL))  /* otherwise the code generator threads share the work */
+    {
+        CompileSections(FileName);  /* returns in each worker too */
+    }
     
-    if (CodeGenerating)
+    if (CodeGenerating && CompileSection == 0)
     {
         GetFileName(FileName, LinkerFileName, "ldr");
         LinkerFileStream = fopen(LinkerFileName, "wb");
@@ -5843,8 +7702,18 @@ bool Compile(char FileName[], bool codegen, bool dis, bool debug, bool bcheck)
     
     ResetNode();
     
-    GenCode2(s_JUMP, 0);
     result = ReadFile(FileName, false);
+#ifndef WIN32
+    if (CompileSection > 0)  /* the worker's section was not compiled */
+    {
+        _exit(EXIT_FAILURE);
+    }
+#endif
+    RemoveTemporaryCache();
+    FreeSources();
+    free(CacheBuffer);
+    CacheBuffer = NULL;
+    CacheBufferSize = 0;
 
     s = sizeof(struct LineInfo) * (LineNumber + 1);
     LineNumberList = malloc(s);
@@ -5854,9 +7723,11 @@ bool Compile(char FileName[], bool codegen, bool dis, bool debug, bool bcheck)
     }
     memcpy(LineNumberList, LineNumbers, s);
     NumberOfLines = LineNumber;
+    FreeTables();
 
     if (CodeGenerating)
     {
+        GenerateCode();
         outword(0, LinkerFileStream);
         fclose(LinkerFileStream);
         WriteMakefile(MakefileStream, FileName);
@@ -5865,6 +7736,57 @@ bool Compile(char FileName[], bool codegen, bool dis, bool debug, bool bcheck)
     return result;
 }
 
+/* --------------------------------------------------------- */
+/* compilation from memory
+   the source is given as text and an include is asked of the caller's resolver. nothing is written - no linker
+   file, makefile, ELF objects, cache or log files - and no workers are started; the model is left in the
+   emulator's tables, as after Compile. a fatal error returns false rather than ending the process */
+
+bool CompileSource(char Name[], char Text[], unsigned int Size, IncludeResolver r, void *Context, bool debug, bool bcheck)
+{
+    jmp_buf      fatal;
+    char         *cache = CacheDirectory;
+    unsigned int jobs = CompileJobs;
+    bool         keeping = KeepingGlobals;
+    bool         result;
+    SourceItem   *f;
+
+    InMemory        = true;
+    Resolver        = r;
+    ResolverContext = Context;
+    CacheDirectory  = NULL;
+    CompileJobs     = 1;
+    KeepingGlobals  = true;  /* the host may look any of them up */
+
+    if (setjmp(fatal) == 0)
+    {
+        FatalErrorPoint = &fatal;
+        f = NewSource(Name, Size);
+        memcpy(f->Text, Text, Size);
+        f->Size = Size;
+        result = Compile(Name, false, false, debug, bcheck) && Errors == 0;
+    }
+    else
+    {
+        CloseConnects();  /* left part way through */
+        FreeSources();
+        FreeTables();
+        AliasMode = false;
+        Including = 0;
+        Errors += 1;
+        result = false;
+    }
+
+    FatalErrorPoint = NULL;
+    InMemory        = false;
+    Resolver        = NULL;
+    ResolverContext = NULL;
+    CacheDirectory  = cache;
+    CompileJobs     = jobs;
+    KeepingGlobals  = keeping;
+    return result;
+}
+
 /* --------------------------------------------------------- */
 void ResetNode()
 {    
@@ -5881,16 +7803,37 @@ void ResetNode()
     NumberOfProcedures = 0;
     NumberOfLabels     = 0;
     NumberOfInterrupts = 0;
+    IntVector          = Grow(IntVector, &IntVectorSize, 0, sizeof(InterruptVector));
     NumberOfExternals  = 0;
     evsize             = 0;
     externmode         = false;
     GlobalDeclarations = true;
     NumberOfLogs       = 0;
 
-    for (i=1; i<=MaxProcedures; i+=1)
+    Instructions   = Grow(Instructions, &InstructionsSize, PC, sizeof(Instruction));  /* the prototype copies from item 0 */
+    Globals        = Grow(Globals, &GlobalsSize, NumberOfGlobals, sizeof(NametableItem));
+    GlobalVector   = Grow(GlobalVector, &GlobalVectorSize, gvsize, sizeof(int));
+    Externals      = Grow(Externals, &ExternalsSize, NumberOfExternals, sizeof(NametableItem));
+    ExternalVector = Grow(ExternalVector, &ExternalVectorSize, evsize, sizeof(int));
+    Procedures     = Grow(Procedures, &ProceduresSize, NumberOfProcedures, sizeof(ProcedureItem));
+    LocalTable(0);
+
+    for (i=0; i<=GLOBALBASE; i+=1)  /* reserved */
+    {
+        Globals[i].Name = InternName("");
+    }
+    for (i=1; i<ProceduresSize; i+=1)
     {
         Procedures[i].nLocals = 0;
     }
+
+    ClearIndex(&GlobalIndex);
+    ClearIndex(&ExternalIndex);
+    ClearIndex(&ProcedureIndex);
+    ClearIndex(&LocalIndex);
+
+    ssp = 0;  /* each section starts alike, whatever was compiled before it */
+    GenCode2(s_JUMP, 0);  /* to main, once it is declared */
 }
 
 /* --------------------------------------------------------- */
@@ -5917,7 +7860,7 @@ char* FindLocalName(unsigned int pc, unsigned int p)
             return (char *) Procedures[pnum].Args[i].Name;
         }
     }
-    return NULL;
+    return "";  /* a temporary of the optimiser */
 }
 
 /* --------------------------------------------------------- */
@@ -6345,62 +8288,48 @@ void DisAssemble()
 }
 
 /* --------------------------------------------------------- */
-struct tnode *AddLink(struct tnode *p, unsigned int s, unsigned int d)
+void AddLink(unsigned int slow, unsigned int shigh, unsigned int dlow, unsigned int dhigh)
 {
-    if (p == NULL)
+    LinkItem *p;
+
+    if (NumberOfLinks > 0)  /* links given one at a time are gathered into ranges again */
     {
-        p = (struct tnode *) malloc(sizeof(struct tnode));
-        if (p == NULL)
+        p = &Links[NumberOfLinks];
+        if (p->slow == slow && p->shigh == shigh && p->dhigh + 1 == dlow)
         {
-            Error(121, "Addlink: out of memory\n");
+            p->dhigh = dhigh;
+            return;
         }
-        p->node                   = s;
-        p->ndest                  = 1;
-        p->destinations[p->ndest] = d;
-        p->left                   = NULL;
-        p->right                  = NULL;
-    }
-    else if (s < p->node)
-    {
-        p->left = AddLink(p->left, s, d);
-    }
-    else if (s > p->node)
-    {
-        p->right = AddLink(p->right, s, d);
-    }
-    else
-    {
-        p->ndest += 1;
-        if (p->ndest > MaxLinks)
+        if (p->dlow == dlow && p->dhigh == dhigh && p->shigh + 1 == slow)
         {
-            Error(122, "Addlink: Too many connections specified (%d)\n", MaxLinks);
+            p->shigh = shigh;
+            return;
         }
-        p->destinations[p->ndest] = d;
     }
-    return p;
+
+    NumberOfLinks += 1;
+    Links = Grow(Links, &LinksSize, NumberOfLinks, sizeof(LinkItem));
+    p = &Links[NumberOfLinks];
+    p->slow  = slow;
+    p->shigh = shigh;
+    p->dlow  = dlow;
+    p->dhigh = dhigh;
 }
 
 /* --------------------------------------------------------- */
-void FreeLinks(struct tnode *p)
+void FreeLinks()
 {
-    if (p != NULL)
-    {
-        if (p->left != NULL)
-        {
-            FreeLinks(p->left);
-        }
-        if (p->right != NULL)
-        {
-            FreeLinks(p->right);
-        }
-        free(p);
-    }
+    free(Links);
+    Links         = NULL;
+    LinksSize     = 0;
+    NumberOfLinks = 0;
 }
 
 /* --------------------------------------------------------- */
 void Shutdown()
 {
-    FreeLinks(Links);
+    FreeLinks();
+    RemoveTemporaryCache();
 }
 
 /* --------------------------------------------------------- */
@@ -5,6 +5,7 @@
 #define COMPILER
 
 #include <stdbool.h>
+#include <setjmp.h>
 
 #define VERSION_MAJOR   5
 #define VERSION_MINOR   5
@@ -84,7 +85,6 @@
 #define MaxNodes       1500
 #define MaxLabels      1000
 #define StackSize      10000
-#define MaxLinks       10001
 #define MaxLines       150000
 
 #define GLOBALBASE     50  /* moved from compiler.c */
@@ -100,7 +100,7 @@ typedef struct
 
 typedef struct
 {
-    char          Name[MaxStringSize + 1];
+    char          *Name;                    /* interned */
     enum VarType  vType;
     unsigned int  vOffset;
     unsigned int  vDimensions[MaxDimensions+1];
@@ -108,13 +108,13 @@ typedef struct
 
 typedef struct
 {
-    char          Name[MaxStringSize + 1];  /* name of the procedure */
+    char          *Name;                    /* name of the procedure (interned) */
     unsigned int  ProcType;                 /* type of the procedure */
     unsigned int  nArgs;                    /* number of parameters of the procedure */
     unsigned int  Label;                    /* start address of the procedure */
     unsigned int  BP;                       /* base pointer */
     unsigned      nLocals;                  /* number of args + local variables */
-    NametableItem Args [MaxLocals];         /* list args + local variables */
+    NametableItem *Args;                    /* list args + local variables, items 0..nLocals */
     unsigned int  Versions;                 /* 0=prototype, 1=implementation, >1=error */
     unsigned int  Offset;                   /* Arm offset - need for ELF builder */
     unsigned int  CallCount;                /* profiler calls */
@@ -123,18 +123,20 @@ typedef struct
 
 typedef struct
 {
-    unsigned int  iNumber;
+    unsigned int  iNumber;                  /* keys iNumber..iLast */
+    unsigned int  iLast;
     unsigned int  iVector;
 } InterruptVector;
 
-struct tnode
+typedef struct
 {
-    unsigned int node;
-    unsigned int destinations[MaxLinks + 1];
-    unsigned int ndest;
-    struct tnode *left;
-    struct tnode *right;
-};
+    unsigned int  slow;                     /* sources slow..shigh are linked */
+    unsigned int  shigh;
+    unsigned int  dlow;                     /* to destinations dlow..dhigh */
+    unsigned int  dhigh;
+} LinkItem;
+
+typedef char *(*IncludeResolver)(char Filename[], unsigned int *Size, void *Context);  /* text of an include, or NULL */
 
 struct LineInfo
 {
@@ -145,15 +147,28 @@ struct LineInfo
 extern enum TimeStampMode TimeStamping;
 extern bool               Monitoring;
 extern unsigned int       NumberOfNodes;
-extern struct tnode       *Links;
+extern LinkItem           *Links;
+extern unsigned int       NumberOfLinks;
 extern unsigned int       Errors;
 extern unsigned int       NumberOfLines;
 extern struct LineInfo    *LineNumberList;
 extern char               FileBaseName[MaxStringSize];
 extern bool               LogFiles;
+extern char               *CacheDirectory;
+extern unsigned int       CompileJobs;
+extern bool               Optimising;
+extern bool               KeepingGlobals;
+extern jmp_buf            *FatalErrorPoint;
 
 extern bool Compile(char Filename[], bool CodeGenerating, bool DisAssembling, bool Debugging, bool BoundsChecking);
+extern bool CompileSource(char Name[], char Text[], unsigned int Size, IncludeResolver Resolver, void *Context,
+                          bool Debugging, bool BoundsChecking);
+extern void AddLink(unsigned int slow, unsigned int shigh, unsigned int dlow, unsigned int dhigh);
+extern void FreeLinks();
 extern void Shutdown();
 extern void Error(unsigned int code, char *fmt, ...);
+extern void *Grow(void *a, unsigned int *size, unsigned int n, unsigned int itemsize);
+extern char *InternName(char v[]);
+extern char *InternedName(char v[]);
 
 #endif
@@ -0,0 +1,328 @@
+/* DAMSON connectivity and binary data import
+   a #connect directive in an alias section reads the connections of its nodes from a binary file
+   rather than the source text. the file is a sequence of little-endian words, as for #incbin:
+
+     magic     "DCSR" (0x52534344) or "DCOO" (0x4F4F4344)
+     flags     bit 0 - a weight for each connection, bit 1 - the weights are IEEE single precision
+     rows      destination nodes 0..rows-1
+     n         number of connections
+     DCSR:     rows+1 offsets, then the n source nodes, the connections of node d being offsets[d]..offsets[d+1]-1
+     DCOO:     the n destination nodes, then the n source nodes
+     weights   n words, if flag 0 is set
+
+   a CSR file is used in place, mapped, on a little-endian machine and converted on others; the connections of a
+   COO file are gathered into rows, keeping their order
+
+   an #incbin directive fills a global or external array from a raw file of little-endian words, 32-bit integers
+   for an int array and IEEE single precision for a float array, the file holding exactly the elements of the array
+*/
+
+#ifndef WIN32
+#define _XOPEN_SOURCE 500
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#ifndef WIN32
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "compiler.h"
+#include "connect.h"
+
+#define CSR_MAGIC       0x52534344  /* "DCSR" */
+#define COO_MAGIC       0x4F4F4344  /* "DCOO" */
+#define CONNECT_WEIGHTS 1
+#define CONNECT_FLOATS  2
+
+unsigned int LittleEndianWord(unsigned char *w);
+void         *MapConnectivity(char Filename[], size_t *size);
+void         UnmapConnectivity(void *p, size_t size);
+bool         GatherRows(Connectivity *c, unsigned int *dst, unsigned int *src, unsigned int *wgt);
+
+/* --------------------------------------------------------- */
+unsigned int LittleEndianWord(unsigned char *w)
+{
+    return w[0] | (w[1] << 8) | (w[2] << 16) | ((unsigned int) w[3] << 24);
+}
+
+/* --------------------------------------------------------- */
+void *MapConnectivity(char Filename[], size_t *size)
+{
+    void        *p;
+#ifndef WIN32
+    int         fd;
+    struct stat st;
+
+    fd = open(Filename, O_RDONLY);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        return NULL;
+    }
+    *size = (size_t) st.st_size;
+    p = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    return (p == MAP_FAILED) ? NULL : p;
+#else
+    FILE        *f;
+    long        n;
+
+    f = fopen(Filename, "rb");
+    if (f == NULL)
+    {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    n = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    p = (n > 0) ? malloc(n) : NULL;
+    if (p != NULL && fread(p, 1, n, f) != (size_t) n)
+    {
+        free(p);
+        p = NULL;
+    }
+    fclose(f);
+    *size = (size_t) n;
+    return p;
+#endif
+}
+
+/* --------------------------------------------------------- */
+void UnmapConnectivity(void *p, size_t size)
+{
+#ifndef WIN32
+    munmap(p, size);
+#else
+    free(p);
+#endif
+}
+
+/* --------------------------------------------------------- */
+bool GatherRows(Connectivity *c, unsigned int *dst, unsigned int *src, unsigned int *wgt)  /* counting sort by destination */
+{
+    unsigned int *next;
+    unsigned int d;
+    unsigned int i;
+    unsigned int k;
+
+    c->Rows = malloc(sizeof(unsigned int) * ((size_t) c->nRows + 1 + 2 * (size_t) c->nConnections));
+    next = malloc(sizeof(unsigned int) * ((size_t) c->nRows + 1));
+    if (c->Rows == NULL || next == NULL)
+    {
+        Error(135, "Unable to allocate connectivity (%d connections)\n", c->nConnections);
+    }
+    c->RowStart = c->Rows;
+    c->Sources = &c->Rows[c->nRows + 1];
+    c->Weights = (wgt != NULL) ? &c->Rows[c->nRows + 1 + c->nConnections] : NULL;
+
+    memset(c->RowStart, 0, sizeof(unsigned int) * (c->nRows + 1));
+    for (i=0; i<c->nConnections; i+=1)
+    {
+        if (dst[i] >= c->nRows)
+        {
+            free(next);
+            return false;
+        }
+        c->RowStart[dst[i] + 1] += 1;
+    }
+    for (d=0; d<c->nRows; d+=1)
+    {
+        c->RowStart[d + 1] += c->RowStart[d];
+        next[d] = c->RowStart[d];
+    }
+    for (i=0; i<c->nConnections; i+=1)
+    {
+        k = next[dst[i]];
+        next[dst[i]] += 1;
+        c->Sources[k] = src[i];
+        if (wgt != NULL)
+        {
+            c->Weights[k] = wgt[i];
+        }
+    }
+    free(next);
+    return true;
+}
+
+/* --------------------------------------------------------- */
+Connectivity *OpenConnectivity(char Filename[])
+{
+    Connectivity *c;
+    unsigned int *w;
+    unsigned int flags;
+    unsigned int one = 1;
+    size_t       words;
+    size_t       need;
+    size_t       j;
+    unsigned int i;
+    bool         ok;
+
+    c = calloc(1, sizeof(Connectivity));
+    if (c == NULL)
+    {
+        Error(135, "Unable to allocate connectivity %s\n", Filename);
+    }
+    c->Map = MapConnectivity(Filename, &c->MapSize);
+    if (c->Map == NULL)
+    {
+        Error(135, "Unable to read connectivity file %s\n", Filename);
+    }
+
+    w = (unsigned int *) c->Map;
+    words = c->MapSize / sizeof(unsigned int);
+    if (*(unsigned char *) &one != 1)  /* a big-endian machine */
+    {
+        c->Words = malloc(sizeof(unsigned int) * (words + 1));
+        if (c->Words == NULL)
+        {
+            Error(135, "Unable to allocate connectivity %s\n", Filename);
+        }
+        for (j=0; j<words; j+=1)
+        {
+            c->Words[j] = LittleEndianWord(&((unsigned char *) c->Map)[j * 4]);
+        }
+        w = c->Words;
+    }
+    ok = words >= 4 && (w[0] == CSR_MAGIC || w[0] == COO_MAGIC) && (w[1] & ~(CONNECT_WEIGHTS | CONNECT_FLOATS)) == 0;
+    if (ok)
+    {
+        flags           = w[1];
+        c->nRows        = w[2];
+        c->nConnections = w[3];
+        c->FloatWeights = (flags & CONNECT_FLOATS) != 0;
+        need = 4 + (size_t) c->nConnections * (((flags & CONNECT_WEIGHTS) != 0) ? 2 : 1);
+        need += (w[0] == CSR_MAGIC) ? (size_t) c->nRows + 1 : (size_t) c->nConnections;
+        ok = words == need && c->MapSize % sizeof(unsigned int) == 0;
+    }
+    if (ok && w[0] == CSR_MAGIC)
+    {
+        c->RowStart = &w[4];
+        c->Sources  = &w[4 + c->nRows + 1];
+        c->Weights  = ((flags & CONNECT_WEIGHTS) != 0) ? &w[4 + c->nRows + 1 + c->nConnections] : NULL;
+        ok = c->RowStart[0] == 0 && c->RowStart[c->nRows] == c->nConnections;
+        for (i=0; ok && i<c->nRows; i+=1)
+        {
+            ok = c->RowStart[i] <= c->RowStart[i + 1];
+        }
+    }
+    else if (ok)
+    {
+        ok = GatherRows(c, &w[4], &w[4 + c->nConnections], 
+                        ((flags & CONNECT_WEIGHTS) != 0) ? &w[4 + 2 * c->nConnections] : NULL);
+    }
+    if (!ok)
+    {
+        Error(136, "Connectivity file %s is not a DAMSON CSR or COO file\n", Filename);
+    }
+    return c;
+}
+
+/* --------------------------------------------------------- */
+void CloseConnectivity(Connectivity *c)
+{
+    if (c != NULL)
+    {
+        UnmapConnectivity(c->Map, c->MapSize);
+        free(c->Words);
+        free(c->Rows);
+        free(c);
+    }
+}
+
+/* --------------------------------------------------------- */
+bool ConnectionWeight(Connectivity *c, unsigned int k, enum VarType t, int *w)  /* as a value of type t, false if out of range */
+{
+    float        f;
+    double       x;
+
+    if (!c->FloatWeights)
+    {
+        x = (double) (int) c->Weights[k];
+    }
+    else
+    {
+        memcpy(&f, &c->Weights[k], sizeof(float));
+        x = (double) f;
+    }
+    if (t == FloatType)
+    {
+        x = x * 65536.0;  /* fixed point, rounded as the compiler does */
+        x = (x >= 0) ? x + 0.5 : x - 0.5;
+    }
+
+    if (!(x > (double) INT_MIN - 1.0 && x < (double) INT_MAX + 1.0))  /* also a NaN */
+    {
+        return false;
+    }
+    *w = (int) x;
+    return true;
+}
+
+/* --------------------------------------------------------- */
+unsigned int SourceRun(Connectivity *c, unsigned int k, unsigned int end)  /* past the consecutive sources from connection k */
+{
+    unsigned int n = k + 1;
+
+    while (n < end && c->Sources[n] == c->Sources[n - 1] + 1)
+    {
+        n += 1;
+    }
+    return n;
+}
+
+/* --------------------------------------------------------- */
+bool LoadBinaryArray(char Filename[], int v[], unsigned int n, enum VarType t, size_t *size)  /* v[0..n-1] from the file, if it is the size of the array */
+{
+    unsigned char *p;
+    unsigned int  k;
+    unsigned int  x;
+    unsigned int  one = 1;
+    float         f;
+    double        d;
+
+    p = MapConnectivity(Filename, size);
+    if (p == NULL)
+    {
+        return false;
+    }
+
+    if (*size == (size_t) n * 4)
+    {
+        if (t == IntType && *(unsigned char *) &one == 1)
+        {
+            memcpy(v, p, *size);  /* the byte order of the machine */
+        }
+        else
+        {
+            for (k=0; k<n; k+=1)
+            {
+                x = LittleEndianWord(&p[k * 4]);
+                if (t == IntType)
+                {
+                    v[k] = (int) x;
+                }
+                else
+                {
+                    memcpy(&f, &x, sizeof(float));
+                    d = (double) f * 65536.0;
+                    v[k] = (d >= 0) ? (int) (d + 0.5) : (int) (d - 0.5);
+                }
+            }
+        }
+    }
+
+    UnmapConnectivity(p, *size);
+    return true;
+}
@@ -0,0 +1,31 @@
+/* DAMSON connectivity and binary data import header
+*/
+
+#ifndef CONNECT
+#define CONNECT
+
+#include <stddef.h>
+
+#include "compiler.h"
+
+typedef struct  /* a connectivity matrix, a row of source nodes for each destination node */
+{
+    unsigned int nRows;           /* destination nodes 0..nRows-1 */
+    unsigned int nConnections;
+    unsigned int *RowStart;       /* the connections of node n are RowStart[n]..RowStart[n+1]-1 */
+    unsigned int *Sources;
+    unsigned int *Weights;        /* NULL if the file has none */
+    bool         FloatWeights;    /* IEEE single precision, otherwise integers */
+    void         *Map;            /* the file, mapped */
+    size_t       MapSize;
+    unsigned int *Rows;           /* a COO file gathered into rows */
+    unsigned int *Words;          /* the file in the byte order of a big-endian machine */
+} Connectivity;
+
+extern Connectivity *OpenConnectivity(char Filename[]);
+extern void         CloseConnectivity(Connectivity *c);
+extern bool         ConnectionWeight(Connectivity *c, unsigned int k, enum VarType t, int *w);
+extern unsigned int SourceRun(Connectivity *c, unsigned int k, unsigned int end);
+extern bool         LoadBinaryArray(char Filename[], int v[], unsigned int n, enum VarType t, size_t *size);
+
+#endif
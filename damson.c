@@ -15,6 +15,11 @@ Contributors:
 #include "compiler.h"
 #include "emulator.h"
 #include "codegen.h"
+#include "partition.h"
+#include "ensemble.h"
+#include "checkpoint.h"
+#include "image.h"
+#include "stimulus.h"
 
 void help();
 
@@ -26,7 +31,15 @@ int main(int argc, char *argv[])
     bool 	     CodeGenerating;
     bool         Debugging;
     bool         BoundsChecking;
-    bool         ArithmeticChecking;
+    unsigned int Partitions;
+    char         *PlacementFile;
+    char         *VariantFile;
+    char         *BranchFile;
+    float        BranchTime;
+    unsigned int Jobs;
+    char         *SourceFile;
+    bool         Running;
+    unsigned int first;
 
     unsigned int i;
     time_t       timer;
@@ -57,8 +70,24 @@ int main(int argc, char *argv[])
     BoundsChecking = false;
     ArithmeticChecking = false;
     ProfileNode = 0;
+    Partitions = 0;
+    PlacementFile = NULL;
+    VariantFile = NULL;
+    BranchFile = NULL;
+    BranchTime = 0.0;
+    Jobs = 0;
 
-    for (i=2; i<argc; i+=1)
+    SourceFile = argv[1];
+    Running = false;
+    first = 2;
+    if (strcmp(argv[1], "-run") == 0 && argc > 2)  /* damson -run image.dimg [options] */
+    {
+        SourceFile = argv[2];
+        Running = true;
+        first = 3;
+    }
+
+    for (i=first; i<argc; i+=1)
     {
         if (strcmp(argv[i], "-dis") == 0)
         {
@@ -78,15 +107,72 @@ int main(int argc, char *argv[])
         {
             BoundsChecking = true;
         }
+        else if (strcmp(argv[i], "-O") == 0)
+        {
+            Optimising = true;
+        }
         else if (strcmp(argv[i], "-ar") == 0)
         {
-             ArithmeticChecking = true;
+             ArithmeticChecking = true;  /* before Compile, which keeps the float overflow checks */
         }
         else if (strcmp(argv[i], "-pr") == 0)
         {
             ProfileNode = atoi(argv[i+1]);
             i += 1;
         }
+        else if (strcmp(argv[i], "-part") == 0 && i+1 < argc)
+        {
+            Partitions = atoi(argv[i+1]);
+            i += 1;
+        }
+        else if (strcmp(argv[i], "-place") == 0 && i+1 < argc)
+        {
+            PlacementFile = argv[i+1];
+            i += 1;
+        }
+        else if (strcmp(argv[i], "-ensemble") == 0 && i+1 < argc)
+        {
+            VariantFile = argv[i+1];
+            i += 1;
+        }
+        else if (strcmp(argv[i], "-branch") == 0 && i+2 < argc)
+        {
+            BranchTime = atof(argv[i+1]);
+            BranchFile = argv[i+2];
+            i += 2;
+        }
+        else if (strcmp(argv[i], "-checkpoint") == 0 && i+1 < argc)
+        {
+            SetCheckpointInterval(atof(argv[i+1]));
+            i += 1;
+        }
+        else if (strcmp(argv[i], "-restore") == 0 && i+1 < argc)
+        {
+            RestoreFile = argv[i+1];  /* before Compile, so the log files are kept */
+            i += 1;
+        }
+        else if (strcmp(argv[i], "-cache") == 0 && i+1 < argc)
+        {
+            CacheDirectory = argv[i+1];
+            i += 1;
+        }
+        else if (strcmp(argv[i], "-o") == 0 && i+1 < argc)
+        {
+            ImageFile = argv[i+1];
+            Emulating = false;
+            i += 1;
+        }
+        else if (strcmp(argv[i], "-in") == 0 && i+1 < argc)
+        {
+            StimulusFile = argv[i+1];
+            i += 1;
+        }
+        else if (strcmp(argv[i], "-j") == 0 && i+1 < argc)
+        {
+            Jobs = atoi(argv[i+1]);
+            CompileJobs = Jobs;
+            i += 1;
+        }
         else
         {
             help();
@@ -94,16 +180,48 @@ int main(int argc, char *argv[])
         }
     }
 
-    if (Compile(argv[1], CodeGenerating, DisAssembling, Debugging, BoundsChecking))
+    KeepingGlobals = (VariantFile != NULL || BranchFile != NULL || ImageFile != NULL);  /* which variants may override */
+
+    if (StimulusFile != NULL && strcmp(StimulusFile, "-") == 0 && (VariantFile != NULL || BranchFile != NULL))
+    {
+        printf("The standard input cannot be shared by ensemble or branch variants\n");
+        return EXIT_FAILURE;
+    }
+
+    if (Running ? LoadImage(SourceFile) : Compile(SourceFile, CodeGenerating, DisAssembling, Debugging, BoundsChecking))
     {
-        if (Emulating && Errors == 0)
+        if (ImageFile != NULL && Errors == 0)
+        {
+            WriteImage(ImageFile);
+        }
+
+        if ((Partitions > 0 || PlacementFile != NULL) && Errors == 0)
+        {
+            BuildPartitionGraph();
+            PartitionNodes(Partitions, PlacementFile);  /* static weights from the link graph */
+        }
+
+        if (Emulating && Errors == 0 && VariantFile != NULL)
+        {
+            RunEnsemble(VariantFile, Jobs, ArithmeticChecking);
+        }
+        else if (Emulating && Errors == 0)
         {
+            if (BranchFile != NULL)
+            {
+                SetBranches(BranchFile, BranchTime, Jobs);
+            }
             Emulate(Debugging, ArithmeticChecking);
+            if (Partitions > 0 && PlacementFile == NULL)
+            {
+                PartitionNodes(Partitions, NULL);  /* again, with the profiled packet counts */
+            }
         }
+        FreePartitionGraph();
     } 
     else 
     {
-        printf("Cannot find %s\n", argv[1]);
+        printf("Cannot find %s\n", SourceFile);
         return EXIT_FAILURE;
     }
 
@@ -119,7 +237,19 @@ void help()
                      "-debug    debugging\n"
 		     "-bc       bounds checking\n"
                      "-ar       arithmetic checking\n"
+                     "-O        optimise the bytecode\n"
                      "-pr       profile checking\n"
+                     "-part n   partition nodes over n workers\n"
+                     "-place f  use the placement in file f\n"
+                     "-ensemble f  run the variants listed in file f\n"
+                     "-branch t f  run to time t, then fork the variants in file f\n"
+                     "-j n      number of compile, ensemble or branch workers\n"
+                     "-checkpoint t  write a checkpoint every t seconds\n"
+                     "-restore f  resume from checkpoint file f\n"
+                     "-cache d  keep compiled prototypes in directory d\n"
+                     "-o f      write the compiled simulation image to file f\n"
+                     "-run f    (first argument) run the simulation image in file f\n"
+                     "-in f     stream timestamped input packets from file f, - for the standard input\n"
                      "--help    this message\n");
 }
 
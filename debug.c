@@ -19,6 +19,7 @@
 
 #include "cbool.h"
 #include "debug.h"
+#include "checkpoint.h"
 
 
 
@@ -35,6 +36,9 @@
 
 #define DEBUG_PRINT false
 
+#define MaxSnapshots        64              /* snapshots kept for going back in time */
+#define SnapshotSpacing     10000           /* instructions between snapshots (doubled when the table fills) */
+
 
 
 /* Prototypes */
@@ -70,6 +74,13 @@ void 	debugSetGlobalVariable(struct NodeInfo *CurrentNode);
 void 	debugSetArrayVariable(struct NodeInfo *CurrentNode);
 void 	debugSetGlobalArrayVariable(struct NodeInfo *CurrentNode);
 void 	debugExit();
+void 	debugBack(struct NodeInfo *CurrentNode);
+void 	debugLastWrite(struct NodeInfo *CurrentNode);
+
+void 	TakeSnapshot(struct NodeInfo *CurrentNode);
+boolean StartReplay();
+void 	LoadSnapshot(unsigned int i);
+unsigned int CurrentOp(struct NodeInfo *CurrentNode);
 
 void 			readStringFromRequestBuffer(char* result);
 unsigned int 	readIntFromRequestBuffer();
@@ -94,6 +105,22 @@ typedef struct
 	unsigned int  AliasCondition; //alias condition (node number) for breakpoint
 } DebugInstruction;
 
+typedef struct
+{
+	FILE                   *stream;	//emulator state (full checkpoint format)
+	unsigned long long int count;	//instructions executed when taken
+	unsigned int           nodes;	//live nodes when taken (an exit cannot be undone)
+} Snapshot;
+
+enum replay{
+	NO_REPLAY,
+	REPLAY_SCAN,						//re-executing to find the instruction to go back to
+	REPLAY_SEEK}replaying;				//re-executing to that instruction
+
+enum travel{
+	TRAVEL_STEP,						//back to the previous line of the process
+	TRAVEL_WRITE}travel;				//back to the last write of a global variable
+
 
 
 boolean 					    suspend;										/* flag for suspending execution of instructions */
@@ -117,6 +144,23 @@ unsigned int 					nlines;
 struct LineInfo 				*LineList;
 DebugInstruction				DebugTable[MaxLines];                   		/* holds the original instruction which is replaced in the node by DEBUG and any breakpoint conditions*/
 
+//time travel
+Snapshot						Snapshots[MaxSnapshots];						/* periodic snapshots, oldest first */
+unsigned int					nSnapshots = 0;
+unsigned long long int			SnapshotInterval = SnapshotSpacing;
+unsigned long long int			NextSnapshot = 0;
+boolean							StateModified = false;							/* a variable was set from the IDE - earlier snapshots no longer lead here */
+unsigned int					ReplaySnapshot;									/* snapshot the replay started from */
+unsigned long long int			ReplayEnd;										/* instruction at which the command was given */
+unsigned long long int			ReplayTarget;									/* instruction to stop at */
+boolean							ReplayFound;
+unsigned long long int			ReplayStop = 0;									/* instruction the replay stopped at (not a breakpoint again) */
+unsigned int					ReplayNode;
+unsigned int					ReplayHandle;
+int								ReplayLine;
+unsigned int					WatchOffset;
+int								WatchValue;
+
 
 #ifdef WIN32
 SOCKET 							request_connection;								/* handle for request connection */
@@ -146,7 +190,9 @@ const char* RequestStrings[] ={
 	"setgvar",
 	"setarrayvar",
 	"setgarrayvar",
-	"exit"
+	"exit",
+	"back",
+	"lastwrite"
 };
 
 typedef enum
@@ -167,6 +213,8 @@ typedef enum
 	DEBUG_COMMAND_SET_ARRAY_VARIABLE,
 	DEBUG_COMMAND_SET_GLOBAL_ARRAY_VARIABLE,
 	DEBUG_COMMAND_EXIT,
+	DEBUG_COMMAND_BACK,
+	DEBUG_COMMAND_LAST_WRITE,
 	DEBUG_COMMAND_UNDEFINED
 }RequestCommand;
 
@@ -214,9 +262,15 @@ void Debug_Init(struct NodeInfo *nnl, struct NodeInfo *nl, unsigned int l, struc
 }
 
 void Debug_End(){
+	unsigned int i;
+
 	//send terminate IDE
 	SendDebugEvent("terminated\n");
 
+	for (i=0; i<nSnapshots; i++)
+		fclose(Snapshots[i].stream);
+	nSnapshots = 0;
+
 #ifdef WIN32
 	closesocket(request_sock);
 	closesocket(event_sock);
@@ -450,19 +504,29 @@ void ProcessDebugRequest(struct NodeInfo *CurrentNode)
 			break;
 		case(DEBUG_COMMAND_SET_VARIABLE):
 			debugSetVariable(CurrentNode);
+			StateModified = true;
 			break;
 		case(DEBUG_COMMAND_SET_GLOBAL_VARIABLE):
 			debugSetGlobalVariable(CurrentNode);
+			StateModified = true;
 			break;
 		case(DEBUG_COMMAND_SET_ARRAY_VARIABLE):
 			debugSetArrayVariable(CurrentNode);
+			StateModified = true;
 			break;
 		case(DEBUG_COMMAND_SET_GLOBAL_ARRAY_VARIABLE):
 			debugSetGlobalArrayVariable(CurrentNode);
+			StateModified = true;
 			break;
 		case(DEBUG_COMMAND_EXIT):
 			debugExit();
 			break;
+		case(DEBUG_COMMAND_BACK):
+			debugBack(CurrentNode);
+			break;
+		case(DEBUG_COMMAND_LAST_WRITE):
+			debugLastWrite(CurrentNode);
+			break;
 		default:
 			Error(DEBUGGER_ERROR, "Unsupported Debug Request!\n");
 			exit(0);
@@ -484,8 +548,11 @@ void Debug(unsigned int node, unsigned int pc)
     //find the node
     CurrentNode = FindNode(node);
 
-    //check for breakpoint (or step) and update suspend
-	CheckForBreakpoint(CurrentNode);
+    //check for breakpoint (or step) and update suspend - not while replaying or where a replay has just stopped
+	if ((replaying == NO_REPLAY)&&(InstructionCount != ReplayStop))
+		CheckForBreakpoint(CurrentNode);
+	else
+		suspend = false;
 
 	if (suspend)
 		UIControlLoop(CurrentNode);
@@ -950,6 +1017,7 @@ void debugVariable(struct NodeInfo *CurrentNode)
 	unsigned int stack_frame;
 	unsigned int p_handle;
 	struct PCB* process;
+	char *name;
 
 	i = 0;
 	j = 0;
@@ -964,6 +1032,7 @@ void debugVariable(struct NodeInfo *CurrentNode)
 
 	//get variable name by reading it from requestBuffer
 	readStringFromRequestBuffer(strBuffer);
+	name = InternedName(strBuffer);		//symbol names are interned, so are matched by pointer (NULL if no such name)
 
 	//get the PC and FP for the process handle
 	process = SearchProcess(CurrentNode, p_handle);
@@ -989,7 +1058,7 @@ void debugVariable(struct NodeInfo *CurrentNode)
 	//iterate current procedure arguments to find variable name location then lookup in stack
 	for (i=1; i<= CurrentNode->Procedures[p].nLocals; i++)
 	{
-		if (strcmp(CurrentNode->Procedures[p].Args[i].Name, strBuffer) == 0) /* found matching variable name */
+		if (CurrentNode->Procedures[p].Args[i].Name == name) /* found matching variable name */
 		{
 			j = CurrentNode->Procedures[p].Args[i].vOffset;
 			if (CurrentNode->Procedures[p].Args[i].vDimensions[0] > 0)
@@ -1023,6 +1092,7 @@ void debugGlobalVariable(struct NodeInfo *CurrentNode)
 	char strBuffer[512];
 	int i;
 	int j;
+	char *name;
 
 
 	i = 0;
@@ -1030,10 +1100,11 @@ void debugGlobalVariable(struct NodeInfo *CurrentNode)
 
 	//get variable name by reading it from requestBuffer
 	readStringFromRequestBuffer(strBuffer);
+	name = InternedName(strBuffer);
 
 	for (i=(GLOBALBASE+1);i<=CurrentNode->NumberOfGlobals; i++)
 	{
-		if (strcmp(CurrentNode->Globals[i].Name, strBuffer)==0)
+		if (CurrentNode->Globals[i].Name == name)
 		{
 			j = CurrentNode->Globals[i].vOffset;
 			if (CurrentNode->Globals[i].vDimensions[0] > 0)
@@ -1081,6 +1152,7 @@ void debugArrayVariable(struct NodeInfo *CurrentNode)
 	unsigned int stack_frame;
 	unsigned int p_handle;
 	struct PCB* process;
+	char *name;
 
 	indices[0] = 0;
 	stack_frame = 0;
@@ -1095,6 +1167,7 @@ void debugArrayVariable(struct NodeInfo *CurrentNode)
 
 	//get variable name by reading it from requestBuffer
 	readStringFromRequestBuffer(strBuffer);
+	name = InternedName(strBuffer);
 
 	//get indices
 	indices[0] = readIntFromRequestBuffer();
@@ -1127,7 +1200,7 @@ void debugArrayVariable(struct NodeInfo *CurrentNode)
 	//iterate current procedure arguments to find variable name location
 	for (i=1; i<= CurrentNode->Procedures[p].nLocals; i++)
 	{
-		if (strcmp(CurrentNode->Procedures[p].Args[i].Name, strBuffer) == 0) /* found matching variable name */
+		if (CurrentNode->Procedures[p].Args[i].Name == name) /* found matching variable name */
 		{
 			j = CurrentNode->Procedures[p].Args[i].vOffset;
 
@@ -1168,12 +1241,14 @@ void debugGlobalArrayVariable(struct NodeInfo *CurrentNode)
 	int i;
 	int j;
 	int d;
+	char *name;
 
 	indices[0] = 0;
 	i=0;
 
 	//get variable name by reading it from requestBuffer
 	readStringFromRequestBuffer(strBuffer);
+	name = InternedName(strBuffer);
 
 	//get indices
 	indices[0] = readIntFromRequestBuffer();
@@ -1184,7 +1259,7 @@ void debugGlobalArrayVariable(struct NodeInfo *CurrentNode)
 	//iterate current procedure arguments to find variable name location
 	for (i=(GLOBALBASE+1); i<=CurrentNode->NumberOfGlobals; i++)
 	{
-		if (strcmp(CurrentNode->Globals[i].Name, strBuffer) == 0) /* found matching variable name */
+		if (CurrentNode->Globals[i].Name == name) /* found matching variable name */
 		{
 			j = CurrentNode->Globals[i].vOffset;
 
@@ -1237,6 +1312,7 @@ void debugSetVariable(struct NodeInfo *CurrentNode)
 	unsigned int stack_frame;
 	unsigned int p_handle;
 	struct PCB* process;
+	char *name;
 
 	i = 0;
 	j = 0;
@@ -1251,6 +1327,7 @@ void debugSetVariable(struct NodeInfo *CurrentNode)
 
 	//get variable name by reading it from requestBuffer
 	readStringFromRequestBuffer(strBuffer);
+	name = InternedName(strBuffer);
 
 	//get variable value by reading it from the requestBuffer
 	readStringFromRequestBuffer(strValueBuffer);
@@ -1279,7 +1356,7 @@ void debugSetVariable(struct NodeInfo *CurrentNode)
 	//iterate current procedure arguments to find variable name location then lookup in stack
 	for (i=1; i<= CurrentNode->Procedures[p].nLocals; i++)
 	{
-		if (strcmp(CurrentNode->Procedures[p].Args[i].Name, strBuffer) == 0) /* found matching variable name */
+		if (CurrentNode->Procedures[p].Args[i].Name == name) /* found matching variable name */
 		{
 			j = CurrentNode->Procedures[p].Args[i].vOffset;
 			if (CurrentNode->Procedures[p].Args[i].vDimensions[0] > 0)
@@ -1310,12 +1387,14 @@ void debugSetGlobalVariable(struct NodeInfo *CurrentNode)
 	char strValueBuffer[32];	//assume 32 chars is big enough
 	int i;
 	int j;
+	char *name;
 
 	i = 0;
 	j = 0;
 
 	//get variable name by reading it from requestBuffer
 	readStringFromRequestBuffer(strBuffer);
+	name = InternedName(strBuffer);
 
 	//get variable value by reading it from the requestBuffer
 	readStringFromRequestBuffer(strValueBuffer);
@@ -1323,7 +1402,7 @@ void debugSetGlobalVariable(struct NodeInfo *CurrentNode)
 	//iterate current procedure arguments to find variable name location then lookup in stack
 	for (i=(GLOBALBASE+1); i<=CurrentNode->NumberOfGlobals; i++)
 	{
-		if (strcmp(CurrentNode->Globals[i].Name, strBuffer) == 0) /* found matching variable name */
+		if (CurrentNode->Globals[i].Name == name) /* found matching variable name */
 		{
 			j = CurrentNode->Globals[i].vOffset;
 			if (CurrentNode->Globals[i].vDimensions[0] > 0)
@@ -1370,6 +1449,7 @@ void debugSetArrayVariable(struct NodeInfo *CurrentNode)
 	unsigned int stack_frame;
 	unsigned int p_handle;
 	struct PCB* process;
+	char *name;
 
 	i = 0;
 	j = 0;
@@ -1384,6 +1464,7 @@ void debugSetArrayVariable(struct NodeInfo *CurrentNode)
 
 	//get variable name by reading it from requestBuffer
 	readStringFromRequestBuffer(strBuffer);
+	name = InternedName(strBuffer);
 
 	//get indices
 	indices[0] = readIntFromRequestBuffer();
@@ -1420,7 +1501,7 @@ void debugSetArrayVariable(struct NodeInfo *CurrentNode)
 	//iterate current procedure arguments to find variable name location
 	for (i=1; i<= CurrentNode->Procedures[p].nLocals; i++)
 	{
-		if (strcmp(CurrentNode->Procedures[p].Args[i].Name, strBuffer) == 0) /* found matching variable name */
+		if (CurrentNode->Procedures[p].Args[i].Name == name) /* found matching variable name */
 		{
 			j = CurrentNode->Procedures[p].Args[i].vOffset;
 
@@ -1457,12 +1538,14 @@ void debugSetGlobalArrayVariable(struct NodeInfo *CurrentNode)
 	int i;
 	int j;
 	int d;
+	char *name;
 
 	i = 0;
 	j = 0;
 
 	//get variable name by reading it from requestBuffer
 	readStringFromRequestBuffer(strBuffer);
+	name = InternedName(strBuffer);
 
 	//get indices
 	indices[0] = readIntFromRequestBuffer();
@@ -1477,7 +1560,7 @@ void debugSetGlobalArrayVariable(struct NodeInfo *CurrentNode)
 	//iterate current procedure arguments to find variable name location
 	for (i=(GLOBALBASE+1); i<=CurrentNode->NumberOfGlobals; i++)
 	{
-		if (strcmp(CurrentNode->Globals[i].Name, strBuffer) == 0) /* found matching variable name */
+		if (CurrentNode->Globals[i].Name == name) /* found matching variable name */
 		{
 			j = CurrentNode->Globals[i].vOffset;
 
@@ -1521,6 +1604,280 @@ void debugExit()
 
 
 
+/*
+ * Goes back to the start of the previous source line executed by the current process.
+ * The state is restored from the nearest earlier snapshot and re-executed (the emulator is deterministic)
+ */
+void debugBack(struct NodeInfo *CurrentNode)
+{
+	if ((CurrentNode == NULL)||(CurrentNode->CurrentProcess == NULL))
+	{
+		appendToResponseBuffer("FAILED: back\n");
+		SendRequestResponse();
+		return;
+	}
+
+	travel = TRAVEL_STEP;
+	ReplayNode = CurrentNode->NodeNumber;
+	ReplayHandle = CurrentNode->CurrentProcess->handle;
+
+	if (!StartReplay())
+	{
+		appendToResponseBuffer("FAILED: back\n");
+		SendRequestResponse();
+	}
+}
+
+/*
+ * Goes back to the instruction which last changed a global variable of the current node.
+ * The requestBuffer should contain a string in the following format "name indices" where
+ *   name = string value representing the name of the global variable
+ *   indices = string value of integer characters where first value represents the dimensionality and the following values represent indices for each dimension (0 for a scalar)
+ */
+void debugLastWrite(struct NodeInfo *CurrentNode)
+{
+	char strBuffer[512];
+	unsigned int indices[MaxDimensions+1];
+	int i;
+	int j;
+	char *name;
+
+	//get variable name and indices by reading them from requestBuffer
+	readStringFromRequestBuffer(strBuffer);
+	name = InternedName(strBuffer);
+	indices[0] = readIntFromRequestBuffer();
+	for (j=1; (j<=indices[0])&&(j<=MaxDimensions); j++)
+	{
+		indices[j] = readIntFromRequestBuffer();
+	}
+
+	if (CurrentNode != NULL)
+	{
+		for (i=(GLOBALBASE+1); i<=CurrentNode->NumberOfGlobals; i++)
+		{
+			if ((CurrentNode->Globals[i].Name == name)&&(indices[0] == CurrentNode->Globals[i].vDimensions[0]))
+			{
+				travel = TRAVEL_WRITE;
+				ReplayNode = CurrentNode->NodeNumber;
+				WatchOffset = CurrentNode->Globals[i].vOffset;
+				if (indices[0] > 0)
+					WatchOffset += getArrayVariableOffset(CurrentNode->Globals[i].vDimensions, indices);
+
+				if (StartReplay())
+					return;
+				break;
+			}
+		}
+	}
+
+	appendToResponseBuffer("FAILED: lastwrite\n");
+	SendRequestResponse();
+}
+
+/*
+ * Starts a replay from the latest snapshot before the current instruction.
+ * Returns false if no snapshot can lead here (a node has since exited)
+ */
+boolean StartReplay()
+{
+	unsigned int i;
+
+	ReplayEnd = InstructionCount;
+	i = nSnapshots;
+	while ((i > 0)&&(Snapshots[i-1].count >= ReplayEnd))
+		i--;
+	if ((i == 0)||(Snapshots[i-1].nodes != NumberOfNodes))
+		return false;
+
+	appendToResponseBuffer("OK %s\n", (travel == TRAVEL_STEP) ? "back" : "lastwrite");
+	SendRequestResponse();
+	SendDebugEvent("resumed step\n");
+
+	Tracing(false);
+	stepping = NO_STEP;
+	suspend = false;
+	replaying = REPLAY_SCAN;
+	Replaying = true;
+	ReplayFound = false;
+	LoadSnapshot(i-1);
+	return true;	//not reached
+}
+
+/*
+ * Restores a snapshot and continues emulation from it
+ */
+void LoadSnapshot(unsigned int i)
+{
+	FILE *chain[1];
+
+	ReplaySnapshot = i;
+	chain[0] = Snapshots[i].stream;
+	LoadState(chain, 1, "snapshot");
+	InstructionCount = Snapshots[i].count;
+
+	ReplayLine = -1;
+	if (travel == TRAVEL_WRITE)
+		WatchValue = FindNode(ReplayNode)->G[WatchOffset];
+
+	Rewind();
+}
+
+/*
+ * Takes a snapshot of the emulator state at the top of the emulation loop.
+ * When the table is full every other snapshot is dropped and the interval doubled, so the whole run stays covered
+ */
+void TakeSnapshot(struct NodeInfo *CurrentNode)
+{
+	FILE *s;
+	unsigned int i;
+	unsigned int n;
+
+	if (nSnapshots == MaxSnapshots)
+	{
+		n = 1;
+		for (i=1; i<nSnapshots; i++)
+		{
+			if (i % 2 == 0)
+				Snapshots[n++] = Snapshots[i];
+			else
+				fclose(Snapshots[i].stream);
+		}
+		nSnapshots = n;
+		SnapshotInterval *= 2;
+	}
+
+	s = tmpfile();
+	if (s == NULL)
+	{
+		Error(DEBUGGER_ERROR, "Unable to create debugger snapshot\n");
+		return;
+	}
+	SaveState(s, CurrentNode->SystemTicks, true, "", false);
+
+	Snapshots[nSnapshots].stream = s;
+	Snapshots[nSnapshots].count = InstructionCount;
+	Snapshots[nSnapshots].nodes = NumberOfNodes;
+	nSnapshots++;
+	NextSnapshot = InstructionCount + SnapshotInterval;
+	debugPrint("SNAPSHOT %i at %llu\n", nSnapshots, InstructionCount);
+}
+
+/*
+ * Called by the emulator at the top of its loop to take periodic snapshots
+ */
+void Debug_Snapshot(struct NodeInfo *CurrentNode)
+{
+	unsigned int i;
+
+	ReplayStop = 0;					//the instruction a replay stopped at has been executed
+
+	if (replaying != NO_REPLAY)		//replayed instructions are already covered
+		return;
+
+	if (StateModified)				//a variable set from the IDE cannot be replayed - start again from here
+	{
+		for (i=0; i<nSnapshots; i++)
+			fclose(Snapshots[i].stream);
+		nSnapshots = 0;
+		SnapshotInterval = SnapshotSpacing;
+		StateModified = false;
+		TakeSnapshot(CurrentNode);
+	}
+	else if (InstructionCount >= NextSnapshot)
+	{
+		TakeSnapshot(CurrentNode);
+	}
+}
+
+/*
+ * Gets the op code of the next instruction of a node (the original if replaced by a breakpoint)
+ */
+unsigned int CurrentOp(struct NodeInfo *CurrentNode)
+{
+	Instruction *i;
+
+	i = &CurrentNode->Instructions[CurrentNode->PC];
+	if (i->Op == s_DEBUG)
+		return DebugTable[i->Arg].Op;
+	return i->Op;
+}
+
+/*
+ * Called by the emulator before each instruction while replaying.
+ * A scan records the last matching instruction before the command was given, then the snapshot is restored and
+ * re-executed to that instruction, where execution is suspended.
+ */
+void Debug_Replay(struct NodeInfo *CurrentNode)
+{
+	int line;
+	int v;
+	unsigned int Op;
+
+	if (replaying == NO_REPLAY)
+		return;
+
+	if (replaying == REPLAY_SCAN)
+	{
+		if (travel == TRAVEL_WRITE)
+		{
+			v = FindNode(ReplayNode)->G[WatchOffset];
+			if (v != WatchValue)			//changed by the previous instruction
+			{
+				ReplayTarget = InstructionCount - 1;
+				ReplayFound = true;
+				WatchValue = v;
+			}
+		}
+
+		if (InstructionCount >= ReplayEnd)
+		{
+			if (ReplayFound)
+			{
+				replaying = REPLAY_SEEK;
+				LoadSnapshot(ReplaySnapshot);
+			}
+			else if ((ReplaySnapshot > 0)&&(Snapshots[ReplaySnapshot-1].nodes == NumberOfNodes))
+			{
+				LoadSnapshot(ReplaySnapshot - 1);		//nothing since this snapshot - look further back
+			}
+			else
+			{
+				ReplayTarget = ReplayEnd;				//nothing earlier - stop where the command was given
+				replaying = REPLAY_SEEK;
+				LoadSnapshot(ReplaySnapshot);
+			}
+		}
+
+		if ((travel == TRAVEL_STEP)&&(CurrentNode->NodeNumber == ReplayNode)&&
+			(CurrentNode->CurrentProcess != NULL)&&(CurrentNode->CurrentProcess->handle == ReplayHandle))
+		{
+			//same test as step into: a change of line or a return
+			Op = CurrentOp(CurrentNode);
+			line = getAliasLineNumber(CurrentNode, CurrentNode->PC);
+			if (((line != ReplayLine)||(Op == s_RTRN))&&isBreakableInstruction(Op))
+			{
+				ReplayTarget = InstructionCount;
+				ReplayFound = true;
+			}
+			ReplayLine = line;
+		}
+		return;
+	}
+
+	if (InstructionCount == ReplayTarget)
+	{
+		replaying = NO_REPLAY;
+		Replaying = false;
+		ReplayStop = InstructionCount;
+		suspend = true;
+		sprintf(suspendBuffer, "suspended step\n");
+		UIControlLoop(CurrentNode);
+
+		if (stepping)
+			Tracing(true);
+	}
+}
+
 /**
  * Gets the next integer string from the request buffer and stores it as an int in result.
  * Returns the number of characters read (including trailing space or EOL marker).
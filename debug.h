@@ -13,5 +13,9 @@ extern void Debug(unsigned int node, unsigned int pc);
 
 extern void Debug_End();
 
+extern void Debug_Snapshot(struct NodeInfo *CurrentNode);
+
+extern void Debug_Replay(struct NodeInfo *CurrentNode);
+
 
 #endif
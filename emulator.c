@@ -9,15 +9,23 @@
 #include <sys/time.h>
 #include <limits.h>
 #include <time.h>
+#include <setjmp.h>
+#include <stdint.h>
 
 #include "compiler.h"
 #include "emulator.h"
 #include "debug.h"
+#include "partition.h"
+#include "ensemble.h"
+#include "checkpoint.h"
+#include "stimulus.h"
 
 #define MaxProcesses         10000
 #define ProcessHashTableSize (MaxProcesses * 2)
 #define diagnostics          false
 #define MaxLogChannels       1000
+#define MaxEvaluationSteps   10000000  /* instructions a call evaluated by the compiler may run */
+#define EndOfEvaluation      0xffffffff  /* return address of a call evaluated by the compiler */
 
 void                   *TOMBSTONE = &TOMBSTONE;
 struct NodeInfo        *NodeList = NULL;
@@ -25,9 +33,17 @@ struct NodeInfo        *NodeListTail = NULL;
 struct NodeInfo        *NameNodeList = NULL;
 struct LimitItem	   *LimitList = NULL;
 struct LimitItem	   *LimitListTail = NULL;
-unsigned int           HashTableSize;
-struct NodeInfo        **HashTable;
+unsigned int           HashTableSize = 0;
+struct NodeInfo        **HashTable = NULL;
+unsigned int           NumberOfHashedNodes = 0;  /* entries in use, including tombstones */
+unsigned int           NameHashTableSize = 0;
+unsigned int           NumberOfNames = 0;     /* entries in use, including tombstones */
+struct NodeInfo        **NameHashTable = NULL;
 struct NodeInfo        *CurrentNode;
+unsigned int           *LinkOrder = NULL;      /* the links by first source */
+unsigned int           *LinkReach = NULL;      /* highest source of the links up to each in that order */
+unsigned int           *LinkHits = NULL;       /* the links of a source, found by FindLinks */
+unsigned int           nLinkOrder = 0;
 unsigned long long int ProcessingTicks;
 unsigned long long int TotalTicks;
 unsigned long long int t1;
@@ -38,14 +54,104 @@ unsigned int           LogStreams = 0;
 unsigned int           mallocs = 0;
 unsigned int           malloc_count = 0;
 unsigned int           ProfileNode = 0;
+unsigned long long int BranchTicks = 0;
+unsigned long long int InstructionCount = 0;
+bool                   Replaying = false;
+jmp_buf                RewindPoint;
+unsigned int           *ProcList = NULL;        /* procedure of each instruction of the profiled node */
+unsigned int           EmulationTimeout;        /* clock ticks since a process last ran */
+bool                   EmulationDebugging = false;
+char                   *PrintBuffer = NULL;     /* the text of a printf */
+unsigned int           PrintBufferSize = 0;
+unsigned int           PrintLength = 0;
+PacketHandler          PacketHook = NULL;       /* set by a program embedding the emulator */
+void                   *PacketContext = NULL;
+PrintHandler           PrintHook = NULL;
+void                   *PrintContext = NULL;
 FILE                   *ProfileStream = NULL;
 float 				   AverageSearches = 0;  /*Used to keep a running average of the number of searches through the linked list*/
 int 				   CountSearches = 0;
 
+const int InstructionTime[68] =  /* ticks of each instruction */
+{
+    0, /*                0  */
+    1, /* s_LG           1  */
+    1, /* s_LP           2  */
+    1, /* s_LN           3  */
+    1, /* s_LSTR         4  */
+    1, /* s_LL           5  */
+    1, /* s_LLG          6  */
+    1, /* s_LLP          7  */
+    1, /* s_LLL          8  */
+    1, /* s_EQ           9  */
+    1, /* s_NE          10  */
+    1, /* s_LS          11  */
+    1, /* s_GR          12  */
+    1, /* s_LE          13  */
+    1, /* s_GE          14  */
+    1, /* s_JT          15  */
+    1, /* s_JF          16  */
+    1, /* s_JUMP        17  */
+    1, /* s_OR          18  */
+    1, /* s_AND         19  */
+    1, /* s_PLUS        20  */
+    1, /* s_MINUS       21  */
+    1, /* s_MULT        22  */
+   11, /* s_MULTF       23  */
+   57, /* s_DIV         24  */
+  129, /* s_DIVF        25  */
+   57, /* s_REM         26  */
+    1, /* s_NEG         27  */
+    1, /* s_NOT         28  */
+    1, /* s_ABS         29  */
+    1, /* s_SG          30  */
+    1, /* s_SP          31  */
+    1, /* s_SL          32  */
+    1, /* s_SYSCALL     33  */
+    1, /* s_LOGAND      34  */
+    1, /* s_LOGOR       35  */
+    1, /* s_NEQV        36  */
+    1, /* s_LSHIFT      37  */
+    1, /* s_RSHIFT      38  */
+    1, /* s_COMP        39  */
+    1, /* s_SWITCHON    40  */
+    0, /* s_FNAP        41  */
+    0, /* s_RTAP        42  */
+    1, /* s_RTRN        43  */
+    1, /* s_ENTRY       44  */
+    1, /* s_RV          45  */
+    1, /* s_STIND       46  */
+    1, /* s_PUSHTOS     47  */
+    1, /* s_VCOPY       48  */
+    1, /* s_FLOAT       49  */
+    1, /* s_INT         50  */
+    1, /* s_SWAP        51  */
+    0, /* s_DEBUG       52  */
+    0, /* s_BOUNDSCHECK 53  */
+    0, /* spare         54  */
+    0, /* spare         55  */
+    0, /* spare         56  */
+    0, /* spare         57  */
+    0, /* spare         58  */
+    0, /* spare         59  */
+
+    0, /* s_STACK       60  */
+    0, /* s_QUERY       61  */
+    0, /* s_STORE       62  */
+    0, /* s_SAVE        63  */
+    0, /* s_RES         64  */
+    0, /* s_RSTACK      65  */
+    0, /* s_LAB         66  */
+    0, /* s_DISCARD     67  */
+};
+
 unsigned int           GetNodeLabel(unsigned int node, unsigned int lab);
 void                   Interrupt(unsigned int dnode, unsigned int NodeId, int pkt);
 unsigned int           Hash(unsigned int n, unsigned int size);
 void                   AddNode(unsigned int n, struct NodeInfo *naddr);
+unsigned int           HashNodeName(char *name, unsigned int size);
+void                   AddNamedNode(struct NodeInfo *b);
+void                   DeleteNamedNode(struct NodeInfo *b);
 void                   RestoreProcess(unsigned int n, struct PCB *p);
 void                   SaveProcess(unsigned int n, struct PCB *p);
 unsigned int           CreateProcess(unsigned int node, unsigned int StartAddress, unsigned int Size, unsigned int plevel);
@@ -58,20 +164,29 @@ int                    StackPop();
 int                    StackTop();
 void                   StackPushbool(bool Item);
 bool                   StackPopbool();
-struct tnode           *FindLink(unsigned int n, struct tnode *p);
+int                    CompareLinkOrder(const void *a, const void *b);
+void                   IndexLinks();
+unsigned int           FindLinks(unsigned int n);
 void                   SendPkt(unsigned int SourceNode, unsigned int port, int DataValue);
+bool                   DeliverPkt(unsigned int SourceNode, unsigned int port, unsigned int DestNode, int DataValue);
 void                   WriteTimeStamp(int n);
-void                   ShowPkt(unsigned int snode, unsigned int dnode, int pkt, unsigned int tstamp);
+void                   ShowPkt(unsigned int snode, unsigned int dnode, int pkt, unsigned long long int tstamp);
 int                    ConvertToFloat(int x);
 int                    ConvertToInt(int x);
 void                   DiadicOp(unsigned int Op);
 void                   MonadicOp(unsigned int Op);
 void                   myprintf(char *fmt, ...);
+void                   PrintAppend(char *fmt, ...);
+void                   PrintAppendList(char *fmt, va_list list);
+void                   Report(char *fmt, ...);
+void                   ReportBuffer();
 void                   myfprintf(FILE *stream, char *fmt, ...);
 void                   AddProcess(unsigned int node, struct PCB *process);
 void                   RemoveProcess(unsigned int node, unsigned int prev);
 void                   Reschedule(unsigned int node);
 void                   DeleteNode(unsigned int node);
+void                   FreePrototype(struct NodeInfo *p);
+void                   EndEmulation();
 void                   UpdateLog(unsigned int n, bool logging);
 void                   CloseLogs();
 void                   RemoveNode(unsigned int node);
@@ -86,6 +201,8 @@ void				   RemoveLinkedLimit(struct LimitItem *prev);
 void				   SyncNodes(unsigned int node);
 unsigned int 		   sync_count;
 void                   CloseProfile();
+bool                   EvaluableCall(struct NodeInfo *h, unsigned int lab, unsigned int excluded);
+bool                   OnEvaluationStack(struct NodeInfo *h, int a, unsigned int bytes);
 bool                   ArithmeticChecking;
 
 /* --------------------------------------------------------- */
@@ -178,6 +295,10 @@ struct NodeInfo *FindNode(unsigned int node)
     struct NodeInfo *b;
 
     //printf("FindNode: node=%d\n", node);  // ***
+    if (HashTable == NULL)
+    {
+        return NULL;
+    }
     n = 0;
     h = Hash(node, HashTableSize);
     
@@ -207,12 +328,40 @@ struct NodeInfo *FindNode(unsigned int node)
 }
 
 /* --------------------------------------------------------- */
-void AddNode(unsigned int node, struct NodeInfo *nodeptr)
+void AddNode(unsigned int node, struct NodeInfo *nodeptr)  /* the table grows as nodes are created */
 {
-    unsigned int h;
-    unsigned int n;
+    unsigned int    h;
+    unsigned int    n;
+    unsigned int    i;
+    unsigned int    oldsize;
+    struct NodeInfo **old;
 
     //printf("AddNode: node=%d\n", node); // *** 
+    if (2 * (NumberOfHashedNodes + 1) > HashTableSize)  /* rehash, dropping tombstones */
+    {
+        old = HashTable;
+        oldsize = HashTableSize;
+        HashTableSize = (oldsize == 0) ? 64 : oldsize * 2;
+        HashTable = malloc(sizeof(struct NodeInfo *) * HashTableSize);
+        if (HashTable == NULL)
+        {
+            Runtime_Error(231, "Unable to allocate hash table\n");
+        }
+        for (i=0; i<HashTableSize; i+=1)
+        {
+            HashTable[i] = NULL;
+        }
+        NumberOfHashedNodes = 0;
+        for (i=0; i<oldsize; i+=1)
+        {
+            if (old[i] != NULL && old[i] != TOMBSTONE)
+            {
+                AddNode(old[i]->NodeNumber, old[i]);
+            }
+        }
+        free(old);
+    }
+
     n = 0;
     h = Hash(node, HashTableSize);
 
@@ -236,6 +385,7 @@ void AddNode(unsigned int node, struct NodeInfo *nodeptr)
         }
     }
     HashTable[h] = nodeptr;
+    NumberOfHashedNodes += 1;
 }
 
 /* --------------------------------------------------------- */
@@ -273,23 +423,117 @@ void RemoveNode(unsigned int node)   /* remove a node from the hash table */
     }
 }
 
+/* --------------------------------------------------------- */
+unsigned int HashNodeName(char *name, unsigned int size)  /* FNV-1a */
+{
+    unsigned int h = 2166136261u;
+
+    while (*name != 0)
+    {
+        h = (h ^ (unsigned char) *name) * 16777619u;
+        name += 1;
+    }
+    return h % size;
+}
+
 /* --------------------------------------------------------- */
 struct NodeInfo *FindNamedNode(char *name)
 {
-    struct NodeInfo *p;
+    unsigned int    h;
+    struct NodeInfo *b;
 
-    p = NameNodeList;
-    while (p != NULL)
+    if (NameHashTable == NULL)
+    {
+        return NULL;
+    }
+
+    h = HashNodeName(name, NameHashTableSize);
+    while (NameHashTable[h] != NULL)
     {
-        if (strcmp(p->NodeName, name) == 0)
+        b = NameHashTable[h];
+        if (b != TOMBSTONE)
         {
-            return p;
+            if (strcmp(b->NodeName, name) == 0)
+            {
+                return b;
+            }
+        }
+        h += 1;
+        if (h >= NameHashTableSize)
+        {
+            h = 0;
         }
-        p = p->NextNode;
     }
     return NULL;
 }
 
+/* --------------------------------------------------------- */
+void AddNamedNode(struct NodeInfo *b)  /* the table grows as prototypes are created during compilation */
+{
+    unsigned int    h;
+    unsigned int    i;
+    unsigned int    oldsize;
+    struct NodeInfo **old;
+
+    if (2 * (NumberOfNames + 1) > NameHashTableSize)  /* rehash, dropping tombstones */
+    {
+        old = NameHashTable;
+        oldsize = NameHashTableSize;
+        NameHashTableSize = (oldsize == 0) ? 64 : oldsize * 2;
+        NameHashTable = malloc(sizeof(struct NodeInfo *) * NameHashTableSize);
+        if (NameHashTable == NULL)
+        {
+            Runtime_Error(246, "Unable to allocate node name table\n");
+        }
+        for (i=0; i<NameHashTableSize; i+=1)
+        {
+            NameHashTable[i] = NULL;
+        }
+        NumberOfNames = 0;
+        for (i=0; i<oldsize; i+=1)
+        {
+            if (old[i] != NULL && old[i] != TOMBSTONE)
+            {
+                AddNamedNode(old[i]);
+            }
+        }
+        free(old);
+    }
+
+    h = HashNodeName(b->NodeName, NameHashTableSize);
+    while (NameHashTable[h] != NULL)
+    {
+        h += 1;
+        if (h >= NameHashTableSize)
+        {
+            h = 0;
+        }
+    }
+    NameHashTable[h] = b;
+    NumberOfNames += 1;
+}
+
+/* --------------------------------------------------------- */
+void DeleteNamedNode(struct NodeInfo *b)
+{
+    unsigned int h;
+
+    h = HashNodeName(b->NodeName, NameHashTableSize);
+    while (NameHashTable[h] != NULL)
+    {
+        if (NameHashTable[h] == b)
+        {
+            NameHashTable[h] = TOMBSTONE;
+            return;
+        }
+        h += 1;
+        if (h >= NameHashTableSize)
+        {
+            h = 0;
+        }
+    }
+}
+
 /* --------------------------------------------------------- */
 struct NodeInfo *CreateNode(unsigned int    node, 
                             char            *name, 
@@ -300,16 +544,10 @@ struct NodeInfo *CreateNode(unsigned int    node,
     struct NodeInfo *b;
     struct NodeInfo *p;
     unsigned int    s;
-    unsigned int    i;
     
-    p = NodeList;       /* remove node from nodelist */
-    while (p != NULL)
+    if (FindNode(node) != NULL)
     {
-        if (p->NodeNumber == node)
-        {
-            Runtime_Error(203, "CreateNode: multiple node %d\n", node);
-        }
-        p = p->NextNode;
+        Runtime_Error(203, "CreateNode: multiple node %d\n", node);
     }
 
     p = FindNamedNode(name);
@@ -341,6 +579,7 @@ struct NodeInfo *CreateNode(unsigned int    node,
     b->NextNode = NodeList;  /* add to head of linked list */
     b->PrevNode = NULL;
     NodeList = b;
+    AddNode(node, b);
     
     b->NodeName = p->NodeName;  /* copy of parent's node name */
     
@@ -394,16 +633,7 @@ struct NodeInfo *CreateNode(unsigned int    node,
     b->Procedures = p->Procedures;  /* copy of parent's procedures information */
     b->NumberOfProcedures = p->NumberOfProcedures;
 
-    b->ProcessHashTable = malloc(sizeof(int) * ProcessHashTableSize);  /* claim space for process hash table */
-    if (b->ProcessHashTable == NULL)
-    {
-        Runtime_Error(208, "Unable to allocate memory for process hash table\n");
-    }
-    
-    for (i=0; i<ProcessHashTableSize; i+=1)  /* initialise process hash table */
-    {
-        b->ProcessHashTable[i] = NULL;
-    }
+    b->ProcessHashTable = NULL;  /* claimed with the node's first process */
     
     b->NumberOfProcesses  = 0;   /* initialise node state */
     b->HandleNumber       = 0;
@@ -416,6 +646,8 @@ struct NodeInfo *CreateNode(unsigned int    node,
     b->PktsRX             = 0;
     b->DMATicks           = 0;
     b->SyncWait           = false;
+    b->ShadowG            = NULL;
+    b->ShadowE            = NULL;
     return b;
 }
 
@@ -430,7 +662,9 @@ struct NodeInfo *CreatePrototype(char          *name,
                                  unsigned int  *labs,      unsigned int nlabs)
 {
     struct NodeInfo *b;
+    NametableItem   *args;
     unsigned int    s;
+    unsigned int    i;
     
     b = FindNamedNode(name);
     if (b != NULL)
@@ -458,6 +692,7 @@ struct NodeInfo *CreatePrototype(char          *name,
     s = strlen(name) + 1;   /* copy node name */
     b->NodeName = malloc(s);
     memcpy(b->NodeName, name, s);
+    AddNamedNode(b);
     
     s = sizeof(Instruction) * (codesize + 1);  /* copy instructions */
     workspace += s;
@@ -533,6 +768,24 @@ struct NodeInfo *CreatePrototype(char          *name,
     }
     memcpy(b->Procedures, procs, s);
 
+    s = 0;  /* the args and locals of all the procedures share one block, sized to those declared */
+    for (i=0; i<=nprocs; i+=1)
+    {
+        s += sizeof(NametableItem) * (procs[i].nLocals + 1);
+    }
+    workspace += s;
+    args = malloc(s);
+    if (args == NULL)
+    {
+        Runtime_Error(217, "Unable to allocate memory for Procedures: prototype node %s\n", name);
+    }
+    for (i=0; i<=nprocs; i+=1)
+    {
+        b->Procedures[i].Args = args;
+        memcpy(args, procs[i].Args, sizeof(NametableItem) * (procs[i].nLocals + 1));
+        args += procs[i].nLocals + 1;
+    }
+
     b->NumberOfProcedures = nprocs;
 
     b->NumberOfProcesses  = 0;   /* initialise node state */
@@ -544,6 +797,8 @@ struct NodeInfo *CreatePrototype(char          *name,
     b->Tickrate           = CLOCK_FREQUENCY / 1000;  /* default 1 ms */
     b->PktsTX             = 0;
     b->PktsRX             = 0;
+    b->ShadowG            = NULL;
+    b->ShadowE            = NULL;
     
     return b;
 }
@@ -566,8 +821,9 @@ void DeleteNode(unsigned int node)
 
     if (b->PktsTX > 0 || b->PktsRX > 0)
     {
-        printf("Node=%d TxPkts=%d RxPkts=%d\n", b->NodeNumber, b->PktsTX, b->PktsRX);
+        Report("Node=%d TxPkts=%d RxPkts=%d\n", b->NodeNumber, b->PktsTX, b->PktsRX);
     }
+    RecordTraffic(b->NodeNumber, b->PktsTX, b->PktsRX);
    
     TotalTicks += b->SystemTicks;
     
@@ -575,6 +831,8 @@ void DeleteNode(unsigned int node)
     free(b->E);
     free(b->ProcessHashTable);
     free(b->IntVector);
+    free(b->ShadowG);   /* checkpoint copies */
+    free(b->ShadowE);
 
     /* remove from linked list */
     RemoveLinkedNode(b);
@@ -586,34 +844,112 @@ void DeleteNode(unsigned int node)
     p->copies -= 1;
     if (p->copies == 0)  /* OK to remove parent from named nodelist? */
     {
-        free(p->NodeName);
-        free(p->Instructions);
-        free(p->Globals);
-        free(p->G);
-        free(p->Externals);
-        free(p->E);
-        free(p->Labels);
-        free(p->Procedures);
+        FreePrototype(p);
+    }
+    
+    NumberOfNodes -= 1;
+}
+
+/* --------------------------------------------------------- */
+void FreePrototype(struct NodeInfo *b)
+{
+    struct NodeInfo *p;
+
+    DeleteNamedNode(b);
+    free(b->NodeName);
+    free(b->Instructions);
+    free(b->Globals);
+    free(b->G);
+    free(b->Externals);
+    free(b->E);
+    free(b->Labels);
+    free(b->Procedures[0].Args);  /* the block of args and locals */
+    free(b->Procedures);
 
-        b = p;
-        p = NameNodeList;   /* remove node from named node list */
-        while (p != NULL)
+    p = NameNodeList;   /* remove node from named node list */
+    while (p != NULL)
+    {
+        if (p->NextNode == b)
         {
-            if (p->NextNode == b)
-            {
-                p->NextNode = b->NextNode;
-            }
-            p = p->NextNode;
+            p->NextNode = b->NextNode;
         }
-    
-        if (b == NameNodeList)
+        p = p->NextNode;
+    }
+
+    if (b == NameNodeList)
+    {
+        NameNodeList = b->NextNode;
+    }
+    free(b);
+}
+
+/* --------------------------------------------------------- */
+void FreeModel()  /* release the nodes, prototypes, links, logs and line table, so that another model can be read */
+{
+    struct NodeInfo  *b;
+    struct LimitItem *l;
+    struct PCB       *p;
+    unsigned int     i;
+
+    while (NodeList != NULL)  /* as DeleteNode, but the node need not have been scheduled */
+    {
+        b = NodeList;
+        NodeList = b->NextNode;
+        while (b->ProcessList != NULL)  /* a model stopped part way through */
+        {
+            p = b->ProcessList;
+            b->ProcessList = p->nextPCB;
+            free(p->stack);
+            free(p->shadow);
+            free(p);
+        }
+        free(b->G);
+        free(b->E);
+        free(b->ProcessHashTable);
+        free(b->IntVector);
+        free(b->ShadowG);
+        free(b->ShadowE);
+        free(b);
+    }
+    NodeListTail = NULL;
+    while (NameNodeList != NULL)
+    {
+        FreePrototype(NameNodeList);
+    }
+    while (LimitList != NULL)
+    {
+        l = LimitList;
+        LimitList = l->NextItem;
+        free(l);
+    }
+    LimitListTail = NULL;
+
+    free(HashTable);
+    free(NameHashTable);
+    HashTable           = NULL;
+    HashTableSize       = 0;
+    NumberOfHashedNodes = 0;
+    NameHashTable       = NULL;
+    NameHashTableSize   = 0;
+    NumberOfNames       = 0;
+    NumberOfNodes       = 0;
+
+    for (i=1; i<=LogStreams; i+=1)
+    {
+        if (LogData[i].stream != NULL)
         {
-            NameNodeList = b->NextNode;
+            fclose(LogData[i].stream);
         }
-        free(b);
+        LogData[i].stream = NULL;
     }
-    
-    NumberOfNodes -= 1;
+    LogStreams = 0;
+
+    FreeLinks();
+    free(LineNumberList);
+    free(ProcList);
+    LineNumberList = NULL;
+    NumberOfLines  = 0;
+    ProcList       = NULL;
 }
     
 /* --------------------------------------------------------- */
@@ -714,7 +1050,7 @@ void Interrupt(unsigned int dnode, unsigned int NodeId, int pkt)
     
     for (i=1; i<=d->NumberOfInterrupts; i+=1)
     {
-        if (d->IntVector[i].iNumber == node)
+        if (d->IntVector[i].iNumber <= node && node <= d->IntVector[i].iLast)
         {
             if (NodeId !=0 && d->CurrentProcess == NULL)  /* may need to move destination node clock backwards */
             {
@@ -826,6 +1162,7 @@ unsigned int CreateProcess(unsigned int node, unsigned int StartAddress, unsigne
     p->priority  = plevel;
     p->dticks    = 0;
     p->semaphore = NULL;
+    p->shadow    = NULL;
 
     p->saved_SP += 1;            /* push zero return addr */
     p->stack[p->saved_SP] = 0;
@@ -851,6 +1188,7 @@ void DeleteProcess(unsigned int node, unsigned int handle)
     }
     
     free(p->stack);
+    free(p->shadow);
     RemoveProcess(node, handle);
     if (p->prevPCB != NULL)
     {
@@ -881,6 +1219,10 @@ struct PCB *FindProcess(unsigned int node, unsigned int prev)
     
     n = 0;
     d = FindNode(node);
+    if (d->ProcessHashTable == NULL)
+    {
+        Runtime_Error(224, "Process missing in hash table node=%d handle=%d\n", node, prev);
+    }
     
     k = Hash(prev, ProcessHashTableSize);
     
@@ -920,6 +1262,14 @@ void AddProcess(unsigned int node, struct PCB *p)   /* add a process to the hash
     struct NodeInfo *d;
 
     d = FindNode(node);
+    if (d->ProcessHashTable == NULL)
+    {
+        d->ProcessHashTable = calloc(ProcessHashTableSize, sizeof(struct PCB *));
+        if (d->ProcessHashTable == NULL)
+        {
+            Runtime_Error(208, "Unable to allocate memory for process hash table\n");
+        }
+    }
     n = 0;
     k = Hash(p->handle, ProcessHashTableSize);
 
@@ -956,6 +1306,10 @@ void RemoveProcess(unsigned int node, unsigned int prev)   /* remove a process f
     
     n = 0;
     d = FindNode(node);
+    if (d->ProcessHashTable == NULL)
+    {
+        Runtime_Error(224, "Process missing in hash table node=%d handle=%d\n", node, prev);
+    }
     
     k = Hash(prev, ProcessHashTableSize);
     
@@ -1015,17 +1369,17 @@ void PrintStatistics()
     unsigned long long int t2;
     unsigned long long int StandbyTicks;
 
-    printf("Workspace: %d bytes\n", workspace);
+    Report("Workspace: %d bytes\n", workspace);
     
     gettimeofday(&tv, NULL);
     t2 = tv.tv_sec * 1000000LL + tv.tv_usec;
-    printf("Execution time: %f secs\n", (float) (t2 - t1) / 1.0E6);
+    Report("Execution time: %f secs\n", (float) (t2 - t1) / 1.0E6);
     
-    printf("Computing ticks: %llu (%f s)\n", ProcessingTicks, TicksToTime(ProcessingTicks));
+    Report("Computing ticks: %llu (%f s)\n", ProcessingTicks, TicksToTime(ProcessingTicks));
     StandbyTicks = TotalTicks - ProcessingTicks;
-    printf("Standby ticks: %llu (%f s) %6.2f%%\n", StandbyTicks, TicksToTime(StandbyTicks), 
+    Report("Standby ticks: %llu (%f s) %6.2f%%\n", StandbyTicks, TicksToTime(StandbyTicks), 
             100.0 * (double) StandbyTicks / (double) TotalTicks); 
-    printf("Average Search Length in Node List %f\n", AverageSearches);
+    Report("Average Search Length in Node List %f\n", AverageSearches);
 }
 
 /* --------------------------------------------------------- */
@@ -1091,34 +1445,105 @@ bool StackPopbool()
 }
 
 /* --------------------------------------------------------- */
-struct tnode *FindLink(unsigned int n, struct tnode *p)
+int CompareLinkOrder(const void *a, const void *b)  /* by first source, then in the order given */
 {
-    if (p == NULL)
+    unsigned int x = *(const unsigned int *) a;
+    unsigned int y = *(const unsigned int *) b;
+
+    if (Links[x].slow != Links[y].slow)
     {
-        return NULL;
+        return (Links[x].slow < Links[y].slow) ? -1 : 1;
     }
-    else
+    return (x < y) ? -1 : (x > y);
+}
+
+/* --------------------------------------------------------- */
+void IndexLinks()  /* sort the link ranges so that the links of a source can be found by a binary search */
+{
+    unsigned int i;
+
+    free(LinkOrder);
+    free(LinkReach);
+    free(LinkHits);
+    LinkOrder = malloc(sizeof(unsigned int) * (NumberOfLinks + 1));
+    LinkReach = malloc(sizeof(unsigned int) * (NumberOfLinks + 1));
+    LinkHits  = malloc(sizeof(unsigned int) * (NumberOfLinks + 1));
+    if (LinkOrder == NULL || LinkReach == NULL || LinkHits == NULL)
+    {
+        Runtime_Error(226, "Unable to allocate link table\n");
+    }
+
+    for (i=1; i<=NumberOfLinks; i+=1)
+    {
+        LinkOrder[i] = i;
+    }
+    qsort(&LinkOrder[1], NumberOfLinks, sizeof(unsigned int), CompareLinkOrder);
+    for (i=1; i<=NumberOfLinks; i+=1)
     {
-        if (n < p->node)
+        LinkReach[i] = Links[LinkOrder[i]].shigh;
+        if (i > 1 && LinkReach[i - 1] > LinkReach[i])
         {
-            return FindLink(n, p->left);
+            LinkReach[i] = LinkReach[i - 1];
         }
-        else if (n > p->node)
+    }
+    nLinkOrder = NumberOfLinks;
+}
+
+/* --------------------------------------------------------- */
+unsigned int FindLinks(unsigned int n)  /* the links from source n into LinkHits[1..], in the order given */
+{
+    unsigned int lo;
+    unsigned int hi;
+    unsigned int m;
+    unsigned int i;
+    unsigned int j;
+    unsigned int nhits;
+
+    if (nLinkOrder != NumberOfLinks || LinkOrder == NULL)
+    {
+        IndexLinks();
+    }
+
+    lo = 1;  /* the last link starting at or below n */
+    hi = NumberOfLinks + 1;
+    while (lo < hi)
+    {
+        m = (lo + hi) / 2;
+        if (Links[LinkOrder[m]].slow <= n)
         {
-            return FindLink(n, p->right);
+            lo = m + 1;
         }
         else
         {
-            return p;
+            hi = m;
         }
     }
+
+    nhits = 0;
+    for (i=lo-1; i>=1 && LinkReach[i]>=n; i-=1)  /* back while an earlier link could still reach n */
+    {
+        if (Links[LinkOrder[i]].shigh >= n)
+        {
+            j = nhits;
+            while (j > 0 && LinkHits[j] > LinkOrder[i])
+            {
+                LinkHits[j + 1] = LinkHits[j];
+                j -= 1;
+            }
+            LinkHits[j + 1] = LinkOrder[i];
+            nhits += 1;
+        }
+    }
+    return nhits;
 }
 
 /* --------------------------------------------------------- */
 void SendPkt(unsigned int SourceNode, unsigned int port, int DataValue)
 {
-    int             i;
-    struct tnode    *p;
+    unsigned int    i;
+    unsigned int    n;
+    unsigned int    dn;
+    LinkItem        *p;
     struct NodeInfo *d;
     struct NodeInfo *s;
   
@@ -1129,23 +1554,27 @@ void SendPkt(unsigned int SourceNode, unsigned int port, int DataValue)
     
     //printf("SendPkt: sourcenode=%d port=%d data=%d\n", SourceNode, port, DataValue); // ***
     s = FindNode(SourceNode);
-    p = FindLink(SourceNode, Links);
-    if (p == NULL)
+    n = FindLinks(SourceNode);
+    if (n == 0)
     {
         return;
         //Runtime_Error(230, "Unknown source node (%d)\n", SourceNode);
     }
 
-    for (i=1; i<=p->ndest; i+=1)
+    for (i=1; i<=n; i+=1)
     {
-        d = FindNode(p->destinations[i]);
-        if (d != NULL)
+        p = &Links[LinkHits[i]];
+        for (dn=p->dlow; dn<=p->dhigh; dn+=1)
         {
-            //dont interrupt blocked cores
-            if (!d->SyncWait){
-                Interrupt(p->destinations[i], (SourceNode << 11) + port, DataValue);
-                Reschedule(p->destinations[i]);
-                ShowPkt((SourceNode << 11) + port, p->destinations[i], DataValue, s->SystemTicks);
+            d = FindNode(dn);
+            if (d != NULL)
+            {
+                //dont interrupt blocked cores
+                if (!d->SyncWait){
+                    Interrupt(dn, (SourceNode << 11) + port, DataValue);
+                    Reschedule(dn);
+                    ShowPkt((SourceNode << 11) + port, dn, DataValue, s->SystemTicks);
+                }
             }
         }
     }
@@ -1153,6 +1582,67 @@ void SendPkt(unsigned int SourceNode, unsigned int port, int DataValue)
     s->PktsTX += 1;
 }
 
+/* --------------------------------------------------------- */
+bool DeliverPkt(unsigned int SourceNode, unsigned int port, unsigned int DestNode, int DataValue)
+{
+    struct NodeInfo *d;
+    unsigned int    i;
+
+    d = FindNode(DestNode);
+    if (d == NULL || d->SyncWait)
+    {
+        return false;
+    }
+
+    for (i=1; i<=d->NumberOfInterrupts; i+=1)
+    {
+        if (d->IntVector[i].iNumber <= SourceNode && SourceNode <= d->IntVector[i].iLast)
+        {
+            Interrupt(DestNode, (SourceNode << 11) + port, DataValue);
+            Reschedule(DestNode);
+            ShowPkt((SourceNode << 11) + port, DestNode, DataValue, d->SystemTicks);
+            return true;
+        }
+    }
+    return false;  /* destination has no handler for this source */
+}
+
+/* --------------------------------------------------------- */
+bool InjectPkt(unsigned int SourceNode, unsigned int port, unsigned int DestNode, int DataValue)  /* packet from outside the model */
+{
+    LinkItem     *p;
+    unsigned int i;
+    unsigned int n;
+    unsigned int dn;
+    bool         delivered;
+
+    if (port > 2047)
+    {
+        Runtime_Error(3, "Invalid port (%d)\n", port);
+    }
+    CurrentNode = NodeList;  /* the packet arrives at the time of the node furthest behind */
+
+    if (DestNode != 0)
+    {
+        return DeliverPkt(SourceNode, port, DestNode, DataValue);
+    }
+
+    delivered = false;
+    n = FindLinks(SourceNode);  /* otherwise to wherever the source is linked */
+    for (i=1; i<=n; i+=1)
+    {
+        p = &Links[LinkHits[i]];
+        for (dn=p->dlow; dn<=p->dhigh; dn+=1)
+        {
+            if (DeliverPkt(SourceNode, port, dn, DataValue))
+            {
+                delivered = true;
+            }
+        }
+    }
+    return delivered;
+}
+
 /* --------------------------------------------------------- */
 void WriteTimeStamp(int n)
 {
@@ -1167,12 +1657,16 @@ void WriteTimeStamp(int n)
 }
 
 /* --------------------------------------------------------- */
-void ShowPkt(unsigned int snode, unsigned int dnode, int pkt, unsigned int tstamp)
+void ShowPkt(unsigned int snode, unsigned int dnode, int pkt, unsigned long long int tstamp)
 {
-    if (Monitoring)
+    if (PacketHook != NULL && !Replaying)
+    {
+        PacketHook(snode >> 11, snode & 0x7ff, dnode, pkt, tstamp, PacketContext);
+    }
+    if (Monitoring && !Replaying)
     {
         WriteTimeStamp(snode >> 11);
-        printf(" %d->%d port %d [%d] Rx:%d\n", snode >> 11, dnode, snode & 0x7ff, pkt, tstamp);
+        printf(" %d->%d port %d [%d] Rx:%d\n", snode >> 11, dnode, snode & 0x7ff, pkt, (unsigned int) tstamp);
     }
 }
 
@@ -1386,7 +1880,7 @@ void MonadicOp(unsigned int Op)
 }
 
 /* --------------------------------------------------------- */
-void myprintf(char *fmt, ...)
+void myprintf(char *fmt, ...)  /* formatted into PrintBuffer */
 {
     va_list  list;
     char         *p, *r;
@@ -1399,13 +1893,20 @@ void myprintf(char *fmt, ...)
     char         t;
     bool      sfound;
     
+    PrintLength = 0;
+    if (PrintBuffer == NULL)
+    {
+        PrintBuffer = Grow(PrintBuffer, &PrintBufferSize, 256, 1);
+    }
+    PrintBuffer[0] = '\0';
+
     va_start(list, fmt);
 
     for (p=fmt; *p; ++p)
     {
         if (*p != '%')
         {
-            printf("%c", *p);
+            PrintAppend("%c", *p);
         }
         else
         {
@@ -1436,41 +1937,102 @@ void myprintf(char *fmt, ...)
             {
                 case 'd': case 'i': case 'o': case 'x': case 'X': case 'u': 
                     e = va_arg(list, int);
-                    printf(str, e);
+                    PrintAppend(str, e);
                     continue;
                 
                 case 'c':
                     c = va_arg(list, int);
-                    printf(str, c);
+                    PrintAppend(str, c);
                     continue;
                     
                 case 's':
                     r = va_arg(list, char *);
-                    printf(str, r);
+                    PrintAppend(str, r);
                     continue;
                     
                 case 'f': case 'e': case 'E': case 'g': case 'G': 
                     x = (double) va_arg(list, int) / 65536.0;
-                    printf(str, x);
+                    PrintAppend(str, x);
                     continue;
 
                 case 'p':
                     u = (long int) va_arg(list, void *);
-                    printf(str, u);
+                    PrintAppend(str, u);
                     continue;
 
                 case '%':
-                    printf("%%");
+                    PrintAppend("%%");
                     continue;
                 
                 default:
-                    printf("%c", *p);
+                    PrintAppend("%c", *p);
             }
         }
     }
     va_end(list);
 }
 
+/* --------------------------------------------------------- */
+void PrintAppend(char *fmt, ...)
+{
+    va_list list;
+
+    va_start(list, fmt);
+    PrintAppendList(fmt, list);
+    va_end(list);
+}
+
+/* --------------------------------------------------------- */
+void PrintAppendList(char *fmt, va_list list)
+{
+    va_list again;
+    int     n;
+
+    if (PrintBuffer == NULL)
+    {
+        PrintBuffer = Grow(PrintBuffer, &PrintBufferSize, 256, 1);
+    }
+    va_copy(again, list);
+    n = vsnprintf(&PrintBuffer[PrintLength], PrintBufferSize - PrintLength, fmt, list);
+    if (n > 0 && PrintLength + n >= PrintBufferSize)  /* truncated - grow the buffer and again */
+    {
+        PrintBuffer = Grow(PrintBuffer, &PrintBufferSize, PrintLength + n, 1);
+        n = vsnprintf(&PrintBuffer[PrintLength], PrintBufferSize - PrintLength, fmt, again);
+    }
+    va_end(again);
+    if (n > 0)
+    {
+        PrintLength += n;
+    }
+}
+
+/* --------------------------------------------------------- */
+void Report(char *fmt, ...)  /* a message of the emulator's own, as ReportBuffer */
+{
+    va_list list;
+
+    PrintLength = 0;
+    va_start(list, fmt);
+    PrintAppendList(fmt, list);
+    va_end(list);
+    ReportBuffer();
+}
+
+/* --------------------------------------------------------- */
+void ReportBuffer()
+/* the emulator's text in PrintBuffer goes to the printf hook as from node 0, if a program embedding the
+   emulator has set one, or is dropped in a library call that has not; otherwise to stdout */
+{
+    if (PrintHook != NULL)
+    {
+        PrintHook(0, PrintBuffer, (CurrentNode != NULL) ? CurrentNode->SystemTicks : 0, PrintContext);
+    }
+    else if (FatalErrorPoint == NULL)
+    {
+        fwrite(PrintBuffer, 1, PrintLength, stdout);
+    }
+}
+
 /* --------------------------------------------------------- */
 void myfprintf(FILE *stream, char *fmt, ...)
 {
@@ -1703,90 +2265,30 @@ void RemoveLinkedLimit(struct LimitItem *i){
 /* --------------------------------------------------------- */
 void Emulate(bool debugging, bool archecking)
 {
-    unsigned int           Op  = 0;
-    int                    Arg = 0;
+    StartEmulation(debugging, archecking);
+
+    if (debugging)
+    {
+        if (setjmp(RewindPoint) != 0)
+        {
+            EmulationTimeout = 0;  /* the debugger has restored a snapshot */
+        }
+    }
+
+    RunEmulation(ULLONG_MAX, ULLONG_MAX);
+}
+
+/* --------------------------------------------------------- */
+void StartEmulation(bool debugging, bool archecking)  /* the main process of each node, and the schedule */
+{
     unsigned int           i;
     struct NodeInfo        *h;
     unsigned int           phandle;
     struct PCB             *d;
-    unsigned int           timeout;
     struct timeval         tv;
-    unsigned int           *ProcList = NULL;
-    
-    const int InstructionTime[68] =
-    {
-        0, /*                0  */
-        1, /* s_LG           1  */
-        1, /* s_LP           2  */
-        1, /* s_LN           3  */
-        1, /* s_LSTR         4  */
-        1, /* s_LL           5  */
-        1, /* s_LLG          6  */
-        1, /* s_LLP          7  */
-        1, /* s_LLL          8  */
-        1, /* s_EQ           9  */
-        1, /* s_NE          10  */
-        1, /* s_LS          11  */
-        1, /* s_GR          12  */
-        1, /* s_LE          13  */
-        1, /* s_GE          14  */
-        1, /* s_JT          15  */
-        1, /* s_JF          16  */
-        1, /* s_JUMP        17  */
-        1, /* s_OR          18  */
-        1, /* s_AND         19  */
-        1, /* s_PLUS        20  */
-        1, /* s_MINUS       21  */
-        1, /* s_MULT        22  */
-       11, /* s_MULTF       23  */
-       57, /* s_DIV         24  */
-      129, /* s_DIVF        25  */
-       57, /* s_REM         26  */
-        1, /* s_NEG         27  */
-        1, /* s_NOT         28  */
-        1, /* s_ABS         29  */
-        1, /* s_SG          30  */
-        1, /* s_SP          31  */
-        1, /* s_SL          32  */
-        1, /* s_SYSCALL     33  */
-        1, /* s_LOGAND      34  */
-        1, /* s_LOGOR       35  */
-        1, /* s_NEQV        36  */
-        1, /* s_LSHIFT      37  */
-        1, /* s_RSHIFT      38  */
-        1, /* s_COMP        39  */
-        1, /* s_SWITCHON    40  */
-        0, /* s_FNAP        41  */
-        0, /* s_RTAP        42  */
-        1, /* s_RTRN        43  */
-        1, /* s_ENTRY       44  */
-        1, /* s_RV          45  */
-        1, /* s_STIND       46  */
-        1, /* s_PUSHTOS     47  */
-        1, /* s_VCOPY       48  */
-        1, /* s_FLOAT       49  */
-        1, /* s_INT         50  */
-        1, /* s_SWAP        51  */
-        0, /* s_DEBUG       52  */
-        0, /* s_BOUNDSCHECK 53  */
-        0, /* spare         54  */
-        0, /* spare         55  */
-        0, /* spare         56  */
-        0, /* spare         57  */
-        0, /* spare         58  */
-        0, /* spare         59  */
-
-        0, /* s_STACK       60  */
-        0, /* s_QUERY       61  */
-        0, /* s_STORE       62  */
-        0, /* s_SAVE        63  */
-        0, /* s_RES         64  */
-        0, /* s_RSTACK      65  */
-        0, /* s_LAB         66  */
-        0, /* s_DISCARD     67  */
-    };
 
     ArithmeticChecking = archecking;
+    EmulationDebugging = debugging;
     
     if (debugging)
     {
@@ -1795,26 +2297,9 @@ void Emulate(bool debugging, bool archecking)
     
     ProcessingTicks = 0;
     TotalTicks = 0;
+    CheckpointInit();
     
-    if (NumberOfNodes < 5)
-    {
-         HashTableSize = 10;
-    }
-    else
-    {
-        HashTableSize = NumberOfNodes * 2;
-    }
-    
-    HashTable = malloc(sizeof(int) * HashTableSize);
-    if (HashTable == NULL)
-    {
-        Runtime_Error(231, "Unable to allocate hash table\n");
-    }
-    
-    for (i=0; i<HashTableSize; i+=1)
-    {
-        HashTable[i] = NULL;
-    }
+    IndexLinks();  /* the nodes are in the hash table from their creation */
     
     if (ProfileNode != 0)
     {
@@ -1847,8 +2332,6 @@ void Emulate(bool debugging, bool archecking)
     h = NodeList;
     while (h != NULL)
     {
-        AddNode(h->NodeNumber, h);
-
         phandle = CreateProcess(h->NodeNumber, h->PC, StackSize, 0);
         if (phandle == 0)
         {
@@ -1870,7 +2353,7 @@ void Emulate(bool debugging, bool archecking)
     //initialise the timer
     gettimeofday(&tv, NULL);
     t1 = tv.tv_sec * 1000000LL + tv.tv_usec;
-    timeout = 0;
+    EmulationTimeout = 0;
     sync_count = 0;
 
     //construct Limit List (all items are within the same limit as all SystemtTicks are at 0)
@@ -1888,12 +2371,62 @@ void Emulate(bool debugging, bool archecking)
         h = h->NextNode;
     }
 
+    if (RestoreFile != NULL)
+    {
+        RestoreCheckpoint(RestoreFile);
+    }
+
+    if (StimulusFile != NULL)
+    {
+        OpenStimulus(StimulusFile, NodeList->SystemTicks, RestoreFile != NULL);
+    }
+}
+
+/* --------------------------------------------------------- */
+unsigned int RunEmulation(unsigned long long int ticks, unsigned long long int instructions)  /* until every node has reached ticks, or instructions have been executed in all */
+{
+    unsigned int           Op  = 0;
+    int                    Arg = 0;
+    unsigned int           i;
+    struct NodeInfo        *h;
+    struct PCB             *d;
+
     //Main execution loop
     while (1)
     {
         //get the next node (front of the queue)
         CurrentNode = NodeList;
 
+        if (CurrentNode->SystemTicks >= ticks || InstructionCount >= instructions)
+        {
+            return EMULATION_PAUSED;
+        }
+
+        if (CurrentNode->SystemTicks >= NextStimulus)  /* every node has reached the time of the next input packet */
+        {
+            ApplyStimulus(CurrentNode->SystemTicks);
+            continue;  /* a node may have been woken, and its clock moved back */
+        }
+
+        if (BranchTicks > 0 && CurrentNode->SystemTicks >= BranchTicks)  /* every node has reached the branch time */
+        {
+            if (!ForkBranches())
+            {
+                EndEmulation();
+                return EMULATION_FINISHED;
+            }
+        }
+
+        if (NextCheckpoint > 0 && CurrentNode->SystemTicks >= NextCheckpoint)  /* every node has reached the checkpoint */
+        {
+            WriteCheckpoint(CurrentNode->SystemTicks);
+        }
+
+        if (EmulationDebugging)
+        {
+            Debug_Snapshot(CurrentNode);
+        }
+
         if (CurrentNode->SystemTicks >= CurrentNode->LastClockTick + CurrentNode->Tickrate)
         {
 
@@ -1930,32 +2463,33 @@ void Emulate(bool debugging, bool archecking)
             if (CurrentNode->DMATicks == 0)
             {
                CurrentNode->SystemTicks = CurrentNode->LastClockTick + CurrentNode->Tickrate;  // jump ahead to next clk tick
+               if (CurrentNode->SystemTicks > NextStimulus)
+               {
+                   CurrentNode->SystemTicks = NextStimulus;  /* or to the next input packet */
+               }
                ReorderLinkedListItem(CurrentNode);
             }
-            timeout += 1;
+            EmulationTimeout += 1;
             
-            if (timeout > 1000000)
+            if (EmulationTimeout > 1000000 && NextStimulus == ULLONG_MAX)  /* no input packet is to come */
             {
-                if (debugging)
+                if (EmulationDebugging)
                 {
                     Debug_End();
                 }
-                printf("Timeout:\n");
-                free(LineNumberList);
-                free(HashTable);
-                if (ProcList != NULL)
+                Report("Timeout:\n");
+                for (h=NodeList; h!=NULL; h=h->NextNode)  /* nodes still running keep their packet counts */
                 {
-                    free(ProcList);
+                    RecordTraffic(h->NodeNumber, h->PktsTX, h->PktsRX);
                 }
-                CloseLogs();
-                PrintStatistics();
-                return;
+                EndEmulation();
+                return EMULATION_TIMEOUT;
             }
             continue;
         }
         else
         {
-            timeout = 0;
+            EmulationTimeout = 0;
         }
         
 
@@ -2009,6 +2543,12 @@ void Emulate(bool debugging, bool archecking)
             printf(" Clk=%llu\n", CurrentNode->SystemTicks);
         }
         
+        InstructionCount += 1;
+        if (EmulationDebugging)
+        {
+            Debug_Replay(CurrentNode);
+        }
+
         ExecuteInstruction(Op, Arg);
 
         //as long as the instruction was not exit then reorder node list
@@ -2018,23 +2558,33 @@ void Emulate(bool debugging, bool archecking)
 
         if (NumberOfNodes == 0)
         {
-            if (debugging)
+            if (EmulationDebugging)
             {
                 Debug_End();
             }
-            free(LineNumberList);
-            free(HashTable);
-            if (ProcList != NULL)
-            {
-                free(ProcList);
-            }
-            CloseLogs();
-            PrintStatistics();
-            return;
+            EndEmulation();
+            return EMULATION_FINISHED;
         }
     }
 }
 
+/* --------------------------------------------------------- */
+void EndEmulation()
+{
+    free(LineNumberList);
+    free(HashTable);
+    free(ProcList);
+    LineNumberList      = NULL;
+    NumberOfLines       = 0;
+    HashTable           = NULL;
+    HashTableSize       = 0;
+    NumberOfHashedNodes = 0;
+    ProcList            = NULL;
+    CloseStimulus();
+    CloseLogs();
+    PrintStatistics();
+}
+
 /* --------------------------------------------------------- */
 void FetchInstruction(unsigned int *Op, int *Arg)
 {
@@ -2363,14 +2913,25 @@ void ExecuteInstruction(unsigned int Op, int Arg)
                 break;
 
             case 3:  /* printf */
-                WriteTimeStamp(h->NodeNumber);
-                printf("%d   ", h->NodeNumber);
-                myprintf((char *) Args[1], Args[2], Args[3], Args[4], Args[5], Args[6], Args[7], Args[8], Args[9], Args[10], Args[11]);
+                if (!Replaying)  /* already printed before the debugger went back */
+                {
+                    myprintf((char *) Args[1], Args[2], Args[3], Args[4], Args[5], Args[6], Args[7], Args[8], Args[9], Args[10], Args[11]);
+                    if (PrintHook != NULL)
+                    {
+                        PrintHook(h->NodeNumber, PrintBuffer, h->SystemTicks, PrintContext);
+                    }
+                    else
+                    {
+                        WriteTimeStamp(h->NodeNumber);
+                        printf("%d   ", h->NodeNumber);
+                        fwrite(PrintBuffer, 1, PrintLength, stdout);
+                    }
+                }
                 h->PC += 1;
                 break;
 
             case 4:  /* exit */
-                printf("Node (%d) Exit %d\n", h->NodeNumber, Args[1]);
+                Report("Node (%d) Exit %d\n", h->NodeNumber, Args[1]);
 
                 while (h->ProcessList != NULL)  /* remove all processes */
                 {
@@ -2517,12 +3078,163 @@ void ExecuteInstruction(unsigned int Op, int Arg)
     }
 }
 
+/* --------------------------------------------------------- */
+bool EvaluableCall(struct NodeInfo *h, unsigned int lab, unsigned int excluded)  /* lab starts a procedure whose code is complete */
+{
+    unsigned int a = h->Labels[lab];
+    unsigned int p;
+
+    if (a == 0 || a > h->ProgramSize || h->Instructions[a].Op != s_ENTRY)
+    {
+        return false;
+    }
+    p = h->Instructions[a].Arg;
+    return p != excluded && h->Procedures[p].Versions > 1;
+}
+
+/* --------------------------------------------------------- */
+bool OnEvaluationStack(struct NodeInfo *h, int a, unsigned int bytes)  /* a is an address as the program holds it */
+{
+    unsigned int offset;
+    unsigned int size;
+
+    offset = (unsigned int) a - (unsigned int) (uintptr_t) &h->S[1];
+    size   = StackSize * sizeof(int);
+    return offset <= size && bytes <= size - offset;
+}
+
+/* --------------------------------------------------------- */
+bool EvaluateProcedure(Instruction   *code,  unsigned int codesize,
+                       unsigned int  *labs,  ProcedureItem *procs,
+                       unsigned int  p,      unsigned int  excluded,
+                       struct NodeInfo *parent,
+                       int           args[], int           *result)
+{
+    /* the compiler runs procedure p on a node of its own; the call is refused if it would
+       touch globals, externals, packets or the clock, call a procedure which is not yet
+       complete, or run for too long */
+    struct NodeInfo n;
+    struct PCB      process;
+    struct NodeInfo *oldnode = CurrentNode;
+    unsigned int    Op;
+    int             Arg;
+    unsigned int    steps = 0;
+    unsigned int    i;
+    bool            pure = true;
+
+    memset(&n, 0, sizeof(n));
+    memset(&process, 0, sizeof(process));
+    process.stack     = calloc(StackSize + 1, sizeof(int));
+    process.stacksize = StackSize;
+    process.status    = Running;
+    if (process.stack == NULL)
+    {
+        Runtime_Error(251, "Unable to allocate stack for compile-time evaluation\n");
+    }
+
+    n.NodeName       = procs[p].Name;
+    n.Parent         = parent;
+    n.S              = process.stack;
+    n.Instructions   = code;
+    n.ProgramSize    = codesize;
+    n.Labels         = labs;
+    n.Procedures     = procs;
+    n.ProcessList    = &process;
+    n.CurrentProcess = &process;
+    n.Tickrate       = 1;
+    CurrentNode      = &n;
+
+    if (!EvaluableCall(&n, procs[p].Label, excluded))
+    {
+        pure = false;
+    }
+    else
+    {
+        for (i=1; i<=procs[p].nArgs; i+=1)
+        {
+            StackPush(args[i]);
+        }
+        StackPush(EndOfEvaluation);
+        n.PC = labs[procs[p].Label];
+    }
+
+    while (pure && n.PC != EndOfEvaluation)
+    {
+        if (steps >= MaxEvaluationSteps || n.PC == 0 || n.PC > codesize)
+        {
+            pure = false;
+            break;
+        }
+        steps += 1;
+        FetchInstruction(&Op, &Arg);
+
+        switch (Op)
+        {
+        case s_LG:
+        case s_SG:
+        case s_LLG:
+        case s_LSTR:
+        case s_LLL:
+        case s_GBOUNDSCHECK:
+            pure = false;
+            break;
+
+        case s_RV:
+        case s_STIND:
+            pure = OnEvaluationStack(&n, n.S[n.SP], bpw);
+            break;
+
+        case s_VCOPY:
+            pure = OnEvaluationStack(&n, n.S[n.SP], Arg) && OnEvaluationStack(&n, n.S[n.SP - 1], Arg);
+            break;
+
+        case s_SYSCALL:  /* abs and fabs only */
+            pure = n.S[n.SP] == 102 || n.S[n.SP] == 103;
+            break;
+
+        case s_FNAP:  /* the labels of the node are those of the compiler */
+        case s_RTAP:
+            pure = EvaluableCall(&n, n.S[n.SP], excluded);
+            if (pure)
+            {
+                Arg = StackPop();
+                StackPush(n.PC + 1);
+                n.PC = n.Labels[Arg];
+            }
+            continue;
+
+        case s_DEBUG:
+            n.PC += 1;
+            continue;
+        }
+
+        if (pure)
+        {
+            ExecuteInstruction(Op, Arg);
+        }
+    }
+
+    if (pure)
+    {
+        *result = StackTop();
+    }
+    free(process.stack);
+    CurrentNode = oldnode;
+    return pure;
+}
+
 /* --------------------------------------------------------- */
 void Tracing(bool mode)
 {
     TraceMode = mode;
 }
 
+/* --------------------------------------------------------- */
+void Rewind()  /* resume at the top of the emulation loop after the debugger restores a snapshot */
+{
+    longjmp(RewindPoint, 1);
+}
+
 /* --------------------------------------------------------- */
 void OpenProfile(unsigned int n, char Filename[])
 {
@@ -2572,13 +3284,21 @@ void CloseProfile()
 unsigned int OpenLog(unsigned int n, char Filename[], char PrototypeName[], char ChannelName[], char Format[], 
                      unsigned long long int t1, unsigned long long int t2, unsigned long long int t3, bool logging)
 {
-    FILE *s;
     char fname[MaxStringSize];
 
     sprintf(fname, "%s_%s_%d_%s.dat", Filename, PrototypeName, n, ChannelName);
+    return OpenLogFile(n, fname, Format, t1, t2, t3, logging);
+}
+
+/* --------------------------------------------------------- */
+unsigned int OpenLogFile(unsigned int n, char fname[], char Format[], 
+                         unsigned long long int t1, unsigned long long int t2, unsigned long long int t3, bool logging)
+{
+    FILE *s;
+
 	if (LogFiles)
 	{
-        s = fopen(fname, "w");
+        s = fopen(fname, (RestoreFile != NULL) ? "a" : "w");  /* a restore rewinds to the checkpoint */
         if (s == NULL)
         {
             Runtime_Error(123, "Unable to open log file %s\n", fname);
@@ -2643,6 +3363,118 @@ void CloseLogs()
     LogStreams = 0;
 }
 
+/* --------------------------------------------------------- */
+void TagLogs(char tag[])  /* ensemble worker: reopen the log and profile files under the variant's tag */
+{
+    unsigned int i;
+    unsigned int b;
+    char         fname[2 * MaxStringSize];
+
+    b = strlen(FileBaseName);
+    for (i=1; i<=LogStreams; i+=1)
+    {
+        if (strlen(LogData[i].name) + strlen(tag) + 1 >= MaxStringSize)
+        {
+            Runtime_Error(123, "Log file name too long %s\n", LogData[i].name);
+        }
+        sprintf(fname, "%s_%s%s", FileBaseName, tag, &LogData[i].name[b]);
+        strcpy(LogData[i].name, fname);
+        if (LogData[i].stream != NULL)
+        {
+            fclose(LogData[i].stream);
+            LogData[i].stream = fopen(fname, "w");
+            if (LogData[i].stream == NULL)
+            {
+                Runtime_Error(123, "Unable to open log file %s\n", fname);
+            }
+        }
+    }
+
+    if (ProfileStream != NULL)
+    {
+        fclose(ProfileStream);
+        sprintf(fname, "%s_%s", FileBaseName, tag);
+        OpenProfile(ProfileNode, fname);
+    }
+}
+
+/* --------------------------------------------------------- */
+void BranchLogs(char dir[])  /* branch worker: continue the logs and profile in the branch's directory */
+{
+    unsigned int i;
+    char         *base;
+    char         fname[2 * MaxStringSize];
+    FILE         *s;
+    int          ch;
+
+    for (i=1; i<=LogStreams; i+=1)
+    {
+        base = strrchr(LogData[i].name, '/');
+        base = (base == NULL) ? LogData[i].name : base + 1;
+        if (strlen(dir) + strlen(base) + 1 >= MaxStringSize)
+        {
+            Runtime_Error(123, "Log file name too long %s/%s\n", dir, base);
+        }
+        sprintf(fname, "%s/%s", dir, base);
+
+        if (LogData[i].stream != NULL)
+        {
+            fclose(LogData[i].stream);  /* flushed before the fork */
+            LogData[i].stream = fopen(fname, "w");
+            if (LogData[i].stream == NULL)
+            {
+                Runtime_Error(123, "Unable to open log file %s\n", fname);
+            }
+
+            s = fopen(LogData[i].name, "r");  /* copy the samples logged before the branch */
+            if (s != NULL)
+            {
+                while ((ch = getc(s)) != EOF)
+                {
+                    putc(ch, LogData[i].stream);
+                }
+                fclose(s);
+            }
+        }
+        strcpy(LogData[i].name, fname);
+    }
+
+    if (ProfileStream != NULL)
+    {
+        fclose(ProfileStream);
+        base = strrchr(FileBaseName, '/');
+        base = (base == NULL) ? FileBaseName : base + 1;
+        sprintf(fname, "%s/%s", dir, base);
+        OpenProfile(ProfileNode, fname);
+    }
+}
+
+/* --------------------------------------------------------- */
+void DiscardLogs()  /* close and remove the log and profile files without writing them */
+{
+    unsigned int i;
+    char         fname[MaxStringSize + 20];
+
+    for (i=1; i<=LogStreams; i+=1)
+    {
+        if (LogData[i].stream != NULL)
+        {
+            fclose(LogData[i].stream);
+            remove(LogData[i].name);
+        }
+        LogData[i].stream = NULL;
+    }
+    LogStreams = 0;
+
+    if (ProfileStream != NULL)
+    {
+        fclose(ProfileStream);
+        ProfileStream = NULL;
+        sprintf(fname, "%s_%d.pr", FileBaseName, ProfileNode);
+        remove(fname);
+    }
+}
+
 /* --------------------------------------------------------- */
 void UpdateLog(unsigned int n, bool logging)
 {
@@ -2687,6 +3519,7 @@ void Runtime_Error(unsigned int code, char *fmt, ...)
     unsigned int n = 0;
     unsigned int i;
     
+    PrintLength = 0;
 	if (CurrentNode != NULL)
 	{
         for (i=1; i<=NumberOfLines; i+=1)
@@ -2701,7 +3534,7 @@ void Runtime_Error(unsigned int code, char *fmt, ...)
             }
         }
 
-        printf("%s %d: node=%d line=%d ", (code < 1000) ? "Runtime error" : "WARNING", code, CurrentNode->NodeNumber, n);
+        PrintAppend("%s %d: node=%d line=%d ", (code < 1000) ? "Runtime error" : "WARNING", code, CurrentNode->NodeNumber, n);
     }
  
     va_start(list, fmt);
@@ -2710,7 +3543,7 @@ void Runtime_Error(unsigned int code, char *fmt, ...)
     {
         if (*p != '%')
         {
-            printf("%c", *p);
+            PrintAppend("%c", *p);
         } 
         else 
         {
@@ -2719,41 +3552,46 @@ void Runtime_Error(unsigned int code, char *fmt, ...)
                 case 's':
                 {
                     r = va_arg(list, char *);
-                    printf("%s", r);
+                    PrintAppend("%s", r);
                     continue;
                 }
  
                 case 'i':
                 {
                     e = va_arg(list, int);
-                    printf("%i", e);
+                    PrintAppend("%i", e);
                     continue;
                 }
  
                 case 'd':
                 {
                     e = va_arg(list, int);
-                    printf("%d", e);
+                    PrintAppend("%d", e);
                     continue;
                 }
  
                 case 'f':
                 {
                     f = va_arg(list, double);
-                    printf("%f", f);
+                    PrintAppend("%f", f);
                     continue;
                 }
  
                 default: 
-                     printf("%c", *p);
+                     PrintAppend("%c", *p);
             }
         }
     }
     
     va_end(list);
+    ReportBuffer();
 
     if (code < 1000)
     {
+        if (FatalErrorPoint != NULL)
+        {
+            longjmp(*FatalErrorPoint, (int) code);  /* the library call fails instead */
+        }
         Shutdown();
         exit(EXIT_FAILURE);
     }
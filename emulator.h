@@ -10,8 +10,16 @@
 #define CLOCK_FREQUENCY (200000000)      /* 200 MHz */
 #define MaxChannelOffsets 1000
 
+#define EMULATION_PAUSED   0            /* RunEmulation reached its limit */
+#define EMULATION_FINISHED 1            /* every node has exited */
+#define EMULATION_TIMEOUT  2            /* no node has anything more to do */
+
 enum ProcessState { Running, Waiting, Delaying, DMATransfer };
 
+typedef void (*PacketHandler)(unsigned int source, unsigned int port, unsigned int dest, int payload,
+                              unsigned long long int ticks, void *context);  /* each packet delivered */
+typedef void (*PrintHandler)(unsigned int node, char text[], unsigned long long int ticks, void *context);  /* each printf */
+
 struct LogInfo 
 {
 	FILE                   *stream;
@@ -41,6 +49,7 @@ struct PCB
     unsigned int           priority;
     unsigned int           dticks;
     int                    *semaphore;
+    int                    *shadow;
 };
 
 struct NodeInfo
@@ -84,6 +93,8 @@ struct NodeInfo
     unsigned long long int LastClockTick;         
     unsigned int           DMATicks;
     bool                   SyncWait;
+    int                    *ShadowG;
+    int                    *ShadowE;
 };
 
 struct LimitItem{
@@ -110,18 +121,41 @@ extern struct NodeInfo *CreateNode(unsigned int    node,
                                    InterruptVector *intv,     unsigned int intvsize);
 
 extern unsigned int ProfileNode;
+extern unsigned long long int BranchTicks;
+extern unsigned long long int InstructionCount;
+extern bool                   Replaying;
+extern bool                   ArithmeticChecking;
+extern PacketHandler          PacketHook;
+extern void                   *PacketContext;
+extern PrintHandler           PrintHook;
+extern void                   *PrintContext;
 
 extern void                   Emulate(bool debugging, bool archecking);
+extern void                   StartEmulation(bool debugging, bool archecking);
+extern unsigned int           RunEmulation(unsigned long long int ticks, unsigned long long int instructions);
 extern void                   FetchInstruction(unsigned int *Op, int *Arg);
 extern void                   ExecuteInstruction(unsigned int Op, int Arg);
+extern bool                   EvaluateProcedure(Instruction   *code,  unsigned int  codesize,
+                                                unsigned int  *labs,  ProcedureItem *procs,
+                                                unsigned int  p,      unsigned int  excluded,
+                                                struct NodeInfo *parent,
+                                                int           args[], int           *result);
 extern struct                 NodeInfo *FindNode(unsigned int n);
 extern struct                 NodeInfo *FindNamedNode(char *nodename);
 extern void                   Tracing(bool mode);
+extern void                   Rewind();
 extern unsigned int           OpenLog(unsigned int n, char Filename[], char PrototypeName[], char ChannelName[], char Format[], 
                                       unsigned long long int s1, unsigned long long int s2, unsigned long long int s3, bool logging);
+extern unsigned int           OpenLogFile(unsigned int n, char fname[], char Format[], 
+                                          unsigned long long int s1, unsigned long long int s2, unsigned long long int s3, bool logging);
 extern void                   AddLog(unsigned int channel, unsigned int offset);
 extern struct LogInfo         *GetLog(unsigned int channel);
 extern void                   OpenProfile(unsigned int n, char Filename[]);
+extern void                   TagLogs(char tag[]);
+extern void                   BranchLogs(char dir[]);
+extern bool                   InjectPkt(unsigned int SourceNode, unsigned int port, unsigned int DestNode, int DataValue);
+extern void                   DiscardLogs();
+extern void                   FreeModel();
 extern float                  TicksToTime(unsigned long long int t);
 extern unsigned long long int TimeToTicks(float t);
 
@@ -0,0 +1,547 @@
+/* DAMSON ensemble runs and what-if branches
+   ensemble: the model is compiled once and each variant is emulated from the start in a forked worker
+   branches: the model is emulated to a given time and then forked, each branch continuing with its variant
+   workers share code, name tables and constant vectors (and for branches, the warm-up state) copy-on-write
+
+   variant file: one variant per line, a tag followed by overrides
+       # tag   overrides
+       slow    gain=0.25 cell.threshold=12 weights[3]=-1
+       burst   packet=7,100,3,42
+   a name may be qualified by its prototype and indexed as a flat array
+   packet=dest,source,port,payload injects a packet into a branch (dest 0 - all linked destinations of source)
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#ifndef WIN32
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "compiler.h"
+#include "emulator.h"
+#include "ensemble.h"
+#include "stimulus.h"
+
+#define MaxLineSize 4000
+
+typedef struct
+{
+    char         Prototype[MaxStringSize + 1];  /* empty - all prototypes */
+    char         Name[MaxStringSize + 1];
+    unsigned int Index;
+    char         Value[MaxStringSize + 1];
+    bool         Packet;                        /* injected packet rather than a variable */
+    unsigned int Dest;
+    unsigned int Source;
+    unsigned int Port;
+    int          Payload;
+    unsigned int Line;                          /* of the variant file */
+} OverrideItem;
+
+typedef struct
+{
+    char         Tag[MaxStringSize + 1];
+    unsigned int nOverrides;
+    OverrideItem *Overrides;
+    int          pid;
+    int          status;
+} VariantItem;
+
+extern struct NodeInfo *NodeList;
+extern unsigned int    LineNumber;
+
+VariantItem  *Variants = NULL;
+unsigned int NumberOfVariants = 0;
+char         *VariantFileName = NULL;
+unsigned int BranchJobs = 0;
+
+void         ReadVariants(char Filename[]);
+void         ReadOverride(char str[], OverrideItem *o, unsigned int line);
+unsigned int ApplyOverride(OverrideItem *o, bool update);
+void         ShowOverride(OverrideItem *o);
+void         FreeVariants();
+void         RunVariant(VariantItem *v, bool archecking);
+void         StartBranch(VariantItem *v, unsigned long long int t);
+unsigned int SpawnWorkers(unsigned int jobs, char kind[]);
+unsigned int DefaultJobs(unsigned int jobs);
+
+/* --------------------------------------------------------- */
+void ReadOverride(char str[], OverrideItem *o, unsigned int line)  /* [proto.]name[[index]]=value */
+{
+    char *p;
+    char *q;
+
+    p = strchr(str, '=');
+    if (p == NULL || p == str || p[1] == '\0')
+    {
+        Error(411, "Ensemble: bad override %s at line %d\n", str, line);
+    }
+    *p = '\0';
+    strncpy(o->Value, p + 1, MaxStringSize);
+    o->Value[MaxStringSize] = '\0';
+    o->Line = line;
+
+    o->Packet = (strcmp(str, "packet") == 0);
+    if (o->Packet)
+    {
+        if (sscanf(o->Value, "%u,%u,%u,%i", &o->Dest, &o->Source, &o->Port, &o->Payload) != 4 || o->Port > 2047)
+        {
+            Error(411, "Ensemble: bad packet %s at line %d\n", o->Value, line);
+        }
+        strcpy(o->Name, str);
+        o->Prototype[0] = '\0';
+        o->Index = 0;
+        return;
+    }
+
+    o->Index = 0;
+    q = strchr(str, '[');
+    if (q != NULL)
+    {
+        *q = '\0';
+        o->Index = atoi(q + 1);
+        if (strchr(q + 1, ']') == NULL)
+        {
+            Error(411, "Ensemble: ] missing in override %s at line %d\n", str, line);
+        }
+    }
+
+    q = strchr(str, '.');
+    if (q != NULL)
+    {
+        *q = '\0';
+        strncpy(o->Prototype, str, MaxStringSize);
+        str = q + 1;
+    }
+    else
+    {
+        o->Prototype[0] = '\0';
+    }
+    o->Prototype[MaxStringSize] = '\0';
+    strncpy(o->Name, str, MaxStringSize);
+    o->Name[MaxStringSize] = '\0';
+}
+
+/* --------------------------------------------------------- */
+void ReadVariants(char Filename[])
+{
+    FILE         *s;
+    char         line[MaxLineSize];
+    char         *tok;
+    char         *p;
+    unsigned int lineno;
+    unsigned int size;
+    unsigned int oldline;
+    VariantItem  *v;
+
+    s = fopen(Filename, "r");
+    if (s == NULL)
+    {
+        Error(410, "Ensemble: unable to open variant file %s\n", Filename);
+    }
+    VariantFileName = Filename;
+
+    oldline = LineNumber;
+    size = 0;
+    lineno = 0;
+    while (fgets(line, MaxLineSize, s) != NULL)
+    {
+        lineno += 1;
+        LineNumber = lineno;  /* an error is of the variant file, not the end of the source */
+        tok = strtok(line, " \t\r\n");
+        if (tok == NULL || tok[0] == '#')
+        {
+            continue;
+        }
+
+        if (NumberOfVariants + 1 >= size)
+        {
+            size = (size == 0) ? 64 : size * 2;
+            Variants = (VariantItem *) realloc(Variants, sizeof(VariantItem) * size);
+            if (Variants == NULL)
+            {
+                Error(412, "Ensemble: out of memory\n");
+            }
+        }
+        NumberOfVariants += 1;
+        v = &Variants[NumberOfVariants];
+
+        for (p=tok; *p; p+=1)  /* the tag is used in file names */
+        {
+            if (!isalnum((unsigned char) *p) && *p != '_' && *p != '-')
+            {
+                Error(411, "Ensemble: invalid variant tag %s at line %d\n", tok, lineno);
+            }
+        }
+        strncpy(v->Tag, tok, MaxStringSize);
+        v->Tag[MaxStringSize] = '\0';
+        v->nOverrides = 0;
+        v->Overrides = NULL;
+        v->pid = 0;
+        v->status = -1;
+
+        while ((tok = strtok(NULL, " \t\r\n")) != NULL)
+        {
+            if (tok[0] == '#')
+            {
+                break;
+            }
+            v->nOverrides += 1;
+            v->Overrides = (OverrideItem *) realloc(v->Overrides, sizeof(OverrideItem) * (v->nOverrides + 1));
+            if (v->Overrides == NULL)
+            {
+                Error(412, "Ensemble: out of memory\n");
+            }
+            ReadOverride(tok, &v->Overrides[v->nOverrides], lineno);
+            if (!v->Overrides[v->nOverrides].Packet && ApplyOverride(&v->Overrides[v->nOverrides], false) == 0)
+            {
+                Error(413, "Ensemble: unknown variable %s in variant %s at line %d\n", tok, v->Tag, lineno);
+            }
+        }
+    }
+    fclose(s);
+    LineNumber = oldline;
+}
+
+/* --------------------------------------------------------- */
+void FreeVariants()
+{
+    unsigned int i;
+
+    for (i=1; i<=NumberOfVariants; i+=1)
+    {
+        free(Variants[i].Overrides);
+    }
+    free(Variants);
+    Variants = NULL;
+    NumberOfVariants = 0;
+}
+
+/* --------------------------------------------------------- */
+unsigned int ApplyOverride(OverrideItem *o, bool update)  /* returns the number of nodes matched */
+{
+    struct NodeInfo *h;
+    NametableItem   *t;
+    int             *vec;
+    unsigned int    n;
+    unsigned int    i;
+    unsigned int    d;
+    unsigned int    size;
+    unsigned int    count;
+    double          x;
+    char            *name;
+
+    name  = InternedName(o->Name);  /* names are interned, so matched by pointer */
+    count = 0;
+    if (name == NULL)
+    {
+        return 0;  /* no variable has the name */
+    }
+    for (h=NodeList; h!=NULL; h=h->NextNode)
+    {
+        if (o->Prototype[0] != '\0' && strcmp(h->Parent->NodeName, o->Prototype) != 0)
+        {
+            continue;
+        }
+
+        t   = h->Globals;
+        n   = h->NumberOfGlobals;
+        vec = h->G;
+        for (i=1; i<=n; i+=1)
+        {
+            if (t[i].Name == name)
+            {
+                break;
+            }
+        }
+        if (i > n)
+        {
+            t   = h->Externals;
+            n   = h->NumberOfExternals;
+            vec = h->E;
+            for (i=1; i<=n; i+=1)
+            {
+                if (t[i].Name == name)
+                {
+                    break;
+                }
+            }
+            if (i > n)
+            {
+                continue;
+            }
+        }
+
+        size = 1;
+        for (d=1; d<=t[i].vDimensions[0]; d+=1)
+        {
+            size = size * t[i].vDimensions[d];
+        }
+        if (o->Index >= size)
+        {
+            Error(414, "Ensemble: index %d out of range for %s in %s at line %d\n", o->Index, o->Name, VariantFileName, o->Line);
+        }
+
+        if (update)
+        {
+            if (t[i].vType == FloatType)  /* 16.16 fixed point */
+            {
+                x = atof(o->Value) * 65536.0;
+                vec[t[i].vOffset + o->Index] = (int) ((x >= 0) ? x + 0.5 : x - 0.5);
+            }
+            else
+            {
+                vec[t[i].vOffset + o->Index] = (int) strtol(o->Value, NULL, 0);
+            }
+        }
+        count += 1;
+    }
+    return count;
+}
+
+/* --------------------------------------------------------- */
+void ShowOverride(OverrideItem *o)
+{
+    if (o->Packet)
+    {
+        printf("  packet %d:%d -> %d [%d]\n", o->Source, o->Port, o->Dest, o->Payload);
+        return;
+    }
+    printf("  %s%s%s", o->Prototype, (o->Prototype[0] != '\0') ? "." : "", o->Name);
+    if (o->Index > 0)
+    {
+        printf("[%d]", o->Index);
+    }
+    printf(" = %s\n", o->Value);
+}
+
+/* --------------------------------------------------------- */
+void RunVariant(VariantItem *v, bool archecking)  /* worker process: never returns */
+{
+    char         fname[2 * MaxStringSize + 10];
+    unsigned int i;
+
+    sprintf(fname, "%s_%s.out", FileBaseName, v->Tag);
+    if (freopen(fname, "w", stdout) == NULL)
+    {
+        exit(EXIT_FAILURE);
+    }
+
+    printf("variant %s\n", v->Tag);
+    for (i=1; i<=v->nOverrides; i+=1)
+    {
+        ApplyOverride(&v->Overrides[i], true);
+        ShowOverride(&v->Overrides[i]);
+    }
+
+    TagLogs(v->Tag);
+    Emulate(false, archecking);
+    fflush(stdout);
+    exit(EXIT_SUCCESS);
+}
+
+/* --------------------------------------------------------- */
+unsigned int DefaultJobs(unsigned int jobs)
+{
+#ifndef WIN32
+    if (jobs == 0)
+    {
+        jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+#endif
+    return (jobs < 1) ? 1 : jobs;
+}
+
+/* --------------------------------------------------------- */
+unsigned int SpawnWorkers(unsigned int jobs, char kind[])  /* returns the variant number in a worker, 0 in the parent */
+{
+#ifdef WIN32
+    Error(415, "%s: worker processes are not supported on this platform\n", kind);
+    return 0;
+#else
+    unsigned int i;
+    unsigned int j;
+    unsigned int next;
+    unsigned int active;
+    unsigned int failed;
+    int          pid;
+    int          status;
+
+    active = 0;
+    next = 1;
+    while (next <= NumberOfVariants || active > 0)
+    {
+        if (next <= NumberOfVariants && active < jobs)
+        {
+            fflush(NULL);  /* otherwise buffered output is duplicated in the worker */
+            pid = fork();
+            if (pid < 0)
+            {
+                Error(416, "%s: unable to start worker for variant %s\n", kind, Variants[next].Tag);
+            }
+            if (pid == 0)
+            {
+                return next;
+            }
+            Variants[next].pid = pid;
+            next += 1;
+            active += 1;
+            continue;
+        }
+
+        pid = wait(&status);  /* all workers busy */
+        if (pid < 0)
+        {
+            break;
+        }
+        for (j=1; j<=NumberOfVariants; j+=1)
+        {
+            if (Variants[j].pid == pid)
+            {
+                Variants[j].status = status;
+                printf("%s: variant %s %s\n", kind, Variants[j].Tag,
+                       (WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS) ? "completed" : "failed");
+            }
+        }
+        active -= 1;
+    }
+
+    failed = 0;
+    for (i=1; i<=NumberOfVariants; i+=1)
+    {
+        if (!WIFEXITED(Variants[i].status) || WEXITSTATUS(Variants[i].status) != EXIT_SUCCESS)
+        {
+            failed += 1;
+        }
+    }
+    printf("%s: %d of %d variants completed\n", kind, NumberOfVariants - failed, NumberOfVariants);
+    return 0;
+#endif
+}
+
+/* --------------------------------------------------------- */
+void RunEnsemble(char Filename[], unsigned int jobs, bool archecking)
+{
+    unsigned int i;
+    unsigned int j;
+
+    ReadVariants(Filename);
+    if (NumberOfVariants == 0)
+    {
+        printf("Ensemble: no variants in %s\n", Filename);
+        return;
+    }
+
+    for (i=1; i<=NumberOfVariants; i+=1)
+    {
+        for (j=1; j<=Variants[i].nOverrides; j+=1)
+        {
+            if (Variants[i].Overrides[j].Packet)
+            {
+                Error(417, "Ensemble: packets can only be injected into branches (variant %s)\n", Variants[i].Tag);
+            }
+        }
+    }
+
+    jobs = DefaultJobs(jobs);
+    printf("Ensemble: %d variants, %d workers\n", NumberOfVariants, jobs);
+
+    i = SpawnWorkers(jobs, "Ensemble");
+    if (i > 0)
+    {
+        RunVariant(&Variants[i], archecking);
+    }
+
+    DiscardLogs();  /* the untagged logs opened by the compiler are not used */
+    FreeVariants();
+}
+
+/* --------------------------------------------------------- */
+void SetBranches(char Filename[], float t, unsigned int jobs)  /* the emulator calls ForkBranches at time t */
+{
+    ReadVariants(Filename);
+    if (NumberOfVariants == 0)
+    {
+        printf("Branch: no variants in %s\n", Filename);
+        return;
+    }
+    BranchJobs  = DefaultJobs(jobs);
+    BranchTicks = TimeToTicks(t);
+    if (BranchTicks == 0)
+    {
+        BranchTicks = 1;
+    }
+}
+
+/* --------------------------------------------------------- */
+void StartBranch(VariantItem *v, unsigned long long int t)  /* worker process: carry on emulating with the variant applied */
+{
+    char         dir[2 * MaxStringSize + 2];
+    char         fname[3 * MaxStringSize];
+    char         *base;
+    unsigned int i;
+
+    sprintf(dir, "%s_%s", FileBaseName, v->Tag);
+#ifndef WIN32
+    mkdir(dir, 0777);  /* may already exist from an earlier run */
+#endif
+
+    base = strrchr(FileBaseName, '/');
+    base = (base == NULL) ? FileBaseName : base + 1;
+    if (snprintf(fname, sizeof(fname), "%s/%s.out", dir, base) >= (int) sizeof(fname))
+    {
+        printf("Branch: output file name for %s is too long\n", v->Tag);
+        exit(EXIT_FAILURE);
+    }
+    if (freopen(fname, "w", stdout) == NULL)
+    {
+        exit(EXIT_FAILURE);
+    }
+
+    printf("branch %s at %f s\n", v->Tag, TicksToTime(t));
+    for (i=1; i<=v->nOverrides; i+=1)
+    {
+        ShowOverride(&v->Overrides[i]);
+        if (v->Overrides[i].Packet)
+        {
+            if (!InjectPkt(v->Overrides[i].Source, v->Overrides[i].Port, v->Overrides[i].Dest, v->Overrides[i].Payload))
+            {
+                printf("  packet not delivered\n");
+            }
+        }
+        else
+        {
+            ApplyOverride(&v->Overrides[i], true);
+        }
+    }
+
+    BranchLogs(dir);
+}
+
+/* --------------------------------------------------------- */
+bool ForkBranches()  /* true - continue as a branch, false - the parent stops once all branches are done */
+{
+    unsigned int           i;
+    unsigned long long int t;
+
+    t = BranchTicks;
+    BranchTicks = 0;
+    printf("Branch: %d variants at %f s, %d workers\n", NumberOfVariants, TicksToTime(t), BranchJobs);
+
+    i = SpawnWorkers(BranchJobs, "Branch");
+    if (i > 0)
+    {
+        ForkStimulus();
+        StartBranch(&Variants[i], t);
+        return true;
+    }
+
+    FreeVariants();
+    return false;
+}
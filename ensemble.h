@@ -0,0 +1,13 @@
+/* DAMSON ensemble header
+*/
+
+#ifndef ENSEMBLE
+#define ENSEMBLE
+
+#include "compiler.h"
+
+extern void RunEnsemble(char Filename[], unsigned int jobs, bool archecking);
+extern void SetBranches(char Filename[], float t, unsigned int jobs);
+extern bool ForkBranches();
+
+#endif
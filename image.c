@@ -0,0 +1,669 @@
+/* DAMSON compiled simulation image
+   the output of Compile - prototypes, node instances, the link graph, log channels and the line table -
+   is written to a versioned binary file holding no addresses, so a run of an unchanged model can start
+   without parsing the source
+
+   node vectors are held as differences from their prototype's vectors, as the nodes of an alias are
+   mostly initialised alike; symbol names are held as strings and interned again when loaded
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "compiler.h"
+#include "emulator.h"
+#include "image.h"
+
+#define IMAGE_MAGIC    0x444D494D  /* "DMIM" - also detects a change of byte order */
+#define IMAGE_VERSION  3
+
+extern struct NodeInfo        *NodeList;
+extern struct NodeInfo        *NodeListTail;
+extern struct NodeInfo        *NameNodeList;
+extern struct LogInfo         LogData[];
+extern unsigned int           LogStreams;
+
+extern void                   Runtime_Error(unsigned int code, char *fmt, ...);
+
+char            *ImageFile = NULL;
+unsigned char   *ImageOut;          /* image being built */
+unsigned int    ImageOutSize;
+unsigned int    ImageOutPos;
+char            *ImageName;
+unsigned char   *ImageData;         /* image being loaded */
+unsigned int    ImageSize;
+unsigned int    ImagePos;
+struct NodeInfo **ImagePrototypes;  /* prototypes in order of creation, from 1 */
+unsigned int    nImagePrototypes;
+
+void          PutImageBytes(void *p, unsigned int n);
+void          PutImageWord(unsigned int x);
+void          PutImageLong(unsigned long long int x);
+void          PutImageBlock(void *p, unsigned int n);
+void          PutImageString(char s[]);
+unsigned int  GetImageWord();
+unsigned long long int GetImageLong();
+void          *GetImageBlock(unsigned int n);
+void          GetImageString(char s[]);
+void          PutVectorDelta(int *v, unsigned int size, int *base, unsigned int basesize);
+void          GetVectorDelta(int *v, unsigned int size, int *base, unsigned int basesize);
+void          PutNames(NametableItem *t, unsigned int n);
+NametableItem *GetNames(unsigned int n);
+void          PutProcedures(ProcedureItem *procs, unsigned int nprocs);
+ProcedureItem *GetProcedures(unsigned int nprocs);
+unsigned int  PrototypeIndex(struct NodeInfo *p);
+
+/* --------------------------------------------------------- */
+void PutImageBytes(void *p, unsigned int n)
+{
+    ImageOut = Grow(ImageOut, &ImageOutSize, ImageOutPos + n, 1);
+    memcpy(&ImageOut[ImageOutPos], p, n);
+    ImageOutPos += n;
+}
+
+/* --------------------------------------------------------- */
+void PutImageWord(unsigned int x)
+{
+    PutImageBytes(&x, sizeof(unsigned int));
+}
+
+/* --------------------------------------------------------- */
+void PutImageLong(unsigned long long int x)
+{
+    PutImageBytes(&x, sizeof(unsigned long long int));
+}
+
+/* --------------------------------------------------------- */
+void PutImageBlock(void *p, unsigned int n)  /* n bytes, padded to a word */
+{
+    unsigned int zero = 0;
+
+    PutImageBytes(p, n);
+    if (n % 4 != 0)
+    {
+        PutImageBytes(&zero, 4 - n % 4);
+    }
+}
+
+/* --------------------------------------------------------- */
+void PutImageString(char s[])
+{
+    unsigned int n = strlen(s) + 1;
+
+    PutImageWord(n);
+    PutImageBlock(s, n);
+}
+
+/* --------------------------------------------------------- */
+void *GetImageBlock(unsigned int n)  /* the block is used in place */
+{
+    void *p;
+
+    if (n > ImageSize - ImagePos)
+    {
+        Runtime_Error(249, "Image file %s is truncated\n", ImageName);
+    }
+    p = &ImageData[ImagePos];
+    ImagePos += (n + 3) & ~3u;
+    if (ImagePos > ImageSize)
+    {
+        ImagePos = ImageSize;
+    }
+    return p;
+}
+
+/* --------------------------------------------------------- */
+unsigned int GetImageWord()
+{
+    unsigned int x;
+
+    memcpy(&x, GetImageBlock(sizeof(unsigned int)), sizeof(unsigned int));
+    return x;
+}
+
+/* --------------------------------------------------------- */
+unsigned long long int GetImageLong()
+{
+    unsigned long long int x;
+
+    memcpy(&x, GetImageBlock(sizeof(unsigned long long int)), sizeof(unsigned long long int));
+    return x;
+}
+
+/* --------------------------------------------------------- */
+void GetImageString(char s[])
+{
+    unsigned int n = GetImageWord();
+
+    if (n == 0 || n > MaxStringSize)
+    {
+        Runtime_Error(249, "Image file %s is corrupt\n", ImageName);
+    }
+    memcpy(s, GetImageBlock(n), n);
+    s[n - 1] = 0;
+}
+
+/* --------------------------------------------------------- */
+void PutVectorDelta(int *v, unsigned int size, int *base, unsigned int basesize)
+{
+    unsigned int i;
+    unsigned int n;
+
+    n = 0;
+    for (i=0; i<=size; i+=1)
+    {
+        if (v[i] != ((i <= basesize) ? base[i] : 0))
+        {
+            n += 1;
+        }
+    }
+
+    PutImageWord(size);
+    PutImageWord(n);
+    for (i=0; i<=size; i+=1)
+    {
+        if (v[i] != ((i <= basesize) ? base[i] : 0))
+        {
+            PutImageWord(i);
+            PutImageWord(v[i]);
+        }
+    }
+}
+
+/* --------------------------------------------------------- */
+void GetVectorDelta(int *v, unsigned int size, int *base, unsigned int basesize)
+{
+    unsigned int i;
+    unsigned int k;
+    unsigned int n;
+
+    for (i=0; i<=size; i+=1)
+    {
+        v[i] = (i <= basesize) ? base[i] : 0;
+    }
+
+    n = GetImageWord();
+    for (i=1; i<=n; i+=1)
+    {
+        k = GetImageWord();
+        if (k > size)
+        {
+            Runtime_Error(249, "Image file %s is corrupt\n", ImageName);
+        }
+        v[k] = GetImageWord();
+    }
+}
+
+/* --------------------------------------------------------- */
+void PutNames(NametableItem *t, unsigned int n)  /* items 0..n */
+{
+    unsigned int i;
+
+    for (i=0; i<=n; i+=1)
+    {
+        PutImageString((t[i].Name != NULL) ? t[i].Name : "");
+        PutImageWord(t[i].vType);
+        PutImageWord(t[i].vOffset);
+        PutImageBlock(t[i].vDimensions, sizeof(t[i].vDimensions));
+    }
+}
+
+/* --------------------------------------------------------- */
+NametableItem *GetNames(unsigned int n)
+{
+    NametableItem *t;
+    char          name[MaxStringSize + 1];
+    unsigned int  i;
+
+    t = malloc(sizeof(NametableItem) * (n + 1));
+    if (t == NULL)
+    {
+        Runtime_Error(250, "Unable to allocate memory for image %s\n", ImageName);
+    }
+    for (i=0; i<=n; i+=1)
+    {
+        GetImageString(name);
+        t[i].Name    = InternName(name);
+        t[i].vType   = GetImageWord();
+        t[i].vOffset = GetImageWord();
+        memcpy(t[i].vDimensions, GetImageBlock(sizeof(t[i].vDimensions)), sizeof(t[i].vDimensions));
+    }
+    return t;
+}
+
+/* --------------------------------------------------------- */
+void PutProcedures(ProcedureItem *procs, unsigned int nprocs)  /* only the locals in use are written */
+{
+    unsigned int i;
+
+    for (i=0; i<=nprocs; i+=1)
+    {
+        PutImageString((procs[i].Name != NULL) ? procs[i].Name : "");
+        PutImageWord(procs[i].ProcType);
+        PutImageWord(procs[i].nArgs);
+        PutImageWord(procs[i].Label);
+        PutImageWord(procs[i].BP);
+        PutImageWord(procs[i].nLocals);
+        PutNames(procs[i].Args, procs[i].nLocals);
+        PutImageWord(procs[i].Versions);
+        PutImageWord(procs[i].Offset);
+    }
+}
+
+/* --------------------------------------------------------- */
+ProcedureItem *GetProcedures(unsigned int nprocs)
+{
+    ProcedureItem *procs;
+    char          name[MaxStringSize + 1];
+    unsigned int  i;
+    unsigned int  n;
+
+    procs = calloc(nprocs + 1, sizeof(ProcedureItem));
+    if (procs == NULL)
+    {
+        Runtime_Error(250, "Unable to allocate memory for image %s\n", ImageName);
+    }
+
+    for (i=0; i<=nprocs; i+=1)
+    {
+        GetImageString(name);
+        procs[i].Name = InternName(name);
+        procs[i].ProcType = GetImageWord();
+        procs[i].nArgs = GetImageWord();
+        procs[i].Label = GetImageWord();
+        procs[i].BP = GetImageWord();
+        n = GetImageWord();
+        if (n > MaxLocals)
+        {
+            Runtime_Error(249, "Image file %s is corrupt\n", ImageName);
+        }
+        procs[i].nLocals = n;
+        procs[i].Args = GetNames(n);
+        procs[i].Versions = GetImageWord();
+        procs[i].Offset = GetImageWord();
+        procs[i].CallCount = 0;
+        procs[i].TickCount = 0;
+    }
+    return procs;
+}
+
+/* --------------------------------------------------------- */
+/* --------------------------------------------------------- */
+unsigned int PrototypeIndex(struct NodeInfo *p)
+{
+    static unsigned int last = 0;  /* consecutive lines are mostly in the same prototype */
+    unsigned int        i;
+
+    if (p == NULL)
+    {
+        return 0;
+    }
+    if (last > 0 && last <= nImagePrototypes && ImagePrototypes[last] == p)
+    {
+        return last;
+    }
+    for (i=1; i<=nImagePrototypes; i+=1)
+    {
+        if (ImagePrototypes[i] == p)
+        {
+            last = i;
+            return i;
+        }
+    }
+    return 0;
+}
+
+/* --------------------------------------------------------- */
+unsigned char *BuildImage(unsigned int *size)  /* the image of the model compiled, in memory */
+{
+    struct NodeInfo *p;
+    struct LogInfo  *l;
+    unsigned int    i;
+    unsigned int    n;
+
+    ImageOut = NULL;
+    ImageOutSize = 0;
+    ImageOutPos = 0;
+
+    nImagePrototypes = 0;
+    for (p=NameNodeList; p!=NULL; p=p->NextNode)
+    {
+        nImagePrototypes += 1;
+    }
+    ImagePrototypes = malloc(sizeof(struct NodeInfo *) * (nImagePrototypes + 1));
+    if (ImagePrototypes == NULL)
+    {
+        Runtime_Error(250, "Unable to allocate memory for image of %s\n", FileBaseName);
+    }
+    i = nImagePrototypes;
+    for (p=NameNodeList; p!=NULL; p=p->NextNode)  /* the list is newest first */
+    {
+        ImagePrototypes[i] = p;
+        i -= 1;
+    }
+
+    PutImageWord(IMAGE_MAGIC);
+    PutImageWord(IMAGE_VERSION);
+    PutImageWord(VERSION_MAJOR);
+    PutImageWord(VERSION_MINOR);
+    PutImageWord(sizeof(Instruction));
+    PutImageWord(sizeof(NametableItem));
+    PutImageWord(sizeof(ProcedureItem));
+    PutImageString(FileBaseName);
+    PutImageWord(TimeStamping);
+    PutImageWord(Monitoring);
+
+    PutImageWord(nImagePrototypes);
+    for (i=1; i<=nImagePrototypes; i+=1)
+    {
+        p = ImagePrototypes[i];
+        PutImageString(p->NodeName);
+        PutImageWord(p->ProgramSize);
+        PutImageBlock(p->Instructions, sizeof(Instruction) * (p->ProgramSize + 1));
+        PutImageWord(p->GlobalVectorSize);
+        PutImageBlock(p->G, sizeof(int) * (p->GlobalVectorSize + 1));
+        PutImageWord(p->NumberOfGlobals);
+        PutNames(p->Globals, p->NumberOfGlobals);
+        PutImageWord(p->ExternalVectorSize);
+        PutImageBlock(p->E, sizeof(int) * (p->ExternalVectorSize + 1));
+        PutImageWord(p->NumberOfExternals);
+        PutNames(p->Externals, p->NumberOfExternals);
+        PutImageWord(p->NumberOfLabels);
+        PutImageBlock(p->Labels, sizeof(unsigned int) * (p->NumberOfLabels + 1));
+        PutImageWord(p->NumberOfProcedures);
+        PutProcedures(p->Procedures, p->NumberOfProcedures);
+    }
+
+    n = 0;
+    for (p=NodeListTail; p!=NULL; p=p->PrevNode)
+    {
+        n += 1;
+    }
+    PutImageWord(n);
+    for (p=NodeListTail; p!=NULL; p=p->PrevNode)  /* oldest first, as created */
+    {
+        PutImageWord(p->NodeNumber);
+        PutImageWord(PrototypeIndex(p->Parent));
+        PutVectorDelta(p->G, p->GlobalVectorSize, p->Parent->G, p->Parent->GlobalVectorSize);
+        PutVectorDelta(p->E, p->ExternalVectorSize, p->Parent->E, p->Parent->ExternalVectorSize);
+        PutImageWord(p->NumberOfInterrupts);
+        PutImageBlock(p->IntVector, sizeof(InterruptVector) * (p->NumberOfInterrupts + 1));
+    }
+
+    PutImageWord(NumberOfLinks);  /* as ranges, in the order given */
+    for (i=1; i<=NumberOfLinks; i+=1)
+    {
+        PutImageWord(Links[i].slow);
+        PutImageWord(Links[i].shigh);
+        PutImageWord(Links[i].dlow);
+        PutImageWord(Links[i].dhigh);
+    }
+
+    PutImageWord(LogStreams);
+    for (i=1; i<=LogStreams; i+=1)
+    {
+        l = &LogData[i];
+        PutImageWord(l->node);
+        PutImageString(l->name);
+        PutImageString(l->format);
+        PutImageLong(l->startwindow);
+        PutImageLong(l->stopwindow);
+        PutImageLong(l->sampleinterval);
+        PutImageWord(l->logmode);
+        PutImageWord(l->noffsets);
+        PutImageBlock(&l->offsets[1], sizeof(unsigned int) * l->noffsets);
+    }
+
+    PutImageWord(NumberOfLines);
+    for (i=0; i<=NumberOfLines; i+=1)
+    {
+        PutImageWord(LineNumberList[i].codeoffset);
+        PutImageWord(PrototypeIndex(LineNumberList[i].pnode));
+    }
+
+    free(ImagePrototypes);
+    *size = ImageOutPos;
+    return ImageOut;
+}
+
+/* --------------------------------------------------------- */
+void WriteImage(char Filename[])
+{
+    FILE            *s;
+    unsigned char   *image;
+    unsigned int    size;
+    struct NodeInfo *p;
+    unsigned int    n;
+
+    image = BuildImage(&size);
+    s = fopen(Filename, "wb");
+    if (s == NULL)
+    {
+        Runtime_Error(247, "Unable to create image file %s\n", Filename);
+    }
+    if (fwrite(image, 1, size, s) != size || fclose(s) != 0)
+    {
+        Runtime_Error(247, "Unable to write image file %s\n", Filename);
+    }
+    free(image);
+
+    n = 0;
+    for (p=NodeListTail; p!=NULL; p=p->PrevNode)
+    {
+        n += 1;
+    }
+    printf("Image %s: %d prototypes, %d nodes\n", Filename, nImagePrototypes, n);
+}
+
+/* --------------------------------------------------------- */
+bool LoadImage(char Filename[])  /* in place of Compile */
+{
+    FILE          *s;
+    long          size;
+    unsigned char *data;
+    unsigned int  n;
+
+    s = fopen(Filename, "rb");
+    if (s == NULL)
+    {
+        return false;
+    }
+    fseek(s, 0, SEEK_END);
+    size = ftell(s);
+    fseek(s, 0, SEEK_SET);
+    data = malloc(size + 1);
+    if (size < 0 || data == NULL)
+    {
+        Runtime_Error(250, "Unable to allocate memory for image %s\n", Filename);
+    }
+    n = fread(data, 1, size, s);
+    fclose(s);
+
+    LoadImageData(Filename, data, n, true);
+    free(data);
+    return true;
+}
+
+/* --------------------------------------------------------- */
+void LoadImageData(char Name[], unsigned char data[], unsigned int size, bool logfiles)  /* an image already in memory */
+{
+    struct NodeInfo *p;
+    char            name[MaxStringSize + 1];
+    char            format[MaxStringSize + 1];
+    Instruction     *code;
+    unsigned int    codesize;
+    int             *gv;
+    unsigned int    gvsize;
+    NametableItem   *globals;
+    unsigned int    nglobals;
+    int             *ev;
+    unsigned int    evsize;
+    NametableItem   *externals;
+    unsigned int    nexternals;
+    unsigned int    *labs;
+    unsigned int    nlabs;
+    ProcedureItem   *procs;
+    unsigned int    nprocs;
+    unsigned int    intvsize;
+    LinkItem        link;
+    unsigned int    node;
+    unsigned int    nodes;
+    unsigned int    i;
+    unsigned int    j;
+    unsigned int    k;
+    unsigned int    n;
+    unsigned int    chn;
+    unsigned long long int t1, t2, t3;
+    bool            logging;
+
+    ImageData = data;
+    ImageSize = size;
+    ImagePos  = 0;
+    ImageName = Name;
+
+    if (GetImageWord() != IMAGE_MAGIC)
+    {
+        Runtime_Error(248, "%s is not a DAMSON image\n", Name);
+    }
+    if (GetImageWord() != IMAGE_VERSION || GetImageWord() != VERSION_MAJOR || GetImageWord() != VERSION_MINOR ||
+        GetImageWord() != sizeof(Instruction) || GetImageWord() != sizeof(NametableItem) ||
+        GetImageWord() != sizeof(ProcedureItem))
+    {
+        Runtime_Error(248, "Image %s was written by a different version of DAMSON\n", Name);
+    }
+
+    GetImageString(FileBaseName);
+    TimeStamping  = GetImageWord();
+    Monitoring    = GetImageWord() != 0;
+    Errors        = 0;
+    LogFiles      = logfiles;
+    NumberOfNodes = 0;
+    FreeLinks();
+
+    nImagePrototypes = GetImageWord();
+    ImagePrototypes = malloc(sizeof(struct NodeInfo *) * (nImagePrototypes + 1));
+    if (ImagePrototypes == NULL)
+    {
+        Runtime_Error(250, "Unable to allocate memory for image %s\n", Name);
+    }
+    for (i=1; i<=nImagePrototypes; i+=1)
+    {
+        GetImageString(name);
+        codesize   = GetImageWord();
+        code       = GetImageBlock(sizeof(Instruction) * (codesize + 1));
+        gvsize     = GetImageWord();
+        gv         = GetImageBlock(sizeof(int) * (gvsize + 1));
+        nglobals   = GetImageWord();
+        globals    = GetNames(nglobals);
+        evsize     = GetImageWord();
+        ev         = GetImageBlock(sizeof(int) * (evsize + 1));
+        nexternals = GetImageWord();
+        externals  = GetNames(nexternals);
+        nlabs      = GetImageWord();
+        labs       = GetImageBlock(sizeof(unsigned int) * (nlabs + 1));
+        nprocs     = GetImageWord();
+        procs      = GetProcedures(nprocs);
+
+        ImagePrototypes[i] = CreatePrototype(name,
+                                             code,      codesize,
+                                             gv,        gvsize,
+                                             globals,   nglobals,
+                                             ev,        evsize,
+                                             externals, nexternals,
+                                             procs,     nprocs,
+                                             labs,      nlabs);
+        for (j=0; j<=nprocs; j+=1)
+        {
+            free(procs[j].Args);
+        }
+        free(procs);
+        free(globals);
+        free(externals);
+    }
+
+    nodes = GetImageWord();
+    for (i=1; i<=nodes; i+=1)
+    {
+        node = GetImageWord();
+        k = GetImageWord();
+        if (k == 0 || k > nImagePrototypes)
+        {
+            Runtime_Error(249, "Image file %s is corrupt\n", Name);
+        }
+        p = ImagePrototypes[k];
+
+        gvsize = GetImageWord();
+        gv = malloc(sizeof(int) * (gvsize + 1));
+        if (gv == NULL)
+        {
+            Runtime_Error(250, "Unable to allocate memory for image %s\n", Name);
+        }
+        GetVectorDelta(gv, gvsize, p->G, p->GlobalVectorSize);
+        evsize = GetImageWord();
+        ev = malloc(sizeof(int) * (evsize + 1));
+        if (ev == NULL)
+        {
+            Runtime_Error(250, "Unable to allocate memory for image %s\n", Name);
+        }
+        GetVectorDelta(ev, evsize, p->E, p->ExternalVectorSize);
+        intvsize = GetImageWord();
+
+        CreateNode(node, p->NodeName,
+                   gv, gvsize,
+                   ev, evsize,
+                   GetImageBlock(sizeof(InterruptVector) * (intvsize + 1)), intvsize);
+        NumberOfNodes += 1;
+        free(gv);
+        free(ev);
+
+        if (node == ProfileNode)
+        {
+            OpenProfile(node, FileBaseName);
+        }
+    }
+
+    n = GetImageWord();
+    for (i=1; i<=n; i+=1)
+    {
+        link.slow  = GetImageWord();
+        link.shigh = GetImageWord();
+        link.dlow  = GetImageWord();
+        link.dhigh = GetImageWord();
+        AddLink(link.slow, link.shigh, link.dlow, link.dhigh);
+    }
+
+    n = GetImageWord();
+    for (i=1; i<=n; i+=1)
+    {
+        node = GetImageWord();
+        GetImageString(name);
+        GetImageString(format);
+        t1 = GetImageLong();
+        t2 = GetImageLong();
+        t3 = GetImageLong();
+        logging = GetImageWord() != 0;
+        chn = OpenLogFile(node, name, format, t1, t2, t3, logging);
+        k = GetImageWord();
+        for (j=1; j<=k; j+=1)
+        {
+            AddLog(chn, GetImageWord());
+        }
+    }
+
+    NumberOfLines = GetImageWord();
+    LineNumberList = malloc(sizeof(struct LineInfo) * (NumberOfLines + 1));
+    if (LineNumberList == NULL)
+    {
+        Runtime_Error(250, "Unable to allocate memory for image %s\n", Name);
+    }
+    for (i=0; i<=NumberOfLines; i+=1)
+    {
+        LineNumberList[i].codeoffset = GetImageWord();
+        k = GetImageWord();
+        LineNumberList[i].pnode = (k > 0 && k <= nImagePrototypes) ? ImagePrototypes[k] : NULL;
+    }
+
+    free(ImagePrototypes);
+    ImageData = NULL;
+}
@@ -0,0 +1,16 @@
+/* DAMSON simulation image header
+*/
+
+#ifndef IMAGE
+#define IMAGE
+
+#include "compiler.h"
+
+extern char          *ImageFile;
+
+extern unsigned char *BuildImage(unsigned int *size);
+extern void          WriteImage(char Filename[]);
+extern bool          LoadImage(char Filename[]);
+extern void          LoadImageData(char Name[], unsigned char data[], unsigned int size, bool logfiles);
+
+#endif
@@ -0,0 +1,517 @@
+/* DAMSON procedure inliner
+   small procedures which call no others are copied into their callers ahead of the SSA optimiser
+   the arguments are popped into locals added at the end of the caller's frame, the callee's other locals are zeroed
+   as ENTRY would zero them and its returns become jumps past the copy, with its labels renumbered for each copy
+   a call inside a loop may inline a larger procedure than one outside; a caller left with no calls may itself be
+   inlined in the next round; the line table keeps the copied code on the line of the call
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "compiler.h"
+#include "inline.h"
+
+#define InlineSize       12  /* instructions of a procedure inlined at any call */
+#define InlineLoopSize   40  /* at a call inside a loop */
+#define MaxInlineRounds   4
+
+typedef struct
+{
+    unsigned int Start;         /* the procedure's label */
+    unsigned int Entry;
+    unsigned int End;           /* its final RTRN */
+    unsigned int Size;          /* instructions of a copy */
+    unsigned int nLabels;       /* labels used by a copy */
+    unsigned int Returns;       /* RTRNs ahead of the final one */
+    bool         Inlinable;
+} InlineRegion;
+
+typedef struct
+{
+    Instruction   *Code;
+    unsigned int  Size;
+    unsigned int  *Labels;
+    unsigned int  *nLabels;
+    unsigned int  LabelLimit;
+    ProcedureItem *Procs;
+    unsigned int  nProcs;
+    InlineRegion  *Regions;
+    unsigned int  *Owner;       /* the procedure holding each instruction */
+    unsigned int  *Callee;      /* the procedure inlined at each call, 0 if none */
+    unsigned int  *Extra;       /* locals added to each caller */
+    unsigned int  *Seen;
+    unsigned int  Added;        /* instructions added by the copies */
+} InlineState;
+
+void         *InlineAllocate(unsigned int n, unsigned int itemsize);
+void         FindRegions(InlineState *s);
+bool         NoteLabel(InlineState *s, unsigned int p, unsigned int l);
+void         CheckCallee(InlineState *s, unsigned int p);
+unsigned int FindCalls(InlineState *s);
+unsigned int Relabel(InlineState *s, unsigned int l, unsigned int *newlab, unsigned int *used, unsigned int *nused);
+unsigned int CopyCallee(InlineState *s, Instruction *out, unsigned int n, unsigned int q, unsigned int base,
+                        unsigned int *newlab, unsigned int *used, unsigned int *pos);
+bool         InlineRound(InlineState *s, Instruction **code, unsigned int *codealloc,
+                         struct LineInfo *lines, unsigned int firstline, unsigned int lastline);
+
+/* --------------------------------------------------------- */
+void *InlineAllocate(unsigned int n, unsigned int itemsize)
+{
+    void *a = calloc(n, itemsize);
+
+    if (a == NULL)
+    {
+        Error(132, "Unable to allocate inliner tables (%d)\n", n);
+    }
+    return a;
+}
+
+/* --------------------------------------------------------- */
+void FindRegions(InlineState *s)  /* each procedure runs from its label to the next one's */
+{
+    unsigned int i;
+    unsigned int p;
+    unsigned int start;
+    unsigned int cur = 0;
+
+    for (i = 1; i <= s->Size; i += 1)
+    {
+        if (s->Code[i].Op == s_SWITCHON)
+        {
+            i += 2 * s->Code[i].Arg + 1;
+            continue;
+        }
+        if (s->Code[i].Op != s_ENTRY || s->Code[i].Arg < 1 || (unsigned int) s->Code[i].Arg > s->nProcs)
+        {
+            continue;
+        }
+        p     = s->Code[i].Arg;
+        start = (s->Procs[p].Label > 0) ? s->Labels[s->Procs[p].Label] : i;  /* main is reached by the jump at 1 */
+        if (start == 0 || start > i || (cur > 0 && start <= s->Regions[cur].Entry))
+        {
+            start = i;
+        }
+        if (cur > 0)
+        {
+            s->Regions[cur].End = start - 1;
+        }
+        s->Regions[p].Start = start;
+        s->Regions[p].Entry = i;
+        cur = p;
+    }
+    if (cur > 0)
+    {
+        s->Regions[cur].End = s->Size;
+    }
+
+    for (p = 1; p <= s->nProcs; p += 1)
+    {
+        if (s->Regions[p].Entry > 0)
+        {
+            for (i = s->Regions[p].Start; i <= s->Regions[p].End; i += 1)
+            {
+                s->Owner[i] = p;
+            }
+        }
+    }
+}
+
+/* --------------------------------------------------------- */
+bool NoteLabel(InlineState *s, unsigned int p, unsigned int l)  /* false if the label is outside the procedure */
+{
+    InlineRegion *r = &s->Regions[p];
+
+    if (l == 0)
+    {
+        return true;
+    }
+    if (l > *s->nLabels || s->Labels[l] <= r->Entry || s->Labels[l] > r->End)
+    {
+        return false;
+    }
+    if (s->Seen[l] != p)
+    {
+        s->Seen[l] = p;
+        r->nLabels += 1;
+    }
+    return true;
+}
+
+/* --------------------------------------------------------- */
+void CheckCallee(InlineState *s, unsigned int p)  /* a leaf procedure which can be copied as it stands */
+{
+    InlineRegion  *r = &s->Regions[p];
+    ProcedureItem *proc = &s->Procs[p];
+    unsigned int  i;
+    unsigned int  j;
+    unsigned int  l;
+    unsigned char Op;
+
+    r->Inlinable = r->End > r->Entry && s->Code[r->End].Op == s_RTRN;
+    if (r->Inlinable && proc->ProcType != VoidType)  /* a function must not run on into its final return */
+    {
+        r->Inlinable = r->End - 1 > r->Entry && (s->Code[r->End - 1].Op == s_RTRN || s->Code[r->End - 1].Op == s_JUMP);
+        for (l = 1; l <= *s->nLabels; l += 1)
+        {
+            r->Inlinable = r->Inlinable && s->Labels[l] != r->End;
+        }
+    }
+    for (i = proc->nArgs + 1; i <= proc->nLocals; i += 1)  /* arrays are reached through their address */
+    {
+        r->Inlinable = r->Inlinable && proc->Args[i].vDimensions[0] == 0;
+    }
+
+    r->Size    = proc->nArgs + 2 * (proc->nLocals - proc->nArgs);
+    r->nLabels = 0;
+    r->Returns = 0;
+    for (i = r->Entry + 1; i < r->End && r->Inlinable; i += 1)
+    {
+        Op = s->Code[i].Op;
+        r->Size += 1;
+        switch (Op)
+        {
+            case s_FNAP: case s_RTAP: case s_ENTRY: case s_DEBUG: case s_LBOUNDSCHECK:
+                r->Inlinable = false;
+                break;
+
+            case s_RTRN:
+                r->Returns += 1;
+                break;
+
+            case s_JUMP: case s_JT: case s_JF: case s_RES:
+                r->Inlinable = NoteLabel(s, p, s->Code[i].Arg);
+                break;
+
+            case s_SWITCHON:
+                if (i + 2 * s->Code[i].Arg + 1 >= r->End)
+                {
+                    r->Inlinable = false;
+                    break;
+                }
+                r->Inlinable = NoteLabel(s, p, s->Code[i + 1].Arg);
+                for (j = 1; j <= (unsigned int) s->Code[i].Arg; j += 1)
+                {
+                    r->Inlinable = r->Inlinable && NoteLabel(s, p, s->Code[i + 2 * j + 1].Arg);
+                }
+                r->Size += 2 * s->Code[i].Arg + 1;
+                i += 2 * s->Code[i].Arg + 1;
+                break;
+
+            default:
+                r->Inlinable = Op > 0 && (Op < s_STACK || Op == s_DISCARD);  /* no code generator pseudo instructions */
+                break;
+        }
+    }
+    if (r->Returns > 0)
+    {
+        r->nLabels += 1;
+    }
+}
+
+/* --------------------------------------------------------- */
+unsigned int FindCalls(InlineState *s)  /* the calls to inline, sizes and labels allowing */
+{
+    int          *loops;
+    unsigned int *procs;
+    bool         *target;
+    unsigned int i;
+    unsigned int l;
+    unsigned int p;
+    unsigned int q;
+    unsigned int labels = *s->nLabels;
+    unsigned int calls = 0;
+    int          depth = 0;
+
+    loops  = InlineAllocate(s->Size + 2, sizeof(int));
+    procs  = InlineAllocate(*s->nLabels + 1, sizeof(unsigned int));
+    target = InlineAllocate(s->Size + 2, sizeof(bool));
+
+    for (p = 1; p <= s->nProcs; p += 1)
+    {
+        if (s->Regions[p].Entry > 0 && s->Procs[p].Label > 0 && s->Procs[p].Label <= *s->nLabels)
+        {
+            procs[s->Procs[p].Label] = p;
+        }
+    }
+    for (l = 1; l <= *s->nLabels; l += 1)
+    {
+        if (s->Labels[l] <= s->Size)
+        {
+            target[s->Labels[l]] = true;
+        }
+    }
+    for (i = 1; i <= s->Size; i += 1)  /* backward jumps close loops */
+    {
+        if ((s->Code[i].Op == s_JUMP || s->Code[i].Op == s_JT || s->Code[i].Op == s_JF) &&
+            s->Code[i].Arg >= 1 && (unsigned int) s->Code[i].Arg <= *s->nLabels)
+        {
+            l = s->Labels[s->Code[i].Arg];
+            if (l >= 1 && l <= i)
+            {
+                loops[l] += 1;
+                loops[i + 1] -= 1;
+            }
+        }
+    }
+
+    for (i = 1; i <= s->Size; i += 1)
+    {
+        depth += loops[i];
+        if ((s->Code[i].Op != s_FNAP && s->Code[i].Op != s_RTAP) || i < 2 || s->Code[i - 1].Op != s_LN ||
+            s->Code[i - 1].Arg < 1 || (unsigned int) s->Code[i - 1].Arg > *s->nLabels || target[i] || s->Owner[i] == 0)
+        {
+            continue;
+        }
+        q = procs[s->Code[i - 1].Arg];
+        if (q == 0 || !s->Regions[q].Inlinable || s->Regions[q].Size > ((depth > 0) ? InlineLoopSize : InlineSize) ||
+            labels + s->Regions[q].nLabels > s->LabelLimit)
+        {
+            continue;
+        }
+        s->Callee[i] = q;
+        labels += s->Regions[q].nLabels;
+        s->Added += s->Regions[q].Size;
+        if (s->Procs[q].BP > s->Extra[s->Owner[i]])
+        {
+            s->Extra[s->Owner[i]] = s->Procs[q].BP;
+        }
+        calls += 1;
+    }
+
+    free(loops);
+    free(procs);
+    free(target);
+    return calls;
+}
+
+/* --------------------------------------------------------- */
+unsigned int Relabel(InlineState *s, unsigned int l, unsigned int *newlab, unsigned int *used, unsigned int *nused)
+{
+    if (l == 0)
+    {
+        return 0;
+    }
+    if (newlab[l] == 0)
+    {
+        *s->nLabels += 1;
+        newlab[l] = *s->nLabels;
+        used[*nused] = l;
+        *nused += 1;
+    }
+    return newlab[l];
+}
+
+/* --------------------------------------------------------- */
+unsigned int CopyCallee(InlineState *s, Instruction *out, unsigned int n, unsigned int q, unsigned int base,
+                        unsigned int *newlab, unsigned int *used, unsigned int *pos)  /* q copied after out[n]; the new n */
+{
+    InlineRegion  *r = &s->Regions[q];
+    ProcedureItem *proc = &s->Procs[q];
+    unsigned int  endlab = 0;
+    unsigned int  nused = 0;
+    unsigned int  i;
+    unsigned int  j;
+    Instruction   c;
+
+    for (i = proc->nArgs; i >= 1; i -= 1)  /* the last argument is on top */
+    {
+        n += 1;
+        out[n].Op  = s_SP;
+        out[n].Arg = base + proc->Args[i].vOffset;
+    }
+    for (i = proc->nArgs + 1; i <= proc->nLocals; i += 1)
+    {
+        n += 1;
+        out[n].Op  = s_LN;
+        out[n].Arg = 0;
+        n += 1;
+        out[n].Op  = s_SP;
+        out[n].Arg = base + proc->Args[i].vOffset;
+    }
+    if (r->Returns > 0)
+    {
+        *s->nLabels += 1;
+        endlab = *s->nLabels;
+    }
+
+    for (i = r->Entry + 1; i < r->End; i += 1)
+    {
+        pos[i - r->Entry] = n + 1;
+        c = s->Code[i];
+        switch (c.Op)
+        {
+            case s_LP: case s_SP: case s_LLP:
+                c.Arg = base + c.Arg;
+                break;
+
+            case s_RTRN:
+                c.Op  = s_JUMP;
+                c.Arg = endlab;
+                break;
+
+            case s_JUMP: case s_JT: case s_JF: case s_RES:
+                c.Arg = Relabel(s, c.Arg, newlab, used, &nused);
+                break;
+
+            case s_SWITCHON:
+                n += 1;
+                out[n] = c;
+                for (j = 1; j <= 2 * (unsigned int) c.Arg + 1; j += 1)  /* the case table, labels in odd entries */
+                {
+                    pos[i + j - r->Entry] = n + 1;
+                    n += 1;
+                    out[n] = s->Code[i + j];
+                    if (j % 2 == 1)
+                    {
+                        out[n].Arg = Relabel(s, out[n].Arg, newlab, used, &nused);
+                    }
+                }
+                i += 2 * c.Arg + 1;
+                continue;
+        }
+        n += 1;
+        out[n] = c;
+    }
+    pos[r->End - r->Entry] = n + 1;
+
+    if (endlab > 0)
+    {
+        s->Labels[endlab] = n + 1;
+    }
+    for (i = 0; i < nused; i += 1)
+    {
+        s->Labels[newlab[used[i]]] = pos[s->Labels[used[i]] - r->Entry];
+        newlab[used[i]] = 0;
+    }
+    return n;
+}
+
+/* --------------------------------------------------------- */
+bool InlineRound(InlineState *s, Instruction **code, unsigned int *codealloc,
+                 struct LineInfo *lines, unsigned int firstline, unsigned int lastline)  /* false if nothing was inlined */
+{
+    Instruction  *out;
+    unsigned int *firstnew;
+    unsigned int *newlab;
+    unsigned int *used;
+    unsigned int *pos;
+    unsigned int nlabs = *s->nLabels;
+    unsigned int i;
+    unsigned int p;
+    unsigned int n;
+    unsigned int calls;
+
+    s->Regions = InlineAllocate(s->nProcs + 1, sizeof(InlineRegion));
+    s->Owner   = InlineAllocate(s->Size + 2, sizeof(unsigned int));
+    s->Callee  = InlineAllocate(s->Size + 2, sizeof(unsigned int));
+    s->Extra   = InlineAllocate(s->nProcs + 1, sizeof(unsigned int));
+    s->Seen    = InlineAllocate(nlabs + 1, sizeof(unsigned int));
+    s->Added   = 0;
+
+    FindRegions(s);
+    for (p = 1; p <= s->nProcs; p += 1)
+    {
+        if (s->Regions[p].Entry > 0)
+        {
+            CheckCallee(s, p);
+        }
+    }
+    calls = FindCalls(s);
+
+    if (calls > 0)
+    {
+        out      = InlineAllocate(s->Size + s->Added + 1, sizeof(Instruction));
+        firstnew = InlineAllocate(s->Size + 2, sizeof(unsigned int));
+        newlab   = InlineAllocate(nlabs + 1, sizeof(unsigned int));
+        used     = InlineAllocate(nlabs + 1, sizeof(unsigned int));
+        pos      = InlineAllocate(s->Size + 2, sizeof(unsigned int));
+
+        out[0] = s->Code[0];
+        n = 0;
+        for (i = 1; i <= s->Size; i += 1)
+        {
+            firstnew[i] = n + 1;
+            if (i < s->Size && s->Callee[i + 1] > 0)  /* the LN of an inlined call */
+            {
+                continue;
+            }
+            if (s->Callee[i] > 0)
+            {
+                n = CopyCallee(s, out, n, s->Callee[i], s->Procs[s->Owner[i]].BP, newlab, used, pos);
+            }
+            else
+            {
+                n += 1;
+                out[n] = s->Code[i];
+            }
+        }
+        firstnew[s->Size + 1] = n + 1;
+
+        for (i = 1; i <= nlabs; i += 1)
+        {
+            if (s->Labels[i] >= 1 && s->Labels[i] <= s->Size + 1)
+            {
+                s->Labels[i] = firstnew[s->Labels[i]];
+            }
+        }
+        for (i = firstline; i <= lastline; i += 1)
+        {
+            if (lines[i].codeoffset >= 1 && lines[i].codeoffset <= s->Size + 1)
+            {
+                lines[i].codeoffset = firstnew[lines[i].codeoffset];
+            }
+        }
+        for (p = 1; p <= s->nProcs; p += 1)  /* callers' frames hold the largest procedure they inline */
+        {
+            s->Procs[p].BP += s->Extra[p];
+        }
+
+        free(*code);
+        *code      = out;
+        *codealloc = s->Size + s->Added + 1;
+        s->Code    = out;
+        s->Size    = n;
+
+        free(firstnew);
+        free(newlab);
+        free(used);
+        free(pos);
+    }
+
+    free(s->Regions);
+    free(s->Owner);
+    free(s->Callee);
+    free(s->Extra);
+    free(s->Seen);
+    return calls > 0;
+}
+
+/* --------------------------------------------------------- */
+unsigned int InlineProcedures(Instruction     **code, unsigned int *codealloc, unsigned int codesize,
+                              unsigned int    *labs,  unsigned int *nlabs,    unsigned int maxlabs,
+                              struct LineInfo *lines, unsigned int firstline, unsigned int lastline,
+                              ProcedureItem   *procs, unsigned int nprocs)
+{
+    InlineState  s;
+    unsigned int round;
+
+    memset(&s, 0, sizeof(InlineState));
+    s.Code       = *code;
+    s.Size       = codesize;
+    s.Labels     = labs;
+    s.nLabels    = nlabs;
+    s.LabelLimit = maxlabs;
+    s.Procs      = procs;
+    s.nProcs     = nprocs;
+
+    for (round = 1; round <= MaxInlineRounds; round += 1)
+    {
+        if (!InlineRound(&s, code, codealloc, lines, firstline, lastline))
+        {
+            break;
+        }
+    }
+    return s.Size;
+}
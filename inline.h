@@ -0,0 +1,14 @@
+/* DAMSON procedure inliner header
+*/
+
+#ifndef INLINE
+#define INLINE
+
+#include "compiler.h"
+
+extern unsigned int InlineProcedures(Instruction     **code, unsigned int *codealloc, unsigned int codesize,
+                                     unsigned int    *labs,  unsigned int *nlabs,    unsigned int maxlabs,
+                                     struct LineInfo *lines, unsigned int firstline, unsigned int lastline,
+                                     ProcedureItem   *procs, unsigned int nprocs);
+
+#endif
@@ -0,0 +1,409 @@
+/* DAMSON library interface
+   entry points for a program that embeds DAMSON rather than running it as a process.
+   CompileProgram compiles a model held in memory, an include being asked of the caller's resolver, to a
+   program object holding the image of the model. nothing is written to the file system, and the compiler's
+   and emulator's tables are emptied again, so that one model can be compiled after another. the tables are
+   global, so the calls of concurrent threads are taken in turn.
+   CreateSimulation loads a program into the emulator, which AdvanceSimulation then runs in steps of simulated
+   time or of instructions, so that the caller can look at and change the model between steps. a runtime error
+   stops the model and is returned as a code rather than ending the process. a model that fails to load gives a
+   simulation holding only the error, which is still to be released by FreeSimulation. there can be one
+   simulation at a time, and no compilation while it exists.
+   the emulator's own messages - runtime errors, node exits and the statistics at the end of a run - go to the
+   printf handler as from node 0, and are not printed if there is none
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#ifndef WIN32
+#include <pthread.h>
+#endif
+
+#include "compiler.h"
+#include "emulator.h"
+#include "image.h"
+#include "library.h"
+
+extern struct NodeInfo *NodeList;
+extern struct NodeInfo *NodeListTail;
+extern struct NodeInfo *NameNodeList;
+extern struct NodeInfo *CurrentNode;
+extern unsigned int    LogStreams;
+
+#ifndef WIN32
+pthread_mutex_t        LibraryLock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+DamsonSimulation       *Simulation = NULL;  /* the model in the emulator */
+
+/* PROTOTYPES */
+void LockLibrary();
+void UnlockLibrary();
+int  *FindNodeVariable(DamsonSimulation *s, unsigned int node, char name[], unsigned int index, enum VarType *t);
+
+/* --------------------------------------------------------- */
+void LockLibrary()
+{
+#ifndef WIN32
+    pthread_mutex_lock(&LibraryLock);
+#endif
+}
+
+/* --------------------------------------------------------- */
+void UnlockLibrary()
+{
+#ifndef WIN32
+    pthread_mutex_unlock(&LibraryLock);
+#endif
+}
+
+/* --------------------------------------------------------- */
+DamsonProgram *CompileProgram(char Name[], char Text[], unsigned int Size, IncludeResolver Resolver, void *Context)
+{
+    DamsonProgram   *p;
+    struct NodeInfo *b;
+    jmp_buf         fatal;
+
+    p = calloc(1, sizeof(DamsonProgram));
+    if (p == NULL)
+    {
+        return NULL;
+    }
+
+    LockLibrary();
+    if (Simulation != NULL)  /* its tables are in use */
+    {
+        UnlockLibrary();
+        free(p);
+        return NULL;
+    }
+    if (CompileSource(Name, Text, Size, Resolver, Context, false, false))
+    {
+        for (b=NameNodeList; b!=NULL; b=b->NextNode)
+        {
+            p->Prototypes += 1;
+        }
+        for (b=NodeListTail; b!=NULL; b=b->PrevNode)
+        {
+            p->Nodes += 1;
+        }
+        p->Links = NumberOfLinks;
+        p->Logs  = LogStreams;
+
+        if (setjmp(fatal) == 0)
+        {
+            FatalErrorPoint = &fatal;
+            p->Image = BuildImage(&p->ImageSize);
+        }
+        else
+        {
+            Errors += 1;  /* out of memory */
+        }
+        FatalErrorPoint = NULL;
+    }
+    p->Errors = Errors;
+    FreeModel();
+    UnlockLibrary();
+
+    return p;
+}
+
+/* --------------------------------------------------------- */
+void FreeProgram(DamsonProgram *p)
+{
+    if (p != NULL)
+    {
+        free(p->Image);
+        free(p);
+    }
+}
+
+/* --------------------------------------------------------- */
+DamsonSimulation *CreateSimulation(DamsonProgram *p, bool LogFiles)
+/* NULL if there is no image, or already a simulation. if the model cannot be loaded, Error is set and the
+   other calls return it */
+{
+    DamsonSimulation *s;
+    jmp_buf          fatal;
+    int              code;
+
+    if (p == NULL || p->Image == NULL)
+    {
+        return NULL;
+    }
+    s = calloc(1, sizeof(DamsonSimulation));
+    if (s == NULL)
+    {
+        return NULL;
+    }
+
+    LockLibrary();
+    if (Simulation != NULL)
+    {
+        UnlockLibrary();
+        free(s);
+        return NULL;
+    }
+
+    code = setjmp(fatal);
+    if (code == 0)
+    {
+        FatalErrorPoint = &fatal;
+        LoadImageData("program", p->Image, p->ImageSize, LogFiles);
+        StartEmulation(false, false);
+        s->Status  = EMULATION_PAUSED;
+        Simulation = s;
+    }
+    else
+    {
+        s->Error = code;
+        FreeModel();
+    }
+    FatalErrorPoint = NULL;
+    UnlockLibrary();
+
+    return s;
+}
+
+/* --------------------------------------------------------- */
+int AdvanceSimulation(DamsonSimulation *s, double Time, unsigned long long int Instructions)
+/* until every node has reached Time (seconds) or a further number of instructions have been executed,
+   either being 0 for no limit. returns the status, or minus the code of a runtime error */
+{
+    unsigned long long int ticks;
+    unsigned long long int limit;
+    jmp_buf                fatal;
+    int                    code;
+
+    if (s == NULL)
+    {
+        return -NO_SIMULATION;
+    }
+
+    LockLibrary();
+    if (s != Simulation || s->Error != 0 || s->Status != EMULATION_PAUSED)
+    {
+        UnlockLibrary();
+        return (s->Error != 0) ? -(int) s->Error : (int) s->Status;
+    }
+
+    ticks = (Time > 0.0) ? (unsigned long long int) (Time * (double) CLOCK_FREQUENCY) : ULLONG_MAX;
+    limit = (Instructions > 0) ? InstructionCount + Instructions : ULLONG_MAX;
+
+    code = setjmp(fatal);
+    if (code == 0)
+    {
+        FatalErrorPoint = &fatal;
+        s->Status = RunEmulation(ticks, limit);
+        if (s->Status == EMULATION_PAUSED)
+        {
+            s->Ticks = NodeList->SystemTicks;  /* the node furthest behind */
+        }
+    }
+    else
+    {
+        s->Error = code;  /* the model is left as the error found it */
+    }
+    FatalErrorPoint = NULL;
+    UnlockLibrary();
+
+    return (s->Error != 0) ? -(int) s->Error : (int) s->Status;
+}
+
+/* --------------------------------------------------------- */
+double SimulationTime(DamsonSimulation *s)  /* seconds, or -1 if there is no simulation */
+{
+    if (s == NULL)
+    {
+        return -1.0;
+    }
+    return (double) s->Ticks / (double) CLOCK_FREQUENCY;
+}
+
+/* --------------------------------------------------------- */
+int InjectPacket(DamsonSimulation *s, unsigned int Source, unsigned int Port, unsigned int Dest, int Payload)
+/* from Source on Port to Dest, or to wherever Source is linked if Dest is 0. returns 1 if delivered,
+   0 if not, or minus the code of a runtime error */
+{
+    jmp_buf fatal;
+    int     code;
+    int     result;
+
+    if (s == NULL)
+    {
+        return -NO_SIMULATION;
+    }
+
+    LockLibrary();
+    if (s != Simulation || s->Error != 0 || s->Status != EMULATION_PAUSED)
+    {
+        UnlockLibrary();
+        return (s->Error != 0) ? -(int) s->Error : 0;
+    }
+
+    code = setjmp(fatal);
+    if (code == 0)
+    {
+        FatalErrorPoint = &fatal;
+        CurrentNode = NULL;  /* an invalid port is the caller's error, not of the node that ran last */
+        result = InjectPkt(Source, Port, Dest, Payload) ? 1 : 0;
+    }
+    else
+    {
+        result = -code;  /* an invalid port; the model is unchanged */
+    }
+    FatalErrorPoint = NULL;
+    UnlockLibrary();
+
+    return result;
+}
+
+/* --------------------------------------------------------- */
+int *FindNodeVariable(DamsonSimulation *s, unsigned int node, char name[], unsigned int index, enum VarType *t)
+/* a global or external variable of a node, by name, as in an ensemble override */
+{
+    struct NodeInfo *h;
+    NametableItem   *v;
+    int             *vec;
+    unsigned int    n;
+    unsigned int    i;
+    unsigned int    d;
+    unsigned int    size;
+    char            *vname;
+
+    if (s == NULL || s != Simulation || s->Error != 0 || s->Status != EMULATION_PAUSED)
+    {
+        return NULL;
+    }
+    vname = InternedName(name);  /* names are interned, so matched by pointer */
+    h = FindNode(node);
+    if (vname == NULL || h == NULL)
+    {
+        return NULL;
+    }
+
+    v   = h->Globals;
+    n   = h->NumberOfGlobals;
+    vec = h->G;
+    for (i=1; i<=n; i+=1)
+    {
+        if (v[i].Name == vname)
+        {
+            break;
+        }
+    }
+    if (i > n)
+    {
+        v   = h->Externals;
+        n   = h->NumberOfExternals;
+        vec = h->E;
+        for (i=1; i<=n; i+=1)
+        {
+            if (v[i].Name == vname)
+            {
+                break;
+            }
+        }
+        if (i > n)
+        {
+            return NULL;
+        }
+    }
+
+    size = 1;
+    for (d=1; d<=v[i].vDimensions[0]; d+=1)
+    {
+        size = size * v[i].vDimensions[d];
+    }
+    if (index >= size)
+    {
+        return NULL;
+    }
+    *t = v[i].vType;
+    return &vec[v[i].vOffset + index];
+}
+
+/* --------------------------------------------------------- */
+bool GetGlobal(DamsonSimulation *s, unsigned int Node, char Name[], unsigned int Index, double *Value)
+{
+    int          *a;
+    enum VarType t;
+
+    LockLibrary();
+    a = FindNodeVariable(s, Node, Name, Index, &t);
+    if (a != NULL)
+    {
+        *Value = (t == FloatType) ? (double) *a / 65536.0 : (double) *a;  /* 16.16 fixed point */
+    }
+    UnlockLibrary();
+
+    return a != NULL;
+}
+
+/* --------------------------------------------------------- */
+bool SetGlobal(DamsonSimulation *s, unsigned int Node, char Name[], unsigned int Index, double Value)
+{
+    int          *a;
+    enum VarType t;
+    double       x;
+
+    LockLibrary();
+    a = FindNodeVariable(s, Node, Name, Index, &t);
+    if (a != NULL)
+    {
+        x = (t == FloatType) ? Value * 65536.0 : Value;
+        *a = (int) ((x >= 0) ? x + 0.5 : x - 0.5);
+    }
+    UnlockLibrary();
+
+    return a != NULL;
+}
+
+/* --------------------------------------------------------- */
+void OnPacket(DamsonSimulation *s, PacketHandler Handler, void *Context)  /* each packet delivered, or NULL */
+{
+    LockLibrary();
+    if (s != NULL && s == Simulation)
+    {
+        PacketHook    = Handler;
+        PacketContext = Context;
+    }
+    UnlockLibrary();
+}
+
+/* --------------------------------------------------------- */
+void OnPrintf(DamsonSimulation *s, PrintHandler Handler, void *Context)
+/* printf output in place of stdout, and the emulator's messages as from node 0, or NULL */
+{
+    LockLibrary();
+    if (s != NULL && s == Simulation)
+    {
+        PrintHook    = Handler;
+        PrintContext = Context;
+    }
+    UnlockLibrary();
+}
+
+/* --------------------------------------------------------- */
+void FreeSimulation(DamsonSimulation *s)
+{
+    if (s == NULL)
+    {
+        return;
+    }
+
+    LockLibrary();
+    if (s == Simulation)
+    {
+        PacketHook    = NULL;
+        PacketContext = NULL;
+        PrintHook     = NULL;
+        PrintContext  = NULL;
+        FreeModel();
+        Simulation = NULL;
+    }
+    UnlockLibrary();
+    free(s);
+}
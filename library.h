@@ -0,0 +1,43 @@
+/* DAMSON library interface header
+*/
+
+#ifndef LIBRARY
+#define LIBRARY
+
+#include "compiler.h"
+#include "emulator.h"
+
+typedef struct  /* a compiled model */
+{
+    unsigned char *Image;         /* the model as an image file holds it - prototypes, nodes, links, logs and lines */
+    unsigned int  ImageSize;      /* bytes */
+    unsigned int  Prototypes;
+    unsigned int  Nodes;
+    unsigned int  Links;          /* link ranges */
+    unsigned int  Logs;           /* log and snapshot channels */
+    unsigned int  Errors;         /* compilation errors; there is no image if any */
+} DamsonProgram;
+
+#define NO_SIMULATION 254                 /* error code for a NULL handle */
+
+typedef struct  /* a model being emulated - only one at a time, as the emulator's tables are global */
+{
+    unsigned int           Status;        /* EMULATION_PAUSED until the model finishes or times out */
+    unsigned int           Error;         /* code of the runtime error that stopped or failed to load the model, or 0 */
+    unsigned long long int Ticks;         /* simulated time reached by every node */
+} DamsonSimulation;
+
+extern DamsonProgram    *CompileProgram(char Name[], char Text[], unsigned int Size, IncludeResolver Resolver, void *Context);
+extern void             FreeProgram(DamsonProgram *p);
+
+extern DamsonSimulation *CreateSimulation(DamsonProgram *p, bool LogFiles);
+extern int              AdvanceSimulation(DamsonSimulation *s, double Time, unsigned long long int Instructions);
+extern double           SimulationTime(DamsonSimulation *s);
+extern int              InjectPacket(DamsonSimulation *s, unsigned int Source, unsigned int Port, unsigned int Dest, int Payload);
+extern bool             GetGlobal(DamsonSimulation *s, unsigned int Node, char Name[], unsigned int Index, double *Value);
+extern bool             SetGlobal(DamsonSimulation *s, unsigned int Node, char Name[], unsigned int Index, double Value);
+extern void             OnPacket(DamsonSimulation *s, PacketHandler Handler, void *Context);
+extern void             OnPrintf(DamsonSimulation *s, PrintHandler Handler, void *Context);
+extern void             FreeSimulation(DamsonSimulation *s);
+
+#endif
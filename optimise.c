@@ -0,0 +1,504 @@
+/* DAMSON bytecode optimiser
+   a peephole pass over the bytecode of a prototype, before it is emulated or code generated
+   rules from a table are matched against short runs of live instructions, which never span a jump target;
+   instructions are deleted by marking, then the code is compacted and the labels and line table moved with it
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "compiler.h"
+#include "optimise.h"
+
+#define MaxHops      32  /* jumps followed along a chain */
+#define MaxRuleOps   3
+
+enum PeepholeMatch  { m_ANY, m_ARG, m_SAMEARG };
+enum PeepholeAction { p_DELETE, p_FOLD, p_FIRST, p_LAST };
+
+typedef struct
+{
+    unsigned char       Op[MaxRuleOps];  /* 0 ends a shorter pattern */
+    enum PeepholeMatch  Match;
+    int                 Arg;             /* argument of the first instruction, for m_ARG */
+    enum PeepholeAction Action;          /* p_FIRST and p_LAST keep one instruction, given op NewOp */
+    unsigned char       NewOp;
+} PeepholeRule;
+
+typedef struct
+{
+    Instruction  *Code;
+    unsigned int Size;
+    bool         *Dead;
+    bool         *Target;  /* a jump target or (debugging) the start of a line */
+    unsigned int *Labels;
+} PeepholeState;
+
+PeepholeRule PeepholeRules[] =
+{
+    { { s_LP, s_SP, 0 },         m_SAMEARG,  0, p_DELETE, 0 },  /* x = x */
+    { { s_LG, s_SG, 0 },         m_SAMEARG,  0, p_DELETE, 0 },
+
+    { { s_LN, s_PLUS, 0 },       m_ARG,      0, p_DELETE, 0 },  /* identities */
+    { { s_LN, s_MINUS, 0 },      m_ARG,      0, p_DELETE, 0 },
+    { { s_LN, s_LOGOR, 0 },      m_ARG,      0, p_DELETE, 0 },
+    { { s_LN, s_NEQV, 0 },       m_ARG,      0, p_DELETE, 0 },
+    { { s_LN, s_LSHIFT, 0 },     m_ARG,      0, p_DELETE, 0 },
+    { { s_LN, s_RSHIFT, 0 },     m_ARG,      0, p_DELETE, 0 },
+    { { s_LN, s_LOGAND, 0 },     m_ARG,     -1, p_DELETE, 0 },
+    { { s_LN, s_MULT, 0 },       m_ARG,      1, p_DELETE, 0 },
+    { { s_LN, s_DIV, 0 },        m_ARG,      1, p_DELETE, 0 },
+
+    { { s_LN, s_NEG, 0 },        m_ANY,      0, p_FOLD,   0 },  /* constants */
+    { { s_LN, s_COMP, 0 },       m_ANY,      0, p_FOLD,   0 },
+    { { s_LN, s_NOT, 0 },        m_ANY,      0, p_FOLD,   0 },
+    { { s_LN, s_FLOAT, 0 },      m_ANY,      0, p_FOLD,   0 },
+    { { s_LN, s_ABS, 0 },        m_ANY,      0, p_FOLD,   0 },
+    { { s_LN, s_LN, s_PLUS },    m_ANY,      0, p_FOLD,   0 },
+    { { s_LN, s_LN, s_MINUS },   m_ANY,      0, p_FOLD,   0 },
+    { { s_LN, s_LN, s_MULT },    m_ANY,      0, p_FOLD,   0 },
+    { { s_LN, s_LN, s_MULTF },   m_ANY,      0, p_FOLD,   0 },
+    { { s_LN, s_LN, s_DIV },     m_ANY,      0, p_FOLD,   0 },
+    { { s_LN, s_LN, s_DIVF },    m_ANY,      0, p_FOLD,   0 },
+    { { s_LN, s_LN, s_REM },     m_ANY,      0, p_FOLD,   0 },
+    { { s_LN, s_LN, s_LOGAND },  m_ANY,      0, p_FOLD,   0 },
+    { { s_LN, s_LN, s_LOGOR },   m_ANY,      0, p_FOLD,   0 },
+    { { s_LN, s_LN, s_NEQV },    m_ANY,      0, p_FOLD,   0 },
+    { { s_LN, s_LN, s_LSHIFT },  m_ANY,      0, p_FOLD,   0 },
+    { { s_LN, s_LN, s_RSHIFT },  m_ANY,      0, p_FOLD,   0 },
+    { { s_LN, s_LN, s_AND },     m_ANY,      0, p_FOLD,   0 },
+    { { s_LN, s_LN, s_OR },      m_ANY,      0, p_FOLD,   0 },
+    { { s_LN, s_LN, s_EQ },      m_ANY,      0, p_FOLD,   0 },
+    { { s_LN, s_LN, s_NE },      m_ANY,      0, p_FOLD,   0 },
+    { { s_LN, s_LN, s_LS },      m_ANY,      0, p_FOLD,   0 },
+    { { s_LN, s_LN, s_GR },      m_ANY,      0, p_FOLD,   0 },
+    { { s_LN, s_LN, s_LE },      m_ANY,      0, p_FOLD,   0 },
+    { { s_LN, s_LN, s_GE },      m_ANY,      0, p_FOLD,   0 },
+
+    { { s_NOT, s_JF, 0 },        m_ANY,      0, p_LAST,   s_JT },  /* conditions */
+    { { s_NOT, s_JT, 0 },        m_ANY,      0, p_LAST,   s_JF },
+    { { s_EQ, s_NOT, 0 },        m_ANY,      0, p_FIRST,  s_NE },
+    { { s_NE, s_NOT, 0 },        m_ANY,      0, p_FIRST,  s_EQ },
+    { { s_LS, s_NOT, 0 },        m_ANY,      0, p_FIRST,  s_GE },
+    { { s_GR, s_NOT, 0 },        m_ANY,      0, p_FIRST,  s_LE },
+    { { s_LE, s_NOT, 0 },        m_ANY,      0, p_FIRST,  s_GR },
+    { { s_GE, s_NOT, 0 },        m_ANY,      0, p_FIRST,  s_LS }
+};
+
+#define NumberOfPeepholeRules (sizeof(PeepholeRules) / sizeof(PeepholeRule))
+
+unsigned int NextLive(PeepholeState *ps, unsigned int i);
+unsigned int ResolveLabel(PeepholeState *ps, unsigned int lab);
+void         DeleteInstruction(PeepholeState *ps, unsigned int i);
+bool         MatchRule(PeepholeState *ps, PeepholeRule *rule, unsigned int i);
+bool         Jumps(PeepholeState *ps, unsigned int i);
+bool         Unreachable(PeepholeState *ps, unsigned int i);
+
+/* --------------------------------------------------------- */
+unsigned int NextLive(PeepholeState *ps, unsigned int i)  /* Size + 1 at the end of the code */
+{
+    i += 1;
+    while (i <= ps->Size && ps->Dead[i])
+    {
+        i += 1;
+    }
+    return i;
+}
+
+/* --------------------------------------------------------- */
+unsigned int ResolveLabel(PeepholeState *ps, unsigned int lab)  /* first live instruction at the label */
+{
+    unsigned int i = ps->Labels[lab];
+
+    if (i == 0 || i > ps->Size)
+    {
+        return ps->Size + 1;
+    }
+    if (ps->Dead[i])
+    {
+        i = NextLive(ps, i);
+    }
+    return i;
+}
+
+/* --------------------------------------------------------- */
+void DeleteInstruction(PeepholeState *ps, unsigned int i)
+{
+    ps->Dead[i] = true;
+    if (ps->Target[i])  /* control now arrives at the next instruction */
+    {
+        ps->Target[i] = false;
+        ps->Target[NextLive(ps, i)] = true;
+    }
+}
+
+/* --------------------------------------------------------- */
+bool FoldConstant(unsigned int Op, int a, int b, int *r)  /* b Op a as the emulator evaluates it, a being on top; false if it could fail at run time */
+{
+    long long int x;
+
+    switch (Op)
+    {
+        case s_NEG:    *r = (int) (0u - (unsigned int) a);              return true;
+        case s_COMP:   *r = ~a;                                           return true;
+        case s_NOT:    *r = (a == 0);                                     return true;
+        case s_FLOAT:  *r = (int) ((unsigned int) a * 65536u);            return true;
+        case s_PLUS:   *r = (int) ((unsigned int) b + (unsigned int) a);  return true;
+        case s_MINUS:  *r = (int) ((unsigned int) b - (unsigned int) a);  return true;
+        case s_LOGAND: *r = b & a;                                        return true;
+        case s_LOGOR:  *r = b | a;                                        return true;
+        case s_NEQV:   *r = b ^ a;                                        return true;
+        case s_AND:    *r = (a != 0 && b != 0);                           return true;
+        case s_OR:     *r = (a != 0 || b != 0);                           return true;
+        case s_EQ:     *r = (b == a);                                     return true;
+        case s_NE:     *r = (b != a);                                     return true;
+        case s_LS:     *r = (b < a);                                      return true;
+        case s_GR:     *r = (b > a);                                      return true;
+        case s_LE:     *r = (b <= a);                                     return true;
+        case s_GE:     *r = (b >= a);                                     return true;
+
+        case s_ABS:
+            if (a == INT_MIN)
+            {
+                return false;
+            }
+            *r = (a < 0) ? -a : a;
+            return true;
+
+        case s_MULT:  /* -ar checks the product */
+            if (a == INT_MIN || b == INT_MIN || (long long int) abs(a) * (long long int) abs(b) > 0x7fffffffLL)
+            {
+                return false;
+            }
+            *r = a * b;
+            return true;
+
+        case s_MULTF:
+            if (a == INT_MIN || b == INT_MIN)
+            {
+                return false;
+            }
+            x = ((long long int) abs(a) * (long long int) abs(b) + 32768LL) / 65536LL;
+            if (x > 0x7fffffffLL || (x == 0 && a != 0 && b != 0))
+            {
+                return false;
+            }
+            *r = ((a ^ b) < 0) ? (int) -x : (int) x;
+            return true;
+
+        case s_DIV:
+            if (a == 0 || a == INT_MIN || (a < 0 && b == INT_MIN))
+            {
+                return false;
+            }
+            *r = (a < 0) ? (-b) / (-a) : b / a;
+            return true;
+
+        case s_DIVF:
+            if (a == 0 || a == INT_MIN || b == INT_MIN)
+            {
+                return false;
+            }
+            x = ((long long int) abs(b) * 65536LL + (long long int) (abs(a) / 2)) / (long long int) abs(a);
+            if (x > 0x7fffffffLL || (x == 0 && b != 0))
+            {
+                return false;
+            }
+            *r = ((a ^ b) < 0) ? (int) -x : (int) x;
+            return true;
+
+        case s_REM:
+            if (a == 0 || (a == -1 && b == INT_MIN))
+            {
+                return false;
+            }
+            *r = b % a;
+            return true;
+
+        case s_LSHIFT:
+        case s_RSHIFT:
+            if (a < 0 || a > 31)
+            {
+                return false;  /* left as the host evaluates it */
+            }
+            *r = (Op == s_LSHIFT) ? (int) ((unsigned int) b << a) : b >> a;
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+/* --------------------------------------------------------- */
+bool MatchRule(PeepholeState *ps, PeepholeRule *rule, unsigned int i)
+{
+    unsigned int w[MaxRuleOps];
+    unsigned int n;
+    unsigned int k;
+    int          r;
+
+    w[0] = i;
+    for (n = 0; n < MaxRuleOps && rule->Op[n] != 0; n += 1)
+    {
+        if (n > 0)
+        {
+            w[n] = NextLive(ps, w[n - 1]);
+            if (w[n] > ps->Size || ps->Target[w[n]])
+            {
+                return false;
+            }
+        }
+        if (ps->Code[w[n]].Op != rule->Op[n])
+        {
+            return false;
+        }
+    }
+
+    switch (rule->Match)
+    {
+        case m_ARG:
+            if (ps->Code[w[0]].Arg != rule->Arg)
+            {
+                return false;
+            }
+            break;
+
+        case m_SAMEARG:
+            if (ps->Code[w[0]].Arg != ps->Code[w[1]].Arg)
+            {
+                return false;
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    switch (rule->Action)
+    {
+        case p_DELETE:
+            for (k = 0; k < n; k += 1)
+            {
+                DeleteInstruction(ps, w[k]);
+            }
+            break;
+
+        case p_FOLD:
+            if (n == 2)
+            {
+                if (!FoldConstant(ps->Code[w[1]].Op, ps->Code[w[0]].Arg, 0, &r))
+                {
+                    return false;
+                }
+            }
+            else if (!FoldConstant(ps->Code[w[2]].Op, ps->Code[w[1]].Arg, ps->Code[w[0]].Arg, &r))
+            {
+                return false;
+            }
+            ps->Code[w[0]].Arg = r;
+            for (k = 1; k < n; k += 1)
+            {
+                DeleteInstruction(ps, w[k]);
+            }
+            break;
+
+        case p_FIRST:
+            ps->Code[w[0]].Op = rule->NewOp;
+            for (k = 1; k < n; k += 1)
+            {
+                DeleteInstruction(ps, w[k]);
+            }
+            break;
+
+        case p_LAST:
+            ps->Code[w[n - 1]].Op = rule->NewOp;
+            for (k = 0; k + 1 < n; k += 1)
+            {
+                DeleteInstruction(ps, w[k]);
+            }
+            break;
+    }
+    return true;
+}
+
+/* --------------------------------------------------------- */
+bool Jumps(PeepholeState *ps, unsigned int i)  /* chains of jumps and jumps to the next instruction */
+{
+    unsigned int lab;
+    unsigned int t;
+    unsigned int hops;
+
+    lab = ps->Code[i].Arg;
+    for (hops = 0; hops < MaxHops; hops += 1)
+    {
+        t = ResolveLabel(ps, lab);
+        while (t <= ps->Size && ps->Code[t].Op == s_LAB)
+        {
+            t = NextLive(ps, t);
+        }
+        if (t > ps->Size || t == i || ps->Code[t].Op != s_JUMP || ps->Code[t].Arg == lab)
+        {
+            break;
+        }
+        lab = ps->Code[t].Arg;
+    }
+
+    if (hops == MaxHops)  /* a loop of jumps - left alone */
+    {
+        return false;
+    }
+    if (lab != (unsigned int) ps->Code[i].Arg)
+    {
+        ps->Code[i].Arg = lab;
+        return true;
+    }
+    if (ps->Code[i].Op == s_JUMP && ResolveLabel(ps, lab) == NextLive(ps, i))
+    {
+        DeleteInstruction(ps, i);
+        return true;
+    }
+    return false;
+}
+
+/* --------------------------------------------------------- */
+bool Unreachable(PeepholeState *ps, unsigned int i)  /* instructions after a jump or return, up to the next target */
+{
+    unsigned int j;
+    unsigned int Op;
+    bool         changed = false;
+
+    j = NextLive(ps, i);
+    while (j <= ps->Size && !ps->Target[j])
+    {
+        Op = ps->Code[j].Op;
+        if (Op == 0 || Op == s_SWITCHON || Op > s_GBOUNDSCHECK)  /* case tables and code generator directives are kept */
+        {
+            break;
+        }
+        DeleteInstruction(ps, j);
+        changed = true;
+        j = NextLive(ps, j);
+    }
+    return changed;
+}
+
+/* --------------------------------------------------------- */
+unsigned int Peephole(Instruction     *code,  unsigned int codesize,
+                      unsigned int    *labs,  unsigned int nlabs,
+                      struct LineInfo *lines, unsigned int firstline, unsigned int lastline,
+                      bool            debugging)
+{
+    PeepholeState ps;
+    unsigned int  *map;
+    unsigned int  i;
+    unsigned int  n;
+    unsigned int  r;
+    bool          changed;
+
+    ps.Code   = code;
+    ps.Size   = codesize;
+    ps.Labels = labs;
+    ps.Dead   = calloc(codesize + 2, sizeof(bool));
+    ps.Target = calloc(codesize + 2, sizeof(bool));
+    map       = malloc(sizeof(unsigned int) * (codesize + 2));
+    if (ps.Dead == NULL || ps.Target == NULL || map == NULL)
+    {
+        Error(130, "Unable to allocate optimiser tables (%d)\n", codesize);
+    }
+
+    for (i = 1; i <= nlabs; i += 1)
+    {
+        if (labs[i] <= codesize)
+        {
+            ps.Target[labs[i]] = true;
+        }
+    }
+    if (debugging)  /* keep the code of each line apart, for breakpoints and stepping */
+    {
+        for (i = firstline; i <= lastline; i += 1)
+        {
+            if (lines[i].codeoffset <= codesize)
+            {
+                ps.Target[lines[i].codeoffset] = true;
+            }
+        }
+    }
+
+    do
+    {
+        changed = false;
+        for (i = 1; i <= codesize; i = NextLive(&ps, i))
+        {
+            if (ps.Dead[i])
+            {
+                continue;
+            }
+            switch (code[i].Op)
+            {
+                case s_JUMP:
+                case s_JT:
+                case s_JF:
+                    changed |= Jumps(&ps, i);
+                    break;
+
+                default:
+                    for (r = 0; r < NumberOfPeepholeRules; r += 1)
+                    {
+                        if (MatchRule(&ps, &PeepholeRules[r], i))
+                        {
+                            changed = true;
+                            break;
+                        }
+                    }
+                    break;
+            }
+            if (!ps.Dead[i] && (code[i].Op == s_JUMP || code[i].Op == s_RTRN))
+            {
+                changed |= Unreachable(&ps, i);
+            }
+            if (code[i].Op == s_SWITCHON && !ps.Dead[i])  /* step over the case table */
+            {
+                i += 2 * code[i].Arg + 1;
+            }
+        }
+    } while (changed);
+
+    n = 0;  /* compact, mapping each old address to its new one */
+    map[0] = 0;
+    for (i = 1; i <= codesize; i += 1)
+    {
+        if (ps.Dead[i])
+        {
+            map[i] = n + 1;  /* the next instruction kept */
+        }
+        else
+        {
+            n += 1;
+            map[i] = n;
+            code[n] = code[i];
+        }
+    }
+    map[codesize + 1] = n + 1;
+
+    for (i = 1; i <= nlabs; i += 1)
+    {
+        if (labs[i] <= codesize + 1)
+        {
+            labs[i] = map[labs[i]];
+        }
+    }
+    for (i = firstline; i <= lastline; i += 1)
+    {
+        if (lines[i].codeoffset <= codesize + 1)
+        {
+            lines[i].codeoffset = map[lines[i].codeoffset];
+        }
+    }
+
+    free(ps.Dead);
+    free(ps.Target);
+    free(map);
+    return n;
+}
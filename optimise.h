@@ -0,0 +1,15 @@
+/* DAMSON bytecode optimiser header
+*/
+
+#ifndef OPTIMISE
+#define OPTIMISE
+
+#include "compiler.h"
+
+extern bool         FoldConstant(unsigned int Op, int a, int b, int *r);
+extern unsigned int Peephole(Instruction     *code,  unsigned int codesize,
+                             unsigned int    *labs,  unsigned int nlabs,
+                             struct LineInfo *lines, unsigned int firstline, unsigned int lastline,
+                             bool            debugging);
+
+#endif
@@ -0,0 +1,1008 @@
+/* DAMSON link-graph partitioner
+   maps nodes to workers, minimising the packet traffic between workers
+   multilevel scheme: heavy-edge coarsening, greedy growing, Kernighan-Lin refinement
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "compiler.h"
+#include "emulator.h"
+#include "partition.h"
+
+#define MaxPartitions   1024
+#define MaxLevels       64
+#define CoarsenTo       20      /* vertices per partition in the coarsest graph */
+#define MinShrink       0.95    /* stop coarsening if a level removes less than 5% */
+#define MaxRefinePasses 10
+#define Imbalance       1.03    /* permitted ratio of largest part to average */
+#define ExpandLimit     4096    /* node pairs of a link range given an edge each; a larger range is joined through a vertex of its own */
+
+typedef struct
+{
+    unsigned int nvtxs;
+    unsigned int nedges;
+    unsigned int *xadj;         /* adjacency of vertex v is adjncy[xadj[v]..xadj[v+1]-1] */
+    unsigned int *adjncy;
+    unsigned int *adjwgt;
+    unsigned int *vwgt;
+    unsigned int *cmap;         /* vertex -> vertex of the next coarser graph */
+} PartGraph;
+
+extern struct NodeInfo *NodeList;
+
+unsigned int PartNodes = 0;               /* number of nodes in the placement */
+unsigned int *PartNodeNumbers = NULL;     /* node numbers, sorted */
+unsigned int *PartTX = NULL;              /* profiled packet counts */
+unsigned int *PartRX = NULL;
+int          *Placement = NULL;           /* node index -> worker */
+bool         Profiled = false;
+unsigned int PartSeed;
+
+int          CompareNodeNumbers(const void *a, const void *b);
+unsigned int PartFirst(unsigned int node);
+unsigned int PartVertex(unsigned int node);
+unsigned int PartRandom(unsigned int n);
+unsigned int PartSpan(unsigned int low, unsigned int high, unsigned int *first);
+bool         LinkSpan(LinkItem *p, unsigned int *s, unsigned int *ns, unsigned int *d, unsigned int *nd);
+void         CountLinks(size_t *nedges, unsigned int *nhubs);
+void         CollectLinks(unsigned int *src, unsigned int *dst, unsigned int *wgt, size_t *nedges);
+PartGraph    *NewGraph(unsigned int nvtxs, unsigned int nedges);
+void         FreeGraph(PartGraph *g);
+PartGraph    *LinkGraph();
+PartGraph    *Coarsen(PartGraph *g, unsigned int maxvwgt);
+void         InitialPartition(PartGraph *g, unsigned int nparts, int *where);
+void         Refine(PartGraph *g, unsigned int nparts, int *where);
+unsigned int EdgeCut(PartGraph *g, int *where);
+void         PlaceHubs(PartGraph *g, unsigned int nparts, int *where);
+void         ReadPlacement(char Filename[], unsigned int *nparts);
+void         WritePlacement(char Filename[], unsigned int nparts);
+void         ReportPartition(PartGraph *g, unsigned int nparts, int *where);
+void         *PartAlloc(size_t size);
+
+/* --------------------------------------------------------- */
+void *PartAlloc(size_t size)
+{
+    void *p;
+
+    p = malloc(size);
+    if (p == NULL)
+    {
+        Error(401, "Partition: out of memory\n");
+    }
+    return p;
+}
+
+/* --------------------------------------------------------- */
+int CompareNodeNumbers(const void *a, const void *b)
+{
+    unsigned int x = *(const unsigned int *) a;
+    unsigned int y = *(const unsigned int *) b;
+
+    return (x > y) - (x < y);
+}
+
+/* --------------------------------------------------------- */
+unsigned int PartRandom(unsigned int n)  /* deterministic, so that placements are reproducible */
+{
+    PartSeed = PartSeed * 1103515245 + 12345;
+    return (PartSeed >> 16) % n;
+}
+
+/* --------------------------------------------------------- */
+void BuildPartitionGraph()  /* snapshot the node list - nodes are deleted as they terminate */
+{
+    struct NodeInfo *h;
+    unsigned int    n;
+
+    FreePartitionGraph();
+
+    n = 0;
+    for (h=NodeList; h!=NULL; h=h->NextNode)
+    {
+        n += 1;
+    }
+
+    PartNodes       = n;
+    PartNodeNumbers = (unsigned int *) PartAlloc(sizeof(unsigned int) * (n + 1));
+    PartTX          = (unsigned int *) PartAlloc(sizeof(unsigned int) * (n + 1));
+    PartRX          = (unsigned int *) PartAlloc(sizeof(unsigned int) * (n + 1));
+    Placement       = (int *) PartAlloc(sizeof(int) * (n + 1));
+
+    n = 0;
+    for (h=NodeList; h!=NULL; h=h->NextNode)
+    {
+        PartNodeNumbers[n] = h->NodeNumber;
+        PartTX[n]          = 0;
+        PartRX[n]          = 0;
+        Placement[n]       = -1;
+        n += 1;
+    }
+    qsort(PartNodeNumbers, PartNodes, sizeof(unsigned int), CompareNodeNumbers);
+    Profiled = false;
+}
+
+/* --------------------------------------------------------- */
+void FreePartitionGraph()
+{
+    free(PartNodeNumbers);
+    free(PartTX);
+    free(PartRX);
+    free(Placement);
+    PartNodeNumbers = NULL;
+    PartTX          = NULL;
+    PartRX          = NULL;
+    Placement       = NULL;
+    PartNodes       = 0;
+}
+
+/* --------------------------------------------------------- */
+unsigned int PartFirst(unsigned int node)  /* the first vertex numbered node or above, PartNodes if none */
+{
+    unsigned int lo = 0;
+    unsigned int hi = PartNodes;
+    unsigned int mid;
+
+    while (lo < hi)
+    {
+        mid = (lo + hi) / 2;
+        if (PartNodeNumbers[mid] < node)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/* --------------------------------------------------------- */
+unsigned int PartVertex(unsigned int node)  /* returns PartNodes if the node is unknown */
+{
+    unsigned int lo = PartFirst(node);
+
+    if (lo < PartNodes && PartNodeNumbers[lo] == node)
+    {
+        return lo;
+    }
+    return PartNodes;
+}
+
+/* --------------------------------------------------------- */
+void RecordTraffic(unsigned int node, unsigned int tx, unsigned int rx)  /* called as each node terminates */
+{
+    unsigned int v;
+
+    if (PartNodes == 0)
+    {
+        return;
+    }
+    v = PartVertex(node);
+    if (v < PartNodes)
+    {
+        PartTX[v] = tx;
+        PartRX[v] = rx;
+        Profiled = true;
+    }
+}
+
+/* --------------------------------------------------------- */
+unsigned int PartSpan(unsigned int low, unsigned int high, unsigned int *first)  /* the number of known nodes low..high */
+{
+    unsigned int last = PartFirst(high);
+
+    *first = PartFirst(low);
+    if (last < PartNodes && PartNodeNumbers[last] == high)
+    {
+        last += 1;
+    }
+    return last - *first;
+}
+
+/* --------------------------------------------------------- */
+bool LinkSpan(LinkItem *p, unsigned int *s, unsigned int *ns, unsigned int *d, unsigned int *nd)
+/* the known sources s..s+ns-1 and destinations d..d+nd-1 of a link range; true if it is joined through a vertex */
+{
+    *ns = PartSpan(p->slow, p->shigh, s);
+    *nd = PartSpan(p->dlow, p->dhigh, d);
+    return (unsigned long long) *ns * (unsigned long long) *nd > ExpandLimit;
+}
+
+/* --------------------------------------------------------- */
+void CountLinks(size_t *nedges, unsigned int *nhubs)
+{
+    unsigned int       i;
+    unsigned int       s;
+    unsigned int       ns;
+    unsigned int       d;
+    unsigned int       nd;
+    unsigned long long n;
+
+    n = 0;
+    for (i=1; i<=NumberOfLinks; i+=1)
+    {
+        if (LinkSpan(&Links[i], &s, &ns, &d, &nd))
+        {
+            n += (unsigned long long) ns + nd;
+            *nhubs += 1;
+        }
+        else
+        {
+            n += (unsigned long long) ns * nd;
+        }
+    }
+    if (n > UINT_MAX / 2 || (unsigned long long) PartNodes + *nhubs >= UINT_MAX)  /* the adjacency is indexed by unsigned int */
+    {
+        Error(406, "Partition: the link graph is too large (%llu edges)\n", n);
+    }
+    *nedges = (size_t) n;
+}
+
+/* --------------------------------------------------------- */
+void CollectLinks(unsigned int *src, unsigned int *dst, unsigned int *wgt, size_t *nedges)
+/* the link ranges, one edge for each pair of nodes, or an edge from each node to a vertex of the range's own */
+{
+    unsigned int       i;
+    unsigned int       s;
+    unsigned int       ns;
+    unsigned int       d;
+    unsigned int       nd;
+    unsigned int       u;
+    unsigned int       v;
+    unsigned int       hub;
+    unsigned long long w;
+
+    hub = PartNodes;
+    for (i=1; i<=NumberOfLinks; i+=1)
+    {
+        if (LinkSpan(&Links[i], &s, &ns, &d, &nd))
+        {
+            w = 0;
+            for (u=s; u<s+ns; u+=1)
+            {
+                src[*nedges] = u;
+                dst[*nedges] = hub;
+                wgt[*nedges] = 1 + PartTX[u];  /* the packets sent by u, once to the range */
+                *nedges += 1;
+                w += 1 + PartTX[u];
+            }
+            for (v=d; v<d+nd; v+=1)
+            {
+                src[*nedges] = hub;
+                dst[*nedges] = v;
+                wgt[*nedges] = (w < UINT_MAX) ? (unsigned int) w : UINT_MAX;  /* every packet sent into the range reaches v */
+                *nedges += 1;
+            }
+            hub += 1;
+            continue;
+        }
+        for (u=s; u<s+ns; u+=1)
+        {
+            for (v=d; v<d+nd; v+=1)
+            {
+                if (v != u)
+                {
+                    src[*nedges] = u;
+                    dst[*nedges] = v;
+                    wgt[*nedges] = 1 + PartTX[u];  /* every packet sent by u reaches v */
+                    *nedges += 1;
+                }
+            }
+        }
+    }
+}
+
+/* --------------------------------------------------------- */
+PartGraph *NewGraph(unsigned int nvtxs, unsigned int nedges)
+{
+    PartGraph *g;
+
+    g = (PartGraph *) PartAlloc(sizeof(PartGraph));
+    g->nvtxs  = nvtxs;
+    g->nedges = 0;
+    g->xadj   = (unsigned int *) PartAlloc(sizeof(unsigned int) * (nvtxs + 1));
+    g->adjncy = (unsigned int *) PartAlloc(sizeof(unsigned int) * (nedges + 1));
+    g->adjwgt = (unsigned int *) PartAlloc(sizeof(unsigned int) * (nedges + 1));
+    g->vwgt   = (unsigned int *) PartAlloc(sizeof(unsigned int) * (nvtxs + 1));
+    g->cmap   = (unsigned int *) PartAlloc(sizeof(unsigned int) * (nvtxs + 1));
+    return g;
+}
+
+/* --------------------------------------------------------- */
+void FreeGraph(PartGraph *g)
+{
+    free(g->xadj);
+    free(g->adjncy);
+    free(g->adjwgt);
+    free(g->vwgt);
+    free(g->cmap);
+    free(g);
+}
+
+/* --------------------------------------------------------- */
+PartGraph *LinkGraph()  /* undirected, weighted graph of the links between known nodes, and the large link ranges */
+{
+    PartGraph    *g;
+    size_t       nlinks;
+    unsigned int nhubs;
+    unsigned int nv;
+    unsigned int *src;
+    unsigned int *dst;
+    unsigned int *wgt;
+    unsigned int *deg;
+    int          *marker;
+    unsigned int i;
+    unsigned int v;
+    unsigned int u;
+    unsigned int k;
+    unsigned int start;
+
+    nlinks = 0;
+    nhubs = 0;
+    CountLinks(&nlinks, &nhubs);
+    nv = PartNodes + nhubs;
+    src = (unsigned int *) PartAlloc(sizeof(unsigned int) * (nlinks + 1));
+    dst = (unsigned int *) PartAlloc(sizeof(unsigned int) * (nlinks + 1));
+    wgt = (unsigned int *) PartAlloc(sizeof(unsigned int) * (nlinks + 1));
+    nlinks = 0;
+    CollectLinks(src, dst, wgt, &nlinks);
+
+    g = NewGraph(nv, 2 * (unsigned int) nlinks);
+    deg = (unsigned int *) PartAlloc(sizeof(unsigned int) * (nv + 1));
+    for (v=0; v<=nv; v+=1)
+    {
+        deg[v] = 0;
+    }
+    for (i=0; i<nlinks; i+=1)
+    {
+        deg[src[i]] += 1;
+        deg[dst[i]] += 1;
+    }
+
+    g->xadj[0] = 0;
+    for (v=0; v<nv; v+=1)
+    {
+        g->xadj[v+1] = g->xadj[v] + deg[v];
+        deg[v] = g->xadj[v];
+        g->vwgt[v] = (v < PartNodes) ? 1 + PartTX[v] + PartRX[v] : 0;  /* a link range does no work */
+    }
+    for (i=0; i<nlinks; i+=1)  /* links are directed, the placement cost is not */
+    {
+        g->adjncy[deg[src[i]]] = dst[i];
+        g->adjwgt[deg[src[i]]] = wgt[i];
+        deg[src[i]] += 1;
+        g->adjncy[deg[dst[i]]] = src[i];
+        g->adjwgt[deg[dst[i]]] = wgt[i];
+        deg[dst[i]] += 1;
+    }
+
+    marker = (int *) PartAlloc(sizeof(int) * (nv + 1));  /* merge parallel edges */
+    for (v=0; v<nv; v+=1)
+    {
+        marker[v] = -1;
+    }
+    k = 0;
+    for (v=0; v<nv; v+=1)
+    {
+        start = k;
+        for (i=g->xadj[v]; i<g->xadj[v+1]; i+=1)
+        {
+            u = g->adjncy[i];
+            if (marker[u] >= (int) start)
+            {
+                g->adjwgt[marker[u]] += g->adjwgt[i];
+            }
+            else
+            {
+                marker[u] = k;
+                g->adjncy[k] = u;
+                g->adjwgt[k] = g->adjwgt[i];
+                k += 1;
+            }
+        }
+        g->xadj[v] = start;
+    }
+    g->xadj[nv] = k;
+    g->nedges = k;
+
+    free(marker);
+    free(deg);
+    free(src);
+    free(dst);
+    free(wgt);
+    return g;
+}
+
+/* --------------------------------------------------------- */
+PartGraph *Coarsen(PartGraph *g, unsigned int maxvwgt)  /* heavy-edge matching */
+{
+    PartGraph    *c;
+    int          *match;
+    unsigned int *perm;
+    unsigned int *first;
+    int          *marker;
+    unsigned int nc;
+    unsigned int i;
+    unsigned int j;
+    unsigned int k;
+    unsigned int t;
+    unsigned int v;
+    unsigned int u;
+    unsigned int w;
+    unsigned int best;
+    unsigned int bestw;
+    unsigned int start;
+
+    match = (int *) PartAlloc(sizeof(int) * (g->nvtxs + 1));
+    perm  = (unsigned int *) PartAlloc(sizeof(unsigned int) * (g->nvtxs + 1));
+    first = (unsigned int *) PartAlloc(sizeof(unsigned int) * (g->nvtxs + 1));
+
+    for (v=0; v<g->nvtxs; v+=1)
+    {
+        match[v] = -1;
+        perm[v]  = v;
+    }
+    for (v=g->nvtxs; v>1; v-=1)
+    {
+        j = PartRandom(v);
+        t = perm[v-1];
+        perm[v-1] = perm[j];
+        perm[j] = t;
+    }
+
+    nc = 0;
+    for (i=0; i<g->nvtxs; i+=1)
+    {
+        v = perm[i];
+        if (match[v] >= 0)
+        {
+            continue;
+        }
+        best  = v;
+        bestw = 0;
+        for (j=g->xadj[v]; j<g->xadj[v+1]; j+=1)
+        {
+            u = g->adjncy[j];
+            if (match[u] < 0 && g->adjwgt[j] > bestw && g->vwgt[v] + g->vwgt[u] <= maxvwgt)
+            {
+                best  = u;
+                bestw = g->adjwgt[j];
+            }
+        }
+        match[v]    = best;
+        match[best] = v;
+        g->cmap[v]    = nc;
+        g->cmap[best] = nc;
+        first[nc]     = v;
+        nc += 1;
+    }
+
+    c = NewGraph(nc, g->nedges);
+    marker = (int *) PartAlloc(sizeof(int) * (nc + 1));
+    for (v=0; v<nc; v+=1)
+    {
+        marker[v] = -1;
+    }
+
+    k = 0;
+    c->xadj[0] = 0;
+    for (w=0; w<nc; w+=1)
+    {
+        start = k;
+        v = first[w];
+        u = match[v];
+        c->vwgt[w] = g->vwgt[v] + ((u != v) ? g->vwgt[u] : 0);
+        for (t=0; t<2; t+=1)
+        {
+            for (j=g->xadj[v]; j<g->xadj[v+1]; j+=1)
+            {
+                i = g->cmap[g->adjncy[j]];
+                if (i == w)  /* edge collapsed by the match */
+                {
+                    continue;
+                }
+                if (marker[i] >= (int) start)
+                {
+                    c->adjwgt[marker[i]] += g->adjwgt[j];
+                }
+                else
+                {
+                    marker[i] = k;
+                    c->adjncy[k] = i;
+                    c->adjwgt[k] = g->adjwgt[j];
+                    k += 1;
+                }
+            }
+            if (u == v)
+            {
+                break;
+            }
+            v = u;
+        }
+        c->xadj[w+1] = k;
+    }
+    c->nedges = k;
+
+    free(marker);
+    free(first);
+    free(perm);
+    free(match);
+    return c;
+}
+
+/* --------------------------------------------------------- */
+void InitialPartition(PartGraph *g, unsigned int nparts, int *where)  /* greedy growing, heaviest vertices first */
+{
+    unsigned int       *pwgt;
+    unsigned int       *conn;
+    unsigned int       *order;
+    unsigned long long total;
+    unsigned long long target;
+    unsigned int       i;
+    unsigned int       j;
+    unsigned int       t;
+    unsigned int       v;
+    unsigned int       p;
+    int                best;
+
+    pwgt  = (unsigned int *) PartAlloc(sizeof(unsigned int) * (nparts + 1));
+    conn  = (unsigned int *) PartAlloc(sizeof(unsigned int) * (nparts + 1));
+    order = (unsigned int *) PartAlloc(sizeof(unsigned int) * (g->nvtxs + 1));
+
+    total = 0;
+    for (v=0; v<g->nvtxs; v+=1)
+    {
+        total += g->vwgt[v];
+        where[v] = -1;
+        order[v] = v;
+    }
+    target = (unsigned long long) ((double) total / (double) nparts * Imbalance) + 1;
+
+    for (i=1; i<g->nvtxs; i+=1)  /* insertion sort - the coarsest graph is small */
+    {
+        t = order[i];
+        j = i;
+        while (j > 0 && g->vwgt[order[j-1]] < g->vwgt[t])
+        {
+            order[j] = order[j-1];
+            j -= 1;
+        }
+        order[j] = t;
+    }
+
+    for (p=0; p<nparts; p+=1)
+    {
+        pwgt[p] = 0;
+    }
+
+    for (i=0; i<g->nvtxs; i+=1)
+    {
+        v = order[i];
+        for (p=0; p<nparts; p+=1)
+        {
+            conn[p] = 0;
+        }
+        for (j=g->xadj[v]; j<g->xadj[v+1]; j+=1)
+        {
+            if (where[g->adjncy[j]] >= 0)
+            {
+                conn[where[g->adjncy[j]]] += g->adjwgt[j];
+            }
+        }
+
+        best = -1;
+        for (p=0; p<nparts; p+=1)
+        {
+            if (pwgt[p] + g->vwgt[v] > target)
+            {
+                continue;
+            }
+            if (best < 0 || conn[p] > conn[best] || (conn[p] == conn[best] && pwgt[p] < pwgt[best]))
+            {
+                best = p;
+            }
+        }
+        if (best < 0)  /* nothing fits - take the lightest part */
+        {
+            best = 0;
+            for (p=1; p<nparts; p+=1)
+            {
+                if (pwgt[p] < pwgt[best])
+                {
+                    best = p;
+                }
+            }
+        }
+        where[v] = best;
+        pwgt[best] += g->vwgt[v];
+    }
+
+    free(order);
+    free(conn);
+    free(pwgt);
+}
+
+/* --------------------------------------------------------- */
+void Refine(PartGraph *g, unsigned int nparts, int *where)  /* Kernighan-Lin style boundary refinement */
+{
+    unsigned long long *pwgt;
+    int                *conn;
+    unsigned int       *touched;
+    unsigned long long total;
+    unsigned long long maxpwgt;
+    unsigned int       ntouched;
+    unsigned int       pass;
+    unsigned int       moves;
+    unsigned int       offset;
+    unsigned int       i;
+    unsigned int       j;
+    unsigned int       v;
+    int                from;
+    int                to;
+    int                p;
+    int                gain;
+    int                bestgain;
+
+    pwgt    = (unsigned long long *) PartAlloc(sizeof(unsigned long long) * (nparts + 1));
+    conn    = (int *) PartAlloc(sizeof(int) * (nparts + 1));
+    touched = (unsigned int *) PartAlloc(sizeof(unsigned int) * (nparts + 1));
+
+    total = 0;
+    for (p=0; p<nparts; p+=1)
+    {
+        pwgt[p] = 0;
+        conn[p] = 0;
+    }
+    for (v=0; v<g->nvtxs; v+=1)
+    {
+        pwgt[where[v]] += g->vwgt[v];
+        total += g->vwgt[v];
+    }
+    maxpwgt = (unsigned long long) ((double) total / (double) nparts * Imbalance) + 1;
+
+    for (pass=1; pass<=MaxRefinePasses; pass+=1)
+    {
+        moves = 0;
+        offset = PartRandom(g->nvtxs);
+        for (i=0; i<g->nvtxs; i+=1)
+        {
+            v = (i + offset) % g->nvtxs;
+            from = where[v];
+
+            ntouched = 0;
+            for (j=g->xadj[v]; j<g->xadj[v+1]; j+=1)
+            {
+                p = where[g->adjncy[j]];
+                if (conn[p] == 0)
+                {
+                    touched[ntouched] = p;
+                    ntouched += 1;
+                }
+                conn[p] += g->adjwgt[j];
+            }
+
+            to = from;
+            bestgain = 0;
+            for (j=0; j<ntouched; j+=1)
+            {
+                p = touched[j];
+                if (p == from || pwgt[p] + g->vwgt[v] > maxpwgt)
+                {
+                    continue;
+                }
+                gain = conn[p] - conn[from];
+                if (gain > bestgain ||
+                    (gain == bestgain && pwgt[p] + g->vwgt[v] < pwgt[from] && (to == from || pwgt[p] < pwgt[to])))
+                {
+                    to = p;
+                    bestgain = gain;
+                }
+            }
+
+            if (to == from && pwgt[from] > maxpwgt)  /* overloaded - move to the lightest part regardless of gain */
+            {
+                for (p=0; p<nparts; p+=1)
+                {
+                    if (pwgt[p] + g->vwgt[v] <= maxpwgt && (to == from || pwgt[p] < pwgt[to]))
+                    {
+                        to = p;
+                    }
+                }
+            }
+
+            if (to != from)
+            {
+                where[v] = to;
+                pwgt[from] -= g->vwgt[v];
+                pwgt[to] += g->vwgt[v];
+                moves += 1;
+            }
+
+            for (j=0; j<ntouched; j+=1)
+            {
+                conn[touched[j]] = 0;
+            }
+        }
+        if (moves == 0)
+        {
+            break;
+        }
+    }
+
+    free(touched);
+    free(conn);
+    free(pwgt);
+}
+
+/* --------------------------------------------------------- */
+unsigned int EdgeCut(PartGraph *g, int *where)
+{
+    unsigned int cut = 0;
+    unsigned int v;
+    unsigned int j;
+
+    for (v=0; v<g->nvtxs; v+=1)
+    {
+        for (j=g->xadj[v]; j<g->xadj[v+1]; j+=1)
+        {
+            if (where[v] != where[g->adjncy[j]])
+            {
+                cut += g->adjwgt[j];
+            }
+        }
+    }
+    return cut / 2;
+}
+
+/* --------------------------------------------------------- */
+void PartitionNodes(unsigned int nparts, char PlacementFile[])
+{
+    PartGraph    *levels[MaxLevels + 1];
+    int          *where;
+    int          *cwhere;
+    unsigned int nlevels;
+    unsigned int maxvwgt;
+    unsigned int i;
+    unsigned int v;
+    unsigned long long total;
+    char         fname[MaxStringSize + 10];
+
+    if (PartNodes == 0 || (nparts == 0 && PlacementFile == NULL))
+    {
+        return;
+    }
+
+    levels[0] = LinkGraph();
+
+    if (PlacementFile != NULL)
+    {
+        ReadPlacement(PlacementFile, &nparts);
+        where = (int *) PartAlloc(sizeof(int) * (levels[0]->nvtxs + 1));
+        for (v=0; v<PartNodes; v+=1)
+        {
+            where[v] = Placement[v];
+        }
+        PlaceHubs(levels[0], nparts, where);
+    }
+    else
+    {
+        if (nparts > MaxPartitions)
+        {
+            Error(402, "Partition: too many partitions (%d)\n", MaxPartitions);
+        }
+        if (nparts > PartNodes)
+        {
+            nparts = PartNodes;
+        }
+
+        total = 0;
+        for (v=0; v<PartNodes; v+=1)
+        {
+            total += levels[0]->vwgt[v];
+        }
+        maxvwgt = (unsigned int) (1.5 * (double) total / (double) (CoarsenTo * nparts)) + 1;
+
+        PartSeed = 1;
+        nlevels = 0;
+        while (levels[nlevels]->nvtxs > CoarsenTo * nparts && nlevels < MaxLevels)
+        {
+            levels[nlevels+1] = Coarsen(levels[nlevels], maxvwgt);
+            if ((double) levels[nlevels+1]->nvtxs > MinShrink * (double) levels[nlevels]->nvtxs)
+            {
+                FreeGraph(levels[nlevels+1]);
+                break;
+            }
+            nlevels += 1;
+        }
+
+        where = (int *) PartAlloc(sizeof(int) * (levels[nlevels]->nvtxs + 1));
+        InitialPartition(levels[nlevels], nparts, where);
+        Refine(levels[nlevels], nparts, where);
+
+        while (nlevels > 0)  /* project back to the finer graph and refine */
+        {
+            nlevels -= 1;
+            cwhere = where;
+            where = (int *) PartAlloc(sizeof(int) * (levels[nlevels]->nvtxs + 1));
+            for (v=0; v<levels[nlevels]->nvtxs; v+=1)
+            {
+                where[v] = cwhere[levels[nlevels]->cmap[v]];
+            }
+            free(cwhere);
+            FreeGraph(levels[nlevels+1]);
+            Refine(levels[nlevels], nparts, where);
+        }
+
+        for (i=0; i<PartNodes; i+=1)
+        {
+            Placement[i] = where[i];
+        }
+
+        sprintf(fname, Profiled ? "%s.profile.place" : "%s.place", FileBaseName);  /* the static placement is kept */
+        WritePlacement(fname, nparts);
+    }
+
+    ReportPartition(levels[0], nparts, where);
+    free(where);
+    FreeGraph(levels[0]);
+}
+
+/* --------------------------------------------------------- */
+void PlaceHubs(PartGraph *g, unsigned int nparts, int *where)  /* each link range with the nodes it is most linked to */
+{
+    unsigned long long *conn;
+    unsigned int       v;
+    unsigned int       j;
+    unsigned int       p;
+
+    conn = (unsigned long long *) PartAlloc(sizeof(unsigned long long) * (nparts + 1));
+    for (v=PartNodes; v<g->nvtxs; v+=1)
+    {
+        for (p=0; p<nparts; p+=1)
+        {
+            conn[p] = 0;
+        }
+        for (j=g->xadj[v]; j<g->xadj[v+1]; j+=1)
+        {
+            conn[where[g->adjncy[j]]] += g->adjwgt[j];  /* a range is linked to nodes only */
+        }
+        where[v] = 0;
+        for (p=1; p<nparts; p+=1)
+        {
+            if (conn[p] > conn[where[v]])
+            {
+                where[v] = p;
+            }
+        }
+    }
+    free(conn);
+}
+
+/* --------------------------------------------------------- */
+void ReportPartition(PartGraph *g, unsigned int nparts, int *where)
+{
+    unsigned long long *pwgt;
+    unsigned long long total;
+    unsigned long long maxw;
+    unsigned long long edges;
+    unsigned int       cut;
+    unsigned int       v;
+    unsigned int       p;
+
+    pwgt = (unsigned long long *) PartAlloc(sizeof(unsigned long long) * (nparts + 1));
+    for (p=0; p<nparts; p+=1)
+    {
+        pwgt[p] = 0;
+    }
+
+    total = 0;
+    for (v=0; v<g->nvtxs; v+=1)
+    {
+        pwgt[where[v]] += g->vwgt[v];
+        total += g->vwgt[v];
+    }
+
+    maxw = 0;
+    for (p=0; p<nparts; p+=1)
+    {
+        if (pwgt[p] > maxw)
+        {
+            maxw = pwgt[p];
+        }
+    }
+
+    edges = 0;
+    for (v=0; v<g->nedges; v+=1)
+    {
+        edges += g->adjwgt[v];
+    }
+    edges /= 2;
+
+    cut = EdgeCut(g, where);
+    printf("Partition: %d nodes, %d parts, %s weights\n", PartNodes, nparts, Profiled ? "profiled" : "static");
+    printf("Partition: edge cut %u of %llu (%.2f%%)\n", cut, edges, (edges > 0) ? 100.0 * (double) cut / (double) edges : 0.0);
+    printf("Partition: balance %.3f (largest part %llu, average %.1f)\n",
+           (total > 0) ? (double) maxw * (double) nparts / (double) total : 1.0, maxw, (double) total / (double) nparts);
+
+    free(pwgt);
+}
+
+/* --------------------------------------------------------- */
+void ReadPlacement(char Filename[], unsigned int *nparts)
+{
+    FILE         *s;
+    char         line[MaxStringSize];
+    unsigned int node;
+    unsigned int part;
+    unsigned int v;
+    unsigned int n;
+
+    s = fopen(Filename, "r");
+    if (s == NULL)
+    {
+        Error(403, "Partition: unable to open placement file %s\n", Filename);
+    }
+
+    n = 0;
+    while (fgets(line, MaxStringSize, s) != NULL)
+    {
+        if (line[0] == '#' || line[0] == '\n')
+        {
+            continue;
+        }
+        if (sscanf(line, "%u %u", &node, &part) != 2)
+        {
+            Error(404, "Partition: bad placement entry %s", line);
+        }
+        if (part >= MaxPartitions)
+        {
+            Error(402, "Partition: too many partitions (%d)\n", MaxPartitions);
+        }
+        v = PartVertex(node);
+        if (v == PartNodes)
+        {
+            printf("Partition: placement for unknown node %d ignored\n", node);
+            continue;
+        }
+        Placement[v] = part;
+        if (part + 1 > n)
+        {
+            n = part + 1;
+        }
+    }
+    fclose(s);
+
+    for (v=0; v<PartNodes; v+=1)
+    {
+        if (Placement[v] < 0)
+        {
+            Error(405, "Partition: node %d has no placement in %s\n", PartNodeNumbers[v], Filename);
+        }
+    }
+    *nparts = n;
+}
+
+/* --------------------------------------------------------- */
+void WritePlacement(char Filename[], unsigned int nparts)
+{
+    FILE         *s;
+    unsigned int v;
+
+    s = fopen(Filename, "w");
+    if (s == NULL)
+    {
+        Error(403, "Partition: unable to open placement file %s\n", Filename);
+    }
+
+    fprintf(s, "# DAMSON placement: %d nodes, %d parts, %s weights\n", PartNodes, nparts, Profiled ? "profiled" : "static");
+    fprintf(s, "# node part\n");
+    for (v=0; v<PartNodes; v+=1)
+    {
+        fprintf(s, "%u %d\n", PartNodeNumbers[v], Placement[v]);
+    }
+    fclose(s);
+}
@@ -0,0 +1,14 @@
+/* DAMSON partitioner header
+*/
+
+#ifndef PARTITION
+#define PARTITION
+
+#include "compiler.h"
+
+extern void BuildPartitionGraph();
+extern void RecordTraffic(unsigned int node, unsigned int tx, unsigned int rx);
+extern void PartitionNodes(unsigned int nparts, char PlacementFile[]);
+extern void FreePartitionGraph();
+
+#endif
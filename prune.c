@@ -0,0 +1,416 @@
+/* DAMSON unused procedure and global elimination
+   run on a prototype's bytecode before it is optimised; the code outside any procedure and the procedures
+   given as roots are live, as is any procedure whose label live code loads, calls or jumps to
+   the code of the others is deleted and their procedures are left declared but without a body
+   the global vector is then cut into the globals and the strings and constant arrays the code loads, and the
+   parts no live code refers to are dropped, with the globals table, offsets and bounds checks renumbered
+   the externals are addressed by plain numbers and are kept
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "compiler.h"
+#include "prune.h"
+
+typedef struct
+{
+    Instruction   *Code;
+    unsigned int  Size;
+    unsigned int  *Labels;
+    unsigned int  nLabels;
+    ProcedureItem *Procs;
+    unsigned int  nProcs;
+    unsigned int  *Region;      /* the region of each instruction, 0 before the first procedure */
+    unsigned int  *RegionProc;  /* the procedure of each region */
+    unsigned int  *RegionFirst;
+    unsigned int  nRegions;
+    bool          *Live;        /* regions reached */
+    unsigned int  *Work;
+    unsigned int  nWork;
+} PruneState;
+
+void         *PruneAllocate(unsigned int n, unsigned int itemsize);
+void         FindProcedures(PruneState *s);
+void         Reach(PruneState *s, unsigned int i);
+void         ReachRegions(PruneState *s);
+unsigned int DeleteDeadCode(PruneState *s, struct LineInfo *lines, unsigned int firstline, unsigned int lastline);
+bool         GlobalOperand(unsigned char Op, int Arg, unsigned int gvsize);
+void         PruneGlobals(PruneState *s, NametableItem *globals, unsigned int *nglobals, bool *liveglobals,
+                          int *gv, unsigned int *gvsize, bool *starts);
+
+/* --------------------------------------------------------- */
+void *PruneAllocate(unsigned int n, unsigned int itemsize)
+{
+    void *a = calloc(n, itemsize);
+
+    if (a == NULL)
+    {
+        Error(133, "Unable to allocate pruning tables (%d)\n", n);
+    }
+    return a;
+}
+
+/* --------------------------------------------------------- */
+void FindProcedures(PruneState *s)  /* each procedure runs from its ENTRY to the next one */
+{
+    unsigned int i;
+    unsigned int f;
+
+    s->nRegions       = 0;
+    s->RegionFirst[0] = 1;
+    for (i = 1; i <= s->Size; i += 1)
+    {
+        if (s->Code[i].Op == s_ENTRY)
+        {
+            s->nRegions += 1;
+            f = i;
+            while (f > 1 && s->Code[f - 1].Op == s_LAB && s->Region[f - 1] == s->nRegions - 1)
+            {
+                f -= 1;  /* the labels ahead of it, kept in the code for the code generator, are its own */
+                s->Region[f] = s->nRegions;
+            }
+            s->RegionProc[s->nRegions]  = s->Code[i].Arg;
+            s->RegionFirst[s->nRegions] = f;
+        }
+        s->Region[i] = s->nRegions;
+        if (s->Code[i].Op == s_SWITCHON)  /* the case table */
+        {
+            unsigned int k;
+
+            for (k = 1; k <= 2 * s->Code[i].Arg + 1 && i + k <= s->Size; k += 1)
+            {
+                s->Region[i + k] = s->nRegions;
+            }
+            i += 2 * s->Code[i].Arg + 1;
+        }
+    }
+}
+
+/* --------------------------------------------------------- */
+void Reach(PruneState *s, unsigned int i)  /* the region holding instruction i is live */
+{
+    unsigned int r;
+
+    if (i < 1 || i > s->Size)
+    {
+        return;
+    }
+    r = s->Region[i];
+    if (!s->Live[r])
+    {
+        s->Live[r] = true;
+        s->nWork += 1;
+        s->Work[s->nWork] = r;
+    }
+}
+
+/* --------------------------------------------------------- */
+void ReachRegions(PruneState *s)
+{
+    unsigned int i;
+    unsigned int r;
+    unsigned int l;
+    unsigned int last;
+
+    while (s->nWork > 0)
+    {
+        r = s->Work[s->nWork];
+        s->nWork -= 1;
+        last = (r < s->nRegions) ? s->RegionFirst[r + 1] - 1 : s->Size;
+        for (i = s->RegionFirst[r]; i <= last; i += 1)
+        {
+            l = 0;
+            switch (s->Code[i].Op)
+            {
+                case s_JUMP:
+                case s_JT:
+                case s_JF:
+                case s_RES:
+                case s_LLL:
+                    l = s->Code[i].Arg;
+                    break;
+
+                case s_LN:  /* a call */
+                    if (i < s->Size && (s->Code[i + 1].Op == s_FNAP || s->Code[i + 1].Op == s_RTAP))
+                    {
+                        l = s->Code[i].Arg;
+                    }
+                    break;
+
+                case s_SWITCHON:
+                    i += 2 * s->Code[i].Arg + 1;
+                    break;
+            }
+            if (l > 0 && l <= s->nLabels)
+            {
+                Reach(s, s->Labels[l]);
+            }
+        }
+    }
+}
+
+/* --------------------------------------------------------- */
+unsigned int DeleteDeadCode(PruneState *s, struct LineInfo *lines, unsigned int firstline, unsigned int lastline)
+{
+    unsigned int *map = PruneAllocate(s->Size + 2, sizeof(unsigned int));
+    unsigned int i;
+    unsigned int n = 0;
+
+    for (i = 1; i <= s->Size; i += 1)
+    {
+        if (!s->Live[s->Region[i]])
+        {
+            map[i] = n + 1;  /* the next instruction kept */
+        }
+        else
+        {
+            n += 1;
+            map[i] = n;
+            s->Code[n] = s->Code[i];
+        }
+    }
+    map[s->Size + 1] = n + 1;
+
+    for (i = 1; i <= s->nLabels; i += 1)
+    {
+        if (s->Labels[i] <= s->Size + 1)
+        {
+            s->Labels[i] = map[s->Labels[i]];
+        }
+    }
+    for (i = firstline; i <= lastline; i += 1)
+    {
+        if (lines[i].codeoffset <= s->Size + 1)
+        {
+            lines[i].codeoffset = map[lines[i].codeoffset];
+        }
+    }
+
+    free(map);
+    return n;
+}
+
+/* --------------------------------------------------------- */
+bool GlobalOperand(unsigned char Op, int Arg, unsigned int gvsize)  /* an offset in the global vector, past the reserved words */
+{
+    return (Op == s_LG || Op == s_SG || Op == s_LLG || Op == s_LSTR) && Arg > GLOBALBASE && Arg <= (int) gvsize;
+}
+
+/* --------------------------------------------------------- */
+void PruneGlobals(PruneState *s, NametableItem *globals, unsigned int *nglobals, bool *liveglobals,
+                  int *gv, unsigned int *gvsize, bool *starts)
+{
+    /* starts marks the first word of each part of the vector: the globals and whatever else the code loaded
+       before it was pruned; a part runs to the next start */
+    unsigned int n = *gvsize;
+    unsigned int *part = PruneAllocate(n + 1, sizeof(unsigned int));
+    unsigned int *first;
+    unsigned int *moved;
+    unsigned int *index = PruneAllocate(*nglobals + 1, sizeof(unsigned int));
+    unsigned int nold = *nglobals;
+    bool         *used;
+    unsigned int nparts = 0;
+    unsigned int i;
+    unsigned int j;
+    unsigned int k;
+
+    first = PruneAllocate(n + 2, sizeof(unsigned int));
+    moved = PruneAllocate(n + 2, sizeof(unsigned int));
+    used  = PruneAllocate(n + 2, sizeof(bool));
+    starts[GLOBALBASE + 1] = true;
+    for (i = GLOBALBASE + 1; i <= n; i += 1)
+    {
+        if (starts[i])
+        {
+            nparts += 1;
+            first[nparts] = i;
+        }
+        part[i] = nparts;
+    }
+
+    for (i = 1; i <= s->Size; i += 1)
+    {
+        if (GlobalOperand(s->Code[i].Op, s->Code[i].Arg, n))
+        {
+            used[part[s->Code[i].Arg]] = true;
+        }
+        if (s->Code[i].Op == s_SWITCHON)
+        {
+            i += 2 * s->Code[i].Arg + 1;
+        }
+    }
+    for (i = GLOBALBASE + 1; i <= *nglobals; i += 1)
+    {
+        if (liveglobals[i] && globals[i].vOffset > GLOBALBASE && globals[i].vOffset <= n)
+        {
+            used[part[globals[i].vOffset]] = true;
+        }
+    }
+
+    k = GLOBALBASE;  /* move the parts kept down */
+    for (j = 1; j <= nparts; j += 1)
+    {
+        unsigned int last = (j < nparts) ? first[j + 1] - 1 : n;
+
+        if (used[j])
+        {
+            moved[j] = k + 1;
+            for (i = first[j]; i <= last; i += 1)
+            {
+                k += 1;
+                gv[k] = gv[i];
+            }
+        }
+    }
+    *gvsize = k;
+
+    k = GLOBALBASE;  /* the globals table, renumbered */
+    for (i = 0; i <= *nglobals; i += 1)
+    {
+        if (i <= GLOBALBASE || globals[i].vOffset <= GLOBALBASE || globals[i].vOffset > n)
+        {
+            liveglobals[i] = true;
+            index[i] = (i <= GLOBALBASE) ? i : k + 1;
+        }
+        else
+        {
+            j = part[globals[i].vOffset];
+            liveglobals[i] = used[j];
+            if (used[j])
+            {
+                globals[i].vOffset = moved[j] + globals[i].vOffset - first[j];
+                index[i] = k + 1;
+            }
+        }
+        if (i > GLOBALBASE && liveglobals[i])
+        {
+            k += 1;
+            globals[k] = globals[i];
+        }
+    }
+    *nglobals = k;
+
+    for (i = 1; i <= s->Size; i += 1)
+    {
+        if (GlobalOperand(s->Code[i].Op, s->Code[i].Arg, n))
+        {
+            j = part[s->Code[i].Arg];
+            s->Code[i].Arg = moved[j] + s->Code[i].Arg - first[j];
+        }
+        else if (s->Code[i].Op == s_GBOUNDSCHECK && s->Code[i].Arg > 0 && s->Code[i].Arg <= (int) nold)
+        {
+            s->Code[i].Arg = index[s->Code[i].Arg];
+        }
+        if (s->Code[i].Op == s_SWITCHON)
+        {
+            i += 2 * s->Code[i].Arg + 1;
+        }
+    }
+
+    free(part);
+    free(first);
+    free(moved);
+    free(used);
+    free(index);
+}
+
+/* --------------------------------------------------------- */
+unsigned int PruneSection(Instruction     *code,    unsigned int codesize,
+                          unsigned int    *labs,    unsigned int nlabs,
+                          struct LineInfo *lines,   unsigned int firstline, unsigned int lastline,
+                          ProcedureItem   *procs,   unsigned int nprocs,    bool *liveprocs,
+                          NametableItem   *globals, unsigned int *nglobals, bool *liveglobals,
+                          int             *gv,      unsigned int *gvsize)
+{
+    /* liveprocs and liveglobals give the roots, and return what is kept, by the old numbering */
+    PruneState   s;
+    bool         *starts;
+    bool         *inside;
+    unsigned int i;
+    unsigned int j;
+    unsigned int p;
+    unsigned int n;
+
+    s.Code        = code;
+    s.Size        = codesize;
+    s.Labels      = labs;
+    s.nLabels     = nlabs;
+    s.Procs       = procs;
+    s.nProcs      = nprocs;
+    s.Region      = PruneAllocate(codesize + 2, sizeof(unsigned int));
+    s.RegionProc  = PruneAllocate(codesize + 2, sizeof(unsigned int));
+    s.RegionFirst = PruneAllocate(codesize + 2, sizeof(unsigned int));
+    s.Live        = PruneAllocate(codesize + 2, sizeof(bool));
+    s.Work        = PruneAllocate(codesize + 2, sizeof(unsigned int));
+    s.nWork       = 0;
+    starts       = PruneAllocate(*gvsize + 2, sizeof(bool));
+    inside       = PruneAllocate(*gvsize + 2, sizeof(bool));
+
+    for (i = GLOBALBASE + 1; i <= *nglobals; i += 1)  /* the parts of the global vector, while all of the code is there */
+    {
+        if (globals[i].vOffset > GLOBALBASE && globals[i].vOffset <= *gvsize)
+        {
+            starts[globals[i].vOffset] = true;
+            n = 1;
+            for (j = 1; j <= globals[i].vDimensions[0]; j += 1)
+            {
+                n = n * globals[i].vDimensions[j];
+            }
+            for (j = 1; j < n && globals[i].vOffset + j <= *gvsize; j += 1)
+            {
+                inside[globals[i].vOffset + j] = true;
+            }
+        }
+    }
+    for (i = 1; i <= codesize; i += 1)
+    {
+        if (GlobalOperand(code[i].Op, code[i].Arg, *gvsize) && !inside[code[i].Arg])
+        {
+            starts[code[i].Arg] = true;
+        }
+        if (code[i].Op == s_SWITCHON)
+        {
+            i += 2 * code[i].Arg + 1;
+        }
+    }
+
+    FindProcedures(&s);
+    Reach(&s, 1);  /* the code ahead of the procedures, with its jump to main */
+    for (i = 1; i <= s.nRegions; i += 1)
+    {
+        p = s.RegionProc[i];
+        if (p <= nprocs && liveprocs[p])
+        {
+            s.Live[i] = true;
+            s.nWork += 1;
+            s.Work[s.nWork] = i;
+        }
+    }
+    ReachRegions(&s);
+
+    for (i = 1; i <= s.nRegions; i += 1)
+    {
+        p = s.RegionProc[i];
+        if (p <= nprocs)
+        {
+            liveprocs[p] = s.Live[i];
+            if (!s.Live[i])
+            {
+                procs[p].Versions = 1;  /* declared, without a body */
+            }
+        }
+    }
+    s.Size = DeleteDeadCode(&s, lines, firstline, lastline);
+    PruneGlobals(&s, globals, nglobals, liveglobals, gv, gvsize, starts);
+
+    free(s.Region);
+    free(s.RegionProc);
+    free(s.RegionFirst);
+    free(s.Live);
+    free(s.Work);
+    free(starts);
+    free(inside);
+    return s.Size;
+}
@@ -0,0 +1,16 @@
+/* DAMSON unused procedure and global elimination header
+*/
+
+#ifndef PRUNE
+#define PRUNE
+
+#include "compiler.h"
+
+extern unsigned int PruneSection(Instruction     *code,    unsigned int codesize,
+                                 unsigned int    *labs,    unsigned int nlabs,
+                                 struct LineInfo *lines,   unsigned int firstline, unsigned int lastline,
+                                 ProcedureItem   *procs,   unsigned int nprocs,    bool *liveprocs,
+                                 NametableItem   *globals, unsigned int *nglobals, bool *liveglobals,
+                                 int             *gv,      unsigned int *gvsize);
+
+#endif
@@ -0,0 +1,2110 @@
+/* DAMSON SSA optimiser
+   an optimising middle end, run over the bytecode of each procedure before the peephole pass
+   the stack code of each basic block is put in SSA form by value numbering: every value pushed and every store to a
+   local gets a value number of its own, and the values of the locals on entry to a block come from a conditional
+   constant propagation over the procedure's flow graph, which merges them at joins in place of phi functions;
+   constants are folded, constant branches and the code they leave unreachable are removed, dead stores to locals are
+   deleted, fixed point multiplies and divides by whole constants are reduced, loop invariant expressions are moved
+   to a preheader and common subexpressions are computed once, then the procedure is lowered back to stack code with
+   the labels and the line table moved to match
+   under -bc, an interval analysis of the locals, narrowed by the tests of conditional jumps and widened at loops,
+   removes the bounds checks of array accesses whose index it proves in range; the others keep their diagnostics
+   globals are never treated as constants or reused - an interrupt handler may change them between any two
+   instructions, and alias blocks, ensemble variants and the debugger give them other values per node
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "compiler.h"
+#include "emulator.h"
+#include "optimise.h"
+#include "ssa.h"
+
+#define MinCSECost      4  /* ticks an expression must cost before it is kept in a temporary */
+#define MaxRangeVisits  3  /* changes to a block's ranges before they are widened */
+
+enum LocalState { l_UNDEFINED, l_CONSTANT, l_VARYING };
+
+typedef struct
+{
+    unsigned int First;         /* instructions of the block */
+    unsigned int Last;
+    unsigned int Term;          /* the jump, switch or return ending it, 0 if it falls through */
+    unsigned int Cond;          /* the item tested by Term */
+    bool         Reached;
+    bool         Queued;
+} FlowBlock;
+
+typedef struct
+{
+    unsigned char Op;           /* s_LN for a constant, 0 for a value not known in the block */
+    int           Arg;
+    unsigned int  A;            /* value numbers of the operands */
+    unsigned int  B;
+} ValueNumber;
+
+typedef struct
+{
+    unsigned int VN;
+    unsigned int First;         /* the run of code computing it, 0 if it is not a single run */
+    unsigned int Def;           /* the instruction pushing it */
+    unsigned int Left;          /* operand items of an operator */
+    unsigned int Right;
+    unsigned int Block;
+    unsigned int Same;          /* an earlier item of the block with the same value */
+    unsigned int Temp;          /* the local holding its value once it is computed */
+    int          Value;
+    bool         Constant;
+    bool         Operator;
+    bool         Pure;          /* the run only loads and operates - it can be deleted, moved or repeated */
+    bool         Traps;         /* the run may raise an arithmetic error */
+} StackItem;
+
+typedef struct
+{
+    int           Lo;
+    int           Hi;
+    unsigned char Base;         /* 0 for a number, else the instruction loading the array the value addresses */
+    int           BaseArg;
+} Interval;
+
+typedef struct
+{
+    unsigned int At;
+    bool         Before;        /* ahead of the instruction rather than after it */
+    unsigned int Seq;
+    Instruction  Code;
+} Insertion;
+
+typedef struct
+{
+    Instruction   *Code;        /* the prototype */
+    unsigned int  Size;
+    unsigned int  *Labels;
+    unsigned int  nLabels;
+    bool          CodeGenerating;
+    bool          *Target;
+    bool          *Dead;
+    bool          *Pinned;      /* code is inserted after it */
+    bool          *AfterPreheader;  /* labels used only inside a loop with a preheader */
+    unsigned int  *BlockOf;
+    unsigned int  *StoreItem;   /* the item stored by an SP */
+    unsigned int  *ItemOf;      /* the item pushed by an instruction */
+    Insertion     *Inserts;
+    unsigned int  nInserts;
+    unsigned int  InsertsSize;
+
+    ProcedureItem *Proc;        /* the procedure */
+    unsigned int  First;
+    unsigned int  Last;
+    unsigned int  nSlots;
+    bool          *Tracked;     /* locals only reached by LP and SP */
+    unsigned int  nTemps;
+    unsigned int  nChecks;
+    FlowBlock     *Blocks;
+    unsigned int  nBlocks;
+    unsigned int  BlocksSize;
+    unsigned char *InState;     /* the locals on entry to each block */
+    int           *InValue;
+    bool          *LiveIn;
+    bool          *Live;
+    unsigned int  *Work;
+    unsigned int  nWork;
+
+    ValueNumber   *VNs;         /* value numbering of a block */
+    unsigned int  nVNs;
+    unsigned int  VNsSize;
+    unsigned int  *Hash;
+    unsigned int  *HashStamp;
+    unsigned int  HashSize;
+    unsigned int  Stamp;
+    unsigned int  *FirstItem;
+    unsigned int  FirstItemSize;
+    StackItem     *Items;
+    unsigned int  nItems;
+    unsigned int  ItemsSize;
+    unsigned int  *Stack;
+    unsigned int  Depth;
+    unsigned int  DepthSize;
+    unsigned int  *SlotVN;
+
+    Interval      *Range;       /* ranges of the items */
+    unsigned int  RangeSize;
+    Interval      *InRange;     /* of the locals on entry to each block */
+    Interval      *SlotRange;
+    Interval      *SavedRange;
+    unsigned int  *LastStore;
+    unsigned int  *RangeVisits;
+    unsigned int  RangeFrom;     /* block whose edges are being joined */
+    int           *Limits;       /* constants of the procedure, to which loops widen */
+    unsigned int  nLimits;
+    bool          *RangeReached;
+} SSAState;
+
+void         *SSAAllocate(unsigned int n, unsigned int itemsize);
+bool         Binary(unsigned char Op);
+bool         Unary(unsigned char Op);
+bool         Trapping(unsigned char Op);
+bool         Pseudo(unsigned char Op);
+unsigned int Cost(unsigned char Op);
+unsigned int NewValue(SSAState *s, unsigned char Op, int Arg, unsigned int A, unsigned int B);
+unsigned int FindValue(SSAState *s, unsigned char Op, int Arg, unsigned int A, unsigned int B);
+unsigned int NewItem(SSAState *s, unsigned int vn, unsigned int first, unsigned int def, bool pure, bool traps);
+void         Push(SSAState *s, unsigned int item);
+unsigned int Pop(SSAState *s);
+unsigned int LoadLocal(SSAState *s, unsigned int slot);
+unsigned int Operate(SSAState *s, unsigned int i, unsigned char Op, unsigned int x, unsigned int y);
+void         EnterProcedure(SSAState *s);
+void         RunBlock(SSAState *s, unsigned int b);
+void         FlowTo(SSAState *s, unsigned int addr, void (*Edge)(SSAState *, unsigned int));
+void         Successors(SSAState *s, unsigned int b, bool folding, void (*Edge)(SSAState *, unsigned int));
+void         MergeEdge(SSAState *s, unsigned int b);
+void         LiveEdge(SSAState *s, unsigned int b);
+bool         PrepareProcedure(SSAState *s);
+void         PropagateConstants(SSAState *s);
+void         FoldBlock(SSAState *s, unsigned int b, unsigned int firstitem);
+void         ReduceItem(SSAState *s, unsigned int k);
+void         DeleteDeadStores(SSAState *s);
+Interval     NumberRange(long long lo, long long hi);
+Interval     AddressRange(unsigned char Op, int Arg, long long lo, long long hi);
+Interval     CombineRanges(unsigned char Op, Interval a, Interval b);
+Interval     ItemRange(SSAState *s, unsigned int k, unsigned int i);
+void         RangeBlock(SSAState *s, unsigned int b);
+bool         NarrowLocal(SSAState *s, unsigned int x, unsigned char Op, Interval r);
+bool         NarrowTest(SSAState *s, unsigned int c, bool sense);
+int          CompareLimits(const void *a, const void *b);
+int          Limit(SSAState *s, int v, bool above);
+void         RangeEdge(SSAState *s, unsigned int b);
+void         RangeSuccessors(SSAState *s, unsigned int b);
+void         RemoveBoundsChecks(SSAState *s);
+void         Insert(SSAState *s, unsigned int at, bool before, unsigned char Op, int Arg);
+bool         RunIsFree(SSAState *s, unsigned int first, unsigned int last);
+unsigned int RunCost(SSAState *s, unsigned int first, unsigned int last);
+bool         NoteJump(SSAState *s, unsigned int i, unsigned int l, unsigned int h, unsigned int t, bool *inside, bool *outside);
+void         HoistLoop(SSAState *s, unsigned int h, unsigned int t);
+void         MoveInvariants(SSAState *s);
+void         ShareExpressions(SSAState *s, unsigned int b, unsigned int firstitem, unsigned int lastitem, unsigned int *ntemps);
+void         OptimiseProcedure(SSAState *s, ProcedureItem *p, unsigned int first, unsigned int last);
+int          CompareInsertions(const void *a, const void *b);
+
+/* --------------------------------------------------------- */
+void *SSAAllocate(unsigned int n, unsigned int itemsize)
+{
+    void *a = calloc(n, itemsize);
+
+    if (a == NULL)
+    {
+        Error(131, "Unable to allocate optimiser tables (%d)\n", n);
+    }
+    return a;
+}
+
+/* --------------------------------------------------------- */
+bool Binary(unsigned char Op)
+{
+    switch (Op)
+    {
+        case s_EQ:    case s_NE:     case s_LS:    case s_GR:     case s_LE:     case s_GE:
+        case s_OR:    case s_AND:    case s_PLUS:  case s_MINUS:  case s_MULT:   case s_MULTF:
+        case s_DIV:   case s_DIVF:   case s_REM:   case s_LOGAND: case s_LOGOR:  case s_NEQV:
+        case s_LSHIFT: case s_RSHIFT:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* --------------------------------------------------------- */
+bool Unary(unsigned char Op)
+{
+    switch (Op)
+    {
+        case s_NEG: case s_NOT: case s_ABS: case s_COMP: case s_FLOAT: case s_INT:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* --------------------------------------------------------- */
+bool Trapping(unsigned char Op)  /* division by zero, or overflow under -ar */
+{
+    switch (Op)
+    {
+        case s_MULT: case s_MULTF: case s_DIV: case s_DIVF: case s_REM:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* --------------------------------------------------------- */
+bool Pseudo(unsigned char Op)  /* directives to the code generator */
+{
+    switch (Op)
+    {
+        case s_STACK: case s_QUERY: case s_STORE: case s_SAVE: case s_RSTACK: case s_LAB:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* --------------------------------------------------------- */
+unsigned int Cost(unsigned char Op)  /* ticks, as the emulator counts them */
+{
+    switch (Op)
+    {
+        case s_MULTF:
+            return 11;
+        case s_DIV:
+        case s_REM:
+            return 57;
+        case s_DIVF:
+            return 129;
+        default:
+            return 1;
+    }
+}
+
+/* --------------------------------------------------------- */
+unsigned int NewValue(SSAState *s, unsigned char Op, int Arg, unsigned int A, unsigned int B)
+{
+    s->nVNs += 1;
+    s->VNs = Grow(s->VNs, &s->VNsSize, s->nVNs, sizeof(ValueNumber));
+    s->VNs[s->nVNs].Op  = Op;
+    s->VNs[s->nVNs].Arg = Arg;
+    s->VNs[s->nVNs].A   = A;
+    s->VNs[s->nVNs].B   = B;
+    return s->nVNs;
+}
+
+/* --------------------------------------------------------- */
+unsigned int FindValue(SSAState *s, unsigned char Op, int Arg, unsigned int A, unsigned int B)  /* the same operation on the same values has the same number */
+{
+    unsigned int h;
+    unsigned int v;
+
+    h = ((unsigned int) Op * 31u + (unsigned int) Arg * 2654435761u + A * 40503u + B * 977u) & (s->HashSize - 1);
+    while (s->HashStamp[h] == s->Stamp)
+    {
+        v = s->Hash[h];
+        if (s->VNs[v].Op == Op && s->VNs[v].Arg == Arg && s->VNs[v].A == A && s->VNs[v].B == B)
+        {
+            return v;
+        }
+        h = (h + 1) & (s->HashSize - 1);
+    }
+    v = NewValue(s, Op, Arg, A, B);
+    s->Hash[h]      = v;
+    s->HashStamp[h] = s->Stamp;
+    return v;
+}
+
+/* --------------------------------------------------------- */
+unsigned int NewItem(SSAState *s, unsigned int vn, unsigned int first, unsigned int def, bool pure, bool traps)
+{
+    StackItem *t;
+
+    s->nItems += 1;
+    s->Items = Grow(s->Items, &s->ItemsSize, s->nItems, sizeof(StackItem));
+    t = &s->Items[s->nItems];
+    memset(t, 0, sizeof(StackItem));
+    t->VN       = vn;
+    t->First    = first;
+    t->Def      = def;
+    t->Block    = (def > 0) ? s->BlockOf[def] : 0;
+    t->Constant = s->VNs[vn].Op == s_LN;
+    t->Value    = s->VNs[vn].Arg;
+    t->Pure     = pure && first > 0;
+    t->Traps    = traps;
+    if (def > 0)
+    {
+        s->ItemOf[def] = s->nItems;
+    }
+    return s->nItems;
+}
+
+/* --------------------------------------------------------- */
+void Push(SSAState *s, unsigned int item)
+{
+    s->Depth += 1;
+    s->Stack = Grow(s->Stack, &s->DepthSize, s->Depth, sizeof(unsigned int));
+    s->Stack[s->Depth] = item;
+}
+
+/* --------------------------------------------------------- */
+unsigned int Pop(SSAState *s)  /* below the values pushed in the block nothing is known */
+{
+    if (s->Depth == 0)
+    {
+        return NewItem(s, NewValue(s, 0, 0, 0, 0), 0, 0, false, false);
+    }
+    s->Depth -= 1;
+    return s->Stack[s->Depth + 1];
+}
+
+/* --------------------------------------------------------- */
+unsigned int LoadLocal(SSAState *s, unsigned int slot)
+{
+    if (s->SlotVN[slot] == 0)  /* its value on entry to the block */
+    {
+        s->SlotVN[slot] = NewValue(s, 0, 0, 0, 0);
+    }
+    return s->SlotVN[slot];
+}
+
+/* --------------------------------------------------------- */
+unsigned int Operate(SSAState *s, unsigned int i, unsigned char Op, unsigned int x, unsigned int y)  /* y on top; x is 0 for a monadic operator */
+{
+    StackItem    a;
+    StackItem    b;
+    unsigned int v;
+    unsigned int first;
+    unsigned int k;
+    int          r;
+
+    memset(&a, 0, sizeof(StackItem));
+    a.Constant = true;
+    a.Pure     = true;
+    if (x > 0)
+    {
+        a = s->Items[x];
+    }
+    b = s->Items[y];
+
+    if (a.Constant && b.Constant && FoldConstant(Op, b.Value, a.Value, &r))
+    {
+        v = FindValue(s, s_LN, r, 0, 0);
+    }
+    else
+    {
+        v = FindValue(s, Op, 0, a.VN, b.VN);
+    }
+
+    first = 0;
+    if (b.First > 0 && b.Def == i - 1)  /* the operands are computed just before it */
+    {
+        if (x == 0)
+        {
+            first = b.First;
+        }
+        else if (a.First > 0 && a.Def == b.First - 1)
+        {
+            first = a.First;
+        }
+    }
+
+    k = NewItem(s, v, first, i, a.Pure && b.Pure, Trapping(Op) || a.Traps || b.Traps);
+    s->Items[k].Left     = x;
+    s->Items[k].Right    = y;
+    s->Items[k].Operator = true;
+    return k;
+}
+
+/* --------------------------------------------------------- */
+void EnterProcedure(SSAState *s)  /* ENTRY clears the declared locals */
+{
+    ProcedureItem *p = s->Proc;
+    unsigned int  i;
+    unsigned int  slot;
+
+    for (slot = 1; slot <= s->nSlots; slot += 1)
+    {
+        s->SlotVN[slot] = 0;
+    }
+    for (i = p->nArgs + 1; i <= p->nLocals; i += 1)
+    {
+        slot = p->Args[i].vOffset;
+        if (p->Args[i].vDimensions[0] == 0 && slot <= s->nSlots && s->Tracked[slot])
+        {
+            s->SlotVN[slot] = FindValue(s, s_LN, 0, 0, 0);
+        }
+    }
+}
+
+/* --------------------------------------------------------- */
+void RunBlock(SSAState *s, unsigned int b)
+{
+    FlowBlock     *fb = &s->Blocks[b];
+    unsigned int  base = b * (s->nSlots + 1);
+    unsigned int  slot;
+    unsigned int  i;
+    unsigned int  x;
+    unsigned int  y;
+    unsigned char Op;
+    int           Arg;
+
+    s->Stamp += 1;
+    s->nVNs  = 0;
+    s->Depth = 0;
+    fb->Term = 0;
+    fb->Cond = 0;
+
+    for (slot = 1; slot <= s->nSlots; slot += 1)
+    {
+        s->SlotVN[slot] = 0;
+        if (s->Tracked[slot] && s->InState[base + slot] == l_CONSTANT)
+        {
+            s->SlotVN[slot] = FindValue(s, s_LN, s->InValue[base + slot], 0, 0);
+        }
+    }
+
+    for (i = fb->First; i <= fb->Last; i += 1)
+    {
+        Op  = s->Code[i].Op;
+        Arg = s->Code[i].Arg;
+        slot = (Arg >= 1 && (unsigned int) Arg <= s->nSlots && s->Tracked[Arg]) ? (unsigned int) Arg : 0;
+
+        switch (Op)
+        {
+            case s_LN:
+                Push(s, NewItem(s, FindValue(s, s_LN, Arg, 0, 0), i, i, true, false));
+                break;
+
+            case s_LP:
+                Push(s, NewItem(s, (slot > 0) ? LoadLocal(s, slot) : NewValue(s, 0, 0, 0, 0), i, i, true, false));
+                break;
+
+            case s_LG:
+            case s_LSTR:
+            case s_LLG:
+            case s_LLP:
+            case s_LLL:
+                Push(s, NewItem(s, NewValue(s, 0, 0, 0, 0), i, i, true, false));
+                break;
+
+            case s_SP:
+                x = Pop(s);
+                if (slot > 0)
+                {
+                    s->SlotVN[slot] = s->Items[x].VN;
+                }
+                s->StoreItem[i] = x;
+                break;
+
+            case s_SG:
+            case s_DISCARD:
+                Pop(s);
+                break;
+
+            case s_STIND:
+            case s_VCOPY:
+                Pop(s);
+                Pop(s);
+                break;
+
+            case s_RV:
+                Pop(s);
+                Push(s, NewItem(s, NewValue(s, 0, 0, 0, 0), 0, i, false, false));
+                break;
+
+            case s_PUSHTOS:
+                x = Pop(s);
+                Push(s, x);
+                Push(s, NewItem(s, s->Items[x].VN, 0, i, false, false));
+                break;
+
+            case s_SWAP:
+                x = Pop(s);
+                y = Pop(s);
+                Push(s, x);
+                Push(s, y);
+                break;
+
+            case s_LBOUNDSCHECK:
+            case s_GBOUNDSCHECK:
+                Pop(s);
+                y = Pop(s);
+                x = Pop(s);
+                Push(s, NewItem(s, s->Items[x].VN, 0, i, false, false));
+                s->Items[s->nItems].Left  = x;  /* the address checked and the array */
+                s->Items[s->nItems].Right = y;
+                break;
+
+            case s_ENTRY:
+                s->Depth = 0;
+                EnterProcedure(s);
+                break;
+
+            case s_FNAP:
+            case s_RTAP:
+            case s_SYSCALL:  /* the stack below is no longer known */
+                s->Depth = 0;
+                break;
+
+            case s_JT:
+            case s_JF:
+            case s_SWITCHON:
+                fb->Cond = Pop(s);
+                fb->Term = i;
+                return;
+
+            case s_JUMP:
+            case s_RES:
+            case s_RTRN:
+                fb->Term = i;
+                return;
+
+            default:
+                if (Binary(Op))
+                {
+                    y = Pop(s);
+                    x = Pop(s);
+                    Push(s, Operate(s, i, Op, x, y));
+                }
+                else if (Unary(Op))
+                {
+                    y = Pop(s);
+                    Push(s, Operate(s, i, Op, 0, y));
+                }
+                break;  /* s_DEBUG and the code generator directives */
+        }
+    }
+}
+
+/* --------------------------------------------------------- */
+void FlowTo(SSAState *s, unsigned int addr, void (*Edge)(SSAState *, unsigned int))
+{
+    if (addr >= s->First && addr <= s->Last)
+    {
+        Edge(s, s->BlockOf[addr]);
+    }
+}
+
+/* --------------------------------------------------------- */
+void Successors(SSAState *s, unsigned int b, bool folding, void (*Edge)(SSAState *, unsigned int))  /* folding - a constant test takes one way */
+{
+    FlowBlock    *fb = &s->Blocks[b];
+    unsigned int t = fb->Term;
+    unsigned int n;
+    unsigned int j;
+    unsigned int lab;
+    bool         known;
+    int          x;
+
+    if (t == 0 || s->Dead[t])
+    {
+        if (b + 1 < s->nBlocks)
+        {
+            Edge(s, b + 1);
+        }
+        return;
+    }
+
+    known = folding && fb->Cond > 0 && s->Items[fb->Cond].Constant && s->Items[fb->Cond].Pure;  /* as FoldBlock removes it */
+    x     = known ? s->Items[fb->Cond].Value : 0;
+
+    switch (s->Code[t].Op)
+    {
+        case s_JUMP:
+        case s_RES:
+            FlowTo(s, s->Labels[s->Code[t].Arg], Edge);
+            return;
+
+        case s_RTRN:
+            return;
+
+        case s_JT:
+        case s_JF:
+            if (!known || ((x != 0) == (s->Code[t].Op == s_JT)))
+            {
+                FlowTo(s, s->Labels[s->Code[t].Arg], Edge);
+            }
+            if ((!known || ((x != 0) != (s->Code[t].Op == s_JT))) && b + 1 < s->nBlocks)
+            {
+                Edge(s, b + 1);
+            }
+            return;
+
+        case s_SWITCHON:
+            n   = s->Code[t].Arg;
+            lab = 0;
+            for (j = 1; j <= n; j += 1)
+            {
+                if (!known)
+                {
+                    FlowTo(s, s->Labels[s->Code[t + 2 * j + 1].Arg], Edge);
+                }
+                else if (s->Code[t + 2 * j].Arg == x)
+                {
+                    lab = s->Code[t + 2 * j + 1].Arg;
+                    break;
+                }
+            }
+            if (lab == 0)
+            {
+                lab = s->Code[t + 1].Arg;
+            }
+            if (!known && s->Code[t + 1].Arg != 0)
+            {
+                FlowTo(s, s->Labels[s->Code[t + 1].Arg], Edge);
+            }
+            else if (lab != 0)
+            {
+                FlowTo(s, s->Labels[lab], Edge);
+            }
+            if (s->Code[t + 1].Arg == 0 && (!known || lab == 0) && b + 1 < s->nBlocks)
+            {
+                Edge(s, b + 1);  /* no default */
+            }
+            return;
+
+        default:
+            return;
+    }
+}
+
+/* --------------------------------------------------------- */
+void MergeEdge(SSAState *s, unsigned int b)  /* meet the locals leaving the current block with those on entry to b */
+{
+    FlowBlock    *fb = &s->Blocks[b];
+    unsigned int base = b * (s->nSlots + 1);
+    unsigned int slot;
+    unsigned int v;
+    bool         changed = !fb->Reached;
+
+    for (slot = 1; slot <= s->nSlots; slot += 1)
+    {
+        if (!s->Tracked[slot])
+        {
+            continue;
+        }
+        v = s->SlotVN[slot];
+        if (v > 0 && s->VNs[v].Op == s_LN)
+        {
+            if (!fb->Reached || s->InState[base + slot] == l_UNDEFINED)
+            {
+                s->InState[base + slot] = l_CONSTANT;
+                s->InValue[base + slot] = s->VNs[v].Arg;
+                changed = true;
+            }
+            else if (s->InState[base + slot] == l_CONSTANT && s->InValue[base + slot] != s->VNs[v].Arg)
+            {
+                s->InState[base + slot] = l_VARYING;
+                changed = true;
+            }
+        }
+        else if (s->InState[base + slot] != l_VARYING)
+        {
+            s->InState[base + slot] = l_VARYING;
+            changed = true;
+        }
+    }
+
+    fb->Reached = true;
+    if (changed && !fb->Queued)
+    {
+        fb->Queued = true;
+        s->nWork += 1;
+        s->Work[s->nWork] = b;
+    }
+}
+
+/* --------------------------------------------------------- */
+void LiveEdge(SSAState *s, unsigned int b)  /* locals live on entry to b are live leaving the current block */
+{
+    unsigned int base = b * (s->nSlots + 1);
+    unsigned int slot;
+
+    if (!s->Blocks[b].Reached)
+    {
+        return;
+    }
+    for (slot = 1; slot <= s->nSlots; slot += 1)
+    {
+        s->Live[slot] = s->Live[slot] || s->LiveIn[base + slot];
+    }
+}
+
+/* --------------------------------------------------------- */
+bool PrepareProcedure(SSAState *s)  /* find the blocks and the locals which can be followed; false if the code is not understood */
+{
+    ProcedureItem *p = s->Proc;
+    unsigned int  i;
+    unsigned int  j;
+    unsigned int  k;
+    unsigned int  size;
+    bool          leader;
+    unsigned char Op;
+
+    s->nSlots  = p->BP;
+    s->Tracked = SSAAllocate(s->nSlots + 1, sizeof(bool));
+    for (i = 1; i <= s->nSlots; i += 1)
+    {
+        s->Tracked[i] = true;
+    }
+    for (i = 1; i <= p->nLocals; i += 1)  /* arrays are reached through their address */
+    {
+        if (p->Args[i].vDimensions[0] > 0)
+        {
+            size = 1;
+            for (j = 1; j <= p->Args[i].vDimensions[0]; j += 1)
+            {
+                size = size * p->Args[i].vDimensions[j];
+            }
+            for (k = p->Args[i].vOffset; k < p->Args[i].vOffset + size && k <= s->nSlots; k += 1)
+            {
+                s->Tracked[k] = false;
+            }
+        }
+    }
+
+    s->nBlocks = 0;
+    leader = true;
+    for (i = s->First; i <= s->Last; i += 1)
+    {
+        Op = s->Code[i].Op;
+        if (Op == 0 || Op == s_LL || Op == s_SL || (Op > s_GBOUNDSCHECK && Op < s_STACK) || Op > s_DISCARD)
+        {
+            return false;
+        }
+        if (Op == s_LBOUNDSCHECK || Op == s_GBOUNDSCHECK)
+        {
+            s->nChecks += 1;
+        }
+        if (Op == s_LLP && s->Code[i].Arg >= 1 && (unsigned int) s->Code[i].Arg <= s->nSlots)
+        {
+            s->Tracked[s->Code[i].Arg] = false;  /* its address is taken */
+        }
+
+        if (leader || s->Target[i])
+        {
+            s->Blocks = Grow(s->Blocks, &s->BlocksSize, s->nBlocks, sizeof(FlowBlock));
+            memset(&s->Blocks[s->nBlocks], 0, sizeof(FlowBlock));
+            s->Blocks[s->nBlocks].First = i;
+            s->nBlocks += 1;
+        }
+        s->Blocks[s->nBlocks - 1].Last = i;
+        s->BlockOf[i] = s->nBlocks - 1;
+
+        leader = Op == s_JT || Op == s_JF || Op == s_JUMP || Op == s_RES || Op == s_RTRN;
+        if (Op == s_SWITCHON)
+        {
+            if (i + 2 * s->Code[i].Arg + 1 > s->Last)
+            {
+                return false;
+            }
+            for (j = 1; j <= 2 * (unsigned int) s->Code[i].Arg + 1; j += 1)  /* the case table */
+            {
+                s->BlockOf[i + j] = s->nBlocks - 1;
+            }
+            i += 2 * s->Code[i].Arg + 1;
+            s->Blocks[s->nBlocks - 1].Last = i;
+            leader = true;
+        }
+    }
+    return true;
+}
+
+/* --------------------------------------------------------- */
+void PropagateConstants(SSAState *s)
+{
+    unsigned int b;
+    unsigned int slot;
+
+    s->InState = SSAAllocate(s->nBlocks * (s->nSlots + 1), sizeof(unsigned char));
+    s->InValue = SSAAllocate(s->nBlocks * (s->nSlots + 1), sizeof(int));
+    s->Work    = SSAAllocate(s->nBlocks + 1, sizeof(unsigned int));
+
+    for (slot = 1; slot <= s->nSlots; slot += 1)
+    {
+        s->InState[slot] = l_VARYING;
+    }
+    s->Blocks[0].Reached = true;
+    s->Blocks[0].Queued  = true;
+    s->Work[1] = 0;
+    s->nWork   = 1;
+
+    while (s->nWork > 0)
+    {
+        b = s->Work[s->nWork];
+        s->nWork -= 1;
+        s->Blocks[b].Queued = false;
+        s->nItems = 0;
+        RunBlock(s, b);
+        Successors(s, b, true, MergeEdge);
+    }
+}
+
+/* --------------------------------------------------------- */
+void FoldBlock(SSAState *s, unsigned int b, unsigned int firstitem)  /* constant tests, constant expressions and reductions */
+{
+    FlowBlock    *fb = &s->Blocks[b];
+    StackItem    *c;
+    unsigned int t = fb->Term;
+    unsigned int i;
+    unsigned int j;
+    unsigned int k;
+    unsigned int lab;
+
+    if (t > 0 && fb->Cond > 0 && s->Items[fb->Cond].Constant && s->Items[fb->Cond].Pure)
+    {
+        c = &s->Items[fb->Cond];
+        for (i = c->First; i <= c->Def; i += 1)
+        {
+            s->Dead[i] = true;
+        }
+        if (s->Code[t].Op == s_SWITCHON)
+        {
+            lab = s->Code[t + 1].Arg;
+            for (j = 1; j <= (unsigned int) s->Code[t].Arg; j += 1)
+            {
+                if (s->Code[t + 2 * j].Arg == c->Value)
+                {
+                    lab = s->Code[t + 2 * j + 1].Arg;
+                    break;
+                }
+            }
+            for (i = t + 1; i <= t + 2 * s->Code[t].Arg + 1; i += 1)
+            {
+                s->Dead[i] = true;
+            }
+            s->Code[t].Op  = s_JUMP;
+            s->Code[t].Arg = lab;
+            if (lab == 0)
+            {
+                s->Dead[t] = true;
+            }
+        }
+        else if ((c->Value != 0) == (s->Code[t].Op == s_JT))
+        {
+            s->Code[t].Op = s_JUMP;
+        }
+        else
+        {
+            s->Dead[t] = true;
+        }
+    }
+
+    for (k = s->nItems; k > firstitem; k -= 1)  /* outer expressions first */
+    {
+        c = &s->Items[k];
+        if (c->Constant && c->Pure && !s->Dead[c->Def] && (c->Def > c->First || s->Code[c->Def].Op != s_LN))
+        {
+            for (i = c->First; i < c->Def; i += 1)
+            {
+                s->Dead[i] = true;
+            }
+            s->Code[c->Def].Op  = s_LN;
+            s->Code[c->Def].Arg = c->Value;
+        }
+    }
+
+    for (k = firstitem + 1; k <= s->nItems; k += 1)
+    {
+        ReduceItem(s, k);
+    }
+}
+
+/* --------------------------------------------------------- */
+void ReduceItem(SSAState *s, unsigned int k)  /* fixed point multiplies and divides by whole numbers */
+{
+    StackItem    *c = &s->Items[k];
+    StackItem    *o;
+    unsigned int i;
+    int          v;
+
+    if (c->First == 0 || c->Constant || s->Dead[c->Def] || (s->Code[c->Def].Op != s_MULTF && s->Code[c->Def].Op != s_DIVF))
+    {
+        return;
+    }
+
+    o = &s->Items[c->Right];
+    if (s->Code[c->Def].Op == s_MULTF && !(o->Constant && o->First > 0))
+    {
+        o = &s->Items[c->Left];
+    }
+    if (!o->Constant || o->First == 0 || s->Dead[o->Def] || s->Code[o->Def].Op != s_LN)
+    {
+        return;
+    }
+    for (i = o->First; i < o->Def; i += 1)
+    {
+        if (!s->Dead[i])
+        {
+            return;
+        }
+    }
+
+    v = s->Code[o->Def].Arg;
+    if (v == 65536)  /* by 1.0 */
+    {
+        s->Dead[o->Def] = true;
+        s->Dead[c->Def] = true;
+    }
+    else if (s->Code[c->Def].Op == s_MULTF && v % 65536 == 0 && !ArithmeticChecking)  /* the same product, but MULT reports an overflow as an integer one */
+    {
+        s->Code[o->Def].Arg = v / 65536;
+        s->Code[c->Def].Op  = s_MULT;
+    }
+}
+
+/* --------------------------------------------------------- */
+void DeleteDeadStores(SSAState *s)
+{
+    unsigned int b;
+    unsigned int i;
+    unsigned int slot;
+    unsigned int base;
+    unsigned int x;
+    unsigned int k;
+    bool         changed;
+    bool         deleted;
+
+    s->LiveIn = SSAAllocate(s->nBlocks * (s->nSlots + 1), sizeof(bool));
+    s->Live   = SSAAllocate(s->nSlots + 1, sizeof(bool));
+
+    do
+    {
+        memset(s->LiveIn, 0, s->nBlocks * (s->nSlots + 1) * sizeof(bool));
+        do
+        {
+            changed = false;
+            for (b = s->nBlocks; b-- > 0; )
+            {
+                if (!s->Blocks[b].Reached)
+                {
+                    continue;
+                }
+                memset(s->Live, 0, (s->nSlots + 1) * sizeof(bool));
+                Successors(s, b, false, LiveEdge);
+                for (i = s->Blocks[b].Last; i >= s->Blocks[b].First; i -= 1)
+                {
+                    slot = s->Code[i].Arg;
+                    if (!s->Dead[i] && slot >= 1 && slot <= s->nSlots && s->Tracked[slot])
+                    {
+                        if (s->Code[i].Op == s_LP)
+                        {
+                            s->Live[slot] = true;
+                        }
+                        else if (s->Code[i].Op == s_SP)
+                        {
+                            s->Live[slot] = false;
+                        }
+                    }
+                }
+                base = b * (s->nSlots + 1);
+                if (memcmp(&s->LiveIn[base], s->Live, (s->nSlots + 1) * sizeof(bool)) != 0)
+                {
+                    memcpy(&s->LiveIn[base], s->Live, (s->nSlots + 1) * sizeof(bool));
+                    changed = true;
+                }
+            }
+        } while (changed);
+
+        deleted = false;
+        for (b = 0; b < s->nBlocks; b += 1)
+        {
+            if (!s->Blocks[b].Reached)
+            {
+                continue;
+            }
+            memset(s->Live, 0, (s->nSlots + 1) * sizeof(bool));
+            Successors(s, b, false, LiveEdge);
+            for (i = s->Blocks[b].Last; i >= s->Blocks[b].First; i -= 1)
+            {
+                slot = s->Code[i].Arg;
+                if (s->Dead[i] || slot < 1 || slot > s->nSlots || !s->Tracked[slot])
+                {
+                    continue;
+                }
+                if (s->Code[i].Op == s_LP)
+                {
+                    s->Live[slot] = true;
+                }
+                else if (s->Code[i].Op == s_SP)
+                {
+                    x = s->StoreItem[i];
+                    for (k = i - 1; k > s->First && s->Dead[k]; k -= 1)  /* the value may be pushed ahead of other stores */
+                    {
+                    }
+                    if (!s->Live[slot] && x > 0 && s->Items[x].Pure && !s->Items[x].Traps && s->Items[x].First > 0 && s->Items[x].Def == k)
+                    {
+                        for (x = s->Items[x].First; x <= i; x += 1)  /* the store and the value stored */
+                        {
+                            s->Dead[x] = true;
+                        }
+                        deleted = true;
+                    }
+                    s->Live[slot] = false;
+                }
+            }
+        }
+    } while (deleted);
+}
+
+/* --------------------------------------------------------- */
+Interval NumberRange(long long lo, long long hi)  /* the whole range if it overflows */
+{
+    Interval r;
+
+    r.Base    = 0;
+    r.BaseArg = 0;
+    if (lo < INT_MIN || hi > INT_MAX || lo > hi)
+    {
+        r.Lo = INT_MIN;
+        r.Hi = INT_MAX;
+    }
+    else
+    {
+        r.Lo = (int) lo;
+        r.Hi = (int) hi;
+    }
+    return r;
+}
+
+/* --------------------------------------------------------- */
+Interval AddressRange(unsigned char Op, int Arg, long long lo, long long hi)  /* bytes from the start of an array */
+{
+    Interval r = NumberRange(lo, hi);
+
+    if (r.Lo > INT_MIN || r.Hi < INT_MAX)
+    {
+        r.Base    = Op;
+        r.BaseArg = Arg;
+    }
+    return r;
+}
+
+/* --------------------------------------------------------- */
+Interval CombineRanges(unsigned char Op, Interval a, Interval b)  /* a Op b, b being on top */
+{
+    long long p[4];
+    long long lo;
+    long long hi;
+    int       j;
+
+    if (Op >= s_EQ && Op <= s_GE)
+    {
+        return NumberRange(0, 1);
+    }
+    if (b.Base != 0 || (a.Base != 0 && Op != s_PLUS && Op != s_MINUS))
+    {
+        if (Op == s_PLUS && a.Base == 0)
+        {
+            return AddressRange(b.Base, b.BaseArg, (long long) a.Lo + b.Lo, (long long) a.Hi + b.Hi);
+        }
+        return NumberRange(INT_MIN, INT_MAX);
+    }
+
+    switch (Op)
+    {
+        case s_PLUS:
+            return AddressRange(a.Base, a.BaseArg, (long long) a.Lo + b.Lo, (long long) a.Hi + b.Hi);
+
+        case s_MINUS:
+            return AddressRange(a.Base, a.BaseArg, (long long) a.Lo - b.Hi, (long long) a.Hi - b.Lo);
+
+        case s_MULT:
+            p[0] = (long long) a.Lo * b.Lo;
+            p[1] = (long long) a.Lo * b.Hi;
+            p[2] = (long long) a.Hi * b.Lo;
+            p[3] = (long long) a.Hi * b.Hi;
+            lo = p[0];
+            hi = p[0];
+            for (j = 1; j < 4; j += 1)
+            {
+                lo = (p[j] < lo) ? p[j] : lo;
+                hi = (p[j] > hi) ? p[j] : hi;
+            }
+            return NumberRange(lo, hi);
+
+        case s_LSHIFT:
+            if (b.Lo == b.Hi && b.Lo >= 0 && b.Lo < 31)
+            {
+                return NumberRange((long long) a.Lo * (1LL << b.Lo), (long long) a.Hi * (1LL << b.Lo));
+            }
+            break;
+
+        case s_RSHIFT:
+            if (b.Lo == b.Hi && b.Lo >= 0 && b.Lo < 32 && a.Lo >= 0)
+            {
+                return NumberRange(a.Lo >> b.Lo, a.Hi >> b.Lo);
+            }
+            break;
+
+        case s_LOGAND:  /* no larger than a mask which is not negative */
+            if (a.Lo >= 0 && b.Lo >= 0)
+            {
+                return NumberRange(0, (a.Hi < b.Hi) ? a.Hi : b.Hi);
+            }
+            if (a.Lo >= 0 || b.Lo >= 0)
+            {
+                return NumberRange(0, (a.Lo >= 0) ? a.Hi : b.Hi);
+            }
+            break;
+
+        case s_DIV:
+            if (b.Lo == b.Hi && b.Lo > 0)
+            {
+                return NumberRange(a.Lo / b.Lo, a.Hi / b.Lo);
+            }
+            break;
+
+        case s_REM:  /* the sign of the dividend */
+            if (b.Lo == b.Hi && b.Lo > 0)
+            {
+                if (a.Lo >= 0)
+                {
+                    return NumberRange(0, (a.Hi < b.Lo - 1) ? a.Hi : b.Lo - 1);
+                }
+                return NumberRange(1 - b.Lo, (a.Hi <= 0) ? 0 : b.Lo - 1);
+            }
+            break;
+
+        case s_NEG:
+            return NumberRange(-(long long) b.Hi, -(long long) b.Lo);
+
+        case s_ABS:
+            if (b.Lo >= 0)
+            {
+                return b;
+            }
+            if (b.Hi <= 0)
+            {
+                return NumberRange(-(long long) b.Hi, -(long long) b.Lo);
+            }
+            return NumberRange(0, (-(long long) b.Lo > b.Hi) ? -(long long) b.Lo : b.Hi);
+
+        case s_NOT:
+            return NumberRange(0, 1);
+    }
+    return NumberRange(INT_MIN, INT_MAX);
+}
+
+/* --------------------------------------------------------- */
+Interval ItemRange(SSAState *s, unsigned int k, unsigned int i)
+{
+    StackItem     *c = &s->Items[k];
+    unsigned char Op = s->Code[i].Op;
+    int           Arg = s->Code[i].Arg;
+
+    switch (Op)
+    {
+        case s_LN:
+            return NumberRange(Arg, Arg);
+
+        case s_LP:
+            if (Arg >= 1 && (unsigned int) Arg <= s->nSlots && s->Tracked[Arg])
+            {
+                return s->SlotRange[Arg];
+            }
+            return AddressRange(Op, Arg, 0, 0);  /* an array argument */
+
+        case s_LLG:
+        case s_LLP:
+            return AddressRange(Op, Arg, 0, 0);
+
+        case s_LBOUNDSCHECK:
+        case s_GBOUNDSCHECK:
+            return s->Range[c->Left];
+
+        default:
+            if (Binary(Op))
+            {
+                return CombineRanges(Op, s->Range[c->Left], s->Range[c->Right]);
+            }
+            if (Unary(Op))
+            {
+                return CombineRanges(Op, NumberRange(INT_MIN, INT_MAX), s->Range[c->Right]);
+            }
+            return NumberRange(INT_MIN, INT_MAX);
+    }
+}
+
+/* --------------------------------------------------------- */
+void RangeBlock(SSAState *s, unsigned int b)  /* the ranges of the block's items and of the locals leaving it */
+{
+    ProcedureItem *p = s->Proc;
+    unsigned int  base = b * (s->nSlots + 1);
+    unsigned int  i;
+    unsigned int  j;
+    unsigned int  k;
+    unsigned int  slot;
+
+    memcpy(s->SlotRange, &s->InRange[base], (s->nSlots + 1) * sizeof(Interval));
+    memset(s->LastStore, 0, (s->nSlots + 1) * sizeof(unsigned int));
+
+    for (i = s->Blocks[b].First; i <= s->Blocks[b].Last; i += 1)
+    {
+        if (s->Dead[i])
+        {
+            continue;
+        }
+        slot = s->Code[i].Arg;
+        switch (s->Code[i].Op)
+        {
+            case s_SWITCHON:
+                i += 2 * s->Code[i].Arg + 1;
+                continue;
+
+            case s_SP:
+                if (slot >= 1 && slot <= s->nSlots && s->Tracked[slot])
+                {
+                    s->SlotRange[slot] = (s->StoreItem[i] > 0) ? s->Range[s->StoreItem[i]] : NumberRange(INT_MIN, INT_MAX);
+                    s->LastStore[slot] = i;
+                }
+                break;
+
+            case s_ENTRY:  /* as ENTRY zeroes them */
+                for (j = p->nArgs + 1; j <= p->nLocals; j += 1)
+                {
+                    slot = p->Args[j].vOffset;
+                    if (p->Args[j].vDimensions[0] == 0 && slot >= 1 && slot <= s->nSlots && s->Tracked[slot])
+                    {
+                        s->SlotRange[slot] = NumberRange(0, 0);
+                    }
+                }
+                break;
+        }
+        k = s->ItemOf[i];
+        if (k > 0 && k <= s->nItems && s->Items[k].Def == i)
+        {
+            s->Range[k] = ItemRange(s, k, i);
+        }
+    }
+}
+
+/* --------------------------------------------------------- */
+bool NarrowLocal(SSAState *s, unsigned int x, unsigned char Op, Interval r)  /* x Op r holds; false if it cannot */
+{
+    unsigned int i;
+    unsigned int slot;
+    long long    lo;
+    long long    hi;
+
+    if (x == 0 || s->Items[x].Def == 0 || s->Dead[s->Items[x].Def] || s->Code[s->Items[x].Def].Op != s_LP)
+    {
+        return true;
+    }
+    i    = s->Items[x].Def;
+    slot = s->Code[i].Arg;
+    if (slot < 1 || slot > s->nSlots || !s->Tracked[slot] || s->LastStore[slot] > i ||  /* stored since it was tested */
+        r.Base != 0 || s->SlotRange[slot].Base != 0)
+    {
+        return true;
+    }
+
+    lo = s->SlotRange[slot].Lo;
+    hi = s->SlotRange[slot].Hi;
+    switch (Op)
+    {
+        case s_LS:
+            hi = (hi < (long long) r.Hi - 1) ? hi : (long long) r.Hi - 1;
+            break;
+        case s_LE:
+            hi = (hi < r.Hi) ? hi : r.Hi;
+            break;
+        case s_GR:
+            lo = (lo > (long long) r.Lo + 1) ? lo : (long long) r.Lo + 1;
+            break;
+        case s_GE:
+            lo = (lo > r.Lo) ? lo : r.Lo;
+            break;
+        case s_EQ:
+            lo = (lo > r.Lo) ? lo : r.Lo;
+            hi = (hi < r.Hi) ? hi : r.Hi;
+            break;
+        case s_NE:
+            if (r.Lo == r.Hi && lo == r.Lo)
+            {
+                lo += 1;
+            }
+            if (r.Lo == r.Hi && hi == r.Hi)
+            {
+                hi -= 1;
+            }
+            break;
+    }
+    if (lo > hi)
+    {
+        return false;
+    }
+    s->SlotRange[slot] = NumberRange(lo, hi);
+    return true;
+}
+
+/* --------------------------------------------------------- */
+bool NarrowTest(SSAState *s, unsigned int c, bool sense)  /* narrow the locals to those for which test c is sense; false if none are */
+{
+    static unsigned char Opposite[] = { s_NE, s_EQ, s_GE, s_LE, s_GR, s_LS };  /* from s_EQ, s_NE, s_LS, s_GR, s_LE, s_GE */
+    static unsigned char Swapped[]  = { s_EQ, s_NE, s_GR, s_LS, s_GE, s_LE };
+    unsigned char        Op;
+
+    while (c > 0 && s->Items[c].Def > 0 && s->Code[s->Items[c].Def].Op == s_NOT)
+    {
+        c     = s->Items[c].Right;
+        sense = !sense;
+    }
+    if (c == 0 || s->Items[c].Def == 0)
+    {
+        return true;
+    }
+    Op = s->Code[s->Items[c].Def].Op;
+    if (Op < s_EQ || Op > s_GE)
+    {
+        return true;
+    }
+    if (!sense)
+    {
+        Op = Opposite[Op - s_EQ];
+    }
+    return NarrowLocal(s, s->Items[c].Left, Op, s->Range[s->Items[c].Right]) &&
+           NarrowLocal(s, s->Items[c].Right, Swapped[Op - s_EQ], s->Range[s->Items[c].Left]);
+}
+
+/* --------------------------------------------------------- */
+int CompareLimits(const void *a, const void *b)
+{
+    int x = *(const int *) a;
+    int y = *(const int *) b;
+
+    return (x < y) ? -1 : (x > y);
+}
+
+/* --------------------------------------------------------- */
+int Limit(SSAState *s, int v, bool above)  /* the nearest constant of the procedure at or beyond v */
+{
+    unsigned int l = 0;
+    unsigned int h = s->nLimits;
+    unsigned int m;
+
+    while (l < h)  /* first limit >= v */
+    {
+        m = (l + h) / 2;
+        if (s->Limits[m] < v)
+        {
+            l = m + 1;
+        }
+        else
+        {
+            h = m;
+        }
+    }
+    if (above)
+    {
+        return (l < s->nLimits) ? s->Limits[l] : INT_MAX;
+    }
+    if (l < s->nLimits && s->Limits[l] == v)
+    {
+        return v;
+    }
+    return (l > 0) ? s->Limits[l - 1] : INT_MIN;
+}
+
+/* --------------------------------------------------------- */
+void RangeEdge(SSAState *s, unsigned int b)  /* join the locals leaving the current block with those on entry to b */
+{
+    unsigned int base = b * (s->nSlots + 1);
+    unsigned int slot;
+    Interval     *o;
+    Interval     n;
+    int          lo;
+    int          hi;
+    bool         changed = !s->RangeReached[b];
+
+    for (slot = 1; slot <= s->nSlots; slot += 1)
+    {
+        if (!s->Tracked[slot])
+        {
+            continue;
+        }
+        o = &s->InRange[base + slot];
+        n = s->SlotRange[slot];
+        if (!s->RangeReached[b])
+        {
+            *o = n;
+        }
+        else if (n.Base != o->Base || n.BaseArg != o->BaseArg)
+        {
+            if (o->Base != 0 || o->Lo > INT_MIN || o->Hi < INT_MAX)
+            {
+                *o = NumberRange(INT_MIN, INT_MAX);
+                changed = true;
+            }
+        }
+        else if (n.Lo < o->Lo || n.Hi > o->Hi)
+        {
+            lo = (n.Lo < o->Lo) ? n.Lo : o->Lo;
+            hi = (n.Hi > o->Hi) ? n.Hi : o->Hi;
+            if (b <= s->RangeFrom && s->RangeVisits[b] >= MaxRangeVisits)  /* widen round loops so that they settle */
+            {
+                lo = (lo < o->Lo) ? Limit(s, lo, false) : lo;
+                hi = (hi > o->Hi) ? Limit(s, hi, true) : hi;
+            }
+            o->Lo = lo;
+            o->Hi = hi;
+            changed = true;
+        }
+    }
+
+    s->RangeReached[b] = true;
+    if (changed)
+    {
+        s->RangeVisits[b] += 1;
+        if (!s->Blocks[b].Queued)
+        {
+            s->Blocks[b].Queued = true;
+            s->nWork += 1;
+            s->Work[s->nWork] = b;
+        }
+    }
+}
+
+/* --------------------------------------------------------- */
+void RangeSuccessors(SSAState *s, unsigned int b)  /* a conditional jump narrows the locals it tests on each way */
+{
+    unsigned int t = s->Blocks[b].Term;
+    unsigned int c = s->Blocks[b].Cond;
+    bool         jt;
+
+    if (t == 0 || s->Dead[t] || c == 0 || (s->Code[t].Op != s_JT && s->Code[t].Op != s_JF))
+    {
+        Successors(s, b, false, RangeEdge);
+        return;
+    }
+
+    jt = s->Code[t].Op == s_JT;
+    memcpy(s->SavedRange, s->SlotRange, (s->nSlots + 1) * sizeof(Interval));
+    if (NarrowTest(s, c, jt))
+    {
+        FlowTo(s, s->Labels[s->Code[t].Arg], RangeEdge);
+    }
+    memcpy(s->SlotRange, s->SavedRange, (s->nSlots + 1) * sizeof(Interval));
+    if (NarrowTest(s, c, !jt) && b + 1 < s->nBlocks)
+    {
+        RangeEdge(s, b + 1);
+    }
+}
+
+/* --------------------------------------------------------- */
+void RemoveBoundsChecks(SSAState *s)  /* checks of array indices which the ranges of the locals keep in bounds */
+{
+    unsigned int b;
+    unsigned int i;
+    unsigned int k;
+    unsigned int slot;
+    Interval     a;
+    Interval     base;
+
+    s->InRange      = SSAAllocate(s->nBlocks * (s->nSlots + 1), sizeof(Interval));
+    s->SlotRange    = SSAAllocate(s->nSlots + 1, sizeof(Interval));
+    s->SavedRange   = SSAAllocate(s->nSlots + 1, sizeof(Interval));
+    s->LastStore    = SSAAllocate(s->nSlots + 1, sizeof(unsigned int));
+    s->RangeVisits  = SSAAllocate(s->nBlocks, sizeof(unsigned int));
+    s->RangeReached = SSAAllocate(s->nBlocks, sizeof(bool));
+    s->Range        = Grow(s->Range, &s->RangeSize, s->nItems, sizeof(Interval));
+    s->Limits       = SSAAllocate(s->Blocks[s->nBlocks - 1].Last - s->Blocks[0].First + 1, sizeof(int));
+    s->nLimits      = 0;
+    for (i = s->Blocks[0].First; i <= s->Blocks[s->nBlocks - 1].Last; i += 1)
+    {
+        if (!s->Dead[i] && s->Code[i].Op == s_LN)
+        {
+            s->Limits[s->nLimits] = s->Code[i].Arg;
+            s->nLimits += 1;
+        }
+    }
+    qsort(s->Limits, s->nLimits, sizeof(int), CompareLimits);
+    for (k = 0; k <= s->nItems; k += 1)
+    {
+        s->Range[k] = NumberRange(INT_MIN, INT_MAX);
+    }
+
+    for (slot = 1; slot <= s->nSlots; slot += 1)
+    {
+        s->InRange[slot] = NumberRange(INT_MIN, INT_MAX);
+    }
+    s->RangeReached[0]  = true;
+    s->Blocks[0].Queued = true;
+    s->Work[1] = 0;
+    s->nWork   = 1;
+    while (s->nWork > 0)
+    {
+        b = s->Work[s->nWork];
+        s->nWork -= 1;
+        s->Blocks[b].Queued = false;
+        s->RangeFrom = b;
+        RangeBlock(s, b);
+        RangeSuccessors(s, b);
+    }
+
+    for (b = 0; b < s->nBlocks; b += 1)
+    {
+        if (!s->RangeReached[b])
+        {
+            continue;
+        }
+        RangeBlock(s, b);
+        for (i = s->Blocks[b].First + 2; i <= s->Blocks[b].Last; i += 1)
+        {
+            if (s->Dead[i] || (s->Code[i].Op != s_LBOUNDSCHECK && s->Code[i].Op != s_GBOUNDSCHECK) ||
+                s->Dead[i - 1] || s->Code[i - 1].Op != s_LN || s->Dead[i - 2])
+            {
+                continue;
+            }
+            k = s->ItemOf[i];
+            if (k == 0 || s->Items[k].Def != i || s->Items[s->Items[k].Right].Def != i - 2)
+            {
+                continue;
+            }
+            a    = s->Range[s->Items[k].Left];
+            base = s->Range[s->Items[k].Right];
+            if (a.Base != 0 && a.Base == base.Base && a.BaseArg == base.BaseArg && base.Lo == 0 && base.Hi == 0 &&
+                a.Lo >= 0 && a.Hi < s->Code[i - 1].Arg)
+            {
+                s->Dead[i - 2] = true;  /* the array, its size and the check */
+                s->Dead[i - 1] = true;
+                s->Dead[i]     = true;
+            }
+        }
+    }
+
+    free(s->InRange);
+    free(s->SlotRange);
+    free(s->SavedRange);
+    free(s->LastStore);
+    free(s->RangeVisits);
+    free(s->RangeReached);
+    free(s->Limits);
+}
+
+/* --------------------------------------------------------- */
+void Insert(SSAState *s, unsigned int at, bool before, unsigned char Op, int Arg)
+{
+    Insertion *n;
+
+    s->nInserts += 1;
+    s->Inserts = Grow(s->Inserts, &s->InsertsSize, s->nInserts, sizeof(Insertion));
+    n = &s->Inserts[s->nInserts];
+    n->At       = at;
+    n->Before   = before;
+    n->Seq      = s->nInserts;
+    n->Code.Op  = Op;
+    n->Code.Arg = Arg;
+}
+
+/* --------------------------------------------------------- */
+bool RunIsFree(SSAState *s, unsigned int first, unsigned int last)  /* no code is inserted inside it */
+{
+    unsigned int i;
+
+    for (i = first; i <= last; i += 1)
+    {
+        if (s->Pinned[i])
+        {
+            return false;
+        }
+    }
+    return !s->Dead[last];
+}
+
+/* --------------------------------------------------------- */
+unsigned int RunCost(SSAState *s, unsigned int first, unsigned int last)
+{
+    unsigned int i;
+    unsigned int n = 0;
+
+    for (i = first; i <= last; i += 1)
+    {
+        if (!s->Dead[i])
+        {
+            n += Cost(s->Code[i].Op);
+        }
+    }
+    return n;
+}
+
+/* --------------------------------------------------------- */
+bool NoteJump(SSAState *s, unsigned int i, unsigned int l, unsigned int h, unsigned int t, bool *inside, bool *outside)  /* false if it enters the loop past its head */
+{
+    if (l == 0)
+    {
+        return true;
+    }
+    if (i >= h && i <= t)
+    {
+        inside[l] = true;
+        return true;
+    }
+    outside[l] = true;
+    return s->Labels[l] <= h || s->Labels[l] > t;
+}
+
+/* --------------------------------------------------------- */
+void HoistLoop(SSAState *s, unsigned int h, unsigned int t)  /* the loop from h back to t */
+{
+    bool          *inside;
+    bool          *outside;
+    bool          *stored;
+    unsigned int  i;
+    unsigned int  j;
+    unsigned int  k;
+    unsigned int  l;
+    unsigned int  a;
+    unsigned int  temp;
+    unsigned char Op;
+    StackItem     *c;
+    bool          invariant;
+    bool          entered = false;
+
+    inside  = SSAAllocate(s->nLabels + 1, sizeof(bool));
+    outside = SSAAllocate(s->nLabels + 1, sizeof(bool));
+    stored  = SSAAllocate(s->nSlots + 1, sizeof(bool));
+
+    for (i = s->First; i <= s->Last && !entered; i += 1)
+    {
+        if (s->Dead[i])
+        {
+            continue;
+        }
+        Op = s->Code[i].Op;
+        if (Op == s_JUMP || Op == s_JT || Op == s_JF || Op == s_RES)
+        {
+            entered = !NoteJump(s, i, s->Code[i].Arg, h, t, inside, outside);
+        }
+        else if (Op == s_SWITCHON)
+        {
+            entered = !NoteJump(s, i, s->Code[i + 1].Arg, h, t, inside, outside);
+            for (j = 1; j <= (unsigned int) s->Code[i].Arg; j += 1)
+            {
+                entered = entered || !NoteJump(s, i, s->Code[i + 2 * j + 1].Arg, h, t, inside, outside);
+            }
+            i += 2 * s->Code[i].Arg + 1;
+        }
+        else if (Op == s_SP && i >= h && i <= t && s->Code[i].Arg >= 1 && (unsigned int) s->Code[i].Arg <= s->nSlots)
+        {
+            stored[s->Code[i].Arg] = true;
+        }
+    }
+    for (l = 1; l <= s->nLabels; l += 1)  /* the head is reached from outside and inside by different labels */
+    {
+        entered = entered || (s->Labels[l] == h && inside[l] && outside[l]);
+    }
+
+    for (k = s->nItems; k > 0 && !entered; k -= 1)  /* outer expressions first */
+    {
+        c = &s->Items[k];
+        if (c->Def < h || c->Def > t || !c->Operator || !c->Pure || c->Constant ||
+            !RunIsFree(s, c->First, c->Def) || RunCost(s, c->First, c->Def) < 3 ||
+            (c->Traps && s->Blocks[c->Block].First != h))  /* the head runs whenever the loop is entered */
+        {
+            continue;
+        }
+
+        invariant = true;
+        for (i = c->First; i <= c->Def && invariant; i += 1)
+        {
+            if (s->Dead[i])
+            {
+                continue;
+            }
+            if (s->Code[i].Op == s_LP)
+            {
+                a = s->Code[i].Arg;
+                invariant = a >= 1 && a <= s->nSlots && s->Tracked[a] && !stored[a];
+            }
+            else
+            {
+                invariant = s->Code[i].Op == s_LN || Binary(s->Code[i].Op) || Unary(s->Code[i].Op);
+            }
+        }
+        if (!invariant)
+        {
+            continue;
+        }
+
+        s->nTemps += 1;
+        temp = s->Proc->BP + s->nTemps;
+        for (i = c->First; i <= c->Def; i += 1)  /* computed once in the preheader */
+        {
+            if (!s->Dead[i])
+            {
+                Insert(s, h, true, s->Code[i].Op, s->Code[i].Arg);
+            }
+        }
+        Insert(s, h, true, s_SP, temp);
+        for (i = c->First; i < c->Def; i += 1)
+        {
+            s->Dead[i] = true;
+        }
+        s->Code[c->Def].Op  = s_LP;
+        s->Code[c->Def].Arg = temp;
+        c->First = 0;
+
+        for (l = 1; l <= s->nLabels; l += 1)  /* the loop itself jumps past the preheader */
+        {
+            if (s->Labels[l] == h && inside[l])
+            {
+                s->AfterPreheader[l] = true;
+            }
+        }
+    }
+
+    free(inside);
+    free(outside);
+    free(stored);
+}
+
+/* --------------------------------------------------------- */
+void MoveInvariants(SSAState *s)  /* outer loops first */
+{
+    unsigned int *tail;
+    unsigned int b;
+    unsigned int h;
+    unsigned int t;
+    unsigned int n;
+    unsigned int best;
+
+    tail = SSAAllocate(s->Last - s->First + 2, sizeof(unsigned int));
+    for (b = 0; b < s->nBlocks; b += 1)
+    {
+        t = s->Blocks[b].Term;
+        if (s->Blocks[b].Reached && t > 0 && !s->Dead[t] &&
+            (s->Code[t].Op == s_JUMP || s->Code[t].Op == s_JT || s->Code[t].Op == s_JF))
+        {
+            h = s->Labels[s->Code[t].Arg];
+            if (h > s->First && h <= t && t > tail[h - s->First])
+            {
+                tail[h - s->First] = t;
+            }
+        }
+    }
+
+    do
+    {
+        best = 0;
+        n    = 0;
+        for (h = s->First + 1; h <= s->Last; h += 1)
+        {
+            if (tail[h - s->First] > 0 && tail[h - s->First] - h + 1 > n)
+            {
+                n    = tail[h - s->First] - h + 1;
+                best = h;
+            }
+        }
+        if (best > 0)
+        {
+            HoistLoop(s, best, tail[best - s->First]);
+            tail[best - s->First] = 0;
+        }
+    } while (best > 0);
+
+    free(tail);
+}
+
+/* --------------------------------------------------------- */
+void ShareExpressions(SSAState *s, unsigned int b, unsigned int firstitem, unsigned int lastitem, unsigned int *ntemps)
+{
+    StackItem    *c;
+    StackItem    *d;
+    unsigned int k;
+    unsigned int i;
+    unsigned int temps = 0;
+
+    s->FirstItem = Grow(s->FirstItem, &s->FirstItemSize, s->VNsSize, sizeof(unsigned int));  /* value numbers of any block */
+    for (k = firstitem + 1; k <= lastitem; k += 1)
+    {
+        s->FirstItem[s->Items[k].VN] = 0;
+    }
+    for (k = firstitem + 1; k <= lastitem; k += 1)  /* find the repeats */
+    {
+        c = &s->Items[k];
+        if (!c->Operator || !c->Pure || c->Constant || c->First == 0 || s->Dead[c->Def])
+        {
+            continue;
+        }
+        if (s->FirstItem[c->VN] == 0)
+        {
+            s->FirstItem[c->VN] = k;
+        }
+        else
+        {
+            c->Same = s->FirstItem[c->VN];
+        }
+    }
+
+    for (k = lastitem; k > firstitem; k -= 1)  /* outer expressions first */
+    {
+        c = &s->Items[k];
+        if (c->Same == 0)
+        {
+            continue;
+        }
+        d = &s->Items[c->Same];
+        if (s->Dead[d->Def] || d->Def >= c->First || !RunIsFree(s, c->First, c->Def) || RunCost(s, c->First, c->Def) < MinCSECost)
+        {
+            continue;
+        }
+        if (d->Temp == 0)
+        {
+            temps += 1;
+            d->Temp = s->Proc->BP + s->nTemps + temps;
+            Insert(s, d->Def, false, s_SP, d->Temp);
+            Insert(s, d->Def, false, s_LP, d->Temp);
+            s->Pinned[d->Def] = true;
+        }
+        for (i = c->First; i < c->Def; i += 1)
+        {
+            s->Dead[i] = true;
+        }
+        s->Code[c->Def].Op  = s_LP;
+        s->Code[c->Def].Arg = d->Temp;
+    }
+
+    if (temps > *ntemps)
+    {
+        *ntemps = temps;
+    }
+}
+
+/* --------------------------------------------------------- */
+void OptimiseProcedure(SSAState *s, ProcedureItem *p, unsigned int first, unsigned int last)
+{
+    unsigned int *firstitem;
+    unsigned int b;
+    unsigned int i;
+    unsigned int ntemps = 0;
+
+    s->Proc    = p;
+    s->First   = first;
+    s->Last    = last;
+    s->nTemps  = 0;
+    s->nChecks = 0;
+
+    if (PrepareProcedure(s))
+    {
+        s->HashSize = 16;
+        while (s->HashSize < 2 * (last - first + s->nSlots + 8))
+        {
+            s->HashSize *= 2;
+        }
+        s->Hash      = SSAAllocate(s->HashSize, sizeof(unsigned int));
+        s->HashStamp = SSAAllocate(s->HashSize, sizeof(unsigned int));
+        s->Stamp     = 0;
+        s->SlotVN    = SSAAllocate(s->nSlots + 1, sizeof(unsigned int));
+
+        PropagateConstants(s);
+
+        firstitem = SSAAllocate(s->nBlocks + 1, sizeof(unsigned int));
+        s->nItems = 0;
+        for (b = 0; b < s->nBlocks; b += 1)
+        {
+            firstitem[b] = s->nItems;
+            if (s->Blocks[b].Reached)
+            {
+                RunBlock(s, b);
+                FoldBlock(s, b, firstitem[b]);
+            }
+            else
+            {
+                for (i = s->Blocks[b].First; i <= s->Blocks[b].Last; i += 1)
+                {
+                    s->Dead[i] = !Pseudo(s->Code[i].Op);
+                }
+            }
+        }
+        firstitem[s->nBlocks] = s->nItems;
+
+        if (s->nChecks > 0)
+        {
+            RemoveBoundsChecks(s);
+        }
+        DeleteDeadStores(s);
+
+        if (!s->CodeGenerating)  /* the ARM code generator lays out its own frame */
+        {
+            MoveInvariants(s);
+            for (b = 0; b < s->nBlocks; b += 1)
+            {
+                if (s->Blocks[b].Reached)
+                {
+                    ShareExpressions(s, b, firstitem[b], firstitem[b + 1], &ntemps);
+                }
+            }
+            p->BP += s->nTemps + ntemps;
+        }
+
+        free(firstitem);
+        free(s->Hash);
+        free(s->HashStamp);
+        free(s->SlotVN);
+        free(s->InState);
+        free(s->InValue);
+        free(s->Work);
+        free(s->LiveIn);
+        free(s->Live);
+    }
+
+    free(s->Tracked);
+    s->nBlocks = 0;
+}
+
+/* --------------------------------------------------------- */
+int CompareInsertions(const void *a, const void *b)
+{
+    const Insertion *x = a;
+    const Insertion *y = b;
+
+    if (x->At != y->At)
+    {
+        return (x->At < y->At) ? -1 : 1;
+    }
+    if (x->Before != y->Before)
+    {
+        return x->Before ? -1 : 1;
+    }
+    return (x->Seq < y->Seq) ? -1 : (x->Seq > y->Seq);
+}
+
+/* --------------------------------------------------------- */
+unsigned int OptimiseSSA(Instruction     **code, unsigned int *codealloc, unsigned int codesize,
+                         unsigned int    *labs,  unsigned int nlabs,
+                         struct LineInfo *lines, unsigned int firstline, unsigned int lastline,
+                         ProcedureItem   *procs, unsigned int nprocs,
+                         bool            codegen)
+{
+    SSAState     s;
+    Instruction  *out;
+    unsigned int *firstnew;
+    unsigned int *ownnew;
+    unsigned int i;
+    unsigned int j;
+    unsigned int n;
+    unsigned int p;
+    unsigned int start;
+    unsigned int next;
+
+    memset(&s, 0, sizeof(SSAState));
+    s.Code           = *code;
+    s.Size           = codesize;
+    s.Labels         = labs;
+    s.nLabels        = nlabs;
+    s.CodeGenerating = codegen;
+    s.Target         = SSAAllocate(codesize + 2, sizeof(bool));
+    s.Dead           = SSAAllocate(codesize + 2, sizeof(bool));
+    s.Pinned         = SSAAllocate(codesize + 2, sizeof(bool));
+    s.BlockOf        = SSAAllocate(codesize + 2, sizeof(unsigned int));
+    s.StoreItem      = SSAAllocate(codesize + 2, sizeof(unsigned int));
+    s.ItemOf         = SSAAllocate(codesize + 2, sizeof(unsigned int));
+    s.AfterPreheader = SSAAllocate(nlabs + 1, sizeof(bool));
+
+    for (i = 1; i <= nlabs; i += 1)
+    {
+        if (labs[i] <= codesize)
+        {
+            s.Target[labs[i]] = true;
+        }
+    }
+
+    for (i = 1; i <= codesize; i += 1)  /* each procedure runs from its label to the next one's */
+    {
+        if (s.Code[i].Op == s_SWITCHON)
+        {
+            i += 2 * s.Code[i].Arg + 1;
+            continue;
+        }
+        if (s.Code[i].Op != s_ENTRY || s.Code[i].Arg < 1 || (unsigned int) s.Code[i].Arg > nprocs)
+        {
+            continue;
+        }
+        p     = s.Code[i].Arg;
+        start = (procs[p].Label > 0) ? labs[procs[p].Label] : i;  /* main is reached by the jump at 1 */
+        if (start == 0 || start > i)
+        {
+            start = i;
+        }
+        for (j = i + 1; j <= codesize && s.Code[j].Op != s_ENTRY; j += 1)
+        {
+            if (s.Code[j].Op == s_SWITCHON)
+            {
+                j += 2 * s.Code[j].Arg + 1;
+            }
+        }
+        next = codesize + 1;
+        if (j <= codesize && s.Code[j].Arg >= 1 && (unsigned int) s.Code[j].Arg <= nprocs)
+        {
+            next = (procs[s.Code[j].Arg].Label > 0) ? labs[procs[s.Code[j].Arg].Label] : j;
+            if (next == 0 || next > j || next <= i)
+            {
+                next = j;
+            }
+        }
+        OptimiseProcedure(&s, &procs[p], start, next - 1);
+        i = next - 1;
+    }
+
+    if (s.nInserts > 0)  /* lower back to stack code */
+    {
+        qsort(&s.Inserts[1], s.nInserts, sizeof(Insertion), CompareInsertions);
+    }
+    out      = SSAAllocate(codesize + s.nInserts + 1, sizeof(Instruction));
+    firstnew = SSAAllocate(codesize + 2, sizeof(unsigned int));
+    ownnew   = SSAAllocate(codesize + 2, sizeof(unsigned int));
+
+    out[0] = s.Code[0];
+    n = 0;
+    j = 1;
+    for (i = 1; i <= codesize + 1; i += 1)
+    {
+        firstnew[i] = n + 1;
+        while (j <= s.nInserts && s.Inserts[j].At == i && s.Inserts[j].Before)
+        {
+            n += 1;
+            out[n] = s.Inserts[j].Code;
+            j += 1;
+        }
+        ownnew[i] = n + 1;
+        if (i <= codesize && !s.Dead[i])
+        {
+            n += 1;
+            out[n] = s.Code[i];
+        }
+        while (j <= s.nInserts && s.Inserts[j].At == i)
+        {
+            n += 1;
+            out[n] = s.Inserts[j].Code;
+            j += 1;
+        }
+    }
+
+    for (i = 1; i <= nlabs; i += 1)
+    {
+        if (labs[i] >= 1 && labs[i] <= codesize + 1)
+        {
+            labs[i] = s.AfterPreheader[i] ? ownnew[labs[i]] : firstnew[labs[i]];
+        }
+    }
+    for (i = firstline; i <= lastline; i += 1)
+    {
+        if (lines[i].codeoffset >= 1 && lines[i].codeoffset <= codesize + 1)
+        {
+            lines[i].codeoffset = firstnew[lines[i].codeoffset];
+        }
+    }
+
+    free(*code);
+    *code      = out;
+    *codealloc = codesize + s.nInserts + 1;
+
+    free(firstnew);
+    free(ownnew);
+    free(s.Target);
+    free(s.Dead);
+    free(s.Pinned);
+    free(s.BlockOf);
+    free(s.StoreItem);
+    free(s.ItemOf);
+    free(s.Range);
+    free(s.AfterPreheader);
+    free(s.Inserts);
+    free(s.Blocks);
+    free(s.VNs);
+    free(s.Items);
+    free(s.Stack);
+    free(s.FirstItem);
+    return n;
+}
@@ -0,0 +1,15 @@
+/* DAMSON SSA optimiser header
+*/
+
+#ifndef SSA
+#define SSA
+
+#include "compiler.h"
+
+extern unsigned int OptimiseSSA(Instruction     **code, unsigned int *codealloc, unsigned int codesize,
+                                unsigned int    *labs,  unsigned int nlabs,
+                                struct LineInfo *lines, unsigned int firstline, unsigned int lastline,
+                                ProcedureItem   *procs, unsigned int nprocs,
+                                bool            codegen);
+
+#endif
@@ -0,0 +1,170 @@
+/* DAMSON stimulus input
+   packets from outside the model are streamed from a binary file, or a pipe, as the simulation runs.
+   the file is the magic word "DSTM" (0x4D545344) followed by records of little-endian words:
+
+     time      64 bits, microseconds of simulated time
+     source    32 bits, the node the packet appears to come from
+     port      32 bits, 0..2047
+     payload   32 bits, as sent - a float being in 16.16 fixed point
+
+   a record is read only when the previous one has been delivered, so the file may be far larger than memory.
+   the packet is routed as if sent by the source node, to the nodes linked from it, once every node has reached
+   its time. the records should be in order of time; one that is late is delivered at once
+*/
+
+#ifndef WIN32
+#define _XOPEN_SOURCE 500   /* fseeko */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#ifndef WIN32
+#include <sys/types.h>
+#endif
+
+#include "compiler.h"
+#include "emulator.h"
+#include "stimulus.h"
+
+#define STIM_MAGIC      0x4D545344  /* "DSTM" */
+#define StimulusRecord  20          /* bytes */
+#define StimulusBuffer  (1 << 20)   /* bytes read from the file at a time */
+
+extern void            Runtime_Error(unsigned int code, char *fmt, ...);
+
+char                   *StimulusFile   = NULL;
+unsigned long long int NextStimulus    = ULLONG_MAX;  /* time of the record waiting to be delivered */
+FILE                   *StimulusStream = NULL;
+unsigned int           StimulusSource;
+unsigned int           StimulusPort;
+int                    StimulusPayload;
+unsigned long long int StimulusCount;                 /* packets delivered */
+unsigned long long int StimulusLost;                  /* records with no destination */
+unsigned long long int StimulusRecords;               /* records read from the file, delivered or skipped on a restore */
+
+bool                   ReadStimulus();
+unsigned int           StimulusWord(unsigned char w[]);
+
+/* --------------------------------------------------------- */
+unsigned int StimulusWord(unsigned char w[])  /* little-endian */
+{
+    return w[0] | (w[1] << 8) | (w[2] << 16) | ((unsigned int) w[3] << 24);
+}
+
+/* --------------------------------------------------------- */
+bool ReadStimulus()  /* the next record, or false at the end of the file */
+{
+    unsigned char          r[StimulusRecord];
+    size_t                 n;
+    unsigned long long int us;
+
+    n = fread(r, 1, StimulusRecord, StimulusStream);
+    if (n < StimulusRecord)
+    {
+        if (n > 0)
+        {
+            printf("Stimulus file %s is truncated\n", StimulusFile);
+        }
+        NextStimulus = ULLONG_MAX;
+        return false;
+    }
+
+    us = (unsigned long long int) StimulusWord(&r[0]) | ((unsigned long long int) StimulusWord(&r[4]) << 32);
+    StimulusSource  = StimulusWord(&r[8]);
+    StimulusPort    = StimulusWord(&r[12]);
+    StimulusPayload = (int) StimulusWord(&r[16]);
+    NextStimulus    = us * (CLOCK_FREQUENCY / 1000000);
+    StimulusRecords += 1;
+    return true;
+}
+
+/* --------------------------------------------------------- */
+void OpenStimulus(char Filename[], unsigned long long int t, bool restored)
+/* "-" is the standard input. on a restore, the records up to the time t of the checkpoint have been delivered */
+{
+    unsigned char w[4];
+
+    StimulusFile   = Filename;
+    StimulusStream = (strcmp(Filename, "-") == 0) ? stdin : fopen(Filename, "rb");
+    if (StimulusStream == NULL)
+    {
+        Runtime_Error(252, "Unable to open stimulus file %s\n", Filename);
+    }
+    setvbuf(StimulusStream, NULL, _IOFBF, StimulusBuffer);
+
+    if (fread(w, 1, 4, StimulusStream) != 4 || StimulusWord(w) != STIM_MAGIC)
+    {
+        Runtime_Error(253, "%s is not a DAMSON stimulus file\n", Filename);
+    }
+
+    StimulusCount   = 0;
+    StimulusLost    = 0;
+    StimulusRecords = 0;
+    while (ReadStimulus() && restored && NextStimulus <= t)
+    {
+    }
+}
+
+/* --------------------------------------------------------- */
+void ApplyStimulus(unsigned long long int t)  /* deliver the records up to time t */
+{
+    do
+    {
+        if (!InjectPkt(StimulusSource, StimulusPort, 0, StimulusPayload))
+        {
+            StimulusLost += 1;
+        }
+        StimulusCount += 1;
+    } while (ReadStimulus() && NextStimulus <= t);
+}
+
+/* --------------------------------------------------------- */
+void ForkStimulus()  /* a branch reads the file by itself, from the record waiting to be delivered */
+{
+    unsigned long long int n;
+    unsigned long long int lost;
+    unsigned long long int r;
+    char                   record[24];
+
+    if (StimulusStream == NULL)
+    {
+        return;
+    }
+    fclose(StimulusStream);  /* the copy of the parent's stream */
+
+    n    = StimulusCount;
+    lost = StimulusLost;
+    r    = (NextStimulus == ULLONG_MAX) ? StimulusRecords : StimulusRecords - 1;  /* ahead of the waiting record */
+    OpenStimulus(StimulusFile, 0, false);
+#ifdef WIN32
+    if (_fseeki64(StimulusStream, 4 + (__int64) r * StimulusRecord, SEEK_SET) != 0)
+#else
+    if (fseeko(StimulusStream, 4 + (off_t) r * StimulusRecord, SEEK_SET) != 0)  /* files of many GB */
+#endif
+    {
+        sprintf(record, "%llu", r + 1);  /* Runtime_Error takes only %s, %i, %d and %f */
+        Runtime_Error(255, "Unable to find record %s of stimulus file %s\n", record, StimulusFile);
+    }
+    StimulusRecords = r;
+    ReadStimulus();
+    StimulusCount = n;
+    StimulusLost  = lost;
+}
+
+/* --------------------------------------------------------- */
+void CloseStimulus()
+{
+    if (StimulusStream != NULL)
+    {
+        printf("Stimulus: %llu packets, %llu not delivered\n", StimulusCount, StimulusLost);
+        if (StimulusStream != stdin)
+        {
+            fclose(StimulusStream);
+        }
+    }
+    StimulusStream = NULL;
+    NextStimulus   = ULLONG_MAX;
+}
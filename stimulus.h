@@ -0,0 +1,17 @@
+/* DAMSON stimulus header
+*/
+
+#ifndef STIMULUS
+#define STIMULUS
+
+#include "compiler.h"
+
+extern char                   *StimulusFile;
+extern unsigned long long int NextStimulus;
+
+extern void OpenStimulus(char Filename[], unsigned long long int t, bool restored);
+extern void ApplyStimulus(unsigned long long int t);
+extern void ForkStimulus();
+extern void CloseStimulus();
+
+#endif
@@ -0,0 +1,67 @@
+#!/bin/sh
+#
+# a branch taken after a restore reads the stimulus file from the checkpoint on, delivering no packet twice
+#   sh tests/restore_branch.sh [damson]
+#
+
+DAMSON=${1:-$(pwd)/damson}
+DIR=$(mktemp -d) || exit 1
+trap 'rm -rf "$DIR"' EXIT
+cd "$DIR" || exit 1
+
+word()  # a little-endian 32-bit word
+{
+    printf "\\$(printf %03o $(($1 & 255)))\\$(printf %03o $(($1 >> 8 & 255)))"
+    printf "\\$(printf %03o $(($1 >> 16 & 255)))\\$(printf %03o $(($1 >> 24 & 255)))"
+}
+
+{
+    printf 'DSTM'
+    for i in 1 2 3 4 5 6  # a packet from node 100 every 2 ms, from 1 ms, with the payload i
+    do
+        word $((i * 2000 - 1000)); word 0; word 100; word 0; word $i
+    done
+} > st.bin
+
+cat > st.d <<'END'
+#timestamp on
+#monitor off
+
+#node sink
+int count = 0;
+void rx(int node, int port, int payload, int t);
+
+void rx(int node, int port, int payload, int t)
+{
+    count = count + 1;
+    printf("rx payload %d count %d\n", payload, count);
+}
+
+void main()
+{
+    delay(1000);
+    exit(0);
+}
+
+#alias sink 1
+rx: 100;
+END
+
+printf 'a\nb   count=100\n' > v.txt
+
+"$DAMSON" st.d -in st.bin -checkpoint 0.004 > run.txt || { echo "FAIL: checkpoint run"; exit 1; }
+"$DAMSON" st.d -in st.bin -restore st_1.ckpt -branch 0.006 v.txt > restore.txt || { echo "FAIL: restore run"; exit 1; }
+
+status=0
+for v in a b
+do
+    if [ "$(grep -c 'rx payload' st_$v/st.out)" != 3 ] || grep -q 'rx payload [123] ' st_$v/st.out ||
+       ! grep -q 'Stimulus: 4 packets, 0 not delivered' st_$v/st.out
+    then
+        echo "FAIL: branch $v"
+        cat st_$v/st.out
+        status=1
+    fi
+done
+[ $status = 0 ] && echo "PASS: restore and branch"
+exit $status